@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "backoff.h"
+
+#define BACKOFF_INITIAL		1000
+#define BACKOFF_MAX		60000
+#define BACKOFF_FACTOR		2.0
+#define BACKOFF_JITTER		10
+#define BACKOFF_STABLE		60
+#define BACKOFF_LIMIT		86400000L	/* one day */
+
+/*
+ * parse a non negative number ending at end. Returns -1 on error.
+ */
+static int
+parse_num(const char *str, const char *end, double *v)
+{
+	char		*e;
+
+	if (*str < '0' || *str > '9')
+		return -1;
+	*v = strtod(str, &e);
+	return e == end ? 0 : -1;
+}
+
+/*
+ * parse "KEY=VALUE,.." with keys initial, max (milliseconds), factor,
+ * jitter (percent) and stable (seconds). Missing keys get defaults.
+ */
+const char *
+backoff_compile(struct backoff *bo, const char *spec)
+{
+	const char	*p = spec,
+			*eq,
+			*end;
+	double		v;
+
+	bo->bo_initial = BACKOFF_INITIAL;
+	bo->bo_max = BACKOFF_MAX;
+	bo->bo_factor = BACKOFF_FACTOR;
+	bo->bo_jitter = BACKOFF_JITTER;
+	bo->bo_stable = BACKOFF_STABLE;
+
+	while (*p != '\0') {
+		if ((end = strchr(p, ',')) == NULL)
+			end = p + strlen(p);
+		if ((eq = memchr(p, '=', end - p)) == NULL
+				|| parse_num(eq + 1, end, &v) == -1)
+			return "illegal backoff.";
+#define KEY(N)	((size_t) (eq - p) == strlen(N) && !strncmp(p, N, eq - p))
+		if (KEY("initial") && v >= 1 && v <= BACKOFF_LIMIT)
+			bo->bo_initial = v;
+		else if (KEY("max") && v >= 1 && v <= BACKOFF_LIMIT)
+			bo->bo_max = v;
+		else if (KEY("factor") && v >= 1 && v <= 100)
+			bo->bo_factor = v;
+		else if (KEY("jitter") && v <= 100)
+			bo->bo_jitter = v;
+		else if (KEY("stable") && v <= 86400)
+			bo->bo_stable = v;
+		else
+			return "illegal backoff.";
+#undef KEY
+		p = *end == ',' ? end + 1 : end;
+	}
+
+	if (bo->bo_max < bo->bo_initial)
+		return "backoff max below initial.";
+	return NULL;
+}
+
+/*
+ * delay after delay (milliseconds, 0 for the first restart).
+ */
+long
+backoff_next(const struct backoff *bo, long delay)
+{
+	double		d;
+
+	if (delay <= 0)
+		return bo->bo_initial;
+	d = delay * bo->bo_factor;
+	return d > bo->bo_max ? bo->bo_max : (long) d;
+}
+
+/*
+ * delay moved by a random amount of up to bo_jitter percent. Instances
+ * crashing at the same time are not restarted at the same time.
+ */
+long
+backoff_jitter(const struct backoff *bo, long delay)
+{
+	static int	seeded = 0;
+	long		j;
+
+	if (bo->bo_jitter == 0 || delay <= 0)
+		return delay;
+	if (!seeded) {
+		srandom(time(NULL) ^ getpid());
+		seeded = 1;
+	}
+	j = delay * bo->bo_jitter / 100;
+	if (j == 0)
+		return delay;
+	return delay - j + random() % (2 * j + 1);
+}
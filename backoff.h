@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __BACKOFF_H
+#define __BACKOFF_H
+
+/*
+ * restart backoff of a group: an instance exiting with an error before it ran
+ * for bo_stable seconds is restarted after a delay. The delay starts at
+ * bo_initial and grows by bo_factor up to bo_max, each restart is moved by up
+ * to bo_jitter percent of the delay.
+ */
+struct backoff {
+	long		bo_initial,	/* milliseconds */
+			bo_max;
+	double		bo_factor;
+	int		bo_jitter,	/* percent */
+			bo_stable;	/* seconds */
+};
+
+const char *backoff_compile(struct backoff *, const char *);
+long backoff_next(const struct backoff *, long);
+long backoff_jitter(const struct backoff *, long);
+
+#endif /* __BACKOFF_H */
@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+
+#include <json/json.h>
+
+#include "misc.h"
+#include "cgroup.h"
+
+#ifndef CGROUP2_SUPER_MAGIC
+#define CGROUP2_SUPER_MAGIC	0x63677270
+#endif
+
+#define CG_CPUMAX	1
+#define CG_WEIGHT	2
+#define CG_BYTES	3
+#define CG_COUNT	4
+
+static const struct {
+	const char	*name,
+			*reset;
+	int		kind;
+} limits[] = {
+	{ "cpu.max",		"max",	CG_CPUMAX },
+	{ "cpu.weight",		"100",	CG_WEIGHT },
+	{ "memory.high",	"max",	CG_BYTES },
+	{ "memory.max",		"max",	CG_BYTES },
+	{ "pids.max",		"max",	CG_COUNT },
+	{ NULL,			NULL,	0 }
+};
+
+static const char *controllers[] = { "+cpu", "+memory", "+pids", NULL };
+
+static char	*cgroup_root = NULL;
+static int	cgroup_is_native = 0;
+static char	cgroup_err[PATH_MAX + 64];
+
+/*
+ * parse a decimal number with an optional k, m or g suffix (if shift is
+ * set) between str and end.
+ */
+static int
+parse_number(const char *str, const char *end, int shift, long long *v)
+{
+	char		*e;
+	long long	n;
+
+	if (str == end || *str < '0' || *str > '9')
+		return -1;
+	n = strtoll(str, &e, 10);
+	if (shift && e < end) {
+		switch (*e) {
+		case 'k': case 'K':
+			n <<= 10;
+			e++;
+			break;
+		case 'm': case 'M':
+			n <<= 20;
+			e++;
+			break;
+		case 'g': case 'G':
+			n <<= 30;
+			e++;
+			break;
+		}
+	}
+	if (e != end || n < 0)
+		return -1;
+	*v = n;
+	return 0;
+}
+
+/*
+ * convert the value of a limit between str and end to what the kernel
+ * expects in the interface file.
+ */
+static int
+format_value(int kind, const char *str, const char *end, char *out, size_t len)
+{
+	const char	*slash;
+	long long	n,
+			p;
+
+	if (kind != CG_WEIGHT && (size_t) (end - str) == 3 && !strncmp(str, "max", 3)) {
+		snprintf(out, len, "max");
+		return 0;
+	}
+
+	switch (kind) {
+	case CG_CPUMAX:
+		if ((slash = memchr(str, '/', end - str)) == NULL)
+			slash = end;
+		if (parse_number(str, slash, 0, &n) == -1 || n == 0)
+			return -1;
+		if (slash == end) {
+			snprintf(out, len, "%lld", n);
+			break;
+		}
+		if (parse_number(slash + 1, end, 0, &p) == -1 || p == 0)
+			return -1;
+		snprintf(out, len, "%lld %lld", n, p);
+		break;
+	case CG_WEIGHT:
+		if (parse_number(str, end, 0, &n) == -1 || n < 1 || n > 10000)
+			return -1;
+		snprintf(out, len, "%lld", n);
+		break;
+	case CG_BYTES:
+	case CG_COUNT:
+		if (parse_number(str, end, kind == CG_BYTES, &n) == -1)
+			return -1;
+		snprintf(out, len, "%lld", n);
+		break;
+	}
+	return 0;
+}
+
+static int
+write_file(int dirfd, const char *name, const char *value, int create)
+{
+	int	fd,
+		ret = 0;
+	size_t	len = strlen(value);
+
+	if ((fd = openat(dirfd, name, O_WRONLY | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0), 0644)) == -1)
+		return -1;
+	if (write(fd, value, len) != (ssize_t) len)
+		ret = -1;
+	if (close(fd) == -1)
+		ret = -1;
+	return ret;
+}
+
+/*
+ * check "KEY=VALUE,.." and write the converted values to the files in
+ * dirfd unless it is -1. seen (if not NULL) marks the limits found.
+ */
+static const char *
+walk_limits(const char *spec, int dirfd, int *seen)
+{
+	const char	*p = spec,
+			*eq,
+			*end;
+	char		buf[64];
+	int		i;
+
+	while (*p != '\0') {
+		if ((end = strchr(p, ',')) == NULL)
+			end = p + strlen(p);
+		if ((eq = memchr(p, '=', end - p)) == NULL)
+			return "illegal cgroup limit.";
+		for (i = 0; limits[i].name != NULL; i++) {
+			if ((size_t) (eq - p) == strlen(limits[i].name)
+					&& !strncmp(p, limits[i].name, eq - p))
+				break;
+		}
+		if (limits[i].name == NULL)
+			return "unknown cgroup limit.";
+		if (format_value(limits[i].kind, eq + 1, end, buf, sizeof(buf)) == -1)
+			return "illegal cgroup limit.";
+		if (dirfd != -1 && write_file(dirfd, limits[i].name, buf, !cgroup_is_native) == -1) {
+			snprintf(cgroup_err, sizeof(cgroup_err), "cannot write %s: %s",
+					limits[i].name, strerror(errno));
+			return cgroup_err;
+		}
+		if (seen != NULL)
+			seen[i] = 1;
+		p = *end == ',' ? end + 1 : end;
+	}
+	return NULL;
+}
+
+/*
+ * set the directory groups are created in. Controllers are enabled for
+ * the subtree if possible, failure to do so is not fatal: a missing
+ * controller shows when a limit is written. Anything but a cgroup2 mount
+ * is used as a fake root where limit files are written but processes are
+ * not moved.
+ */
+int
+cgroup_root_init(const char *path)
+{
+	struct statfs	sfs;
+	char		buf[PATH_MAX];
+	int		fd,
+			i;
+
+	if (realpath(path, buf) == NULL || statfs(buf, &sfs) == -1)
+		return -1;
+	if ((fd = open(buf, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+		return -1;
+	cgroup_root = xstrdup(buf);
+	cgroup_is_native = sfs.f_type == CGROUP2_SUPER_MAGIC;
+	if (cgroup_is_native) {
+		for (i = 0; controllers[i] != NULL; i++)
+			(void) write_file(fd, "cgroup.subtree_control", controllers[i], 0);
+	}
+	close(fd);
+	return 0;
+}
+
+int
+cgroup_enabled(void)
+{
+	return cgroup_root != NULL;
+}
+
+/*
+ * 1 if processes are placed in group cgroups.
+ */
+int
+cgroup_native(void)
+{
+	return cgroup_is_native;
+}
+
+/*
+ * check a limit spec without writing it. Returns an error message or NULL.
+ */
+const char *
+cgroup_limits_check(const char *spec)
+{
+	return walk_limits(spec, -1, NULL);
+}
+
+/*
+ * remove the directory and close fd, which stays open if that fails. Limit
+ * files only exist as such below a fake root.
+ */
+static int
+remove_dir(const char *name, int fd)
+{
+	char	path[PATH_MAX];
+	int	i;
+
+	if (!cgroup_is_native) {
+		for (i = 0; limits[i].name != NULL; i++)
+			(void) unlinkat(fd, limits[i].name, 0);
+	}
+	snprintf(path, sizeof(path), "%s/%s", cgroup_root, name);
+	if (rmdir(path) == -1)
+		return -1;
+	close(fd);
+	return 0;
+}
+
+/*
+ * remove the cgroup of a group and close fd. Fails if processes are still
+ * in it, fd is left open then.
+ */
+const char *
+cgroup_group_remove(const char *name, int fd)
+{
+	if (remove_dir(name, fd) == -1) {
+		snprintf(cgroup_err, sizeof(cgroup_err), "cannot remove cgroup %s: %s",
+				name, strerror(errno));
+		return cgroup_err;
+	}
+	return NULL;
+}
+
+/*
+ * create (or reuse) the cgroup of a group and write its limits. Returns
+ * an O_DIRECTORY descriptor of it or -1 and sets err.
+ */
+int
+cgroup_group_create(const char *name, const char *spec, const char **err)
+{
+	char	path[PATH_MAX];
+	int	fd,
+		created;
+
+	if (strchr(name, '/') != NULL || name[0] == '.') {
+		*err = "illegal group name for cgroup.";
+		return -1;
+	}
+	if (spec != NULL && (*err = walk_limits(spec, -1, NULL)) != NULL)
+		return -1;
+	snprintf(path, sizeof(path), "%s/%s", cgroup_root, name);
+	if ((created = mkdir(path, 0755)) == -1 && errno != EEXIST) {
+		snprintf(cgroup_err, sizeof(cgroup_err), "cannot create cgroup: %s", strerror(errno));
+		*err = cgroup_err;
+		return -1;
+	}
+	if ((fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+		snprintf(cgroup_err, sizeof(cgroup_err), "cannot open cgroup: %s", strerror(errno));
+		*err = cgroup_err;
+		return -1;
+	}
+	if (spec != NULL && (*err = walk_limits(spec, fd, NULL)) != NULL) {
+		if (created != 0 || remove_dir(name, fd) == -1)
+			close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * write new limits. Limits not in spec anymore are reset to their default.
+ */
+const char *
+cgroup_group_limits(int fd, const char *spec)
+{
+	const char	*err;
+	int		seen[sizeof(limits) / sizeof(limits[0])],
+			i;
+
+	memset(seen, '\0', sizeof(seen));
+	if (spec != NULL && (err = walk_limits(spec, fd, seen)) != NULL)
+		return err;
+	for (i = 0; limits[i].name != NULL; i++) {
+		if (!seen[i])
+			(void) write_file(fd, limits[i].name, limits[i].reset, !cgroup_is_native);
+	}
+	return NULL;
+}
+
+static int
+read_file(int dirfd, const char *name, char *buf, size_t len)
+{
+	ssize_t	n;
+	int	fd;
+
+	if ((fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC)) == -1)
+		return -1;
+	n = read(fd, buf, len - 1);
+	close(fd);
+	if (n < 0)
+		return -1;
+	buf[n] = '\0';
+	return 0;
+}
+
+/*
+ * aggregate accounting of a group: memory in bytes, cpu time in seconds
+ * and the number of tasks. Files that do not exist (controller not
+ * enabled) are left out.
+ */
+json_object *
+cgroup_group_stats(int fd)
+{
+	json_object	*obj;
+	char		buf[512],
+			*p;
+
+	obj = json_object_new_object();
+	if (read_file(fd, "memory.current", buf, sizeof(buf)) == 0)
+		json_object_object_add(obj, "memory_current", json_object_new_double(strtod(buf, NULL)));
+	if (read_file(fd, "cpu.stat", buf, sizeof(buf)) == 0
+			&& (p = strstr(buf, "usage_usec ")) != NULL)
+		json_object_object_add(obj, "cpu_usage", json_object_new_double(strtod(p + 11, NULL) / 1000000.0));
+	if (read_file(fd, "pids.current", buf, sizeof(buf)) == 0)
+		json_object_object_add(obj, "pids_current", json_object_new_int(atoi(buf)));
+	return obj;
+}
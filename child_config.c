@@ -29,26 +29,90 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include <json/json.h>
 
 #include "misc.h"
+#include "cpus.h"
+#include "resources.h"
 #include "child_config.h"
 
+extern char **environ;
+
 struct child_config_list		child_config_list_head;
 uvstrhash_t				*child_config_hash;
+char					*child_config_notify_socket;	/* set by the server */
 
 /*
- * Serialize child_config struct to string. Returned buffer must be freed.
+ * free NULL terminated string array.
  */
-char *
-child_config_serialize(const struct child_config *cc)
+void
+str_array_free(char **a)
 {
-	json_object		*obj,
-				*t,
-				*s;
 	int			x;
-	char			*ret;
+
+	if (a == NULL)
+		return;
+	for (x = 0; a[x] != NULL; x++)
+		free(a[x]);
+	free(a);
+}
+
+/*
+ * NULL terminated string array to json array.
+ */
+static json_object *
+str_array_to_json(char **a)
+{
+	json_object		*t;
+	int			x;
+
+	t = json_object_new_array();
+	for (x = 0; a[x] != NULL; x++)
+		json_object_array_add(t, json_object_new_string(a[x]));
+	return t;
+}
+
+/*
+ * json array of strings to NULL terminated string array. Returns NULL on
+ * type errors.
+ */
+static char **
+str_array_from_json(json_object *t)
+{
+	json_object		*s;
+	char			**ret;
+	int			i,
+				len;
+
+	if (!json_object_is_type(t, json_type_array))
+		return NULL;
+
+	len = json_object_array_length(t);
+	ret = xmalloc(sizeof(char *) * (len + 1));
+
+	for (i = 0; i < len; i++) {
+		if ((s = json_object_array_get_idx(t, i)) == NULL
+				|| !json_object_is_type(s, json_type_string)) {
+			ret[i] = NULL;
+			str_array_free(ret);
+			return NULL;
+		}
+		ret[i] = xstrdup(json_object_get_string(s));
+	}
+	ret[i] = NULL;
+	return ret;
+}
+
+/*
+ * child_config struct as json object.
+ */
+json_object *
+child_config_to_json(const struct child_config *cc)
+{
+	json_object		*obj,
+				*t;
 
 #define ADD(X, Y)	if (Y != NULL) { \
 				t = json_object_new_string(Y); \
@@ -60,6 +124,11 @@ child_config_serialize(const struct child_config *cc)
 				json_object_object_add(obj, X, t); \
 			}
 
+#define ADDRES(X, Y)	if (Y != RES_UNSET) { \
+				t = json_object_new_int(Y); \
+				json_object_object_add(obj, X, t); \
+			}
+
 	obj = json_object_new_object();
 	ADD("name", cc->cc_name);
 	ADD("stdout", cc->cc_stdout);
@@ -69,26 +138,52 @@ child_config_serialize(const struct child_config *cc)
 	ADD("fatal_cb", cc->cc_fatal_cb);
 	ADD("username", cc->cc_username);
 	ADD("groupname", cc->cc_groupname);
+	ADD("cpus", cc->cc_cpus);
+	ADD("ioprio", cc->cc_ioprio);
+	ADD("sched", cc->cc_sched);
+	ADD("rlimits", cc->cc_rlimits);
+	ADD("cgroup", cc->cc_cgroup);
+	ADD("backoff", cc->cc_backoff);
+	ADD("crashloop", cc->cc_crashloop);
 	ADDINT("instances", cc->cc_instances);
 	ADDINT("status", cc->cc_status);
 	ADDINT("killsig", cc->cc_killsig);
+	ADDINT("priority", cc->cc_priority);
+	ADDINT("port", cc->cc_port);
+	ADDINT("zygote", cc->cc_zygote);
+	ADDINT("standby", cc->cc_standby);
+	ADDINT("ondemand", cc->cc_ondemand);
+	ADDINT("stop_timeout", cc->cc_stop_timeout);
+	ADDINT("notify", cc->cc_notify);
+	ADDRES("nice", cc->cc_nice);
+	ADDRES("oom_score_adj", cc->cc_oom_score_adj);
 	ADDINT("uid", cc->cc_uid);
 	ADDINT("gid", cc->cc_gid);
 	ADDINT("error", cc->cc_error);
 	ADDINT("age", cc->cc_age);
 
-	if (cc->cc_command != NULL) {
-		t = json_object_new_array();
-		x = 0;
+	if (cc->cc_command != NULL)
+		json_object_object_add(obj, "args", str_array_to_json(cc->cc_command));
 
-		while (cc->cc_command[x] != NULL) {
-			s = json_object_new_string(cc->cc_command[x]);
-			json_object_array_add(t, s);
-			x++;
-		}
-		json_object_object_add(obj, "args", t);
-	}
+	if (cc->cc_listen != NULL)
+		json_object_object_add(obj, "listen", str_array_to_json(cc->cc_listen));
+
+	if (cc->cc_env != NULL)
+		json_object_object_add(obj, "env", str_array_to_json(cc->cc_env));
+
+	return obj;
+}
+
+/*
+ * Serialize child_config struct to string. Returned buffer must be freed.
+ */
+char *
+child_config_serialize(const struct child_config *cc)
+{
+	json_object		*obj;
+	char			*ret;
 
+	obj = child_config_to_json(cc);
 	ret = xstrdup(json_object_to_json_string(obj));
 	json_object_put(obj);
 
@@ -98,9 +193,7 @@ child_config_serialize(const struct child_config *cc)
 struct child_config *child_config_from_json(json_object *obj)
 {
 	struct child_config	*ret;
-	json_object		*t,
-				*s;
-	int			i, len;
+	json_object		*t;
 
 	ret = child_config_new();
 
@@ -133,37 +226,40 @@ struct child_config *child_config_from_json(json_object *obj)
 	GET(ret->cc_fatal_cb, "fatal_cb");
 	GET(ret->cc_username, "username");
 	GET(ret->cc_groupname, "groupname");
+	GET(ret->cc_cpus, "cpus");
+	GET(ret->cc_ioprio, "ioprio");
+	GET(ret->cc_sched, "sched");
+	GET(ret->cc_rlimits, "rlimits");
+	GET(ret->cc_cgroup, "cgroup");
+	GET(ret->cc_backoff, "backoff");
+	GET(ret->cc_crashloop, "crashloop");
 	GETINT(ret->cc_instances, "instances");
 	GETINT(ret->cc_status, "status");
 	GETINT(ret->cc_killsig, "killsig");
+	GETINT(ret->cc_priority, "priority");
+	GETINT(ret->cc_port, "port");
+	GETINT(ret->cc_zygote, "zygote");
+	GETINT(ret->cc_standby, "standby");
+	GETINT(ret->cc_ondemand, "ondemand");
+	GETINT(ret->cc_stop_timeout, "stop_timeout");
+	GETINT(ret->cc_notify, "notify");
+	GETINT(ret->cc_nice, "nice");
+	GETINT(ret->cc_oom_score_adj, "oom_score_adj");
 	GETINT(ret->cc_uid, "uid");
 	GETINT(ret->cc_gid, "gid");
 	GETINT(ret->cc_error, "error");
 	GETINT(ret->cc_age, "age");
 
-	if ((t = json_object_object_get(obj, "args")) != NULL) {
-		if (!json_object_is_type(t, json_type_array)) {
-			child_config_free(ret);
-			return NULL;
-		}
-
-		len = json_object_array_length(t);
-		ret->cc_command = xmalloc(sizeof(char *) * (len + 1));
-
-		for (i = 0; i < len; i++) {
-			if ((s = json_object_array_get_idx(t, i)) == NULL) {
-				ret->cc_command[i] = NULL;
-				child_config_free(ret);
-				return NULL;
-			}
-			if (!json_object_is_type(s, json_type_string)) {
-				child_config_free(ret);
-				return NULL;
+#define GETARR(X, Y)	if ((t = json_object_object_get(obj, Y)) != NULL) { \
+				if ((X = str_array_from_json(t)) == NULL) { \
+					child_config_free(ret); \
+					return NULL; \
+				} \
 			}
-			ret->cc_command[i] = xstrdup(json_object_get_string(s));
-		}
-		ret->cc_command[i] = NULL;
-	}
+
+	GETARR(ret->cc_command, "args");
+	GETARR(ret->cc_listen, "listen");
+	GETARR(ret->cc_env, "env");
 	return ret;
 }
 
@@ -188,6 +284,263 @@ struct child_config *child_config_unserialize(const char *buf)
 	return ret;
 }
 
+/*
+ * free compiled templates.
+ */
+static void
+child_config_compile_free(struct child_config *cc)
+{
+	int		i;
+
+	template_free(cc->cc_tpl_stdout);
+	template_free(cc->cc_tpl_stderr);
+	template_free(cc->cc_tpl_dir);
+	cc->cc_tpl_stdout = NULL;
+	cc->cc_tpl_stderr = NULL;
+	cc->cc_tpl_dir = NULL;
+	if (cc->cc_tpl_args != NULL) {
+		for (i = 0; cc->cc_tpl_args[i] != NULL; i++)
+			template_free(cc->cc_tpl_args[i]);
+		free(cc->cc_tpl_args);
+		cc->cc_tpl_args = NULL;
+	}
+	if (cc->cc_tpl_env != NULL) {
+		for (i = 0; cc->cc_tpl_env[i] != NULL; i++)
+			template_free(cc->cc_tpl_env[i]);
+		free(cc->cc_tpl_env);
+		cc->cc_tpl_env = NULL;
+	}
+	child_config_envp_free(cc);
+}
+
+/*
+ * (re)compile templates of a group. Must be called after stdout, stderr,
+ * dir, args, env or port were changed.
+ */
+void
+child_config_compile(struct child_config *cc)
+{
+	int		i,
+			n,
+			tokens = 0;
+
+	child_config_compile_free(cc);
+
+	if (cc->cc_stdout != NULL)
+		cc->cc_tpl_stdout = template_compile(cc->cc_stdout);
+	if (cc->cc_stderr != NULL)
+		cc->cc_tpl_stderr = template_compile(cc->cc_stderr);
+	if (cc->cc_dir != NULL)
+		cc->cc_tpl_dir = template_compile(cc->cc_dir);
+
+	if (cc->cc_env != NULL) {
+		for (n = 0; cc->cc_env[n] != NULL; n++)
+			;
+		cc->cc_tpl_env = xmalloc(sizeof(struct template *) * (n + 1));
+		for (i = 0; i < n; i++)
+			cc->cc_tpl_env[i] = template_compile(cc->cc_env[i]);
+		cc->cc_tpl_env[n] = NULL;
+	}
+
+	if (cc->cc_command == NULL)
+		return;
+
+	for (n = 0; cc->cc_command[n] != NULL; n++)
+		;
+	cc->cc_tpl_args = xmalloc(sizeof(struct template *) * (n + 1));
+	for (i = 0; i < n; i++) {
+		cc->cc_tpl_args[i] = template_compile(cc->cc_command[i]);
+		tokens |= cc->cc_tpl_args[i]->t_tokens;
+	}
+	cc->cc_tpl_args[n] = NULL;
+
+	/* no tokens: cc_command is used as it is */
+	if (tokens == 0) {
+		for (i = 0; i < n; i++)
+			template_free(cc->cc_tpl_args[i]);
+		free(cc->cc_tpl_args);
+		cc->cc_tpl_args = NULL;
+	}
+}
+
+/*
+ * return 1 if any template of the group uses token type.
+ */
+int
+child_config_uses_token(const struct child_config *cc, int type)
+{
+	int		i;
+
+	if (cc->cc_tpl_stdout && template_uses(cc->cc_tpl_stdout, type))
+		return 1;
+	if (cc->cc_tpl_stderr && template_uses(cc->cc_tpl_stderr, type))
+		return 1;
+	if (cc->cc_tpl_dir && template_uses(cc->cc_tpl_dir, type))
+		return 1;
+	if (cc->cc_tpl_args != NULL) {
+		for (i = 0; cc->cc_tpl_args[i] != NULL; i++) {
+			if (template_uses(cc->cc_tpl_args[i], type))
+				return 1;
+		}
+	}
+	if (cc->cc_tpl_env != NULL) {
+		for (i = 0; cc->cc_tpl_env[i] != NULL; i++) {
+			if (template_uses(cc->cc_tpl_env[i], type))
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * 1 if str is a variable named like the one in var ("KEY=...").
+ */
+static int
+env_same_key(const char *str, const char *var)
+{
+	size_t		len;
+
+	len = strcspn(var, "=");
+	return !strncmp(str, var, len) && str[len] == '=';
+}
+
+/*
+ * 1 if the environment variable str is set by the group in own.
+ */
+static int
+env_overridden(const char *str, char **own, int nown)
+{
+	int		i;
+
+	for (i = 0; i < nown; i++) {
+		if (env_same_key(str, own[i]))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * build the environment of an instance: the server's environment, GROUP,
+ * INSTANCES, INSTANCE and PORT (if the group has a port), NOTIFY_SOCKET (if
+ * the group uses readiness notification) and the expanded cc_env. Variables of cc_env win over the others. instance -1 leaves out
+ * INSTANCE and PORT (standby and zygote processes). Pointers and strings
+ * are one block, free the returned pointer only.
+ */
+char **
+child_config_env(const struct child_config *cc, int instance)
+{
+	struct template_vars	tv;
+	char			**own,
+				**ret,
+				*p;
+	size_t			len = 0;
+	int			nown = 0,
+				nenv,
+				n,
+				i,
+				j;
+
+	for (nenv = 0; environ[nenv] != NULL; nenv++)
+		;
+	for (n = 0; cc->cc_env != NULL && cc->cc_env[n] != NULL; n++)
+		;
+
+	/* group variables first, expanded */
+	template_vars_init(&tv, cc->cc_name, instance == -1 ? 0 : instance,
+			cc->cc_port);
+	own = xmalloc(sizeof(char *) * (n + 5));
+	for (i = 0; i < n; i++)
+		own[nown++] = template_expand_dup(cc->cc_tpl_env[i], &tv);
+	own[nown] = xmalloc(strlen(cc->cc_name) + 7);
+	sprintf(own[nown++], "GROUP=%s", cc->cc_name);
+	own[nown] = xmalloc(24);
+	sprintf(own[nown++], "INSTANCES=%d", cc->cc_instances);
+	if (instance != -1) {
+		own[nown] = xmalloc(24);
+		sprintf(own[nown++], "INSTANCE=%d", instance);
+		if (cc->cc_port != -1) {
+			own[nown] = xmalloc(24);
+			sprintf(own[nown++], "PORT=%s", tv.tv_port);
+		}
+	}
+	if (cc->cc_notify == 1 && child_config_notify_socket != NULL) {
+		own[nown] = xmalloc(strlen(child_config_notify_socket) + 15);
+		sprintf(own[nown++], "NOTIFY_SOCKET=%s", child_config_notify_socket);
+	}
+
+	/* drop automatic variables set in cc_env */
+	for (i = n, j = n; i < nown; i++) {
+		if (env_overridden(own[i], own, n))
+			free(own[i]);
+		else
+			own[j++] = own[i];
+	}
+	nown = j;
+
+	for (i = 0; i < nenv; i++) {
+		if (!env_overridden(environ[i], own, nown))
+			len += strlen(environ[i]) + 1;
+	}
+	for (i = 0; i < nown; i++)
+		len += strlen(own[i]) + 1;
+
+	ret = xmalloc(sizeof(char *) * (nenv + nown + 1) + len);
+	p = (char *) (ret + nenv + nown + 1);
+	for (i = j = 0; i < nenv; i++) {
+		if (env_overridden(environ[i], own, nown))
+			continue;
+		len = strlen(environ[i]) + 1;
+		ret[j++] = memcpy(p, environ[i], len);
+		p += len;
+	}
+	for (i = 0; i < nown; i++) {
+		len = strlen(own[i]) + 1;
+		ret[j++] = memcpy(p, own[i], len);
+		p += len;
+		free(own[i]);
+	}
+	ret[j] = NULL;
+	free(own);
+	return ret;
+}
+
+/*
+ * cached child_config_env() of an instance. Freed by
+ * child_config_envp_free(), which must be called when the environment of
+ * the server, env, port, notify or the number of instances change.
+ */
+char **
+child_config_envp(struct child_config *cc, int instance)
+{
+	int		i = instance + 1;
+
+	if (cc->cc_envp == NULL || i >= cc->cc_nenvp) {
+		child_config_envp_free(cc);
+		cc->cc_nenvp = cc->cc_instances + 1;
+		if (i >= cc->cc_nenvp)
+			cc->cc_nenvp = i + 1;
+		cc->cc_envp = xmalloc(sizeof(char **) * cc->cc_nenvp);
+		memset(cc->cc_envp, '\0', sizeof(char **) * cc->cc_nenvp);
+	}
+	if (cc->cc_envp[i] == NULL)
+		cc->cc_envp[i] = child_config_env(cc, instance);
+	return cc->cc_envp[i];
+}
+
+void
+child_config_envp_free(struct child_config *cc)
+{
+	int		i;
+
+	if (cc->cc_envp == NULL)
+		return;
+	for (i = 0; i < cc->cc_nenvp; i++)
+		free(cc->cc_envp[i]);
+	free(cc->cc_envp);
+	cc->cc_envp = NULL;
+	cc->cc_nenvp = 0;
+}
+
 /*
  * free child_config.
  */
@@ -207,12 +560,33 @@ child_config_free(struct child_config *cc)
 	FREE(cc->cc_fatal_cb);
 	FREE(cc->cc_username);
 	FREE(cc->cc_groupname);
+	FREE(cc->cc_cpus);
+	FREE(cc->cc_ioprio);
+	FREE(cc->cc_sched);
+	FREE(cc->cc_rlimits);
+	FREE(cc->cc_cgroup);
+	FREE(cc->cc_backoff);
+	FREE(cc->cc_backoff_policy);
+	FREE(cc->cc_backoff_slots);
+	FREE(cc->cc_crashloop);
+	FREE(cc->cc_crashloop_policy);
+	FREE(cc->cc_crash_rings);
+	FREE(cc->cc_res);
 	FREE(cc->cc_childs);
-	if (cc->cc_command) {
-		for (i = 0; cc->cc_command[i] != NULL; i++)
-			free(cc->cc_command[i]);
-		free(cc->cc_command);
+	FREE(cc->cc_standbys);
+	FREE(cc->cc_inst_stat);
+	child_config_compile_free(cc);
+	cpu_policy_free(cc->cc_cpu_policy);
+	str_array_free(cc->cc_command);
+	str_array_free(cc->cc_listen);
+	str_array_free(cc->cc_env);
+	if (cc->cc_listen_fds != NULL) {
+		for (i = 0; i < cc->cc_nlisten; i++)
+			close(cc->cc_listen_fds[i]);
+		free(cc->cc_listen_fds);
 	}
+	if (cc->cc_cgroup_fd != -1)
+		close(cc->cc_cgroup_fd);
 
 	free(cc);
 }
@@ -230,8 +604,20 @@ struct child_config *child_config_new(void)
 	cc->cc_instances = -1;
 	cc->cc_status = -1;
 	cc->cc_killsig = -1;
+	cc->cc_priority = -1;
+	cc->cc_port = -1;
+	cc->cc_zygote = -1;
+	cc->cc_standby = -1;
+	cc->cc_ondemand = -1;
+	cc->cc_stop_timeout = -1;
+	cc->cc_notify = -1;
+	cc->cc_nice = RES_UNSET;
+	cc->cc_oom_score_adj = RES_UNSET;
 	cc->cc_uid = -1;
 	cc->cc_gid = -1;
+	cc->cc_cred_uid = -1;
+	cc->cc_cred_gid = -1;
+	cc->cc_cgroup_fd = -1;
 	cc->cc_age = 0;
 	return cc;
 }
@@ -36,6 +36,8 @@
 #include <json/json.h>
 
 #include "uvhash.h"
+#include "template.h"
+#include "exitstat.h"
 
 #define STATUS_RUNNING	1
 #define STATUS_STOPPED	2
@@ -48,7 +50,9 @@
 struct child_config {
 	LIST_ENTRY(child_config)	cc_ent;
 
-	char				**cc_command;
+	char				**cc_command,
+					**cc_listen,	/* listen specs, see cmd_server.c */
+					**cc_env;	/* KEY=VALUE, may contain tokens */
 
 	char				*cc_name,
 					*cc_stdout,
@@ -57,11 +61,27 @@ struct child_config {
 					*cc_heartbeat,
 					*cc_fatal_cb,
 					*cc_username,
-					*cc_groupname;
+					*cc_groupname,
+					*cc_cpus,	/* see cpus.c */
+					*cc_ioprio,	/* see resources.c */
+					*cc_sched,
+					*cc_rlimits,
+					*cc_cgroup,	/* see cgroup.c */
+					*cc_backoff,	/* see backoff.c */
+					*cc_crashloop;	/* see crashloop.c */
 
 	int				cc_instances,
 					cc_status,
-					cc_killsig;
+					cc_killsig,
+					cc_priority,
+					cc_port,
+					cc_zygote,
+					cc_standby,
+					cc_ondemand,	/* idle seconds */
+					cc_stop_timeout,	/* seconds until SIGKILL */
+					cc_notify,	/* readiness via NOTIFY_SOCKET */
+					cc_nice,	/* RES_UNSET if not set */
+					cc_oom_score_adj;
 
 	time_t				cc_age;
 
@@ -72,14 +92,74 @@ struct child_config {
 	/* internal */
 	int				cc_error;
 	time_t				cc_errtime;
-	struct process			**cc_childs;
+	struct process			**cc_childs,
+					**cc_standbys;	/* cc_standby entries */
+
+	/* ids looked up from cc_username / cc_groupname (or cc_uid / cc_gid),
+	 * cached in the server. */
+	int				cc_cred_uid,
+					cc_cred_gid,
+					cc_cred_errno;
+	const char			*cc_cred_errfunc;
+	time_t				cc_cred_time;
+
+	/* compiled stdout, stderr, dir and args. cc_tpl_args is NULL if no
+	 * argument contains a token. */
+	struct template			*cc_tpl_stdout,
+					*cc_tpl_stderr,
+					*cc_tpl_dir,
+					**cc_tpl_args,
+					**cc_tpl_env;
+
+	/* environment per instance (index instance + 1, 0 is for processes
+	 * without instance), built on first use by child_config_envp(). */
+	char				***cc_envp;
+	int				cc_nenvp;
+
+	/* sockets bound by the server for cc_listen, passed to every
+	 * process as fd 3 and up. */
+	int				*cc_listen_fds,
+					cc_nlisten;
+
+	/* template process of a zygote group, owned by the server. */
+	struct zygote			*cc_zyg;
+
+	/* socket activation state of an on demand group. */
+	struct ondemand			*cc_od;
+
+	/* compiled cc_cpus */
+	struct cpu_policy		*cc_cpu_policy;
+
+	/* compiled resource controls, NULL if none are set */
+	struct resources		*cc_res;
+
+	/* directory of the group cgroup, -1 without cgroup root */
+	int				cc_cgroup_fd;
+
+	/* resource usage of exited processes, of the group and per instance
+	 * (cc_instances entries) */
+	struct exit_stat		cc_exit_stat,
+					*cc_inst_stat;
+
+	/* compiled cc_backoff, NULL if not set, and restart state per
+	 * instance (cc_instances entries, see cmd_server.c) */
+	struct backoff			*cc_backoff_policy;
+	struct backoff_slot		**cc_backoff_slots;
+
+	/* compiled cc_crashloop, NULL if not set, and recent errors per
+	 * instance (cc_instances entries) */
+	struct crashloop		*cc_crashloop_policy;
+	struct crash_ring		*cc_crash_rings;
 };
 
 LIST_HEAD(child_config_list, child_config);
 
 extern struct child_config_list		child_config_list_head;
 extern uvstrhash_t			*child_config_hash;
+extern char				*child_config_notify_socket;
 
+void str_array_free(char **);
+json_object *child_config_to_json(const struct child_config *);
 char *child_config_serialize(const struct child_config *);
 struct child_config *child_config_unserialize(const char *);
 struct child_config *child_config_from_json(json_object *);
@@ -89,5 +169,10 @@ void child_config_insert(struct child_config *);
 struct child_config *child_config_find_by_name(const char *);
 void child_config_remove(struct child_config *);
 int child_config_status_from_string(const char *);
+void child_config_compile(struct child_config *);
+int child_config_uses_token(const struct child_config *, int);
+char **child_config_env(const struct child_config *, int);
+char **child_config_envp(struct child_config *, int);
+void child_config_envp_free(struct child_config *);
 
 #endif /* __CHILD_CONFIG_H */
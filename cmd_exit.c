@@ -28,32 +28,87 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <getopt.h>
 #include <sys/types.h>
 
+#include <json/json.h>
+
+#include "main.h"
 #include "client.h"
 #include "cmd_exit.h"
 #include "misc.h"
 
+static char exit_opts[] = "hst:";
+
+static struct option exit_longopts[] = {
+	{ "help",	no_argument,		NULL,	'h' },
+	{ "stop",	no_argument,		NULL,	's' },
+	{ "timeout",	required_argument,	NULL,	't' },
+	{ NULL,		0,			NULL,	0 }
+};
+
+static void
+help_exit(void)
+{
+	printf("Usage: %s exit [Options]\n", program_name);
+	printf("\n");
+	printf("Options:\n");
+	printf("\t-h, --help         help.\n");
+	printf("\t-s, --stop         stop all processes, exit when they exited.\n");
+	printf("\t-t, --timeout SEC  with -s: SIGKILL after SEC instead of the stop\n");
+	printf("\t                   timeout of the groups.\n");
+	printf("\n");
+	exit(EXIT_FAILURE);
+}
+
 int
 cmd_exit(int argc, char **argv)
 {
 	int		sock,
-			ret;
+			ch,
+			ret,
+			stop = 0,
+			timeout = -1;
+	char		*msg = NULL;
+	json_object	*obj;
 
-	if (argc > 1) {
-		fprintf(stderr, "%s takes no options.\n", argv[0]);
-		return EXIT_FAILURE;
+	while ((ch = getopt_long(argc, argv, exit_opts, exit_longopts, NULL)) != -1) {
+		switch (ch) {
+		case 's':
+			stop = 1;
+			break;
+		case 't':
+			timeout = strtol(optarg, NULL, 10);
+			break;
+		case 'h':
+		default:
+			help_exit();
+		}
+	}
+
+	if (argc - optind != 0)
+		help_exit();
+
+	if (stop) {
+		obj = json_object_new_object();
+		json_object_object_add(obj, "stop", json_object_new_boolean(1));
+		if (timeout != -1)
+			json_object_object_add(obj, "timeout",
+					json_object_new_int(timeout));
+		msg = xstrdup(json_object_to_json_string(obj));
+		json_object_put(obj);
 	}
 
 	if ((sock = sock_connect()) == -1) {
 		die("Failed to connect server");
 	}
 
-	if (sock_send_command(sock, "EXIT", NULL) == -1) {
+	if (sock_send_command(sock, "EXIT", msg) == -1) {
 		fprintf(stderr, "write data\n");
 		return EXIT_FAILURE;
 	}
 
+	free(msg);
 	ret = get_status_reply(sock);
 	close(sock);
 	return ret;
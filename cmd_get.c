@@ -30,33 +30,84 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <time.h>
 
 #include "main.h"
 #include "client.h"
 #include "misc.h"
 #include "child_config.h"
 
-static char get_opts[] = "adDefgGhHikosuU";
+static char get_opts[] = "aAbBcCdDeEfFgGhHiIklLmnNoOpPrRsSTuUxZ";
 
 static struct option get_longopts[] = {
 	{ "age",	no_argument,		NULL,	'a' },
+	{ "accounting",	no_argument,		NULL,	'A' },
+	{ "standby",	no_argument,		NULL,	'b' },
+	{ "backoff",	no_argument,		NULL,	'B' },
+	{ "cpus",	no_argument,		NULL,	'c' },
+	{ "effective",	no_argument,		NULL,	'C' },
 	{ "dir",	no_argument,		NULL,	'd' },
 	{ "dump",	no_argument,		NULL,	'D' },
 	{ "stderr",	no_argument,		NULL,	'e' },
+	{ "env",	no_argument,		NULL,	'E' },
 	{ "fatal",	no_argument,		NULL,	'f' },
+	{ "crashloop",	no_argument,		NULL,	'F' },
 	{ "gid",	no_argument,		NULL,	'g' },
 	{ "groupname",	no_argument,		NULL,	'G' },
 	{ "help",	no_argument,		NULL,	'h' },
 	{ "heartbeat",	no_argument,		NULL,	'H' },
 	{ "instances",	no_argument,		NULL,	'i' },
+	{ "ioprio",	no_argument,		NULL,	'I' },
 	{ "killsig",	no_argument,		NULL,	'k' },
+	{ "listen",	no_argument,		NULL,	'l' },
+	{ "cgroup",	no_argument,		NULL,	'L' },
+	{ "oomadj",	no_argument,		NULL,	'm' },
+	{ "nice",	no_argument,		NULL,	'n' },
+	{ "notify",	no_argument,		NULL,	'N' },
 	{ "stdout",	no_argument,		NULL,	'o' },
+	{ "ondemand",	no_argument,		NULL,	'O' },
+	{ "priority",	no_argument,		NULL,	'p' },
+	{ "port",	no_argument,		NULL,	'P' },
+	{ "rlimit",	no_argument,		NULL,	'r' },
+	{ "ready",	no_argument,		NULL,	'R' },
 	{ "status",	no_argument,		NULL,	's' },
+	{ "sched",	no_argument,		NULL,	'S' },
+	{ "stoptimeout",	no_argument,		NULL,	'T' },
 	{ "uid",	no_argument,		NULL,	'u' },
 	{ "username",	no_argument,		NULL,	'U' },
+	{ "exits",	no_argument,		NULL,	'x' },
+	{ "zygote",	no_argument,		NULL,	'Z' },
 	{ NULL,		0,			NULL,	0 }
 };
 
+/*
+ * print one entry of exit_stats.
+ */
+static void
+print_exit_stat(const char *what, json_object *es)
+{
+	static const char	*keys[] = { "exits", "orphans", "utime", "stime",
+					"maxrss", "minflt", "majflt", "nvcsw",
+					"nivcsw", "adopted", NULL };
+	json_object		*v;
+	int			i;
+
+	printf("%s:", what);
+	for (i = 0; keys[i] != NULL; i++) {
+		if ((v = json_object_object_get(es, keys[i])) == NULL)
+			continue;
+		if (i == 2 || i == 3)
+			printf(" %s %.6f", keys[i], json_object_get_double(v));
+		else
+			printf(" %s %.0f", keys[i], json_object_get_double(v));
+	}
+	if ((v = json_object_object_get(es, "code")) != NULL)
+		printf(" code %d", json_object_get_int(v));
+	if ((v = json_object_object_get(es, "signal")) != NULL)
+		printf(" signal %d", json_object_get_int(v));
+	printf("\n");
+}
+
 static void
 help_get(void)
 {
@@ -64,18 +115,40 @@ help_get(void)
 	printf("\n");
 	printf("Options:\n");
 	printf("\t-a, --age        print age.\n");
+	printf("\t-A, --accounting print memory, cpu time and tasks of the group cgroup.\n");
+	printf("\t-b, --standby    print number of standby processes.\n");
+	printf("\t-B, --backoff    print restart backoff and delay of every instance.\n");
+	printf("\t-c, --cpus       print cpu policy.\n");
+	printf("\t-C, --effective  print cpu affinity of each instance.\n");
 	printf("\t-d, --dir        print dir.\n");
 	printf("\t-D, --dump       print raw reply.\n");
 	printf("\t-e, --stderr     print stderr.\n");
+	printf("\t-E, --env        print environment variables.\n");
 	printf("\t-f, --fatal      print fatal_cb.\n");
+	printf("\t-F, --crashloop  print crash loop detection and broken instances.\n");
 	printf("\t-g, --gid        print gid processes are started with.\n");
 	printf("\t-h, --help       help.\n");
 	printf("\t-H, --heartbeat  print heartbeat command.\n");
 	printf("\t-i, --instances  print number of instances.\n");
+	printf("\t-I, --ioprio     print io priority.\n");
 	printf("\t-k, --killsig    print signal used to kill processes.\n");
+	printf("\t-l, --listen     print listen specs.\n");
+	printf("\t-L, --cgroup     print cgroup limits.\n");
+	printf("\t-m, --oomadj     print oom_score_adj.\n");
+	printf("\t-n, --nice       print nice value.\n");
+	printf("\t-N, --notify     print 1 if processes report readiness.\n");
 	printf("\t-o, --stdout     print stdout.\n");
+	printf("\t-O, --ondemand   print idle timeout of on demand groups.\n");
+	printf("\t-p, --priority   print spawn priority.\n");
+	printf("\t-P, --port       print port base.\n");
+	printf("\t-r, --rlimit     print resource limits.\n");
+	printf("\t-R, --ready      print number of ready instances.\n");
 	printf("\t-s, --status     print status.\n");
+	printf("\t-S, --sched      print scheduling policy.\n");
+	printf("\t-T, --stoptimeout print seconds stopped processes get before SIGKILL.\n");
 	printf("\t-u, --uid        print uid processes are started with.\n");
+	printf("\t-x, --exits      print resource usage of exited processes.\n");
+	printf("\t-Z, --zygote     print 1 if instances are forked by a zygote.\n");
 	printf("\n");
 	exit(EXIT_FAILURE);
 }
@@ -84,6 +157,8 @@ int
 cmd_get(int argc, char **argv)
 {
 	int			ch,
+				i,
+				len,
 				sock,
 				dump = 0,
 				get_stdout = 0,
@@ -95,18 +170,44 @@ cmd_get(int argc, char **argv)
 				get_status = 0,
 				get_instances = 0,
 				get_killsig = 0,
+				get_priority = 0,
+				get_port = 0,
 				get_heartbeat = 0,
 				get_fatal = 0,
 				get_username = 0,
-				get_groupname = 0;
+				get_groupname = 0,
+				get_zygote = 0,
+				get_standby = 0,
+				get_ondemand = 0,
+				get_stop_timeout = 0,
+				get_notify = 0,
+				get_ready = 0,
+				get_cpus = 0,
+				get_effective = 0,
+				get_ioprio = 0,
+				get_oomadj = 0,
+				get_nice = 0,
+				get_rlimits = 0,
+				get_sched = 0,
+				get_cgroup = 0,
+				get_accounting = 0,
+				get_listen = 0,
+				get_env = 0,
+				get_exits = 0,
+				get_backoff = 0,
+				get_crashloop = 0;
 
-	char			*msg;
+	char			*msg,
+				what[16];
 
 	char			*buf;
 	size_t			buf_siz;
 
 	json_object		*obj,
-				*n;
+				*n,
+				*e,
+				*v;
+	time_t			now;
 
 	if (argc < 2)
 		help_get();
@@ -116,6 +217,21 @@ cmd_get(int argc, char **argv)
 		case 'a':
 			get_age = 1;
 			break;
+		case 'A':
+			get_accounting = 1;
+			break;
+		case 'b':
+			get_standby = 1;
+			break;
+		case 'B':
+			get_backoff = 1;
+			break;
+		case 'c':
+			get_cpus = 1;
+			break;
+		case 'C':
+			get_effective = 1;
+			break;
 		case 'd':
 			get_dir = 1;
 			break;
@@ -125,9 +241,15 @@ cmd_get(int argc, char **argv)
 		case 'e':
 			get_stderr = 1;
 			break;
+		case 'E':
+			get_env = 1;
+			break;
 		case 'f':
 			get_fatal = 1;
 			break;
+		case 'F':
+			get_crashloop = 1;
+			break;
 		case 'g':
 			get_gid = 1;
 			break;
@@ -143,21 +265,66 @@ cmd_get(int argc, char **argv)
 		case 'i':
 			get_instances = 1;
 			break;
+		case 'I':
+			get_ioprio = 1;
+			break;
 		case 'k':
 			get_killsig = 1;
 			break;
+		case 'l':
+			get_listen = 1;
+			break;
+		case 'L':
+			get_cgroup = 1;
+			break;
+		case 'm':
+			get_oomadj = 1;
+			break;
+		case 'n':
+			get_nice = 1;
+			break;
 		case 'o':
 			get_stdout = 1;
 			break;
+		case 'O':
+			get_ondemand = 1;
+			break;
+		case 'p':
+			get_priority = 1;
+			break;
+		case 'P':
+			get_port = 1;
+			break;
+		case 'r':
+			get_rlimits = 1;
+			break;
+		case 'N':
+			get_notify = 1;
+			break;
+		case 'R':
+			get_ready = 1;
+			break;
 		case 's':
 			get_status = 1;
 			break;
+		case 'S':
+			get_sched = 1;
+			break;
+		case 'T':
+			get_stop_timeout = 1;
+			break;
 		case 'u':
 			get_uid = 1;
 			break;
 		case 'U':
 			get_username = 1;
 			break;
+		case 'x':
+			get_exits = 1;
+			break;
+		case 'Z':
+			get_zygote = 1;
+			break;
 		default:
 			help_get();
 			break;
@@ -249,11 +416,113 @@ cmd_get(int argc, char **argv)
 	GETSTR("fatal_cb", get_fatal);
 	GETSTR("username", get_username);
 	GETSTR("groupname", get_groupname);
+	GETSTR("cpus", get_cpus);
+	GETSTR("ioprio", get_ioprio);
+	GETSTR("sched", get_sched);
+	GETSTR("rlimits", get_rlimits);
+	GETSTR("cgroup", get_cgroup);
+	GETSTR("backoff", get_backoff);
+	GETSTR("crashloop", get_crashloop);
 	GETINT("age", get_age);
 	GETINT("uid", get_uid);
 	GETINT("gid", get_gid);
 	GETINT("status", get_status);
 	GETINT("instances", get_instances);
 	GETINT("killsig", get_killsig);
+	GETINT("priority", get_priority);
+	GETINT("port", get_port);
+	GETINT("zygote", get_zygote);
+	GETINT("standby", get_standby);
+	GETINT("ondemand", get_ondemand);
+	GETINT("stop_timeout", get_stop_timeout);
+	GETINT("notify", get_notify);
+	GETINT("ready", get_ready);
+	GETINT("nice", get_nice);
+	GETINT("oom_score_adj", get_oomadj);
+
+	if (get_listen && (n = json_object_object_get(obj, "listen")) != NULL) {
+		if (!json_object_is_type(n, json_type_array)) {
+			fprintf(stderr, "failed.\n");
+			return EXIT_FAILURE;
+		}
+		len = json_object_array_length(n);
+		for (i = 0; i < len; i++)
+			printf("%s\n", json_object_get_string(
+					json_object_array_get_idx(n, i)));
+	}
+
+	if (get_env && (n = json_object_object_get(obj, "env")) != NULL) {
+		if (!json_object_is_type(n, json_type_array)) {
+			fprintf(stderr, "failed.\n");
+			return EXIT_FAILURE;
+		}
+		len = json_object_array_length(n);
+		for (i = 0; i < len; i++)
+			printf("%s\n", json_object_get_string(
+					json_object_array_get_idx(n, i)));
+	}
+
+	if (get_effective && (n = json_object_object_get(obj, "cpus_effective")) != NULL) {
+		if (!json_object_is_type(n, json_type_array)) {
+			fprintf(stderr, "failed.\n");
+			return EXIT_FAILURE;
+		}
+		len = json_object_array_length(n);
+		for (i = 0; i < len; i++) {
+			e = json_object_array_get_idx(n, i);
+			printf("%d: %s\n", i, e != NULL ? json_object_get_string(e) : "-");
+		}
+	}
+
+	if (get_accounting && (n = json_object_object_get(obj, "cgroup_stats")) != NULL) {
+		if (!json_object_is_type(n, json_type_object)) {
+			fprintf(stderr, "failed.\n");
+			return EXIT_FAILURE;
+		}
+		if ((e = json_object_object_get(n, "memory_current")) != NULL)
+			printf("memory %.0f\n", json_object_get_double(e));
+		if ((e = json_object_object_get(n, "cpu_usage")) != NULL)
+			printf("cpu %.6f\n", json_object_get_double(e));
+		if ((e = json_object_object_get(n, "pids_current")) != NULL)
+			printf("pids %d\n", json_object_get_int(e));
+	}
+
+	if (get_backoff && (n = json_object_object_get(obj, "backoff_state")) != NULL
+			&& json_object_is_type(n, json_type_array)) {
+		now = time(NULL);
+		len = json_object_array_length(n);
+		for (i = 0; i < len; i++) {
+			e = json_object_array_get_idx(n, i);
+			if ((v = json_object_object_get(e, "delay")) != NULL)
+				printf("%d: delay %d ms", i, json_object_get_int(v));
+			if ((v = json_object_object_get(e, "until")) != NULL
+					&& json_object_get_double(v) > now)
+				printf(", restart in %.0f s",
+						json_object_get_double(v) - now);
+			printf("\n");
+		}
+	}
+
+	if (get_crashloop && (n = json_object_object_get(obj, "broken_instances")) != NULL
+			&& json_object_is_type(n, json_type_array)) {
+		printf("broken:");
+		len = json_object_array_length(n);
+		for (i = 0; i < len; i++)
+			printf(" %d", json_object_get_int(
+					json_object_array_get_idx(n, i)));
+		printf("\n");
+	}
+
+	if (get_exits && (n = json_object_object_get(obj, "exit_stats")) != NULL) {
+		print_exit_stat("all", n);
+		if ((n = json_object_object_get(obj, "instance_exit_stats")) != NULL
+				&& json_object_is_type(n, json_type_array)) {
+			len = json_object_array_length(n);
+			for (i = 0; i < len; i++) {
+				snprintf(what, sizeof(what), "%d", i);
+				print_exit_stat(what, json_object_array_get_idx(n, i));
+			}
+		}
+	}
 	return EXIT_SUCCESS;
 }
@@ -28,6 +28,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <json/json.h>
 
@@ -41,6 +42,7 @@ cmd_pids(int argc, char **argv)
 	int			sock,
 				len,
 				ret,
+				verbose = 0,
 				i;
 
 	char			*msg;
@@ -50,10 +52,17 @@ cmd_pids(int argc, char **argv)
 
 	json_object		*obj,
 				*n,
-				*e;
+				*e,
+				*f;
+
+	if (argc == 3 && !strcmp(argv[1], "-v")) {
+		verbose = 1;
+		argc--;
+		argv++;
+	}
 
 	if (argc != 2) {
-		printf("Usage: %s %s <name>\n", program_name, argv[0]);
+		printf("Usage: %s pids [-v] <name>\n", program_name);
 		return EXIT_FAILURE;
 	}
 
@@ -101,6 +110,26 @@ cmd_pids(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
+	if (verbose) {
+		/* pid, instance, state and status text of each process */
+		if ((n = json_object_object_get(obj, "processes")) == NULL) {
+			fprintf(stderr, "Failed to parse reply.\n");
+			return EXIT_FAILURE;
+		}
+		len = json_object_array_length(n);
+		for (i = 0; i < len; i++) {
+			e = json_object_array_get_idx(n, i);
+			printf("%d", json_object_get_int(json_object_object_get(e, "pid")));
+			printf(" %d", json_object_get_int(json_object_object_get(e, "instance")));
+			printf(" %s", json_object_get_string(json_object_object_get(e, "state")));
+			if ((f = json_object_object_get(e, "status_text")) != NULL)
+				printf(" %s", json_object_get_string(f));
+			printf("\n");
+		}
+		json_object_put(obj);
+		return EXIT_SUCCESS;
+	}
+
 	if ((n = json_object_object_get(obj, "pids")) == NULL) {
 		fprintf(stderr, "Failed to parse reply.\n");
 		return EXIT_FAILURE;
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <json/json.h>
+
+#include "main.h"
+#include "client.h"
+#include "cmd_roll.h"
+#include "misc.h"
+
+static char roll_opts[] = "b:ht:u:";
+
+static struct option roll_longopts[] = {
+	{ "batch",	required_argument,	NULL,	'b' },
+	{ "help",	no_argument,		NULL,	'h' },
+	{ "timeout",	required_argument,	NULL,	't' },
+	{ "uptime",	required_argument,	NULL,	'u' },
+	{ NULL,		0,			NULL,	0 }
+};
+
+static void
+help_roll(void)
+{
+	printf("Usage: %s roll [Options] <name>\n", program_name);
+	printf("\n");
+	printf("Restart the instances of a group in waves.\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("\t-b, --batch N[%%]   instances per wave, or percent of the\n");
+	printf("\t                   instances. Default: 1.\n");
+	printf("\t-h, --help         help.\n");
+	printf("\t-t, --timeout SEC  abort if a wave is not done SEC seconds after\n");
+	printf("\t                   the stop timeout. Default: 60.\n");
+	printf("\t-u, --uptime SEC   seconds new processes have to run before the\n");
+	printf("\t                   next wave starts. Default: 1.\n");
+	printf("\n");
+	exit(EXIT_FAILURE);
+}
+
+/*
+ * print a progress message, "wave 1/4 restarting: 0 1 (pids 10 11)".
+ */
+static void
+print_progress(json_object *obj)
+{
+	json_object	*n,
+			*a;
+	int		i;
+
+	n = json_object_object_get(obj, "state");
+	printf("wave %d/%d %s:",
+			json_object_get_int(json_object_object_get(obj, "wave")),
+			json_object_get_int(json_object_object_get(obj, "waves")),
+			n != NULL ? json_object_get_string(n) : "");
+	if ((a = json_object_object_get(obj, "instances")) != NULL) {
+		for (i = 0; i < (int)json_object_array_length(a); i++)
+			printf(" %d", json_object_get_int(
+					json_object_array_get_idx(a, i)));
+	}
+	if ((a = json_object_object_get(obj, "pids")) != NULL) {
+		printf(" (pids");
+		for (i = 0; i < (int)json_object_array_length(a); i++)
+			printf(" %d", json_object_get_int(
+					json_object_array_get_idx(a, i)));
+		printf(")");
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+int
+cmd_roll(int argc, char **argv)
+{
+	int		sock,
+			ch,
+			ret,
+			timeout = -1,
+			uptime = -1;
+	char		*msg,
+			*buf,
+			*batch = NULL;
+	size_t		buf_siz;
+	json_object	*obj,
+			*n;
+
+	while ((ch = getopt_long(argc, argv, roll_opts, roll_longopts, NULL)) != -1) {
+		switch (ch) {
+		case 'b':
+			batch = optarg;
+			break;
+		case 't':
+			timeout = strtol(optarg, NULL, 10);
+			break;
+		case 'u':
+			uptime = strtol(optarg, NULL, 10);
+			break;
+		case 'h':
+		default:
+			help_roll();
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 1)
+		help_roll();
+
+	obj = json_object_new_object();
+	json_object_object_add(obj, "name", json_object_new_string(argv[0]));
+	if (batch != NULL)
+		json_object_object_add(obj, "batch", json_object_new_string(batch));
+	if (timeout != -1)
+		json_object_object_add(obj, "timeout", json_object_new_int(timeout));
+	if (uptime != -1)
+		json_object_object_add(obj, "min_uptime", json_object_new_int(uptime));
+	msg = xstrdup(json_object_to_json_string(obj));
+	json_object_put(obj);
+
+	if ((sock = sock_connect()) == -1) {
+		die("Failed to connect server");
+	}
+
+	if (sock_send_command(sock, "ROLL", msg) == -1) {
+		fprintf(stderr, "write data\n");
+		return EXIT_FAILURE;
+	}
+	free(msg);
+
+	/* progress messages until the final reply, which has a "msg" */
+	for (;;) {
+		if ((buf = read_reply(sock, &buf_siz)) == NULL) {
+			fprintf(stderr, "Failed to parse reply.\n");
+			return EXIT_FAILURE;
+		}
+		obj = json_tokener_parse(buf);
+		free(buf);
+		if (obj == NULL || is_error(obj)) {
+			fprintf(stderr, "Failed to parse reply.\n");
+			return EXIT_FAILURE;
+		}
+		if ((n = json_object_object_get(obj, "msg")) != NULL)
+			break;
+		print_progress(obj);
+		json_object_put(obj);
+	}
+	close(sock);
+
+	ret = json_object_get_boolean(json_object_object_get(obj, "code"));
+	fprintf(ret ? stdout : stderr, "%s\n", json_object_get_string(n));
+	json_object_put(obj);
+	return ret ? EXIT_SUCCESS : EXIT_FAILURE;
+}
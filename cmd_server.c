@@ -38,6 +38,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <assert.h>
+#include <poll.h>
 
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -45,12 +46,16 @@
 #include <sys/un.h>
 #include <sys/stat.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
 #include <dirent.h>
 
 #include <json/json.h>
 #include <event.h>
 
 #include "config.h"
+#ifdef HAVE_SYS_PRCTL_H
+#include <sys/prctl.h>
+#endif
 #include "main.h"
 #include "client.h"
 #include "child_config.h"
@@ -59,6 +64,16 @@
 #include "subscription.h"
 #include "process.h"
 #include "uvhash.h"
+#include "spawn.h"
+#include "hist.h"
+#include "cpus.h"
+#include "resources.h"
+#include "cgroup.h"
+#include "backoff.h"
+#include "crashloop.h"
+#include "statefile.h"
+#include "notify.h"
+#include "cred.h"
 #include "cmd_server.h"
 
 #include "compat/queue.h"
@@ -86,14 +101,208 @@ static LIST_HEAD(client_con_list, client_con)		client_con_list_head;
 static struct event_base	*evloop;
 static FILE			*log_fd;
 static int			auto_dump,
-				allow_exit;
+				allow_exit,
+				draining,	/* EXIT is stopping all groups */
+				spawn_method;
 static char			*server_logfile;
 
+/*
+ * server socket and how to execute the server again, see c_upgr().
+ */
+static int			server_fd = -1;
+static char			**server_argv,
+				server_exe[PATH_MAX];
+
+/*
+ * spawn queue. spawn_queue_add() only queues a process, spawn_queue_run()
+ * starts queued processes in order of group priority, but no more then
+ * spawn_rate per SPAWN_TICK_MSEC and only while less then spawn_max_inflight
+ * started processes have not called execv yet.
+ */
+struct spawn_entry {
+	TAILQ_ENTRY(spawn_entry)	se_ent;
+	struct child_config		*se_child_config;
+	int				se_instance,	/* standby slot if se_standby */
+					se_priority,
+					se_standby;
+	long long			se_queued;
+};
+
+static TAILQ_HEAD(spawn_queue, spawn_entry)	spawn_queue_head;
+static struct event		spawn_timer,
+				cred_timer;
+static int			spawn_rate,
+				spawn_max_inflight,
+				spawn_tick_count,
+				spawn_inflight,
+				spawn_queue_len;
+static long long		spawn_total,
+				spawn_wait_total,
+				spawn_wait_max;
+
+/*
+ * spawn latencies of processes that called execv successfully.
+ */
+static struct hist		hist_fork_exec,
+				hist_setids,
+				hist_logopen;
+
+/*
+ * socket shared by all starting children, see spawn_chan_open().
+ */
+static int			spawn_chan[2] = { -1, -1 };
+static struct event		spawn_chan_ev;
+
+/*
+ * requests to the spawn helper waiting for its reply. The server does not
+ * wait for the helper, the process is added when the reply is read by
+ * helper_read(). Requests for instances count as in flight.
+ */
+struct helper_req {
+	LIST_ENTRY(helper_req)	hr_ent;
+	uint32_t		hr_seq;
+	struct child_config	*hr_child_config;	/* NULL if deleted */
+	int			hr_instance,	/* -1 for commands */
+				hr_standby,
+				hr_expired;	/* timed out, waits for the reply */
+	char			*hr_command;	/* heartbeat, fatal_cb */
+	long long		hr_spawn_usec;
+	struct event		hr_timer;
+};
+
+/*
+ * children of the helper are children of the server and may be reaped
+ * before the reply with their pid is read. While requests are pending,
+ * exits of unknown children are kept here instead of the reaped ring, which
+ * may overwrite them.
+ */
+struct helper_exit {
+	LIST_ENTRY(helper_exit)	he_ent;
+	pid_t			he_pid;
+	int			he_status;
+};
+
+static LIST_HEAD(, helper_req)	helper_reqs;
+static LIST_HEAD(, helper_exit)	helper_exits;
+static struct event		helper_ev;
+static int			helper_watched;
+
+/*
+ * user and group names are looked up by the name resolver (see cred.c), so
+ * a slow name service does not stall the server. cl_ev is the timeout of the
+ * request cl_seq. Without a resolver a child of the server does the lookup,
+ * writes one cred_rep to cl_fd and exits, cl_ev waits for it.
+ * cr_errfunc indexes cred_funcs.
+ */
+static const char		*cred_funcs[] = {
+	NULL, "getpwnam", "getgrnam", "lookup", "fork"
+};
+
+struct cred_lookup {
+	LIST_ENTRY(cred_lookup)	cl_ent;
+	struct child_config	*cl_child_config;	/* NULL if deleted */
+	uint32_t		cl_seq;		/* 0 if forked */
+	pid_t			cl_pid;
+	int			cl_fd,
+				cl_stale;	/* names changed, look up again */
+	struct event		cl_ev;
+};
+
+static LIST_HEAD(, cred_lookup)	cred_lookups;
+static struct event		resolver_ev;
+static int			resolver_watched;
+
+/*
+ * readiness notifications of children, see notify_start().
+ */
+static int			notify_fd = -1;
+static struct event		notify_ev;
+
+/*
+ * stops with a deadline: a stopped process gets the kill signal of its group
+ * and SIGKILL when its stop timer fires. A stop_op counts the processes a
+ * STOP or EXIT command waits for and replies when all exited, at the latest
+ * STOP_GIVEUP_SEC after the deadline. DELE uses one without client to
+ * remove the cgroup of the group when its processes exited.
+ */
+struct stop_op {
+	LIST_ENTRY(stop_op)	so_ent;
+	struct client_con	*so_con;	/* NULL if gone or answered */
+	uint16_t		so_cid;
+	int			so_pending,	/* processes not exited */
+				so_killed,	/* processes sent SIGKILL */
+				so_timeout,	/* longest deadline */
+				so_done,
+				so_expired,	/* the timer fired */
+				so_exit,	/* server exits when done */
+				so_cgroup_fd;	/* cgroup to remove or -1 */
+	char			*so_cgroup;	/* name of the deleted group */
+	struct event		so_timer;
+};
+
+static LIST_HEAD(, stop_op)	stop_ops;
+
+/*
+ * rolling restarts: the instances of a group are restarted in waves of
+ * r_batch. A wave is done when every instance has a new process that is
+ * ready (see process_ready()) and runs for r_min_uptime seconds. Progress
+ * is sent to r_con.
+ */
+struct roll {
+	LIST_ENTRY(roll)	r_ent;
+	struct child_config	*r_child_config;
+	struct client_con	*r_con;		/* NULL if gone */
+	uint16_t		r_cid;
+	int			r_batch,
+				r_min_uptime,
+				r_timeout,
+				r_wave,		/* current wave, from 0 */
+				r_waves;
+	pid_t			*r_old;		/* pids of the wave, 0 if none */
+	time_t			r_deadline;
+	struct event		r_timer;
+};
+
+static LIST_HEAD(, roll)	rolls;
+
+/*
+ * WAIT commands: the reply is sent when all instances of the group are
+ * ready, see wait_timer_cb().
+ */
+struct wait_op {
+	LIST_ENTRY(wait_op)	w_ent;
+	struct child_config	*w_child_config;
+	struct client_con	*w_con;		/* NULL if gone */
+	uint16_t		w_cid;
+	time_t			w_deadline;
+	struct event		w_timer;
+};
+
+static LIST_HEAD(, wait_op)	wait_ops;
+
 /*
  * prototypes
  */
 static void heartbeat_cb(int, short, void *);
+static void pidfd_cb(int, short, void *);
+static void pidfd_gone_cb(int, short, void *);
+static void helper_cb(int, short, void *);
+static void resolver_cb(int, short, void *);
+static void stop_op_timer_cb(int, short, void *);
+static void group_error(struct child_config *, int);
+static int helper_spawn(struct spawn_args *, struct child_config *, int, int,
+		const char *);
+static int helper_pending(const struct child_config *, int, int);
+static int backoff_pending(const struct child_config *, int);
+static void group_queue_missing(struct child_config *);
+static void process_exit(struct process *, int, const struct rusage *);
+static int exit_is_error(int, struct child_config *);
+static void spawn_queue_run(void);
+static int zygote_spawn(struct child_config *, int);
+static void ondemand_update(struct child_config *);
 static void slog(const char *, ...);
+static void clients_flush(struct client_con *);
+static const char *dump_write(void);
 
 static int c_dele(struct client_con *, char *);
 static int c_dump(struct client_con *, char *);
@@ -104,9 +313,14 @@ static int c_kill(struct client_con *, char *);
 static int c_list(struct client_con *, char *);
 static int c_pids(struct client_con *, char *);
 static int c_spwn(struct client_con *, char *);
+static int c_stat(struct client_con *, char *);
+static int c_stop(struct client_con *, char *);
 static int c_subs(struct client_con *, char *);
 static int c_updt(struct client_con *, char *);
+static int c_upgr(struct client_con *, char *);
 static int c_read(struct client_con *, char *);
+static int c_roll(struct client_con *, char *);
+static int c_wait(struct client_con *, char *);
 
 typedef int (*cfunc_t)(struct client_con *, char *);
 
@@ -125,9 +339,14 @@ struct commands_s commands[] = {
 	{"LIST",	c_list},
 	{"PIDS",	c_pids},
 	{"READ",	c_read},
+	{"ROLL",	c_roll},
 	{"SPWN",	c_spwn},
+	{"STAT",	c_stat},
+	{"STOP",	c_stop},
 	{"SUBS",	c_subs},
 	{"UPDT",	c_updt},
+	{"UPGR",	c_upgr},
+	{"WAIT",	c_wait},
 };
 
 /*
@@ -142,27 +361,91 @@ struct commands_s commands[] = {
  */
 #define HEARTBEAT_SEC	5
 
-#define LOG_TS_FORMAT	"%b %d %T"
+/*
+ * don't restart the spawn helper if it exits more then once in this period
+ * of seconds.
+ */
+#define HELPER_RESTART_PERIOD	10
+
+/*
+ * a request of the spawn helper that timed out waits this many seconds for
+ * the late reply, whose process is killed.
+ */
+#define HELPER_LATE_SEC		60
+
+/*
+ * spawn queue tick and defaults for the limits.
+ */
+#define SPAWN_TICK_MSEC			100
+#define SPAWN_RATE_DEFAULT		64
+#define SPAWN_MAX_INFLIGHT_DEFAULT	128
+
+/*
+ * user and group ids looked up from names are refreshed after CRED_TTL
+ * seconds. Checked every CRED_CHECK_SEC seconds.
+ */
+#define CRED_TTL		300
+#define CRED_CHECK_SEC		30
+/* seconds a lookup may take */
+#define CRED_LOOKUP_SEC		30
+/* fork for lookups if the resolver exits again within this many seconds */
+#define CRED_RESTART_PERIOD	10
+
+/*
+ * seconds a stopped process gets before SIGKILL, if the group doesn't set
+ * stop_timeout. STOP and EXIT reply STOP_GIVEUP_SEC after the deadline even
+ * if processes are left.
+ */
+#define STOP_TIMEOUT_DEFAULT	10
+#define STOP_GIVEUP_SEC		5
 
-/* logfile create mode */
-#define _LO_C		(O_APPEND | O_CREAT | O_WRONLY)
+/*
+ * rolling restarts check their wave every ROLL_TICK_MSEC. A wave has to be
+ * done within the stop timeout plus ROLL_TIMEOUT_DEFAULT seconds.
+ */
+#define ROLL_TICK_MSEC		200
+#define ROLL_MIN_UPTIME_DEFAULT	1
+#define ROLL_TIMEOUT_DEFAULT	60
+
+/*
+ * WAIT checks the group every WAIT_TICK_MSEC, for WAIT_TIMEOUT_DEFAULT
+ * seconds unless a timeout is given.
+ */
+#define WAIT_TICK_MSEC		200
+#define WAIT_TIMEOUT_DEFAULT	60
+
+/*
+ * pids of unknown children reaped by the server (e.g. zygote instances that
+ * exit before the zygote reported them).
+ */
+#define REAPED_MAX		64
 
-/* logfile open mode */
-#define _LO_O 		(S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)
+/*
+ * idle checks of active on demand groups run at least every
+ * ONDEMAND_CHECK_SEC seconds.
+ */
+#define ONDEMAND_CHECK_SEC	5
+
+#define LOG_TS_FORMAT	"%b %d %T"
 
-static char		server_opts[] = "ac:d:fhlo:P:s";
+static char		server_opts[] = "ac:d:fg:hI:lo:P:R:sS:t:";
 
 static struct option	server_longopts[] = {
 	{ "autodump",	no_argument,		NULL,	'a' },
 	{ "config",	required_argument,	NULL,	'c' },
 	{ "dir",	required_argument,	NULL,	'd' },
 	{ "foreground",	no_argument,		NULL,	'f' },
+	{ "cgroup",	required_argument,	NULL,	'g' },
 	{ "help",	no_argument,		NULL,	'h' },
+	{ "inflight",	required_argument,	NULL,	'I' },
 	{ "loadlatest",	no_argument,		NULL,	'l' },
 	{ "noexit",	no_argument,		NULL,	'n' },
 	{ "logfile",	required_argument,	NULL,	'o' },
 	{ "perm",	required_argument,	NULL,	'P' },
+	{ "rate",	required_argument,	NULL,	'R' },
 	{ "silent",	no_argument,		NULL,	's' },
+	{ "spawn",	required_argument,	NULL,	'S' },
+	{ "state",	required_argument,	NULL,	't' },
 	{ NULL,		0,			NULL,	0 }
 };
 
@@ -176,12 +459,23 @@ help_server(void)
 	printf("\t-c, --config FILE      load a dump from FILE.\n");
 	printf("\t-d, --dir DIR          change to DIR after start.\n");
 	printf("\t-f, --foreground       don't fork into background.\n");
+	printf("\t-g, --cgroup DIR       create a cgroup for each group below DIR.\n");
 	printf("\t-h, --help             help.\n");
+	printf("\t-I, --inflight COUNT   max processes started but not yet running (%d).\n",
+			SPAWN_MAX_INFLIGHT_DEFAULT);
 	printf("\t-l, --loadlatest FILE  load most recent dump.\n");
 	printf("\t-n, --noexit           don't obey the exit command..\n");
 	printf("\t-o, --logfile FILE     write log output to FILE.\n");
+	printf("\t-R, --rate COUNT       start at most COUNT processes every %dms (%d).\n",
+			SPAWN_TICK_MSEC, SPAWN_RATE_DEFAULT);
 	printf("\t-s, --silent           exit silently if server is already running.\n");
+	printf("\t-S, --spawn METHOD     how to start processes: fork, vfork or helper\n");
+	printf("\t                       (default: %s).\n",
+			SPAWN_DEFAULT);
 	printf("\t-P, --perm             set permissions on socket (default: 600).\n");
+	printf("\t-t, --state FILE       running processes are kept in FILE and taken\n");
+	printf("\t                       over after a restart, '' disables (%s).\n",
+			STATE_PATH);
 	printf("\n");
 	printf("Examples:\n");
 	printf("\tubervisor server -d /tmp\n");
@@ -211,47 +505,152 @@ open_server_log(void) {
 }
 
 /*
- * child process pipe callback.
+ * process is about to call execv or exited, it no longer counts as in
+ * flight.
  */
 static void
-child_read_cb(struct bufferevent *b, void *px __attribute__((unused)))
+spawn_done(struct process *p)
 {
-	char			buf[1024];
-	size_t			r;
-
+	if (!p->p_starting)
+		return;
+	p->p_starting = 0;
+	spawn_inflight--;
+}
 
-	r = bufferevent_read(b, buf, sizeof(buf) - 1);
-	if (r > 0) {
-		buf[r] = '\0';
-		slog("%s", buf);
+/*
+ * handle a record sent by a starting child.
+ */
+static void
+child_rec(struct process *p, const struct spawn_rec *rec)
+{
+	struct child_config	*cc = p->p_child_config;
+
+	switch (rec->sr_type) {
+	case SPAWN_REC_EXEC:
+		p->p_exec_usec = rec->sr_exec;
+		p->p_setids_usec = rec->sr_setids;
+		p->p_logopen_usec = rec->sr_logopen;
+		if (!p->p_starting || p->p_failed)
+			break;
+		hist_add(&hist_fork_exec, p->p_exec_usec - p->p_spawn_usec);
+		hist_add(&hist_setids, p->p_setids_usec);
+		hist_add(&hist_logopen, p->p_logopen_usec);
+
+		/* standbys wait stopped until they are promoted. The child
+		 * is about to call execv, a stop arriving before it is
+		 * delayed until execv returned. */
+		if (p->p_standby)
+			process_kill(p, SIGSTOP);
+		spawn_done(p);
+		spawn_queue_run();
+		break;
+	case SPAWN_REC_FAIL:
+	case SPAWN_REC_LOG:
+		/* getpwnam and getgrnam may leave errno at 0 on errors. */
+		if (rec->sr_errno != 0)
+			slog("spawn failed for \"%s\": %s: %s\n",
+					cc ? cc->cc_name : NULL,
+					rec->sr_func, strerror(rec->sr_errno));
+		else
+			slog("spawn failed for \"%s\": %s failed\n",
+					cc ? cc->cc_name : NULL, rec->sr_func);
+
+		/* count the error now, not when the process is reaped. */
+		if (rec->sr_type == SPAWN_REC_FAIL && !p->p_failed) {
+			p->p_failed = 1;
+			if (cc != NULL)
+				group_error(cc, p->p_standby ? -1 : p->p_instance);
+		}
+		break;
 	}
 }
 
 /*
- * child pipe error callback.
+ * read all pending records from the spawn channel. Records of processes
+ * already reaped are dropped.
  */
 static void
-child_error_cb(struct bufferevent *b __attribute__((unused)),
-		short what __attribute__((unused)), void *px)
+spawn_chan_read(void)
 {
-	struct process	*p = px;
+	struct spawn_rec	rec;
+	struct process		*p;
+	ssize_t			r;
+
+	if (spawn_chan[0] == -1)
+		return;
 
-	if (p->p_child_sockbuf != NULL) {
-		close(p->p_child_sock);
-		bufferevent_disable(p->p_child_sockbuf, EV_READ);
-		bufferevent_free(p->p_child_sockbuf);
-		p->p_child_sockbuf = NULL;
+	while ((r = recv(spawn_chan[0], &rec, sizeof(rec), 0)) != -1) {
+		if (r != sizeof(rec)) {
+			if (r == 0)
+				break;
+			slog("short spawn record (%zd bytes).\n", r);
+			continue;
+		}
+		rec.sr_func[sizeof(rec.sr_func) - 1] = '\0';
+		if ((p = process_find_by_pid(rec.sr_pid)) != NULL)
+			child_rec(p, &rec);
 	}
 }
 
+/*
+ * spawn channel callback.
+ */
+static void
+spawn_chan_cb(int fd __attribute__((unused)),
+		short what __attribute__((unused)),
+		void *unused __attribute__((unused)))
+{
+	spawn_chan_read();
+}
+
+/*
+ * create the socket children report spawn errors and exec timings to. One
+ * SOCK_SEQPACKET pair is shared by all children: the write end is passed to
+ * every child (close on exec), the server reads from the other end.
+ */
+static void
+spawn_chan_open(void)
+{
+	int	sz = 1024 * 1024;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, spawn_chan) == -1)
+		die("socketpair");
+	setcloseonexec(spawn_chan[0]);
+	setcloseonexec(spawn_chan[1]);
+	setnonblock(spawn_chan[0]);
+
+	/* children block on a full channel. vfork'ed children block the
+	 * server as well, see spawn(). */
+	setsockopt(spawn_chan[1], SOL_SOCKET, SO_SNDBUF, &sz, sizeof(sz));
+
+	event_set(&spawn_chan_ev, spawn_chan[0], EV_READ | EV_PERSIST,
+			spawn_chan_cb, NULL);
+	event_add(&spawn_chan_ev, NULL);
+}
 
 static void
 drop_client_connection(struct client_con *c)
 {
+	struct stop_op		*so;
+	struct roll		*r;
+	struct wait_op		*w;
+
 	bufferevent_disable(c->c_be, EV_READ | EV_WRITE);
 	bufferevent_free(c->c_be);
 	close(c->c_sock);
 	subscription_remove_for_client(c);
+	LIST_FOREACH (so, &stop_ops, so_ent) {
+		if (so->so_con == c)
+			so->so_con = NULL;
+	}
+	LIST_FOREACH (r, &rolls, r_ent) {
+		if (r->r_con == c)
+			r->r_con = NULL;
+	}
+	LIST_FOREACH (w, &wait_ops, w_ent) {
+		if (w->w_con == c)
+			w->w_con = NULL;
+	}
 	LIST_REMOVE(c, c_ent);
 	free(c);
 }
@@ -437,324 +836,3392 @@ send_group_cfg_update_notification(const struct child_config *cc)
 }
 
 /*
- * run fatal callback command for a group.
+ * Return 1 if an instance is running and ready. Processes of groups with
+ * readiness notification are ready after READY=1, others after execv.
  */
-static void
-run_fatal_cb(struct child_config *cc)
+static int
+process_ready(const struct process *p)
 {
-	char	*args[3];
-	pid_t	pid;
-
-	if (cc->cc_fatal_cb == NULL)
-		return;
-
-	if ((pid = fork()) == -1) {
-		slog("fork failed when running fatal_cb for %s\n", cc->cc_name);
-		return;
-	}
+	return !p->p_starting && !p->p_stopping && !p->p_standby
+		&& !p->p_reloading && !p->p_failed
+		&& (p->p_child_config->cc_notify != 1 || p->p_ready);
+}
 
-	slog("running fatal_cb \"%s\" for %s ...\n", cc->cc_fatal_cb, cc->cc_name);
-	if (pid == 0) {
-		args[0] = cc->cc_fatal_cb;
-		args[1] = cc->cc_name;
-		args[2] = NULL;
-		execv(args[0], args);
-		exit(EXIT_FAILURE);
-	}
+static const char *
+process_state(const struct process *p)
+{
+	if (p->p_standby)
+		return "standby";
+	if (p->p_stopping)
+		return "stopping";
+	if (p->p_reloading)
+		return "reloading";
+	return process_ready(p) ? "ready" : "starting";
 }
 
 /*
- * start heartbeat timer for process.
+ * {"pid": .., "instance": .., "state": .., "status_text": ..,
+ * "watchdog": seconds since the last ping}, for PIDS and notifications.
  */
-static void
-schedule_heartbeat(struct process *p)
+static json_object *
+process_to_json(const struct process *p)
 {
-	struct timeval	tv = {HEARTBEAT_SEC, 0};
-	evtimer_set(&p->p_heartbeat_timer, heartbeat_cb, p);
-	evtimer_add(&p->p_heartbeat_timer, &tv);
-	event_base_set(evloop, &p->p_heartbeat_timer);
+	json_object		*o;
+
+	o = json_object_new_object();
+	json_object_object_add(o, "pid", json_object_new_int(p->p_pid));
+	json_object_object_add(o, "instance", json_object_new_int(p->p_instance));
+	json_object_object_add(o, "state", json_object_new_string(process_state(p)));
+	if (p->p_status != NULL)
+		json_object_object_add(o, "status_text",
+				json_object_new_string(p->p_status));
+	if (p->p_watchdog != 0)
+		json_object_object_add(o, "watchdog",
+				json_object_new_int(time(NULL) - p->p_watchdog));
+	return o;
 }
 
 /*
- * log errors from spawn_child.
+ * send notification about a changed readiness state or status text.
  */
 static void
-spawn_child_log(struct child_config *cc, const char *func, int fd) {
-	char				buf[1024];
-	int					r;
+send_process_notification(const struct process *p)
+{
+	json_object		*obj;
 
-	/* getpwnam and getgrnam may leave errno at 0 on errors. */
-	if (errno != 0) {
-		r = snprintf(buf, sizeof(buf), "spawn failed for \"%s\": %s: %s\n",
-				cc->cc_name, func, strerror(errno));
-	} else {
-		r = snprintf(buf, sizeof(buf), "spawn failed for \"%s\": %s failed\n",
-				cc->cc_name, func);
-	}
-	if (r < 0)
-		exit(EXIT_FAILURE);
-	if (r > (int) sizeof(buf))
-		r = sizeof(buf);
-	write(fd, buf, r);
+	obj = process_to_json(p);
+	json_object_object_add(obj, "name",
+			json_object_new_string(p->p_child_config->cc_name));
+	send_notification(SUBS_PROCESS, json_object_to_json_string(obj));
+	json_object_put(obj);
 }
 
 /*
- * set uid/gid if needed.
+ * apply a notification sent by pid. Children of an instance send as
+ * themselves, they are found by the session of the instance.
  */
 static void
-spawn_child_setids(struct child_config *cc, int pfd)
+notify_message(pid_t pid, char *buf)
 {
-	struct passwd		*pw;
-	struct group		*gr;
+	struct process		*p;
+	struct notify_msg	nm;
+	pid_t			sid;
+	int			changed = 0,
+				was;
+
+	if ((p = process_find_by_pid(pid)) == NULL
+			&& (sid = getsid(pid)) > 0)
+		p = process_find_by_pid(sid);
+	if (p == NULL || p->p_child_config == NULL)
+		return;
 
-	if (cc->cc_username != NULL) {
-		if ((pw = getpwnam(cc->cc_username)) == NULL) {
-			spawn_child_log(cc, "getpwnam", pfd);
-			exit(EXIT_FAILURE);
-		}
-		cc->cc_uid = pw->pw_uid;
+	notify_parse(buf, &nm);
+	was = process_ready(p);
+	if (nm.nm_ready == 1 && (!p->p_ready || p->p_reloading)) {
+		p->p_ready = 1;
+		p->p_reloading = 0;
+		changed = 1;
+	} else if (nm.nm_reloading == 1 && !p->p_reloading) {
+		p->p_reloading = 1;
+		changed = 1;
 	}
-
-	if (cc->cc_groupname != NULL) {
-		if ((gr = getgrnam(cc->cc_groupname)) == NULL) {
-			spawn_child_log(cc, "getgrnam", pfd);
-			exit(EXIT_FAILURE);
-		}
-		 cc->cc_gid = gr->gr_gid;
+	if (nm.nm_watchdog == 1)
+		p->p_watchdog = time(NULL);
+	if (nm.nm_status != NULL && (p->p_status == NULL
+			|| strcmp(p->p_status, nm.nm_status))) {
+		free(p->p_status);
+		p->p_status = xstrdup(nm.nm_status);
+		changed = 1;
 	}
+	if (was != process_ready(p))
+		slog("[notify] %s pid: %d instance: %d %s\n",
+				p->p_child_config->cc_name, p->p_pid,
+				p->p_instance, process_state(p));
+	if (changed)
+		send_process_notification(p);
+}
 
-	if (cc->cc_gid != -1) {
-		if (setgid(cc->cc_gid) != 0) {
-			spawn_child_log(cc, "setgid", pfd);
-			exit(EXIT_FAILURE);
-		}
+static void
+notify_cb(int fd, short what __attribute__((unused)),
+		void *unused __attribute__((unused)))
+{
+	char			buf[NOTIFY_MSG_MAX + 1];
+	pid_t			pid;
 
-		if (setegid(cc->cc_gid) != 0) {
-			spawn_child_log(cc, "setegid", pfd);
-			exit(EXIT_FAILURE);
-		}
+	while ((pid = notify_recv(fd, buf, sizeof(buf))) != -1) {
+		if (pid > 0)
+			notify_message(pid, buf);
 	}
+}
 
-	if (cc->cc_uid != -1) {
-		if (setuid(cc->cc_uid) != 0) {
-			spawn_child_log(cc, "setuid", pfd);
-			exit(EXIT_FAILURE);
-		}
-
-		if (seteuid(cc->cc_uid) != 0) {
-			spawn_child_log(cc, "seteuid", pfd);
-			exit(EXIT_FAILURE);
-		}
+/*
+ * open the notification socket, the abstract address "@DIR/NOTIFY_PATH" of
+ * the server directory, and pass it as NOTIFY_SOCKET to groups with
+ * readiness notification. Abstract addresses work for children with other
+ * ids, the sender is found by its credentials. After an upgrade the socket
+ * is already open.
+ */
+static void
+notify_start(void)
+{
+	char			cwd[PATH_MAX],
+				name[PATH_MAX + 32];
 
-		if (cc->cc_uid != 0) {
-			if (setuid(0) != -1) {
-				spawn_child_log(cc, "setuid", pfd);
-				exit(EXIT_FAILURE);
-			}
-		}
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+		return;
+	snprintf(name, sizeof(name), "@%s/%s", cwd, NOTIFY_PATH);
+	if (notify_fd == -1 && (notify_fd = notify_open(name)) == -1) {
+		slog("notify socket %s: %s. readiness notification is not "
+				"available.\n", name, strerror(errno));
+		return;
 	}
+	setcloseonexec(notify_fd);
+	child_config_notify_socket = xstrdup(name);
+	event_set(&notify_ev, notify_fd, EV_READ | EV_PERSIST, notify_cb, NULL);
+	event_add(&notify_ev, NULL);
+}
 
-	if (cc->cc_gid > 0) {
-		if (setgid(0) != -1) {
-			spawn_child_log(cc, "setgid", pfd);
-			exit(EXIT_FAILURE);
-		}
-	}
+/*
+ * run a command (heartbeat, fatal_cb) as it is: without changing ids,
+ * directory or stdio.
+ */
+static pid_t
+spawn_command(char **args)
+{
+	struct spawn_args	sa;
+
+	memset(&sa, '\0', sizeof(sa));
+	sa.sa_argv = args;
+	sa.sa_name = args[0];
+	sa.sa_uid = -1;
+	sa.sa_gid = -1;
+	sa.sa_errfd = -1;
+	sa.sa_flags = SPAWN_F_EXEC;
+	if (spawn_method == SPAWN_HELPER && spawn_helper_fd() != -1)
+		return helper_spawn(&sa, NULL, -1, 0, args[0]) ? 0 : -1;
+	return spawn_process(spawn_method, &sa);
 }
 
 /*
- * Inplace substring replace. Only handling the cases where strlen(b) <=
- * strlen(a) - which is fine for the purpose this is used for: replacing
- * the instance number in log files.
+ * run fatal callback command for a group.
  */
 static void
-replace_str(char *in, const char *a, const char *b)
+run_fatal_cb(struct child_config *cc)
 {
-	char		*in_ptr;
-	size_t		a_len,
-			b_len,
-			in_len;
+	char	*args[3];
 
-	if ((in_ptr = strstr(in, a)) == NULL)
+	if (cc->cc_fatal_cb == NULL)
 		return;
 
-	a_len = strlen(a);
-	b_len = strlen(b);
-	if (b_len > a_len)
-		return;
-	in_len = strlen(in_ptr);
-	memcpy(in_ptr, b, b_len);
-	memmove(in_ptr + b_len, in_ptr + a_len, in_len - a_len + 1);
+	slog("running fatal_cb \"%s\" for %s ...\n", cc->cc_fatal_cb, cc->cc_name);
+	args[0] = cc->cc_fatal_cb;
+	args[1] = cc->cc_name;
+	args[2] = NULL;
+	if (spawn_command(args) == -1)
+		slog("fork failed when running fatal_cb for %s\n", cc->cc_name);
 }
 
 /*
- * setup child process. we are already forked here.
+ * start heartbeat timer for process.
  */
 static void
-spawn_child(struct child_config *cc, int instance, int pfd)
+schedule_heartbeat(struct process *p)
 {
-	int		stdout_fd = 0,
-			stderr_fd = 0;
-	char		instance_str[5];
-
-	snprintf(instance_str, sizeof(instance_str), "%d", instance);
-	spawn_child_setids(cc, pfd);
+	struct timeval	tv = {HEARTBEAT_SEC, 0};
+	evtimer_set(&p->p_heartbeat_timer, heartbeat_cb, p);
+	evtimer_add(&p->p_heartbeat_timer, &tv);
+	event_base_set(evloop, &p->p_heartbeat_timer);
+}
 
-	if (cc->cc_dir != NULL) {
-		if (chdir(cc->cc_dir) == -1) {
-			spawn_child_log(cc, "chdir", pfd);
-			exit(EXIT_FAILURE);
+/*
+ * cache looked up user and group ids in the group. If a lookup fails and
+ * there are no ids from an earlier lookup, the error is kept and passed on to
+ * the child which reports it and exits (like it did when the lookup was done
+ * after forking). If there are ids from an earlier lookup, they are used
+ * until a lookup succeeds again.
+ */
+static void
+cred_set(struct child_config *cc, int uid, int gid, const char *errfunc,
+		int err)
+{
+	if (errfunc != NULL) {
+		if (cc->cc_cred_time != 0 && cc->cc_cred_errfunc == NULL) {
+			slog("[cred] %s: %s failed, keeping uid %d gid %d\n",
+					cc->cc_name, errfunc, cc->cc_cred_uid,
+					cc->cc_cred_gid);
+		} else {
+			cc->cc_cred_errfunc = errfunc;
+			cc->cc_cred_errno = err;
 		}
+		cc->cc_cred_time = time(NULL);
+		return;
 	}
-	close(0);
-	close(1);
-	close(2);
 
-	if (cc->cc_stdout != NULL) {
-		replace_str(cc->cc_stdout, "%(NUM)", instance_str);
-		if ((stdout_fd = open(cc->cc_stdout, _LO_C, _LO_O)) == -1)
-			spawn_child_log(cc, "open (stdout)", pfd);
-		dup2(stdout_fd, STDOUT_FILENO);
-		close(stdout_fd);
-	}
+	cc->cc_cred_time = time(NULL);
 
-	if (cc->cc_stderr != NULL) {
-		replace_str(cc->cc_stderr, "%(NUM)", instance_str);
-		if ((stderr_fd = open(cc->cc_stderr, _LO_C, _LO_O)) == -1)
-			spawn_child_log(cc, "open (stderr)", pfd);
-		dup2(stderr_fd, STDERR_FILENO);
-		close(stderr_fd);
-	}
+	if (uid != cc->cc_cred_uid || gid != cc->cc_cred_gid)
+		slog("[cred] %s: uid %d gid %d\n", cc->cc_name, uid, gid);
+	cc->cc_cred_uid = uid;
+	cc->cc_cred_gid = gid;
+	cc->cc_cred_errfunc = NULL;
+	cc->cc_cred_errno = 0;
+}
 
-	setsid();
-	execv(cc->cc_command[0], cc->cc_command);
-	spawn_child_log(cc, "execv", pfd);
-	exit(EXIT_FAILURE);
+static struct cred_lookup *
+cred_lookup_find(const struct child_config *cc)
+{
+	struct cred_lookup	*cl;
+
+	LIST_FOREACH (cl, &cred_lookups, cl_ent) {
+		if (cl->cl_child_config == cc)
+			return cl;
+	}
+	return NULL;
 }
 
 /*
- * start process.
+ * Return 1 if a group has no ids yet and waits for a lookup. Its processes
+ * are queued again when the lookup is done.
  */
 static int
-spawn(struct child_config *cc, int instance)
+cred_waiting(const struct child_config *cc)
+{
+	return (cc->cc_cred_time == 0 || cc->cc_cred_errfunc != NULL)
+		&& cred_lookup_find(cc) != NULL;
+}
+
+/*
+ * group is deleted: drop the result of its lookup.
+ */
+static void
+cred_forget(const struct child_config *cc)
 {
-	pid_t		pid;
-	int		pp[2];
+	struct cred_lookup	*cl;
 
-	struct process	*p;
+	if ((cl = cred_lookup_find(cc)) != NULL)
+		cl->cl_child_config = NULL;
+}
 
-	if (socketpair(AF_UNIX, SOCK_STREAM, 0, pp) == -1)
-		return 0;
+static void cred_resolve(struct child_config *);
 
-	if ((pid = fork()) == -1) {
-		return 0;
-	}
+/*
+ * a lookup is done: set the ids of its group and start the processes that
+ * waited for them.
+ */
+static void
+cred_done(struct cred_lookup *cl, struct cred_rep *rep)
+{
+	struct child_config	*cc = cl->cl_child_config;
+	int			waiting,
+				stale = cl->cl_stale;
+
+	if (rep->cr_errfunc < 0 || rep->cr_errfunc > CRED_F_FORK) {
+		rep->cr_errfunc = CRED_F_LOOKUP;
+		rep->cr_errno = EINVAL;
+	}
+
+	waiting = cc != NULL && cred_waiting(cc);
+	LIST_REMOVE(cl, cl_ent);
+	event_del(&cl->cl_ev);
+	if (cl->cl_fd != -1)
+		close(cl->cl_fd);
+	free(cl);
+	if (cc == NULL)
+		return;
 
-	if (pid == 0) {
-		close(pp[0]);
-		setcloseonexec(pp[1]);
-		spawn_child(cc, instance, pp[1]);
-		/* not reached */
+	if (stale) {
+		cred_resolve(cc);
+		return;
+	}
+	cred_set(cc, rep->cr_uid, rep->cr_gid, cred_funcs[rep->cr_errfunc],
+			rep->cr_errno);
+	if (waiting) {
+		group_queue_missing(cc);
+		spawn_queue_run();
 	}
+}
 
-	close(pp[1]);
-	setcloseonexec(pp[0]);
-	p = xmalloc(sizeof(struct process));
-	p->p_pid = pid;
-	p->p_child_config = cc;
-	p->p_instance = instance;
-	p->p_start = time(NULL);
-	p->p_terminated = 0;
-	p->p_age = cc->cc_age;
-	p->p_child_sock = pp[0];
+/*
+ * lookup child replied, exited without reply or timed out.
+ */
+static void
+cred_lookup_cb(int fd, short what, void *vcl)
+{
+	struct cred_lookup	*cl = vcl;
+	struct cred_rep		rep;
+
+	if (what & EV_TIMEOUT) {
+		kill(cl->cl_pid, SIGKILL);
+		rep.cr_errfunc = CRED_F_LOOKUP;
+		rep.cr_errno = ETIMEDOUT;
+	} else if (read(fd, &rep, sizeof(rep)) != sizeof(rep)) {
+		rep.cr_errfunc = CRED_F_LOOKUP;
+		rep.cr_errno = EIO;
+	}
+	cred_done(cl, &rep);
+}
+
+/*
+ * watch the request socket of the resolver, after it was (re)started or
+ * dropped.
+ */
+static void
+resolver_watch(void)
+{
+	if (resolver_watched)
+		event_del(&resolver_ev);
+	resolver_watched = 0;
+	if (cred_resolver_fd() == -1)
+		return;
+	event_set(&resolver_ev, cred_resolver_fd(), EV_READ | EV_PERSIST,
+			resolver_cb, NULL);
+	event_add(&resolver_ev, NULL);
+	resolver_watched = 1;
+}
 
-	setnonblock(pp[0]);
+/*
+ * read the replies of the resolver. Returns -1 if it is gone.
+ */
+static int
+resolver_read(void)
+{
+	struct cred_lookup	*cl;
+	struct cred_rep		rep;
+	int			r;
 
-	if ((p->p_child_sockbuf = bufferevent_new(pp[0], child_read_cb, NULL, child_error_cb, p)) != NULL) {
-		if (bufferevent_enable(p->p_child_sockbuf, EV_READ) == -1) {
-			bufferevent_free(p->p_child_sockbuf);
-			p->p_child_sockbuf = NULL;
-			close(pp[0]);
+	while ((r = cred_resolver_recv(&rep)) == 1) {
+		LIST_FOREACH (cl, &cred_lookups, cl_ent) {
+			if (cl->cl_seq != 0 && cl->cl_seq == rep.cr_seq)
+				break;
 		}
+		/* timed out */
+		if (cl != NULL)
+			cred_done(cl, &rep);
 	}
-
-	schedule_heartbeat(p);
-	process_insert(p);
-	cc->cc_childs[instance] = p;
-	slog("[process_start] %s pid: %d\n", cc->cc_name, pid);
-	return 1;
+	return r;
 }
 
 /*
- * heartbeat timer callback.
+ * the resolver closed its socket: kill it. It is started again when it is
+ * reaped.
  */
 static void
-heartbeat_cb(int unused0 __attribute__((unused)),
+resolver_cb(int fd __attribute__((unused)), short what __attribute__((unused)),
+		void *unused __attribute__((unused)))
+{
+	if (resolver_read() == -1) {
+		slog("name resolver is gone.\n");
+		cred_resolver_stop();
+		resolver_watch();
+	}
+}
+
+/*
+ * the resolver did not reply in time: kill it and fail the lookup. The
+ * other lookups are sent again when it is restarted.
+ */
+static void
+resolver_timer_cb(int fd __attribute__((unused)),
+		short what __attribute__((unused)), void *vcl)
+{
+	struct cred_rep		rep;
+
+	slog("name resolver did not reply in %d s.\n", CRED_LOOKUP_SEC);
+	cred_resolver_stop();
+	resolver_watch();
+	rep.cr_errfunc = CRED_F_LOOKUP;
+	rep.cr_errno = ETIMEDOUT;
+	cred_done(vcl, &rep);
+}
+
+/*
+ * restart the resolver after it exited and look up the names of the
+ * requests it did not reply to again. If it exits again right away, give up
+ * and fork for lookups.
+ */
+static void
+restart_cred_resolver(void)
+{
+	static time_t		last = 0;
+	struct cred_lookup	*cl,
+				*tmp;
+	struct child_config	*cc;
+	LIST_HEAD(, cred_lookup) retry;
+	time_t			t;
+
+	/* replies sent before it exited */
+	resolver_read();
+	cred_resolver_reaped();
+
+	t = time(NULL);
+	if (last + CRED_RESTART_PERIOD > t) {
+		slog("name resolver keeps exiting. forking for lookups.\n");
+	} else {
+		slog("name resolver exited. restarting.\n");
+		if (cred_resolver_start() == -1)
+			slog("failed to start name resolver. forking for lookups.\n");
+	}
+	last = t;
+	resolver_watch();
+
+	LIST_INIT(&retry);
+	LIST_FOREACH_SAFE (cl, &cred_lookups, cl_ent, tmp) {
+		if (cl->cl_seq == 0)
+			continue;
+		LIST_REMOVE(cl, cl_ent);
+		LIST_INSERT_HEAD(&retry, cl, cl_ent);
+	}
+	while ((cl = LIST_FIRST(&retry)) != NULL) {
+		cc = cl->cl_child_config;
+		LIST_REMOVE(cl, cl_ent);
+		event_del(&cl->cl_ev);
+		free(cl);
+		if (cc != NULL)
+			cred_resolve(cc);
+	}
+}
+
+/*
+ * lookup user and group ids for a group. Names are looked up by the
+ * resolver, the ids are set when it replies. Without a resolver (or if its
+ * socket is full) a child of the server looks them up.
+ */
+static void
+cred_resolve(struct child_config *cc)
+{
+	struct cred_lookup	*cl;
+	struct cred_rep		rep;
+	struct timeval		tv;
+	int			fds[2];
+	uint32_t		seq;
+	pid_t			pid;
+
+	if (cc->cc_username == NULL && cc->cc_groupname == NULL) {
+		cred_set(cc, cc->cc_uid, cc->cc_gid, NULL, 0);
+		return;
+	}
+
+	if ((cl = cred_lookup_find(cc)) != NULL) {
+		cl->cl_stale = 1;
+		return;
+	}
+
+	tv.tv_sec = CRED_LOOKUP_SEC;
+	tv.tv_usec = 0;
+
+	if ((seq = cred_resolver_send(cc->cc_username, cc->cc_groupname,
+			cc->cc_uid, cc->cc_gid)) != 0) {
+		cl = xmalloc(sizeof(struct cred_lookup));
+		memset(cl, '\0', sizeof(struct cred_lookup));
+		cl->cl_child_config = cc;
+		cl->cl_seq = seq;
+		cl->cl_fd = -1;
+		evtimer_set(&cl->cl_ev, resolver_timer_cb, cl);
+		evtimer_add(&cl->cl_ev, &tv);
+		LIST_INSERT_HEAD(&cred_lookups, cl, cl_ent);
+		return;
+	}
+
+	if (pipe(fds) == -1) {
+		cred_set(cc, -1, -1, cred_funcs[CRED_F_FORK], errno);
+		return;
+	}
+	setcloseonexec(fds[0]);
+	setcloseonexec(fds[1]);
+
+	if ((pid = fork()) == -1) {
+		close(fds[0]);
+		close(fds[1]);
+		cred_set(cc, -1, -1, cred_funcs[CRED_F_FORK], errno);
+		return;
+	}
+
+	if (pid == 0) {
+		close(fds[0]);
+		cred_lookup(cc->cc_username, cc->cc_groupname, cc->cc_uid,
+				cc->cc_gid, &rep);
+		if (write(fds[1], &rep, sizeof(rep)) != sizeof(rep))
+			_exit(EXIT_FAILURE);
+		_exit(EXIT_SUCCESS);
+	}
+
+	close(fds[1]);
+	cl = xmalloc(sizeof(struct cred_lookup));
+	memset(cl, '\0', sizeof(struct cred_lookup));
+	cl->cl_child_config = cc;
+	cl->cl_pid = pid;
+	cl->cl_fd = fds[0];
+	event_set(&cl->cl_ev, cl->cl_fd, EV_READ, cred_lookup_cb, cl);
+	event_add(&cl->cl_ev, &tv);
+	LIST_INSERT_HEAD(&cred_lookups, cl, cl_ent);
+}
+
+/*
+ * timer callback. refresh cached ids of groups that use a user or group
+ * name and were looked up more then CRED_TTL seconds ago.
+ */
+static void
+cred_timer_cb(int unused0 __attribute__((unused)),
 		short unused1 __attribute__((unused)),
-		void *vp)
+		void *unused2 __attribute__((unused)))
+{
+	struct child_config	*cc;
+	struct timeval		tv;
+	time_t			t;
+
+	t = time(NULL);
+	LIST_FOREACH (cc, &child_config_list_head, cc_ent) {
+		if (cc->cc_username == NULL && cc->cc_groupname == NULL)
+			continue;
+		if (cc->cc_cred_time + CRED_TTL <= t
+				&& cred_lookup_find(cc) == NULL)
+			cred_resolve(cc);
+	}
+
+	tv.tv_sec = CRED_CHECK_SEC;
+	tv.tv_usec = 0;
+	evtimer_add(&cred_timer, &tv);
+}
+
+/*
+ * bind and listen on one listen spec of a group:
+ *   tcp:PORT		127.0.0.1:PORT
+ *   tcp:ADDR:PORT	IPv4 address ADDR
+ *   unix:PATH		unix socket, a stale socket file is removed
+ * Returns fd or -1 and sets errno.
+ */
+static int
+listen_bind(const char *spec)
+{
+	struct sockaddr_un	sun;
+	struct sockaddr_in	sin;
+	struct sockaddr		*sa;
+	socklen_t		sa_len;
+	struct stat		st;
+	const char		*p,
+				*c;
+	char			addr[INET_ADDRSTRLEN],
+				*end;
+	long			port;
+	int			fd,
+				err,
+				one = 1;
+
+	if (strncmp(spec, "unix:", 5) == 0) {
+		p = spec + 5;
+		if (*p == '\0' || strlen(p) >= sizeof(sun.sun_path)) {
+			errno = EINVAL;
+			return -1;
+		}
+		memset(&sun, '\0', sizeof(sun));
+		sun.sun_family = AF_UNIX;
+		strcpy(sun.sun_path, p);
+		if (stat(p, &st) == 0 && S_ISSOCK(st.st_mode))
+			unlink(p);
+		sa = (struct sockaddr *) &sun;
+		sa_len = sizeof(sun);
+	} else if (strncmp(spec, "tcp:", 4) == 0) {
+		p = spec + 4;
+		memset(&sin, '\0', sizeof(sin));
+		sin.sin_family = AF_INET;
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if ((c = strrchr(p, ':')) != NULL) {
+			if (c - p >= (int) sizeof(addr)) {
+				errno = EINVAL;
+				return -1;
+			}
+			memcpy(addr, p, c - p);
+			addr[c - p] = '\0';
+			if (inet_pton(AF_INET, addr, &sin.sin_addr) != 1) {
+				errno = EINVAL;
+				return -1;
+			}
+			p = c + 1;
+		}
+		port = strtol(p, &end, 10);
+		if (*p == '\0' || *end != '\0' || port < 1 || port > 65535) {
+			errno = EINVAL;
+			return -1;
+		}
+		sin.sin_port = htons(port);
+		sa = (struct sockaddr *) &sin;
+		sa_len = sizeof(sin);
+	} else {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((fd = socket(sa->sa_family, SOCK_STREAM, 0)) == -1)
+		return -1;
+	if (sa->sa_family == AF_INET)
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(fd, sa, sa_len) == -1 || listen(fd, SOMAXCONN) == -1) {
+		err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	setcloseonexec(fd);
+	return fd;
+}
+
+/*
+ * bind all listen sockets of a new group. The sockets stay open for the
+ * lifetime of the group, so restarts never close the accept queue. Returns
+ * NULL or an error message.
+ */
+static const char *
+listen_open(struct child_config *cc)
+{
+	static char	msg[256];
+	int		n,
+			i;
+
+	if (cc->cc_listen == NULL)
+		return NULL;
+
+	for (n = 0; cc->cc_listen[n] != NULL; n++)
+		;
+	if (n > SPAWN_MAX_LISTEN)
+		return "too many listen sockets.";
+
+	cc->cc_listen_fds = xmalloc(sizeof(int) * (n > 0 ? n : 1));
+	for (i = 0; i < n; i++) {
+		if ((cc->cc_listen_fds[i] = listen_bind(cc->cc_listen[i])) == -1) {
+			snprintf(msg, sizeof(msg), "listen %s: %s", cc->cc_listen[i],
+					strerror(errno));
+			while (--i >= 0)
+				close(cc->cc_listen_fds[i]);
+			free(cc->cc_listen_fds);
+			cc->cc_listen_fds = NULL;
+			return msg;
+		}
+	}
+	cc->cc_nlisten = n;
+	return NULL;
+}
+
+/*
+ * compile the resource controls of a group into cc_res. Returns an error
+ * message or NULL.
+ */
+static const char *
+resources_set(struct child_config *cc)
+{
+	struct resources	rs;
+	const char		*err;
+
+	if ((err = resources_compile(&rs, cc->cc_nice, cc->cc_oom_score_adj,
+			cc->cc_ioprio, cc->cc_sched, cc->cc_rlimits)) != NULL)
+		return err;
+	free(cc->cc_res);
+	cc->cc_res = NULL;
+	if (rs.rs_flags != 0) {
+		cc->cc_res = xmalloc(sizeof(struct resources));
+		*cc->cc_res = rs;
+	}
+	return NULL;
+}
+
+/*
+ * check the environment of a group: KEY=VALUE with a non empty KEY.
+ */
+static const char *
+env_check(char **env)
+{
+	int			i;
+
+	for (i = 0; env[i] != NULL; i++) {
+		if (env[i][0] == '=' || strchr(env[i], '=') == NULL)
+			return "illegal env, KEY=VALUE required.";
+	}
+	return NULL;
+}
+
+/*
+ * create the cgroup of a group below the cgroup root, if the server has
+ * one. Returns an error message or NULL.
+ */
+static const char *
+cgroup_set(struct child_config *cc)
+{
+	const char		*err;
+
+	if (!cgroup_enabled())
+		return cc->cc_cgroup != NULL ? "cgroup requires a cgroup root." : NULL;
+	if ((cc->cc_cgroup_fd = cgroup_group_create(cc->cc_name, cc->cc_cgroup, &err)) == -1)
+		return err;
+	return NULL;
+}
+
+/*
+ * strings expanded and placement computed for one instance, see
+ * spawn_prepare().
+ */
+struct spawn_strings {
+	char			*ss_out,
+				*ss_err,
+				*ss_dir,
+				**ss_argv;
+	struct cpu_place	ss_place;
+};
+
+/*
+ * fill spawn args for an instance of a group. The expanded strings must be
+ * freed with spawn_strings_free().
+ */
+static void
+spawn_prepare(struct child_config *cc, int instance, struct spawn_args *sa,
+		struct spawn_strings *ss)
+{
+	struct template_vars	tv;
+
+	memset(sa, '\0', sizeof(struct spawn_args));
+	memset(ss, '\0', sizeof(struct spawn_strings));
+
+	template_vars_init(&tv, cc->cc_name, instance, cc->cc_port);
+	if (cc->cc_tpl_stdout != NULL)
+		ss->ss_out = template_expand_dup(cc->cc_tpl_stdout, &tv);
+	if (cc->cc_tpl_stderr != NULL)
+		ss->ss_err = template_expand_dup(cc->cc_tpl_stderr, &tv);
+	if (cc->cc_tpl_dir != NULL)
+		ss->ss_dir = template_expand_dup(cc->cc_tpl_dir, &tv);
+	if (cc->cc_tpl_args != NULL)
+		ss->ss_argv = template_expand_argv(cc->cc_tpl_args, &tv);
+
+	sa->sa_argv = ss->ss_argv != NULL ? ss->ss_argv : cc->cc_command;
+	sa->sa_name = cc->cc_name;
+	sa->sa_dir = ss->ss_dir;
+	sa->sa_stdout = ss->ss_out;
+	sa->sa_stderr = ss->ss_err;
+	sa->sa_errfd = -1;
+	sa->sa_uid = cc->cc_cred_uid;
+	sa->sa_gid = cc->cc_cred_gid;
+	sa->sa_errfunc = cc->cc_cred_errfunc;
+	sa->sa_errno = cc->cc_cred_errno;
+	sa->sa_listen_fds = cc->cc_listen_fds;
+	sa->sa_nlisten = cc->cc_nlisten;
+	if (cc->cc_cpu_policy != NULL) {
+		cpu_policy_place(cc->cc_cpu_policy, instance, cc->cc_instances,
+				&ss->ss_place);
+		sa->sa_place = &ss->ss_place;
+	}
+	sa->sa_res = cc->cc_res;
+	sa->sa_env = child_config_envp(cc, instance);
+	if (cc->cc_cgroup_fd != -1 && cgroup_native()) {
+		sa->sa_flags |= SPAWN_F_CGROUP;
+		sa->sa_cgroup_fd = cc->cc_cgroup_fd;
+	}
+}
+
+static void
+spawn_strings_free(struct spawn_strings *ss)
+{
+	free(ss->ss_out);
+	free(ss->ss_err);
+	free(ss->ss_dir);
+	free(ss->ss_argv);
+}
+
+/*
+ * create process struct for a process with pidfd (may be -1) and register
+ * it.
+ */
+static struct process *
+process_new_fd(struct child_config *cc, int instance, int standby, pid_t pid,
+		int pidfd)
+{
+	struct process		*p;
+
+	p = xmalloc(sizeof(struct process));
+	memset(p, '\0', sizeof(struct process));
+	p->p_pid = pid;
+	p->p_child_config = cc;
+	p->p_instance = instance;
+	p->p_start = time(NULL);
+	p->p_terminated = 0;
+	p->p_age = cc->cc_age;
+	p->p_state_slot = state_add(cc->cc_name, instance, standby, pid,
+			p->p_start);
+
+	if ((p->p_pidfd = pidfd) != -1) {
+		event_set(&p->p_pidfd_ev, p->p_pidfd, EV_READ, pidfd_cb, p);
+		event_add(&p->p_pidfd_ev, NULL);
+	}
+
+	schedule_heartbeat(p);
+	process_insert(p);
+	if (standby) {
+		p->p_standby = 1;
+		cc->cc_standbys[instance] = p;
+		slog("[standby_start] %s pid: %d\n", cc->cc_name, pid);
+	} else {
+		cc->cc_childs[instance] = p;
+		slog("[process_start] %s pid: %d\n", cc->cc_name, pid);
+	}
+	return p;
+}
+
+/*
+ * create process struct for a started instance and register it. If the
+ * pid is already gone, its exit (with unknown status) is handled from the
+ * event loop.
+ */
+static struct process *
+process_new(struct child_config *cc, int instance, int standby, pid_t pid)
+{
+	struct process		*p;
+	struct timeval		tv = {0, 0};
+	int			fd,
+				gone;
+
+	/* safe: the pid can't be reused before we reaped it */
+	fd = process_pidfd_open(pid);
+	gone = fd == -1 && errno == ESRCH;
+	p = process_new_fd(cc, instance, standby, pid, fd);
+	if (gone) {
+		slog("pid %d of %s is gone\n", pid, cc->cc_name);
+		p->p_gone = 1;
+		evtimer_set(&p->p_pidfd_ev, pidfd_gone_cb, p);
+		evtimer_add(&p->p_pidfd_ev, &tv);
+	}
+	return p;
+}
+
+/*
+ * set the start time of a process taken over from a previous server.
+ */
+static void
+process_set_start(struct process *p, time_t start)
+{
+	p->p_start = start;
+	state_del(p->p_state_slot);
+	p->p_state_slot = state_add(p->p_child_config->cc_name, p->p_instance,
+			p->p_standby, p->p_pid, p->p_start);
+}
+
+/*
+ * take over the instances of a group the previous server left running,
+ * instead of starting them again. A process is only taken if its pid still
+ * has the start time in the state file. They are not our children, the pid
+ * is pinned by a pidfd before the start time is compared.
+ */
+static void
+instances_adopt(struct child_config *cc)
+{
+	struct state_rec	*r;
+	struct process		*p;
+	unsigned long long	ticks;
+	int			i,
+				n,
+				fd;
+
+	r = state_old(&n);
+	for (i = 0; i < n; i++) {
+		if (r[i].sr_pid <= 0 || r[i].sr_standby
+				|| strcmp(r[i].sr_name, cc->cc_name)
+				|| r[i].sr_instance < 0
+				|| r[i].sr_instance >= cc->cc_instances
+				|| cc->cc_childs[r[i].sr_instance] != NULL)
+			continue;
+		if ((fd = process_pidfd_open(r[i].sr_pid)) == -1 && errno == ESRCH)
+			continue;
+		ticks = state_pid_ticks(r[i].sr_pid);
+		if (ticks == 0 || ticks != r[i].sr_ticks) {
+			if (fd != -1)
+				close(fd);
+			continue;
+		}
+
+		p = process_new_fd(cc, r[i].sr_instance, 0, r[i].sr_pid, fd);
+		p->p_adopted = 1;
+		p->p_ticks = ticks;
+		/* readiness was reported to the previous server */
+		p->p_ready = 1;
+		process_set_start(p, r[i].sr_start);
+		slog("[adopt] %s pid: %d instance: %d\n", cc->cc_name, p->p_pid,
+				p->p_instance);
+		r[i].sr_pid = 0;
+	}
+}
+
+/*
+ * after the dump was loaded: kill standbys of the previous server, they are
+ * stopped and of no use, and log processes that were not taken over.
+ */
+static void
+state_forget(void)
+{
+	struct state_rec	*r;
+	int			i,
+				n;
+
+	r = state_old(&n);
+	for (i = 0; i < n; i++) {
+		if (r[i].sr_pid == 0 || r[i].sr_ticks == 0
+				|| state_pid_ticks(r[i].sr_pid) != r[i].sr_ticks)
+			continue;
+		if (r[i].sr_standby) {
+			kill(r[i].sr_pid, SIGKILL);
+			continue;
+		}
+		slog("%s instance %d pid %d left running, group or instance is gone.\n",
+				r[i].sr_name, r[i].sr_instance, r[i].sr_pid);
+	}
+	state_old_free();
+}
+
+/*
+ * start process. A standby is started for slot instance of cc_standbys if
+ * standby is set.
+ */
+static int
+spawn(struct child_config *cc, int instance, int standby)
+{
+	pid_t			pid;
+	long long		t;
+	struct spawn_args	sa;
+	struct spawn_strings	ss;
+	struct process		*p;
+
+	if (cc->cc_zygote == 1)
+		return zygote_spawn(cc, instance);
+
+	/* standbys are only allowed for groups without per instance tokens */
+	spawn_prepare(cc, standby ? 0 : instance, &sa, &ss);
+	if (standby)
+		sa.sa_env = child_config_envp(cc, -1);
+	sa.sa_errfd = spawn_chan[1];
+
+	/* empty the channel first. A vfork'ed child blocking on a full
+	 * channel would block the server, too. */
+	spawn_chan_read();
+
+	/* the process is added when the helper replies */
+	if (spawn_method == SPAWN_HELPER && spawn_helper_fd() != -1) {
+		if (!helper_spawn(&sa, cc, instance, standby, NULL)) {
+			slog("spawn helper request for %s failed: %s\n",
+					cc->cc_name, strerror(errno));
+			spawn_strings_free(&ss);
+			return 0;
+		}
+		spawn_strings_free(&ss);
+		return 1;
+	}
+
+	t = monotonic_usec();
+	pid = spawn_process(spawn_method, &sa);
+	spawn_strings_free(&ss);
+
+	if (pid == -1)
+		return 0;
+
+	p = process_new(cc, instance, standby, pid);
+	p->p_spawn_usec = t;
+	p->p_starting = 1;
+	spawn_inflight++;
+	return 1;
+}
+
+/*
+ * on demand groups: while inactive, the server watches the listen sockets
+ * and starts the instances on the first connection. After cc_ondemand
+ * seconds without cpu time used by the instances and without pending
+ * connections the instances are stopped again.
+ */
+struct ondemand {
+	struct event		*od_ev;		/* one per listen socket */
+	struct event		od_timer;
+	int			od_active;
+	long long		od_cpu;
+	time_t			od_last;
+};
+
+/*
+ * Return 1 if a group is on demand and currently has no processes.
+ */
+static int
+group_is_idle(const struct child_config *cc)
+{
+	return cc->cc_od != NULL && !cc->cc_od->od_active;
+}
+
+/*
+ * Return 1 if processes of a group should be running.
+ */
+static int
+group_wants_processes(const struct child_config *cc)
+{
+	return cc->cc_status == STATUS_RUNNING && !group_is_idle(cc);
+}
+
+/*
+ * Return 1 if an instance was set broken by the crash loop policy.
+ */
+static int
+instance_broken(const struct child_config *cc, int instance)
+{
+	return cc->cc_crash_rings != NULL
+		&& cc->cc_crash_rings[instance].cr_broken;
+}
+
+/*
+ * queue instance (or standby slot) of a group to be started by
+ * spawn_queue_run(). Entries are kept sorted by priority, FIFO within the
+ * same priority.
+ */
+static void
+spawn_queue_insert(struct child_config *cc, int instance, int standby)
+{
+	struct spawn_entry	*se,
+				*i;
+
+	se = xmalloc(sizeof(struct spawn_entry));
+	se->se_child_config = cc;
+	se->se_instance = instance;
+	se->se_standby = standby;
+	se->se_priority = cc->cc_priority;
+	se->se_queued = monotonic_msec();
+
+	TAILQ_FOREACH_REVERSE (i, &spawn_queue_head, spawn_queue, se_ent) {
+		if (i->se_priority >= se->se_priority)
+			break;
+	}
+	if (i == NULL)
+		TAILQ_INSERT_HEAD(&spawn_queue_head, se, se_ent);
+	else
+		TAILQ_INSERT_AFTER(&spawn_queue_head, i, se, se_ent);
+	spawn_queue_len++;
+}
+
+static void
+spawn_queue_add(struct child_config *cc, int instance)
+{
+	spawn_queue_insert(cc, instance, 0);
+}
+
+/*
+ * queue empty standby slots of a running group.
+ */
+static void
+standby_queue_missing(struct child_config *cc)
+{
+	int		i;
+
+	if (!group_wants_processes(cc))
+		return;
+	for (i = 0; i < cc->cc_standby; i++) {
+		if (cc->cc_standbys[i] == NULL)
+			spawn_queue_insert(cc, i, 1);
+	}
+}
+
+/*
+ * remove all queued entries of a group (before it is freed).
+ */
+static void
+spawn_queue_drop(struct child_config *cc)
+{
+	struct spawn_entry	*se,
+				*tmp;
+
+	TAILQ_FOREACH_SAFE (se, &spawn_queue_head, se_ent, tmp) {
+		if (se->se_child_config != cc)
+			continue;
+		TAILQ_REMOVE(&spawn_queue_head, se, se_ent);
+		spawn_queue_len--;
+		free(se);
+	}
+}
+
+/*
+ * start queued processes as far as the limits allow. Entries for groups that
+ * were stopped, shrunk, went idle or already have a process for the instance (or
+ * standby slot) are dropped.
+ */
+static void
+spawn_queue_run(void)
+{
+	struct spawn_entry	*se;
+	struct child_config	*cc;
+	struct timeval		tv;
+	long long		now,
+				wait;
+	int			want;
+
+	now = monotonic_msec();
+	while ((se = TAILQ_FIRST(&spawn_queue_head)) != NULL) {
+		if (spawn_tick_count >= spawn_rate)
+			break;
+		if (spawn_inflight >= spawn_max_inflight)
+			break;
+
+		TAILQ_REMOVE(&spawn_queue_head, se, se_ent);
+		spawn_queue_len--;
+		cc = se->se_child_config;
+		if (se->se_standby)
+			want = se->se_instance < cc->cc_standby
+				&& cc->cc_standbys[se->se_instance] == NULL;
+		else
+			want = se->se_instance < cc->cc_instances
+				&& cc->cc_childs[se->se_instance] == NULL
+				&& !instance_broken(cc, se->se_instance)
+				&& !backoff_pending(cc, se->se_instance);
+		if (helper_pending(cc, se->se_instance, se->se_standby)
+				|| cred_waiting(cc))
+			want = 0;
+		if (group_wants_processes(cc) && want) {
+			wait = now - se->se_queued;
+			spawn_total++;
+			spawn_wait_total += wait;
+			if (wait > spawn_wait_max)
+				spawn_wait_max = wait;
+			spawn_tick_count++;
+			spawn(cc, se->se_instance, se->se_standby);
+		}
+		free(se);
+	}
+
+	if (spawn_tick_count > 0 && !evtimer_pending(&spawn_timer, NULL)) {
+		tv.tv_sec = 0;
+		tv.tv_usec = SPAWN_TICK_MSEC * 1000;
+		evtimer_add(&spawn_timer, &tv);
+	}
+}
+
+/*
+ * spawn queue timer callback. Starts a new tick.
+ */
+static void
+spawn_timer_cb(int unused0 __attribute__((unused)),
+		short unused1 __attribute__((unused)),
+		void *unused2 __attribute__((unused)))
+{
+	spawn_tick_count = 0;
+	spawn_queue_run();
+}
+
+/*
+ * restart backoff, see backoff.c. Every instance slot of a group with a
+ * backoff policy has its own restart timer.
+ */
+struct backoff_slot {
+	struct child_config	*bs_child_config;
+	int			bs_instance;
+	long			bs_delay;	/* milliseconds, 0 after a stable run */
+	time_t			bs_until;	/* time of the pending restart or 0 */
+	struct event		bs_timer;
+};
+
+/*
+ * compile cc_backoff into cc_backoff_policy. Returns an error message or
+ * NULL.
+ */
+static const char *
+backoff_set(struct child_config *cc)
+{
+	struct backoff	bo;
+	const char	*err;
+
+	free(cc->cc_backoff_policy);
+	cc->cc_backoff_policy = NULL;
+	if (cc->cc_backoff != NULL && cc->cc_backoff[0] == '\0') {
+		free(cc->cc_backoff);
+		cc->cc_backoff = NULL;
+	}
+	if (cc->cc_backoff == NULL)
+		return NULL;
+	if ((err = backoff_compile(&bo, cc->cc_backoff)) != NULL)
+		return err;
+	cc->cc_backoff_policy = xmalloc(sizeof(struct backoff));
+	*cc->cc_backoff_policy = bo;
+	return NULL;
+}
+
+/*
+ * backoff timer callback. Queues the instance.
+ */
+static void
+backoff_cb(int unused0 __attribute__((unused)),
+		short unused1 __attribute__((unused)), void *bsx)
+{
+	struct backoff_slot	*bs = bsx;
+	struct child_config	*cc = bs->bs_child_config;
+
+	bs->bs_until = 0;
+	if (group_wants_processes(cc) && cc->cc_childs[bs->bs_instance] == NULL) {
+		spawn_queue_add(cc, bs->bs_instance);
+		spawn_queue_run();
+	}
+}
+
+/*
+ * restart state of an instance, created on first use.
+ */
+static struct backoff_slot *
+backoff_slot(struct child_config *cc, int instance)
+{
+	struct backoff_slot	*bs;
+
+	if (cc->cc_backoff_slots == NULL) {
+		cc->cc_backoff_slots = xmalloc(sizeof(struct backoff_slot *)
+				* cc->cc_instances);
+		memset(cc->cc_backoff_slots, '\0', sizeof(struct backoff_slot *)
+				* cc->cc_instances);
+	}
+	if ((bs = cc->cc_backoff_slots[instance]) == NULL) {
+		bs = xmalloc(sizeof(struct backoff_slot));
+		memset(bs, '\0', sizeof(struct backoff_slot));
+		bs->bs_child_config = cc;
+		bs->bs_instance = instance;
+		evtimer_set(&bs->bs_timer, backoff_cb, bs);
+		cc->cc_backoff_slots[instance] = bs;
+	}
+	return bs;
+}
+
+/*
+ * restart instance of bs in delay milliseconds.
+ */
+static void
+backoff_wait(struct backoff_slot *bs, long delay)
+{
+	struct timeval		tv;
+
+	tv.tv_sec = delay / 1000;
+	tv.tv_usec = (delay % 1000) * 1000;
+	bs->bs_until = time(NULL) + (delay + 999) / 1000;
+	evtimer_add(&bs->bs_timer, &tv);
+}
+
+/*
+ * Return 1 if the restart of an instance is delayed.
+ */
+static int
+backoff_pending(const struct child_config *cc, int instance)
+{
+	return cc->cc_backoff_slots != NULL
+		&& cc->cc_backoff_slots[instance] != NULL
+		&& cc->cc_backoff_slots[instance]->bs_until != 0;
+}
+
+/*
+ * drop the restart state of instances from and up. With requeue, delayed
+ * restarts are queued now.
+ */
+static void
+backoff_drop(struct child_config *cc, int from, int requeue)
+{
+	struct backoff_slot	*bs;
+	int			i;
+
+	if (cc->cc_backoff_slots == NULL)
+		return;
+	for (i = from; i < cc->cc_instances; i++) {
+		if ((bs = cc->cc_backoff_slots[i]) == NULL)
+			continue;
+		if (bs->bs_until != 0) {
+			evtimer_del(&bs->bs_timer);
+			if (requeue && group_wants_processes(cc)
+					&& cc->cc_childs[i] == NULL)
+				spawn_queue_add(cc, i);
+		}
+		free(bs);
+		cc->cc_backoff_slots[i] = NULL;
+	}
+	if (from == 0) {
+		free(cc->cc_backoff_slots);
+		cc->cc_backoff_slots = NULL;
+	}
+}
+
+/*
+ * resize restart state when the number of instances changes to n.
+ */
+static void
+backoff_resize(struct child_config *cc, int n)
+{
+	int		i;
+
+	if (cc->cc_backoff_slots == NULL)
+		return;
+	backoff_drop(cc, n, 0);
+	cc->cc_backoff_slots = xrealloc(cc->cc_backoff_slots,
+			sizeof(struct backoff_slot *) * n);
+	for (i = cc->cc_instances; i < n; i++)
+		cc->cc_backoff_slots[i] = NULL;
+}
+
+/*
+ * queue the restart of an exited instance. Error exits before the process
+ * ran for bo_stable seconds are delayed, an error exit after a stable run
+ * is restarted at once and resets the delay.
+ */
+static void
+backoff_restart(struct child_config *cc, int instance, int error,
+		time_t uptime)
+{
+	const struct backoff	*bo = cc->cc_backoff_policy;
+	struct backoff_slot	*bs;
+	long			delay;
+
+	if (bo == NULL || !error) {
+		spawn_queue_add(cc, instance);
+		return;
+	}
+
+	bs = backoff_slot(cc, instance);
+	if (uptime >= bo->bo_stable) {
+		bs->bs_delay = 0;
+		spawn_queue_add(cc, instance);
+		return;
+	}
+	bs->bs_delay = backoff_next(bo, bs->bs_delay);
+	delay = backoff_jitter(bo, bs->bs_delay);
+	slog("[backoff] %s instance %d restart in %ld ms\n", cc->cc_name,
+			instance, delay);
+	backoff_wait(bs, delay);
+}
+
+/*
+ * restart state as json array, one {"delay": .., "until": ..} object per
+ * instance.
+ */
+static json_object *
+backoff_to_json(const struct child_config *cc)
+{
+	json_object		*a,
+				*o;
+	struct backoff_slot	*bs;
+	int			i;
+
+	a = json_object_new_array();
+	for (i = 0; i < cc->cc_instances; i++) {
+		bs = cc->cc_backoff_slots[i];
+		o = json_object_new_object();
+		json_object_object_add(o, "delay",
+				json_object_new_int(bs ? bs->bs_delay : 0));
+		json_object_object_add(o, "until",
+				json_object_new_double(bs ? bs->bs_until : 0));
+		json_object_array_add(a, o);
+	}
+	return a;
+}
+
+/*
+ * restore restart state saved by backoff_to_json(). Restarts still pending
+ * are scheduled again.
+ */
+static void
+backoff_load(struct child_config *cc, json_object *obj)
+{
+	struct backoff_slot	*bs;
+	json_object		*e,
+				*v;
+	time_t			now,
+				until;
+	int			i,
+				len;
+
+	if (cc->cc_backoff_policy == NULL || obj == NULL
+			|| !json_object_is_type(obj, json_type_array))
+		return;
+	now = time(NULL);
+	len = json_object_array_length(obj);
+	for (i = 0; i < len && i < cc->cc_instances; i++) {
+		e = json_object_array_get_idx(obj, i);
+		if (e == NULL || !json_object_is_type(e, json_type_object))
+			continue;
+		bs = backoff_slot(cc, i);
+		if ((v = json_object_object_get(e, "delay")) != NULL)
+			bs->bs_delay = json_object_get_int(v);
+		if ((v = json_object_object_get(e, "until")) != NULL
+				&& (until = json_object_get_double(v)) > now)
+			backoff_wait(bs, (until - now) * 1000);
+	}
+}
+
+/*
+ * zygote groups: the server starts one template process per group which
+ * forks the instances on request. The instances are reparented to the
+ * server (child subreaper) and tracked like normal processes.
+ *
+ * Messages are JSON objects over a SOCK_SEQPACKET socket:
+ *   zygote -> server	{"ready": 1}
+ *   server -> zygote	{"instance": N, "dir": .., "stdout": .., "stderr": ..}
+ *   zygote -> server	{"instance": N, "pid": P} or {"instance": N, "error": ..}
+ */
+struct zygote_req {
+	LIST_ENTRY(zygote_req)	zr_ent;
+	int			zr_instance;
+};
+
+struct zygote {
+	pid_t			z_pid;
+	int			z_fd,
+				z_ready;
+	struct event		z_ev;
+	struct child_config	*z_child_config;
+	LIST_HEAD(, zygote_req)	z_reqs;
+};
+
+static struct {
+	pid_t			r_pid;
+	int			r_status;
+} reaped[REAPED_MAX];
+static int			reaped_next;
+
+/*
+ * session of an exited instance with descendants still running. Descendants
+ * are reparented to the server, it adds their resource usage to the instance
+ * when they exit.
+ */
+struct session {
+	LIST_ENTRY(session)	s_ent;
+	pid_t			s_sid;
+	struct child_config	*s_child_config;
+	int			s_instance;
+};
+
+static LIST_HEAD(, session)	sessions;
+
+/*
+ * make the server a child subreaper, so descendants of instances are
+ * reparented to it and zygotes can fork instances. Returns 0 if not
+ * supported.
+ */
+static int
+subreaper_set(void)
+{
+#if defined(HAVE_SYS_PRCTL_H) && defined(PR_SET_CHILD_SUBREAPER)
+	static int	done = 0;
+
+	if (done)
+		return 1;
+	if (prctl(PR_SET_CHILD_SUBREAPER, 1, 0, 0, 0) == -1) {
+		slog("prctl(PR_SET_CHILD_SUBREAPER): %s\n", strerror(errno));
+		return 0;
+	}
+	done = 1;
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * remember exit status of an unknown child.
+ */
+static void
+reaped_add(pid_t pid, int status)
+{
+	struct helper_exit	*he;
+
+	if (!LIST_EMPTY(&helper_reqs)) {
+		he = xmalloc(sizeof(struct helper_exit));
+		he->he_pid = pid;
+		he->he_status = status;
+		LIST_INSERT_HEAD(&helper_exits, he, he_ent);
+		return;
+	}
+	reaped[reaped_next].r_pid = pid;
+	reaped[reaped_next].r_status = status;
+	reaped_next = (reaped_next + 1) % REAPED_MAX;
+}
+
+/*
+ * find and forget exit status of an unknown child. Returns 0 if pid was
+ * not reaped.
+ */
+static int
+reaped_take(pid_t pid, int *status)
+{
+	struct helper_exit	*he;
+	int			i;
+
+	LIST_FOREACH (he, &helper_exits, he_ent) {
+		if (he->he_pid != pid)
+			continue;
+		*status = he->he_status;
+		LIST_REMOVE(he, he_ent);
+		free(he);
+		return 1;
+	}
+	for (i = 0; i < REAPED_MAX; i++) {
+		if (reaped[i].r_pid != pid)
+			continue;
+		reaped[i].r_pid = 0;
+		*status = reaped[i].r_status;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * remember session sid of an exited instance if processes are left in it.
+ */
+static void
+session_add(struct child_config *cc, int instance, pid_t sid)
+{
+	struct session		*s;
+
+	if (kill(-sid, 0) == -1)
+		return;
+	s = xmalloc(sizeof(struct session));
+	s->s_sid = sid;
+	s->s_child_config = cc;
+	s->s_instance = instance;
+	LIST_INSERT_HEAD(&sessions, s, s_ent);
+	slog("[session] %s instance: %d left processes in session %d\n",
+			cc->cc_name, instance, sid);
+}
+
+/*
+ * a descendant of an instance in session sid exited. Its usage is added to
+ * the instance (live or exited), sessions without processes are forgotten.
+ * Returns 0 if sid is not a session of an instance.
+ */
+static int
+session_reaped(pid_t pid, pid_t sid, const struct rusage *ru)
+{
+	struct child_config	*cc;
+	struct process		*p;
+	struct session		*s;
+	int			instance;
+
+	if ((p = process_find_by_pid(sid)) != NULL) {
+		if ((cc = p->p_child_config) == NULL || p->p_standby)
+			return 1;
+		instance = p->p_instance;
+		s = NULL;
+	} else {
+		LIST_FOREACH (s, &sessions, s_ent) {
+			if (s->s_sid == sid)
+				break;
+		}
+		if (s == NULL)
+			return 0;
+		cc = s->s_child_config;
+		instance = s->s_instance;
+	}
+
+	slog("[orphan_exit] %s pid: %d instance: %d\n", cc->cc_name, pid,
+			instance);
+	exit_stat_orphan(&cc->cc_exit_stat, ru);
+	if (instance < cc->cc_instances)
+		exit_stat_orphan(&cc->cc_inst_stat[instance], ru);
+	if (s != NULL && kill(-sid, 0) == -1) {
+		LIST_REMOVE(s, s_ent);
+		free(s);
+	}
+	return 1;
+}
+
+/*
+ * signal the sessions an instance left behind, instance -1 means all
+ * instances.
+ */
+static void
+session_kill(struct child_config *cc, int instance, int sig)
+{
+	struct session		*s;
+
+	LIST_FOREACH (s, &sessions, s_ent) {
+		if (s->s_child_config == cc
+				&& (instance == -1 || instance == s->s_instance))
+			kill(-s->s_sid, sig);
+	}
+}
+
+/*
+ * signal the process group of an instance and the sessions it left behind,
+ * instance -1 means all instances.
+ */
+static void
+instance_kill(struct child_config *cc, int instance, int sig)
+{
+	int			i;
+
+	for (i = 0; i < cc->cc_instances; i++) {
+		if ((instance == -1 || instance == i) && cc->cc_childs[i] != NULL)
+			process_kill_group(cc->cc_childs[i], sig);
+	}
+	session_kill(cc, instance, sig);
+}
+
+/*
+ * forget the sessions of a group that is deleted.
+ */
+static void
+session_drop(struct child_config *cc)
+{
+	struct session		*s,
+				*tmp;
+
+	LIST_FOREACH_SAFE (s, &sessions, s_ent, tmp) {
+		if (s->s_child_config != cc)
+			continue;
+		LIST_REMOVE(s, s_ent);
+		free(s);
+	}
+}
+
+/*
+ * stop timer callback: p did not exit in time.
+ */
+static void
+stop_timer_cb(int unused0 __attribute__((unused)),
+		short unused1 __attribute__((unused)),
+		void *vp)
+{
+	struct process		*p = vp;
+	struct child_config	*cc = p->p_child_config;
+
+	slog("[stop_timeout] %s pid: %d, sending KILL\n",
+			cc ? cc->cc_name : NULL, p->p_pid);
+	if (cc != NULL && !p->p_standby)
+		instance_kill(cc, p->p_instance, SIGKILL);
+	else
+		process_kill_group(p, SIGKILL);
+	if (p->p_stop_op != NULL)
+		p->p_stop_op->so_killed++;
+}
+
+/*
+ * send sig to p and SIGKILL after timeout seconds. A process already
+ * stopping keeps its deadline. so (may be NULL) waits for the exit.
+ */
+static void
+process_stop(struct process *p, int sig, int timeout, struct stop_op *so)
+{
+	struct timeval		tv;
+
+	/* standbys are stopped and don't see sig */
+	process_kill_group(p, p->p_standby ? SIGKILL : sig);
+	if (so != NULL && p->p_stop_op == NULL) {
+		p->p_stop_op = so;
+		so->so_pending++;
+		if (timeout > so->so_timeout)
+			so->so_timeout = timeout;
+	}
+	if (p->p_stopping)
+		return;
+	p->p_stopping = 1;
+	p->p_stop_until = time(NULL) + timeout;
+	tv.tv_sec = timeout;
+	tv.tv_usec = 0;
+	evtimer_set(&p->p_stop_timer, stop_timer_cb, p);
+	evtimer_add(&p->p_stop_timer, &tv);
+}
+
+/*
+ * stop all processes of a group in parallel, each with a deadline of
+ * timeout seconds. Nothing is restarted or started from the queue.
+ */
+static void
+group_stop(struct child_config *cc, int timeout, struct stop_op *so)
+{
+	int			i;
+
+	spawn_queue_drop(cc);
+	backoff_drop(cc, 0, 0);
+	for (i = 0; i < cc->cc_standby; i++) {
+		if (cc->cc_standbys[i] != NULL)
+			process_stop(cc->cc_standbys[i], SIGKILL, 0, so);
+	}
+	for (i = 0; i < cc->cc_instances; i++) {
+		if (cc->cc_childs[i] != NULL)
+			process_stop(cc->cc_childs[i], cc->cc_killsig, timeout, so);
+	}
+	session_kill(cc, -1, cc->cc_killsig);
+}
+
+static struct stop_op *
+stop_op_new(struct client_con *con, int exit_when_done)
+{
+	struct stop_op		*so;
+
+	so = xmalloc(sizeof(struct stop_op));
+	memset(so, '\0', sizeof(struct stop_op));
+	so->so_con = con;
+	so->so_cid = con != NULL ? con->c_cid : 0;
+	so->so_exit = exit_when_done;
+	so->so_cgroup_fd = -1;
+	/* set up now, stop_op_finish() deletes it even if never added */
+	evtimer_set(&so->so_timer, stop_op_timer_cb, so);
+	LIST_INSERT_HEAD(&stop_ops, so, so_ent);
+	return so;
+}
+
+/*
+ * reply to the command of so, exit if it was EXIT.
+ */
+static void
+stop_op_finish(struct stop_op *so)
+{
+	json_object		*obj;
+	const char		*ret;
+	uint16_t		cid;
+
+	so->so_done = 1;
+	/* a cgroup still in use is retried at the deadline */
+	if (so->so_cgroup_fd == -1)
+		evtimer_del(&so->so_timer);
+	if (so->so_con != NULL) {
+		obj = json_object_new_object();
+		json_object_object_add(obj, "code", json_object_new_boolean(1));
+		json_object_object_add(obj, "msg", json_object_new_string(
+				so->so_pending > 0 ? "deadline exceeded." : "stopped."));
+		json_object_object_add(obj, "killed", json_object_new_int(so->so_killed));
+		json_object_object_add(obj, "running", json_object_new_int(so->so_pending));
+		ret = json_object_to_json_string(obj);
+		cid = so->so_con->c_cid;
+		so->so_con->c_cid = so->so_cid;
+		send_message(so->so_con, ret, strlen(ret));
+		so->so_con->c_cid = cid;
+		json_object_put(obj);
+		so->so_con = NULL;
+	}
+	if (so->so_exit) {
+		slog("server exiting due to exit command, %d processes left.\n",
+				so->so_pending);
+		clients_flush(NULL);
+		exit(0);
+	}
+}
+
+static void
+stop_op_free(struct stop_op *so)
+{
+	LIST_REMOVE(so, so_ent);
+	free(so->so_cgroup);
+	free(so);
+}
+
+/*
+ * remove the cgroup of so. It fails while processes are left in it, with
+ * last the cgroup is given up then. Returns 0 if it should be retried.
+ */
+static int
+stop_op_cgroup(struct stop_op *so, int last)
+{
+	const char		*err;
+
+	if (so->so_cgroup_fd == -1)
+		return 1;
+	if ((err = cgroup_group_remove(so->so_cgroup, so->so_cgroup_fd)) == NULL) {
+		so->so_cgroup_fd = -1;
+		return 1;
+	}
+	if (!last)
+		return 0;
+	slog("[dele] %s\n", err);
+	close(so->so_cgroup_fd);
+	so->so_cgroup_fd = -1;
+	return 1;
+}
+
+/*
+ * a process counted in so exited.
+ */
+static void
+stop_op_exited(struct stop_op *so)
+{
+	if (--so->so_pending > 0)
+		return;
+	stop_op_cgroup(so, so->so_expired);
+	if (!so->so_done)
+		stop_op_finish(so);
+	if (so->so_cgroup_fd == -1)
+		stop_op_free(so);
+}
+
+static void
+stop_op_timer_cb(int unused0 __attribute__((unused)),
+		short unused1 __attribute__((unused)),
+		void *vso)
+{
+	struct stop_op		*so = vso;
+
+	so->so_expired = 1;
+	if (!so->so_done)
+		stop_op_finish(so);
+	stop_op_cgroup(so, 1);
+	if (so->so_pending == 0)
+		stop_op_free(so);
+}
+
+/*
+ * all processes of so are stopped: reply at once if there are none, else
+ * when they exited.
+ */
+static void
+stop_op_start(struct stop_op *so)
+{
+	struct timeval		tv;
+
+	if (so->so_pending == 0 && stop_op_cgroup(so, 0)) {
+		stop_op_finish(so);
+		stop_op_free(so);
+		return;
+	}
+	tv.tv_sec = so->so_timeout + STOP_GIVEUP_SEC;
+	tv.tv_usec = 0;
+	evtimer_add(&so->so_timer, &tv);
+}
+
+static struct roll *
+roll_find(const struct child_config *cc)
+{
+	struct roll		*r;
+
+	LIST_FOREACH (r, &rolls, r_ent) {
+		if (r->r_child_config == cc)
+			return r;
+	}
+	return NULL;
+}
+
+/*
+ * send obj to the client of a roll, on the cid of its ROLL command.
+ */
+static void
+roll_send(struct roll *r, json_object *obj)
+{
+	const char		*ret;
+	uint16_t		cid;
+
+	if (r->r_con != NULL) {
+		ret = json_object_to_json_string(obj);
+		cid = r->r_con->c_cid;
+		r->r_con->c_cid = r->r_cid;
+		send_message(r->r_con, ret, strlen(ret));
+		r->r_con->c_cid = cid;
+	}
+	json_object_put(obj);
+}
+
+/*
+ * progress of the current wave: {"wave": n, "waves": n, "state": state,
+ * "instances": [..], "pids": [..]}, pids of the new processes when ready.
+ */
+static void
+roll_progress(struct roll *r, const char *state)
+{
+	struct child_config	*cc = r->r_child_config;
+	json_object		*obj,
+				*inst,
+				*pids;
+	int			i;
+
+	obj = json_object_new_object();
+	json_object_object_add(obj, "code", json_object_new_boolean(1));
+	json_object_object_add(obj, "wave", json_object_new_int(r->r_wave + 1));
+	json_object_object_add(obj, "waves", json_object_new_int(r->r_waves));
+	json_object_object_add(obj, "state", json_object_new_string(state));
+	inst = json_object_new_array();
+	pids = json_object_new_array();
+	for (i = r->r_wave * r->r_batch; i < (r->r_wave + 1) * r->r_batch
+			&& i < cc->cc_instances; i++) {
+		json_object_array_add(inst, json_object_new_int(i));
+		if (cc->cc_childs[i] != NULL)
+			json_object_array_add(pids,
+					json_object_new_int(cc->cc_childs[i]->p_pid));
+	}
+	json_object_object_add(obj, "instances", inst);
+	json_object_object_add(obj, "pids", pids);
+	roll_send(r, obj);
+}
+
+/*
+ * end a roll with the final reply.
+ */
+static void
+roll_finish(struct roll *r, int code, const char *msg)
+{
+	json_object		*obj;
+
+	slog("[roll] %s: %s\n", r->r_child_config->cc_name, msg);
+	obj = json_object_new_object();
+	json_object_object_add(obj, "code", json_object_new_boolean(code));
+	json_object_object_add(obj, "msg", json_object_new_string(msg));
+	json_object_object_add(obj, "waves", json_object_new_int(r->r_wave));
+	roll_send(r, obj);
+	evtimer_del(&r->r_timer);
+	LIST_REMOVE(r, r_ent);
+	free(r->r_old);
+	free(r);
+}
+
+static void
+roll_schedule(struct roll *r)
+{
+	struct timeval		tv;
+
+	tv.tv_sec = 0;
+	tv.tv_usec = ROLL_TICK_MSEC * 1000;
+	evtimer_add(&r->r_timer, &tv);
+}
+
+/*
+ * stop the processes of the current wave, they are started again by
+ * process_exit().
+ */
+static void
+roll_wave_start(struct roll *r)
+{
+	struct child_config	*cc = r->r_child_config;
+	struct process		*p;
+	int			i,
+				n;
+
+	slog("[roll] %s wave %d/%d\n", cc->cc_name, r->r_wave + 1, r->r_waves);
+	r->r_deadline = time(NULL) + cc->cc_stop_timeout + r->r_timeout;
+	for (n = 0; n < r->r_batch; n++) {
+		i = r->r_wave * r->r_batch + n;
+		r->r_old[n] = 0;
+		if (i >= cc->cc_instances || (p = cc->cc_childs[i]) == NULL)
+			continue;
+		r->r_old[n] = p->p_pid;
+		process_stop(p, cc->cc_killsig, cc->cc_stop_timeout, NULL);
+	}
+	roll_progress(r, "restarting");
+	roll_schedule(r);
+}
+
+/*
+ * Returns 1 if every instance of the current wave runs a new, ready process
+ * for r_min_uptime seconds.
+ */
+static int
+roll_wave_done(const struct roll *r, time_t now)
+{
+	const struct child_config	*cc = r->r_child_config;
+	const struct process		*p;
+	int				i,
+					n;
+
+	for (n = 0; n < r->r_batch; n++) {
+		i = r->r_wave * r->r_batch + n;
+		if (i >= cc->cc_instances)
+			break;
+		p = cc->cc_childs[i];
+		if (p == NULL || p->p_pid == r->r_old[n] || !process_ready(p)
+				|| now - p->p_start < r->r_min_uptime)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * roll timer: abort on crash loops and timeouts, start the next wave when
+ * the current one is done.
+ */
+static void
+roll_timer_cb(int unused0 __attribute__((unused)),
+		short unused1 __attribute__((unused)),
+		void *vr)
+{
+	struct roll		*r = vr;
+	struct child_config	*cc = r->r_child_config;
+	static char		msg[64];
+	time_t			now;
+	int			i;
+
+	if (cc->cc_status == STATUS_BROKEN) {
+		roll_finish(r, 0, "group broken, roll aborted.");
+		return;
+	}
+	if (!group_wants_processes(cc)) {
+		roll_finish(r, 0, "group stopped, roll aborted.");
+		return;
+	}
+	for (i = r->r_wave * r->r_batch; i < (r->r_wave + 1) * r->r_batch
+			&& i < cc->cc_instances; i++) {
+		if (instance_broken(cc, i)) {
+			snprintf(msg, sizeof(msg),
+					"crash loop in instance %d, roll aborted.", i);
+			roll_finish(r, 0, msg);
+			return;
+		}
+	}
+
+	now = time(NULL);
+	if (!roll_wave_done(r, now)) {
+		if (now > r->r_deadline)
+			roll_finish(r, 0, "wave timed out, roll aborted.");
+		else
+			roll_schedule(r);
+		return;
+	}
+
+	roll_progress(r, "ready");
+	if (++r->r_wave >= r->r_waves
+			|| r->r_wave * r->r_batch >= cc->cc_instances) {
+		roll_finish(r, 1, "rolled.");
+		return;
+	}
+	roll_wave_start(r);
+}
+
+/*
+ * abort the roll of a group, if any.
+ */
+static void
+roll_abort(struct child_config *cc, const char *why)
+{
+	struct roll		*r;
+
+	if ((r = roll_find(cc)) != NULL)
+		roll_finish(r, 0, why);
+}
+
+/*
+ * send the reply of a WAIT command and forget it. With code 1, the pids of
+ * the instances are sent along.
+ */
+static void
+wait_finish(struct wait_op *w, int code, const char *msg)
+{
+	struct child_config	*cc = w->w_child_config;
+	json_object		*obj,
+				*a;
+	const char		*ret;
+	uint16_t		cid;
+	int			i,
+				ready = 0;
+
+	if (w->w_con != NULL) {
+		obj = json_object_new_object();
+		json_object_object_add(obj, "code", json_object_new_boolean(code));
+		json_object_object_add(obj, "msg", json_object_new_string(msg));
+		a = json_object_new_array();
+		for (i = 0; i < cc->cc_instances; i++) {
+			if (cc->cc_childs[i] == NULL
+					|| !process_ready(cc->cc_childs[i]))
+				continue;
+			json_object_array_add(a,
+					json_object_new_int(cc->cc_childs[i]->p_pid));
+			ready++;
+		}
+		json_object_object_add(obj, "pids", a);
+		json_object_object_add(obj, "ready", json_object_new_int(ready));
+		ret = json_object_to_json_string(obj);
+		cid = w->w_con->c_cid;
+		w->w_con->c_cid = w->w_cid;
+		send_message(w->w_con, ret, strlen(ret));
+		w->w_con->c_cid = cid;
+		json_object_put(obj);
+	}
+	evtimer_del(&w->w_timer);
+	LIST_REMOVE(w, w_ent);
+	free(w);
+}
+
+/*
+ * WAIT timer: reply when every instance is ready, the group can't get
+ * ready or the deadline passed.
+ */
+static void
+wait_timer_cb(int unused0 __attribute__((unused)),
+		short unused1 __attribute__((unused)),
+		void *vw)
+{
+	struct wait_op		*w = vw;
+	struct child_config	*cc = w->w_child_config;
+	struct timeval		tv;
+	static char		msg[64];
+	int			i,
+				ready = 1;
+
+	if (w->w_con == NULL) {
+		wait_finish(w, 0, NULL);
+		return;
+	}
+	if (cc->cc_status == STATUS_BROKEN) {
+		wait_finish(w, 0, "group broken.");
+		return;
+	}
+	if (!group_wants_processes(cc)) {
+		wait_finish(w, 0, "group is not running.");
+		return;
+	}
+	for (i = 0; i < cc->cc_instances; i++) {
+		if (instance_broken(cc, i)) {
+			snprintf(msg, sizeof(msg), "instance %d broken.", i);
+			wait_finish(w, 0, msg);
+			return;
+		}
+		if (cc->cc_childs[i] == NULL || !process_ready(cc->cc_childs[i]))
+			ready = 0;
+	}
+	if (ready) {
+		wait_finish(w, 1, "ready.");
+		return;
+	}
+	if (time(NULL) >= w->w_deadline) {
+		wait_finish(w, 0, "timed out.");
+		return;
+	}
+	tv.tv_sec = 0;
+	tv.tv_usec = WAIT_TICK_MSEC * 1000;
+	evtimer_add(&w->w_timer, &tv);
+}
+
+/*
+ * answer the WAIT commands of a group that is deleted.
+ */
+static void
+wait_abort(struct child_config *cc)
+{
+	struct wait_op		*w,
+				*tmp;
+
+	LIST_FOREACH_SAFE (w, &wait_ops, w_ent, tmp) {
+		if (w->w_child_config == cc)
+			wait_finish(w, 0, "group deleted.");
+	}
+}
+
+static struct zygote_req *
+zygote_req_find(struct zygote *z, int instance)
+{
+	struct zygote_req	*r;
+
+	LIST_FOREACH (r, &z->z_reqs, zr_ent) {
+		if (r->zr_instance == instance)
+			return r;
+	}
+	return NULL;
+}
+
+/*
+ * close control socket and forget pending requests.
+ */
+static void
+zygote_close(struct zygote *z)
+{
+	struct zygote_req	*r;
+
+	if (z->z_fd != -1) {
+		event_del(&z->z_ev);
+		close(z->z_fd);
+		z->z_fd = -1;
+	}
+	z->z_ready = 0;
+	while ((r = LIST_FIRST(&z->z_reqs)) != NULL) {
+		LIST_REMOVE(r, zr_ent);
+		free(r);
+	}
+}
+
+/*
+ * stop and free zygote of a group (group is deleted).
+ */
+static void
+zygote_free(struct child_config *cc)
+{
+	struct zygote	*z = cc->cc_zyg;
+
+	if (z == NULL)
+		return;
+	if (z->z_pid != -1)
+		kill(z->z_pid, SIGTERM);
+	zygote_close(z);
+	free(z);
+	cc->cc_zyg = NULL;
+}
+
+/*
+ * queue all instances of a zygote group that have no process and no pending
+ * request.
+ */
+static void
+zygote_queue_missing(struct child_config *cc)
+{
+	int		i;
+
+	if (cc->cc_status != STATUS_RUNNING)
+		return;
+	for (i = 0; i < cc->cc_instances; i++) {
+		if (cc->cc_childs[i] != NULL)
+			continue;
+		if (cc->cc_zyg != NULL && zygote_req_find(cc->cc_zyg, i) != NULL)
+			continue;
+		spawn_queue_add(cc, i);
+	}
+}
+
+/*
+ * queue the instances and standbys of a group that have no process, when
+ * its ids were looked up.
+ */
+static void
+group_queue_missing(struct child_config *cc)
+{
+	int		i;
+
+	if (!group_wants_processes(cc))
+		return;
+	if (cc->cc_zygote == 1) {
+		zygote_queue_missing(cc);
+		return;
+	}
+	for (i = 0; i < cc->cc_instances; i++) {
+		if (cc->cc_childs[i] == NULL && !instance_broken(cc, i)
+				&& !backoff_pending(cc, i)
+				&& !helper_pending(cc, i, 0))
+			spawn_queue_add(cc, i);
+	}
+	standby_queue_missing(cc);
+}
+
+/*
+ * Return 1 if pid was forked by the zygote of a group: it was reparented to
+ * the server and runs with the ids of the group.
+ */
+static int
+zygote_child_valid(const struct child_config *cc, pid_t pid)
+{
+	pid_t			ppid;
+	uid_t			uid;
+
+	if (proc_owner(pid, &ppid, &uid) == -1 || ppid != getpid())
+		return 0;
+	if (cc->cc_cred_uid != -1)
+		return uid == (uid_t) cc->cc_cred_uid;
+	return uid == getuid();
+}
+
+/*
+ * zygote reported a started instance. The zygote is a program of the user,
+ * pids that are not its descendants are ignored.
+ */
+static void
+zygote_started(struct child_config *cc, int instance, pid_t pid)
+{
+	int			status,
+				gone;
+	struct cpu_place	pl;
+
+	gone = reaped_take(pid, &status);
+	if (!gone && !zygote_child_valid(cc, pid)) {
+		slog("zygote for \"%s\": pid %d of instance %d is not a child "
+				"of the zygote, ignored\n", cc->cc_name, pid,
+				instance);
+		return;
+	}
+
+	if (instance >= cc->cc_instances || cc->cc_childs[instance] != NULL
+			|| cc->cc_status != STATUS_RUNNING) {
+		slog("zygote for \"%s\": instance %d not wanted, killing %d\n",
+				cc->cc_name, instance, pid);
+		if (!gone)
+			kill(pid, cc->cc_killsig);
+		return;
+	}
+
+	/* exited before we got the reply */
+	if (gone) {
+		slog("[process_exit] %s pid: %d\n", cc->cc_name, pid);
+		exit_stat_add(&cc->cc_exit_stat, status, NULL);
+		exit_stat_add(&cc->cc_inst_stat[instance], status, NULL);
+		if (exit_is_error(status, cc))
+			group_error(cc, instance);
+		if (cc->cc_status == STATUS_RUNNING)
+			spawn_queue_add(cc, instance);
+		return;
+	}
+
+	if (cc->cc_cpu_policy != NULL) {
+		cpu_policy_place(cc->cc_cpu_policy, instance, cc->cc_instances,
+				&pl);
+		if (cpu_mask_set(pid, &pl.cp_mask) == -1)
+			slog("zygote for \"%s\": sched_setaffinity %d: %s\n",
+					cc->cc_name, pid, strerror(errno));
+	}
+	process_new(cc, instance, 0, pid);
+}
+
+/*
+ * handle one message from a zygote.
+ */
+static void
+zygote_message(struct zygote *z, const char *buf)
+{
+	struct child_config	*cc = z->z_child_config;
+	struct zygote_req	*r;
+	json_object		*obj,
+				*o;
+	int			instance;
+
+	if ((obj = json_tokener_parse(buf)) == NULL || is_error(obj)) {
+		slog("zygote for \"%s\": invalid message\n", cc->cc_name);
+		return;
+	}
+
+	if (!json_object_is_type(obj, json_type_object)) {
+		slog("zygote for \"%s\": invalid message\n", cc->cc_name);
+		json_object_put(obj);
+		return;
+	}
+
+	if ((o = json_object_object_get(obj, "ready")) != NULL) {
+		slog("zygote for \"%s\" ready, pid: %d\n", cc->cc_name, z->z_pid);
+		z->z_ready = 1;
+		zygote_queue_missing(cc);
+		json_object_put(obj);
+		return;
+	}
+
+	if ((o = json_object_object_get(obj, "instance")) == NULL
+			|| !json_object_is_type(o, json_type_int)) {
+		slog("zygote for \"%s\": invalid message\n", cc->cc_name);
+		json_object_put(obj);
+		return;
+	}
+	instance = json_object_get_int(o);
+	if (instance < 0) {
+		slog("zygote for \"%s\": invalid instance %d\n", cc->cc_name,
+				instance);
+		json_object_put(obj);
+		return;
+	}
+
+	if ((r = zygote_req_find(z, instance)) != NULL) {
+		LIST_REMOVE(r, zr_ent);
+		free(r);
+	}
+
+	if ((o = json_object_object_get(obj, "pid")) != NULL
+			&& json_object_is_type(o, json_type_int)) {
+		if (json_object_get_int(o) > 0)
+			zygote_started(cc, instance, json_object_get_int(o));
+		else
+			slog("zygote for \"%s\": invalid pid %d for instance %d\n",
+					cc->cc_name, json_object_get_int(o),
+					instance);
+	} else {
+		o = json_object_object_get(obj, "error");
+		slog("zygote for \"%s\" failed to start instance %d: %s\n",
+				cc->cc_name, instance,
+				o != NULL ? json_object_get_string(o) : "unknown error");
+		group_error(cc, instance);
+		if (cc->cc_status == STATUS_RUNNING && instance < cc->cc_instances)
+			spawn_queue_add(cc, instance);
+	}
+	json_object_put(obj);
+}
+
+/*
+ * zygote control socket callback.
+ */
+static void
+zygote_read_cb(int fd, short unused __attribute__((unused)), void *vz)
+{
+	struct zygote	*z = vz;
+	char		buf[1024];
+	ssize_t		n;
+
+	for (;;) {
+		n = recv(fd, buf, sizeof(buf) - 1, 0);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1 && errno == EAGAIN)
+			break;
+		if (n <= 0) {
+			/* the process is restarted when it is reaped */
+			slog("zygote for \"%s\" closed control socket\n",
+					z->z_child_config->cc_name);
+			zygote_close(z);
+			if (z->z_pid != -1)
+				kill(z->z_pid, SIGTERM);
+			break;
+		}
+		buf[n] = '\0';
+		zygote_message(z, buf);
+	}
+	spawn_queue_run();
+}
+
+/*
+ * start the template process of a group. The control socket is passed in
+ * UBERVISOR_ZYGOTE_FD.
+ */
+static int
+zygote_start(struct child_config *cc)
+{
+	struct zygote		*z;
+	struct spawn_args	sa;
+	struct spawn_strings	ss;
+	int			sv[2];
+	char			fd_str[16],
+				**env;
+	pid_t			pid;
+
+	if ((z = cc->cc_zyg) == NULL) {
+		z = xmalloc(sizeof(struct zygote));
+		memset(z, '\0', sizeof(struct zygote));
+		z->z_pid = -1;
+		z->z_fd = -1;
+		z->z_child_config = cc;
+		LIST_INIT(&z->z_reqs);
+		cc->cc_zyg = z;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == -1)
+		return 0;
+	setcloseonexec(sv[0]);
+	setnonblock(sv[0]);
+
+	spawn_prepare(cc, 0, &sa, &ss);
+	/* instances are placed by zygote_started() */
+	sa.sa_place = NULL;
+	snprintf(fd_str, sizeof(fd_str), "%d", sv[1]);
+	setenv("UBERVISOR_ZYGOTE_FD", fd_str, 1);
+	/* instances inherit the environment of the zygote */
+	sa.sa_env = env = child_config_env(cc, -1);
+	/* the spawn helper can not pass the socket */
+	pid = spawn_process(spawn_method == SPAWN_HELPER ? SPAWN_VFORK
+			: spawn_method, &sa);
+	free(env);
+	unsetenv("UBERVISOR_ZYGOTE_FD");
+	close(sv[1]);
+	spawn_strings_free(&ss);
+
+	if (pid == -1) {
+		close(sv[0]);
+		return 0;
+	}
+
+	z->z_pid = pid;
+	z->z_fd = sv[0];
+	z->z_ready = 0;
+	event_set(&z->z_ev, z->z_fd, EV_READ | EV_PERSIST, zygote_read_cb, z);
+	event_add(&z->z_ev, NULL);
+	slog("[zygote_start] %s pid: %d\n", cc->cc_name, pid);
+	return 1;
+}
+
+/*
+ * ask the zygote of a group to start an instance. Until the zygote is ready,
+ * instances are started when it reports ready.
+ */
+static int
+zygote_spawn(struct child_config *cc, int instance)
+{
+	struct zygote		*z = cc->cc_zyg;
+	struct zygote_req	*r;
+	struct spawn_args	sa;
+	struct spawn_strings	ss;
+	json_object		*obj,
+				*env;
+	const char		*msg;
+	char			**e;
+
+	if (z == NULL || z->z_pid == -1)
+		return zygote_start(cc);
+
+	/* not ready yet or exiting */
+	if (!z->z_ready || z->z_fd == -1)
+		return 1;
+
+	if (zygote_req_find(z, instance) != NULL)
+		return 1;
+
+	spawn_prepare(cc, instance, &sa, &ss);
+	obj = json_object_new_object();
+	json_object_object_add(obj, "instance", json_object_new_int(instance));
+	if (ss.ss_dir != NULL)
+		json_object_object_add(obj, "dir", json_object_new_string(ss.ss_dir));
+	if (ss.ss_out != NULL)
+		json_object_object_add(obj, "stdout", json_object_new_string(ss.ss_out));
+	if (ss.ss_err != NULL)
+		json_object_object_add(obj, "stderr", json_object_new_string(ss.ss_err));
+	spawn_strings_free(&ss);
+	/* the whole environment of the instance, with INSTANCE and PORT */
+	env = json_object_new_array();
+	for (e = child_config_envp(cc, instance); *e != NULL; e++)
+		json_object_array_add(env, json_object_new_string(*e));
+	json_object_object_add(obj, "env", env);
+
+	msg = json_object_to_json_string(obj);
+	if (send(z->z_fd, msg, strlen(msg), MSG_NOSIGNAL | MSG_DONTWAIT) == -1) {
+		slog("zygote for \"%s\": send: %s\n", cc->cc_name, strerror(errno));
+		json_object_put(obj);
+		return 0;
+	}
+	json_object_put(obj);
+
+	r = xmalloc(sizeof(struct zygote_req));
+	r->zr_instance = instance;
+	LIST_INSERT_HEAD(&z->z_reqs, r, zr_ent);
+	return 1;
+}
+
+/*
+ * find group by the pid of its zygote.
+ */
+static struct child_config *
+zygote_find_by_pid(pid_t pid)
+{
+	struct child_config	*cc;
+
+	LIST_FOREACH (cc, &child_config_list_head, cc_ent) {
+		if (cc->cc_zyg != NULL && cc->cc_zyg->z_pid == pid)
+			return cc;
+	}
+	return NULL;
+}
+
+/*
+ * zygote process exited. Restarted via the spawn queue.
+ */
+static void
+zygote_exit(struct child_config *cc, int status)
+{
+	struct zygote	*z = cc->cc_zyg;
+
+	slog("[zygote_exit] %s pid: %d\n", cc->cc_name, z->z_pid);
+	z->z_pid = -1;
+	zygote_close(z);
+	if (exit_is_error(status, cc) || !WIFEXITED(status))
+		group_error(cc, -1);
+	zygote_queue_missing(cc);
+}
+
+/*
+ * heartbeat timer callback.
+ */
+static void
+heartbeat_cb(int unused0 __attribute__((unused)),
+		short unused1 __attribute__((unused)),
+		void *vp)
+{
+	struct process		*p;
+	struct child_config	*cc;
+	char			*args[5],
+				pid_str[8],
+				inst_str[8];
+	time_t			uptime;
+
+	if (vp == NULL)
+		return;
+
+	p = vp;
+	schedule_heartbeat(p);
+	if (p->p_standby)
+		return;
+
+	/* without a pidfd adopted processes are polled */
+	if (p->p_adopted && p->p_pidfd == -1
+			&& state_pid_ticks(p->p_pid) != p->p_ticks) {
+		process_exit(p, EXIT_UNKNOWN, NULL);
+		spawn_queue_run();
+		return;
+	}
+	uptime = time(NULL) - p->p_start;
+
+	cc = p->p_child_config;
+
+	if (p->p_age > 0 && uptime > p->p_age) {
+		if (p->p_terminated) {
+			slog("pid %d exceeded uptime. Sending KILL\n", p->p_pid);
+			process_kill_group(p, SIGKILL);
+			return;
+		}
+		slog("pid %d exceeded uptime. Sending kill signal\n", p->p_pid);
+		if (cc)
+			process_kill_group(p, cc->cc_killsig);
+		else
+			process_kill_group(p, SIGTERM);
+		p->p_terminated = 1;
+		return;
+	}
+
+	if (cc == NULL || cc->cc_heartbeat == NULL)
+		return;
+
+	snprintf(pid_str, sizeof(pid_str), "%d", p->p_pid);
+	snprintf(inst_str, sizeof(inst_str), "%d", p->p_instance);
+
+	args[0] = cc->cc_heartbeat;
+	args[1] = cc->cc_name;
+	args[2] = pid_str;
+	args[3] = inst_str;
+	args[4] = NULL;
+	if (spawn_command(args) == -1)
+		slog("heartbeat spawn error in group %s.\n", cc->cc_name);
+}
+
+static struct helper_req *
+helper_req_find(uint32_t seq)
+{
+	struct helper_req	*hr;
+
+	LIST_FOREACH (hr, &helper_reqs, hr_ent) {
+		if (hr->hr_seq == seq)
+			return hr;
+	}
+	return NULL;
+}
+
+/*
+ * Return 1 if instance (or standby slot) of a group waits for the spawn
+ * helper.
+ */
+static int
+helper_pending(const struct child_config *cc, int instance, int standby)
+{
+	struct helper_req	*hr;
+
+	LIST_FOREACH (hr, &helper_reqs, hr_ent) {
+		if (hr->hr_child_config == cc && hr->hr_instance == instance
+				&& hr->hr_standby == standby)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * group is deleted: processes of its pending requests are killed when the
+ * replies arrive.
+ */
+static void
+helper_forget(const struct child_config *cc)
+{
+	struct helper_req	*hr;
+
+	LIST_FOREACH (hr, &helper_reqs, hr_ent) {
+		if (hr->hr_child_config == cc)
+			hr->hr_child_config = NULL;
+	}
+}
+
+static void
+helper_req_free(struct helper_req *hr)
+{
+	struct helper_exit	*he;
+
+	LIST_REMOVE(hr, hr_ent);
+	evtimer_del(&hr->hr_timer);
+	if (hr->hr_instance != -1 && !hr->hr_expired)
+		spawn_inflight--;
+	free(hr->hr_command);
+	free(hr);
+
+	/* exits left over are not of children of the helper */
+	if (!LIST_EMPTY(&helper_reqs))
+		return;
+	while ((he = LIST_FIRST(&helper_exits)) != NULL) {
+		LIST_REMOVE(he, he_ent);
+		reaped_add(he->he_pid, he->he_status);
+		free(he);
+	}
+}
+
+/*
+ * a request timed out: it no longer counts as inflight, but is kept until
+ * the reply arrives, so that the process can be killed.
+ */
+static void
+helper_expire(struct helper_req *hr)
+{
+	struct timeval		tv;
+
+	if (hr->hr_instance != -1)
+		spawn_inflight--;
+	hr->hr_expired = 1;
+	hr->hr_child_config = NULL;
+	tv.tv_sec = HELPER_LATE_SEC;
+	tv.tv_usec = 0;
+	evtimer_add(&hr->hr_timer, &tv);
+}
+
+/*
+ * a request failed or timed out. The error is counted and the instance
+ * started again, delayed by the backoff policy.
+ */
+static void
+helper_failed(struct helper_req *hr, int err)
+{
+	struct child_config	*cc = hr->hr_child_config;
+	int			inst = hr->hr_instance,
+				standby = hr->hr_standby;
+
+	if (hr->hr_expired) {
+		helper_req_free(hr);
+		return;
+	}
+	if (hr->hr_command != NULL)
+		slog("spawn helper failed to run \"%s\": %s\n", hr->hr_command,
+				strerror(err));
+	else if (cc != NULL)
+		slog("spawn helper failed to start %s %s %d: %s\n", cc->cc_name,
+				standby ? "standby" : "instance", inst,
+				strerror(err));
+	if (err == ETIMEDOUT)
+		helper_expire(hr);
+	else
+		helper_req_free(hr);
+	if (cc == NULL || inst == -1)
+		return;
+
+	group_error(cc, standby ? -1 : inst);
+	if (!group_wants_processes(cc))
+		return;
+	if (standby) {
+		if (inst < cc->cc_standby && cc->cc_standbys[inst] == NULL)
+			spawn_queue_insert(cc, inst, 1);
+	} else if (inst < cc->cc_instances && cc->cc_childs[inst] == NULL
+			&& !instance_broken(cc, inst)) {
+		backoff_restart(cc, inst, 1, 0);
+	}
+}
+
+static void
+helper_fail_all(int err)
+{
+	struct helper_req	*hr;
+
+	while ((hr = LIST_FIRST(&helper_reqs)) != NULL)
+		helper_failed(hr, err);
+}
+
+/*
+ * the helper started the process of hr. Processes no longer wanted (group
+ * deleted, stopped or shrunk) are killed.
+ */
+static void
+helper_started(struct helper_req *hr, pid_t pid)
+{
+	struct child_config	*cc = hr->hr_child_config;
+	struct process		*p;
+	long long		t = hr->hr_spawn_usec;
+	int			inst = hr->hr_instance,
+				standby = hr->hr_standby,
+				status,
+				gone,
+				want;
+
+	/* the exit is known if it was reaped before the reply was read.
+	 * Otherwise the pid is our child and can't be reused. */
+	gone = reaped_take(pid, &status);
+
+	/* commands are reaped as unknown children */
+	if (hr->hr_command != NULL) {
+		helper_req_free(hr);
+		return;
+	}
+
+	if (hr->hr_expired) {
+		slog("late reply of the spawn helper. killing %d\n", pid);
+		want = 0;
+	} else if (cc == NULL || !group_wants_processes(cc))
+		want = 0;
+	else if (standby)
+		want = inst < cc->cc_standby && cc->cc_standbys[inst] == NULL;
+	else
+		want = inst < cc->cc_instances && cc->cc_childs[inst] == NULL;
+
+	if (!want) {
+		if (!hr->hr_expired)
+			slog("spawn helper started %d, no longer wanted. "
+					"killing it.\n", pid);
+		helper_req_free(hr);
+		if (!gone)
+			kill(pid, SIGKILL);
+		return;
+	}
+	helper_req_free(hr);
+
+	p = process_new(cc, inst, standby, pid);
+	p->p_spawn_usec = t;
+	p->p_starting = 1;
+	spawn_inflight++;
+
+	/* exited before the reply was read */
+	if (gone)
+		process_exit(p, status, NULL);
+}
+
+/*
+ * read all replies of the spawn helper. A pid of a late reply, for a
+ * request that already timed out, is killed. Returns -1 if the helper is
+ * gone.
+ */
+static int
+helper_read(void)
+{
+	struct helper_req	*hr;
+	uint32_t		seq;
+	pid_t			pid;
+	int			err,
+				status,
+				r;
+
+	while ((r = spawn_helper_recv(&seq, &pid, &err)) == 1) {
+		if ((hr = helper_req_find(seq)) != NULL) {
+			if (pid > 0)
+				helper_started(hr, pid);
+			else
+				helper_failed(hr, err);
+			continue;
+		}
+		/* the request was given up, the pid can't be trusted */
+		if (pid > 0 && !reaped_take(pid, &status))
+			slog("reply of the spawn helper for unknown request, "
+					"pid %d left running\n", pid);
+	}
+	return r;
+}
+
+/*
+ * watch the request socket of the spawn helper, after it was (re)started or
+ * dropped.
+ */
+static void
+helper_watch(void)
+{
+	if (helper_watched)
+		event_del(&helper_ev);
+	helper_watched = 0;
+	if (spawn_helper_fd() == -1)
+		return;
+	event_set(&helper_ev, spawn_helper_fd(), EV_READ | EV_PERSIST,
+			helper_cb, NULL);
+	event_add(&helper_ev, NULL);
+	helper_watched = 1;
+}
+
+/*
+ * the helper closed its socket or failed to take a request: kill it and
+ * fail the pending requests. It is started again when it is reaped.
+ */
+static void
+helper_lost(void)
+{
+	slog("spawn helper is gone.\n");
+	spawn_helper_stop();
+	helper_watch();
+	helper_fail_all(EPIPE);
+}
+
+static void
+helper_cb(int fd __attribute__((unused)), short what __attribute__((unused)),
+		void *unused __attribute__((unused)))
+{
+	if (helper_read() == -1)
+		helper_lost();
+	spawn_queue_run();
+}
+
+static void
+helper_timer_cb(int fd __attribute__((unused)),
+		short what __attribute__((unused)), void *vhr)
+{
+	struct helper_req	*hr = vhr;
+
+	if (hr->hr_expired)
+		slog("spawn helper did not reply in %d s, giving up.\n",
+				HELPER_LATE_SEC);
+	else
+		slog("spawn helper did not reply in %d ms.\n",
+				SPAWN_HELPER_TIMEOUT);
+	helper_failed(hr, ETIMEDOUT);
+	spawn_queue_run();
+}
+
+/*
+ * send a request to the spawn helper, for instance (or standby slot) of cc
+ * or for command. Returns 0 and sets errno on error.
+ */
+static int
+helper_spawn(struct spawn_args *sa, struct child_config *cc, int instance,
+		int standby, const char *command)
+{
+	struct helper_req	*hr;
+	struct timeval		tv;
+	long long		t;
+	uint32_t		seq;
+
+	t = monotonic_usec();
+	if ((seq = spawn_helper_send(sa)) == 0) {
+		if (spawn_helper_fd() == -1)
+			helper_watch();
+		return 0;
+	}
+
+	hr = xmalloc(sizeof(struct helper_req));
+	memset(hr, '\0', sizeof(struct helper_req));
+	hr->hr_seq = seq;
+	hr->hr_spawn_usec = t;
+	if (command != NULL) {
+		hr->hr_command = xstrdup(command);
+		hr->hr_instance = -1;
+	} else {
+		hr->hr_child_config = cc;
+		hr->hr_instance = instance;
+		hr->hr_standby = standby;
+		spawn_inflight++;
+	}
+	tv.tv_sec = SPAWN_HELPER_TIMEOUT / 1000;
+	tv.tv_usec = (SPAWN_HELPER_TIMEOUT % 1000) * 1000;
+	evtimer_set(&hr->hr_timer, helper_timer_cb, hr);
+	evtimer_add(&hr->hr_timer, &tv);
+	LIST_INSERT_HEAD(&helper_reqs, hr, hr_ent);
+	return 1;
+}
+
+/*
+ * restart the spawn helper after it exited. If it exits again right
+ * away, give up and spawn from the server.
+ */
+static void
+restart_spawn_helper(void)
+{
+	static time_t		last = 0;
+	time_t			t;
+
+	if (spawn_method != SPAWN_HELPER)
+		return;
+
+	/* replies sent before it exited */
+	helper_read();
+	helper_watch();
+	helper_fail_all(EPIPE);
+
+	t = time(NULL);
+	if (last + HELPER_RESTART_PERIOD > t) {
+		slog("spawn helper keeps exiting. using vfork.\n");
+		spawn_method = SPAWN_VFORK;
+		return;
+	}
+	last = t;
+
+	slog("spawn helper exited. restarting.\n");
+	if (spawn_helper_start() == -1) {
+		slog("failed to start spawn helper. using vfork.\n");
+		spawn_method = SPAWN_VFORK;
+	}
+	helper_watch();
+}
+
+/*
+ * set a group broken, no processes are started any more.
+ */
+static void
+group_broken(struct child_config *cc, const char *why)
+{
+	cc->cc_status = STATUS_BROKEN;
+	slog("%s. setting broken on %s\n", why, cc->cc_name);
+	send_status_update_notification(cc->cc_name, STATUS_BROKEN);
+	ondemand_update(cc);
+	run_fatal_cb(cc);
+}
+
+/*
+ * compile cc_crashloop into cc_crashloop_policy and forget the errors of all
+ * instances. Returns an error message or NULL.
+ */
+static const char *
+crashloop_set(struct child_config *cc)
+{
+	struct crashloop	cl;
+	const char		*err;
+
+	free(cc->cc_crashloop_policy);
+	cc->cc_crashloop_policy = NULL;
+	free(cc->cc_crash_rings);
+	cc->cc_crash_rings = NULL;
+	if (cc->cc_crashloop != NULL && cc->cc_crashloop[0] == '\0') {
+		free(cc->cc_crashloop);
+		cc->cc_crashloop = NULL;
+	}
+	if (cc->cc_crashloop == NULL)
+		return NULL;
+	if ((err = crashloop_compile(&cl, cc->cc_crashloop)) != NULL)
+		return err;
+	cc->cc_crashloop_policy = xmalloc(sizeof(struct crashloop));
+	*cc->cc_crashloop_policy = cl;
+	cc->cc_crash_rings = xmalloc(sizeof(struct crash_ring) * cc->cc_instances);
+	memset(cc->cc_crash_rings, '\0', sizeof(struct crash_ring) * cc->cc_instances);
+	return NULL;
+}
+
+/*
+ * count an error of an instance of a group with crash loop policy. An
+ * instance with cl_count errors within cl_window seconds sets the group
+ * broken, with scope=instance only the instance. A group with all instances
+ * broken is broken.
+ */
+static void
+instance_error(struct child_config *cc, int instance, time_t t)
+{
+	const struct crashloop	*cl = cc->cc_crashloop_policy;
+	struct crash_ring	*cr = &cc->cc_crash_rings[instance];
+	int			i;
+
+	if (!crash_ring_add(cr, cl, t) || cc->cc_status == STATUS_BROKEN)
+		return;
+	if (!cl->cl_instance) {
+		slog("crash loop in instance %d of %s\n", instance, cc->cc_name);
+		group_broken(cc, "crash loop");
+		return;
+	}
+	if (cr->cr_broken)
+		return;
+	cr->cr_broken = 1;
+	slog("crash loop. setting instance %d broken on %s\n", instance,
+			cc->cc_name);
+	for (i = 0; i < cc->cc_instances; i++) {
+		if (!cc->cc_crash_rings[i].cr_broken)
+			return;
+	}
+	group_broken(cc, "all instances broken");
+}
+
+/*
+ * count a failed start or an error exit in a group, instance is -1 for
+ * errors not caused by an instance. With a crash loop policy, errors of
+ * instances are handled by instance_error(). Otherwise, if there are more
+ * then (ERROR_MAX * instances) errors over a period of ERROR_PERIOD seconds,
+ * the group is set broken.
+ */
+static void
+group_error(struct child_config *cc, int instance)
+{
+	time_t			t;
+
+	t = time(NULL);
+	if (cc->cc_crashloop_policy != NULL && instance >= 0
+			&& instance < cc->cc_instances) {
+		instance_error(cc, instance, t);
+		return;
+	}
+
+	if (cc->cc_errtime + ERROR_PERIOD < t)
+		cc->cc_error = 0;
+	cc->cc_error++;
+	cc->cc_errtime = t;
+
+	if (cc->cc_status != STATUS_BROKEN
+			&& cc->cc_error >= (ERROR_MAX * cc->cc_instances))
+		group_broken(cc, "spawn failures");
+}
+
+/*
+ * instances set broken by the crash loop policy as json array.
+ */
+static json_object *
+broken_instances(const struct child_config *cc)
+{
+	json_object	*a;
+	int		i;
+
+	a = json_object_new_array();
+	for (i = 0; i < cc->cc_instances; i++) {
+		if (instance_broken(cc, i))
+			json_object_array_add(a, json_object_new_int(i));
+	}
+	return a;
+}
+
+/*
+ * move a standby into the empty slot of instance and continue it. A new
+ * standby is queued for the used slot. Returns 0 if no standby is available.
+ * Standbys that already called execv are preferred.
+ */
+static int
+standby_promote(struct child_config *cc, int instance)
+{
+	struct process		*p = NULL;
+	int			i,
+				pass;
+
+	for (pass = 0; pass < 2 && p == NULL; pass++) {
+		for (i = 0; i < cc->cc_standby; i++) {
+			p = cc->cc_standbys[i];
+			if (p != NULL && !p->p_failed && (pass || !p->p_starting))
+				break;
+			p = NULL;
+		}
+	}
+	if (p == NULL)
+		return 0;
+
+	cc->cc_standbys[i] = NULL;
+	p->p_standby = 0;
+	p->p_instance = instance;
+	p->p_start = time(NULL);
+	state_set(p->p_state_slot, instance, 0);
+	cc->cc_childs[instance] = p;
+	process_kill(p, SIGCONT);
+	slog("[standby_promote] %s pid: %d instance: %d\n", cc->cc_name,
+			p->p_pid, instance);
+	spawn_queue_insert(cc, i, 1);
+	return 1;
+}
+
+/*
+ * kill standbys in slots >= n (before the group is shrunk or deleted).
+ * Standbys are stopped, so SIGKILL is used.
+ */
+static void
+standby_kill(struct child_config *cc, int n)
+{
+	int		i;
+
+	for (i = n; i < cc->cc_standby; i++) {
+		if (cc->cc_standbys[i] == NULL)
+			continue;
+		cc->cc_standbys[i]->p_child_config = NULL;
+		process_kill_group(cc->cc_standbys[i], SIGKILL);
+		cc->cc_standbys[i] = NULL;
+	}
+}
+
+/*
+ * change number of standby slots of a group.
+ */
+static void
+standby_resize(struct child_config *cc, int n)
+{
+	int		i;
+
+	if (n < cc->cc_standby)
+		standby_kill(cc, n);
+	if (n == 0) {
+		free(cc->cc_standbys);
+		cc->cc_standbys = NULL;
+	} else {
+		cc->cc_standbys = xrealloc(cc->cc_standbys,
+				sizeof(struct process *) * n);
+		for (i = cc->cc_standby > 0 ? cc->cc_standby : 0; i < n; i++)
+			cc->cc_standbys[i] = NULL;
+	}
+	cc->cc_standby = n;
+}
+
+/*
+ * sum of cpu ticks used by the instances of a group.
+ */
+static long long
+ondemand_cpu(struct child_config *cc)
+{
+	long long	sum = 0,
+			t;
+	int		i;
+
+	for (i = 0; i < cc->cc_instances; i++) {
+		if (cc->cc_childs[i] == NULL)
+			continue;
+		if ((t = proc_cpu_ticks(cc->cc_childs[i]->p_pid)) > 0)
+			sum += t;
+	}
+	return sum;
+}
+
+/*
+ * Return 1 if a connection is waiting on one of the listen sockets.
+ */
+static int
+ondemand_pending(struct child_config *cc)
 {
-	struct process		*p;
-	struct child_config	*cc;
-	pid_t			pid;
-	char			*args[5],
-				pid_str[8],
-				inst_str[8];
-	time_t			uptime;
+	struct pollfd	pfd[SPAWN_MAX_LISTEN];
+	int		i;
 
-	if (vp == NULL)
-		return;
+	for (i = 0; i < cc->cc_nlisten; i++) {
+		pfd[i].fd = cc->cc_listen_fds[i];
+		pfd[i].events = POLLIN;
+		pfd[i].revents = 0;
+	}
+	return poll(pfd, cc->cc_nlisten, 0) > 0;
+}
 
-	p = vp;
-	schedule_heartbeat(p);
-	uptime = time(NULL) - p->p_start;
+static void
+ondemand_watch(struct child_config *cc)
+{
+	int		i;
 
-	cc = p->p_child_config;
+	for (i = 0; i < cc->cc_nlisten; i++) {
+		if (!event_pending(&cc->cc_od->od_ev[i], EV_READ, NULL))
+			event_add(&cc->cc_od->od_ev[i], NULL);
+	}
+}
 
-	if (p->p_age > 0 && uptime > p->p_age) {
-		if (p->p_terminated) {
-			slog("pid %d exceeded uptime. Sending KILL\n", p->p_pid);
-			kill(p->p_pid, SIGKILL);
-			return;
-		}
-		slog("pid %d exceeded uptime. Sending kill signal\n", p->p_pid);
-		if (cc)
-			kill(p->p_pid, cc->cc_killsig);
-		else
-			kill(p->p_pid, SIGTERM);
-		p->p_terminated = 1;
+static void
+ondemand_unwatch(struct child_config *cc)
+{
+	int		i;
+
+	for (i = 0; i < cc->cc_nlisten; i++)
+		event_del(&cc->cc_od->od_ev[i]);
+}
+
+static void
+ondemand_schedule(struct child_config *cc)
+{
+	struct timeval		tv;
+
+	tv.tv_sec = cc->cc_ondemand < ONDEMAND_CHECK_SEC
+		? cc->cc_ondemand : ONDEMAND_CHECK_SEC;
+	tv.tv_usec = 0;
+	evtimer_add(&cc->cc_od->od_timer, &tv);
+}
+
+/*
+ * Return 1 if a group has instances.
+ */
+static int
+ondemand_running(struct child_config *cc)
+{
+	int		i;
+
+	for (i = 0; i < cc->cc_instances; i++) {
+		if (cc->cc_childs[i] != NULL)
+			return 1;
+	}
+	return 0;
+}
+
+static void
+ondemand_activate(struct child_config *cc)
+{
+	ondemand_unwatch(cc);
+	cc->cc_od->od_active = 1;
+	cc->cc_od->od_cpu = -1;
+	cc->cc_od->od_last = time(NULL);
+	ondemand_schedule(cc);
+}
+
+/*
+ * stop all processes of an idle group and watch the listen sockets again.
+ */
+static void
+ondemand_stop(struct child_config *cc)
+{
+	slog("[ondemand_stop] %s idle for %d seconds\n", cc->cc_name,
+			(int) (time(NULL) - cc->cc_od->od_last));
+	cc->cc_od->od_active = 0;
+	evtimer_del(&cc->cc_od->od_timer);
+	group_stop(cc, cc->cc_stop_timeout, NULL);
+	ondemand_watch(cc);
+}
+
+/*
+ * idle timer callback of an active group.
+ */
+static void
+ondemand_timer_cb(int unused0 __attribute__((unused)),
+		short unused1 __attribute__((unused)),
+		void *vcc)
+{
+	struct child_config	*cc = vcc;
+	long long		cpu;
+	time_t			now;
+
+	now = time(NULL);
+	cpu = ondemand_cpu(cc);
+	if (cpu != cc->cc_od->od_cpu || ondemand_pending(cc)) {
+		cc->cc_od->od_cpu = cpu;
+		cc->cc_od->od_last = now;
+	} else if (now - cc->cc_od->od_last >= cc->cc_ondemand) {
+		ondemand_stop(cc);
 		return;
 	}
+	ondemand_schedule(cc);
+}
 
-	if (cc == NULL || cc->cc_heartbeat == NULL)
+/*
+ * connection on a listen socket of an inactive group. The connection is left
+ * for the instances to accept.
+ */
+static void
+ondemand_listen_cb(int unused0 __attribute__((unused)),
+		short unused1 __attribute__((unused)),
+		void *vcc)
+{
+	struct child_config	*cc = vcc;
+	int			i;
+
+	if (cc->cc_status != STATUS_RUNNING || cc->cc_od->od_active)
 		return;
 
-	snprintf(pid_str, sizeof(pid_str), "%d", p->p_pid);
-	snprintf(inst_str, sizeof(inst_str), "%d", p->p_instance);
+	slog("[ondemand_start] %s\n", cc->cc_name);
+	ondemand_activate(cc);
+	for (i = 0; i < cc->cc_instances; i++) {
+		if (cc->cc_childs[i] == NULL)
+			spawn_queue_add(cc, i);
+	}
+	standby_queue_missing(cc);
+	spawn_queue_run();
+}
 
-	pid = fork();
+/*
+ * set up on demand state of a new group (after listen_open()).
+ */
+static void
+ondemand_init(struct child_config *cc)
+{
+	struct ondemand		*od;
+	int			i;
 
-	if (pid == -1) {
-		slog("heartbeat spawn error in group %s.\n", cc->cc_name);
+	if (cc->cc_ondemand <= 0)
 		return;
-	}
+	od = xmalloc(sizeof(struct ondemand));
+	memset(od, '\0', sizeof(struct ondemand));
+	od->od_ev = xmalloc(sizeof(struct event) * cc->cc_nlisten);
+	for (i = 0; i < cc->cc_nlisten; i++)
+		event_set(&od->od_ev[i], cc->cc_listen_fds[i], EV_READ,
+				ondemand_listen_cb, cc);
+	evtimer_set(&od->od_timer, ondemand_timer_cb, cc);
+	cc->cc_od = od;
+	ondemand_update(cc);
+}
 
-	if (pid == 0) {
-		args[0] = cc->cc_heartbeat;
-		args[1] = cc->cc_name;
-		args[2] = pid_str;
-		args[3] = inst_str;
-		args[4] = NULL;
-		execv(args[0], args);
-		exit(EXIT_FAILURE);
+/*
+ * follow status changes of a group: only running groups watch their listen
+ * sockets, other groups become inactive.
+ */
+static void
+ondemand_update(struct child_config *cc)
+{
+	if (cc->cc_od == NULL)
+		return;
+	if (cc->cc_status != STATUS_RUNNING) {
+		ondemand_unwatch(cc);
+		evtimer_del(&cc->cc_od->od_timer);
+		cc->cc_od->od_active = 0;
+	} else if (!cc->cc_od->od_active) {
+		/* processes left from before the group was stopped */
+		if (ondemand_running(cc))
+			ondemand_activate(cc);
+		else
+			ondemand_watch(cc);
 	}
 }
 
+static void
+ondemand_free(struct child_config *cc)
+{
+	if (cc->cc_od == NULL)
+		return;
+	ondemand_unwatch(cc);
+	evtimer_del(&cc->cc_od->od_timer);
+	free(cc->cc_od->od_ev);
+	free(cc->cc_od);
+	cc->cc_od = NULL;
+}
+
 /*
  * Return 1 if the exit conditon should be considered an error.
  */
 static int
 exit_is_error(int ret, struct child_config *cc)
 {
+	if (ret == EXIT_UNKNOWN)
+		return 0;
 	if ((WIFEXITED(ret) && WEXITSTATUS(ret) != 0)
 			|| (WIFSIGNALED(ret)
 			&& WTERMSIG(ret) == cc->cc_killsig)) {
@@ -764,63 +4231,200 @@ exit_is_error(int ret, struct child_config *cc)
 }
 
 /*
- * libevent signal handler.
+ * stop watching the pidfd of p.
+ */
+static void
+process_pidfd_close(struct process *p)
+{
+	if (p->p_gone) {
+		evtimer_del(&p->p_pidfd_ev);
+		p->p_gone = 0;
+	}
+	if (p->p_pidfd == -1)
+		return;
+	event_del(&p->p_pidfd_ev);
+	close(p->p_pidfd);
+	p->p_pidfd = -1;
+}
+
+/*
+ * p was reaped with exit status ret and resource usage ru. Frees p and
+ * queues a restart.
+ */
+static void
+process_exit(struct process *p, int ret, const struct rusage *ru)
+{
+	int			inst,
+				failed,
+				standby,
+				stopping;
+	time_t			uptime;
+	struct child_config	*cc;
+	struct stop_op		*so;
+	char			*cc_name;
+
+	cc = p->p_child_config;
+
+	if (cc)
+		cc_name = cc->cc_name;
+	else
+		cc_name = NULL;
+
+	inst = p->p_instance;
+	failed = p->p_failed;
+	standby = p->p_standby;
+	stopping = p->p_stopping;
+	uptime = time(NULL) - p->p_start;
+	if (standby)
+		slog("[standby_exit] %s pid: %d\n", cc_name, p->p_pid);
+	else
+		slog("[process_exit] %s pid: %d\n", cc_name, p->p_pid);
+	if (cc) {
+		exit_stat_add(&cc->cc_exit_stat, ret, ru);
+		if (!standby && inst < cc->cc_instances) {
+			exit_stat_add(&cc->cc_inst_stat[inst], ret, ru);
+			session_add(cc, inst, p->p_pid);
+		}
+	}
+	spawn_done(p);
+	process_remove(p);
+	state_del(p->p_state_slot);
+	evtimer_del(&(p->p_heartbeat_timer));
+	if (p->p_stopping)
+		evtimer_del(&p->p_stop_timer);
+	so = p->p_stop_op;
+	process_pidfd_close(p);
+	free(p->p_status);
+	free(p);
+	if (cc && standby) {
+		if (inst < cc->cc_standby)
+			cc->cc_standbys[inst] = NULL;
+		if (!failed && !stopping && exit_is_error(ret, cc)
+				&& !group_is_idle(cc))
+			group_error(cc, -1);
+		if (inst < cc->cc_standby && group_wants_processes(cc))
+			spawn_queue_insert(cc, inst, 1);
+	} else if (cc) {
+		if (inst < cc->cc_instances)
+			cc->cc_childs[inst] = NULL;
+		/* failed starts are counted when reported. Processes
+		 * of idle groups and stopped ones were stopped by the
+		 * server. */
+		if (!failed && !stopping && exit_is_error(ret, cc)
+				&& !group_is_idle(cc))
+			group_error(cc, inst);
+		if (inst < cc->cc_instances && group_wants_processes(cc)
+				&& !instance_broken(cc, inst)
+				&& !standby_promote(cc, inst))
+			backoff_restart(cc, inst, failed
+					|| (!stopping && exit_is_error(ret, cc)),
+					uptime);
+	}
+	if (so != NULL)
+		stop_op_exited(so);
+}
+
+/*
+ * pidfd callback: p exited.
+ */
+static void
+pidfd_cb(int fd __attribute__((unused)), short what __attribute__((unused)),
+		void *px)
+{
+	struct process	*p = px;
+	struct rusage	ru;
+	int		ret;
+
+	/* records of exited children are still in the channel */
+	spawn_chan_read();
+
+	if (wait4(p->p_pid, &ret, WNOHANG, &ru) == p->p_pid) {
+		process_exit(p, ret, &ru);
+		spawn_queue_run();
+		return;
+	}
+
+	/* the exit status went to the parent of an adopted process */
+	if (p->p_adopted) {
+		process_exit(p, EXIT_UNKNOWN, NULL);
+		spawn_queue_run();
+		return;
+	}
+
+	/* not a child (yet), e.g. a zygote instance: left to SIGCHLD. */
+	process_pidfd_close(p);
+}
+
+/*
+ * timer callback: the pid of p was gone when it was registered.
+ */
+static void
+pidfd_gone_cb(int fd __attribute__((unused)),
+		short what __attribute__((unused)), void *px)
+{
+	struct process	*p = px;
+
+	p->p_gone = 0;
+	process_exit(p, EXIT_UNKNOWN, NULL);
+	spawn_queue_run();
+}
+
+/*
+ * libevent signal handler. Processes with a pidfd are usually reaped by
+ * pidfd_cb, this handles the others, the spawn helper and zygotes.
  */
 static void
 sigchld_cb(int unused0 __attribute__((unused)),
 		short unused1 __attribute__((unused)),
 		void *unused2 __attribute__((unused)))
 {
-	pid_t			pid;
-	int			ret,
-				inst;
+	pid_t			pid,
+				sid;
+	int			ret;
+	siginfo_t		si;
+	struct rusage		ru;
 	struct process		*p;
 	struct child_config	*cc;
-	time_t			t;
-	char			*cc_name;
 
-	while ((pid = waitpid(-1, &ret, WNOHANG)) > 0) {
-		if ((p = process_find_by_pid(pid)) == NULL)
-			return;
+	/* processes of replies of the helper are known before they are
+	 * reaped */
+	if (helper_read() == -1 && spawn_helper_fd() != -1)
+		helper_lost();
+	/* records of exited children are still in the channel */
+	spawn_chan_read();
+
+	for (;;) {
+		/* the session of a zombie is known until it is reaped */
+		si.si_pid = 0;
+		if (waitid(P_ALL, 0, &si, WEXITED | WNOHANG | WNOWAIT) == -1
+				|| si.si_pid == 0)
+			break;
+		pid = si.si_pid;
+		sid = getsid(pid);
+		if (wait4(pid, &ret, WNOHANG, &ru) != pid)
+			break;
 
-		cc = p->p_child_config;
+		if (pid == spawn_helper_pid()) {
+			restart_spawn_helper();
+			continue;
+		}
 
-		if (cc)
-			cc_name = cc->cc_name;
-		else
-			cc_name = NULL;
-
-		inst = p->p_instance;
-		slog("[process_exit] %s pid: %d\n", cc_name, pid);
-		process_remove(p);
-		evtimer_del(&(p->p_heartbeat_timer));
-		if (p->p_child_sockbuf != NULL) {
-			bufferevent_disable(p->p_child_sockbuf, EV_READ);
-			bufferevent_free(p->p_child_sockbuf);
-			close(p->p_child_sock);
-		}
-		free(p);
-		if (cc) {
-			if (inst < cc->cc_instances)
-				cc->cc_childs[inst] = NULL;
-			if (exit_is_error(ret, cc)) {
-				t = time(NULL);
-				if (cc->cc_errtime + ERROR_PERIOD < t)
-					cc->cc_error = 0;
-				cc->cc_error++;
-				cc->cc_errtime = t;
-
-				if (cc->cc_error >= (ERROR_MAX * cc->cc_instances)) {
-					cc->cc_status = STATUS_BROKEN;
-					slog("spawn failures. setting broken on %s\n", cc->cc_name);
-					send_status_update_notification(cc->cc_name, STATUS_BROKEN);
-					run_fatal_cb(cc);
-				}
-			}
-			if (inst < cc->cc_instances && cc->cc_status == STATUS_RUNNING)
-				spawn(cc, inst);
+		if (pid == cred_resolver_pid()) {
+			restart_cred_resolver();
+			continue;
 		}
+
+		if ((p = process_find_by_pid(pid)) == NULL) {
+			if ((cc = zygote_find_by_pid(pid)) != NULL)
+				zygote_exit(cc, ret);
+			else if (sid == pid || !session_reaped(pid, sid, &ru))
+				reaped_add(pid, ret);
+			continue;
+		}
+
+		process_exit(p, ret, &ru);
 	}
+	spawn_queue_run();
 }
 
 /*
@@ -901,6 +4505,17 @@ c_list(struct client_con *con, char *unused __attribute__((unused)))
 	return 1;
 }
 
+/*
+ * Return 1 if args, dir, stdout or stderr differ per instance. Standbys
+ * are started before their instance is known and can't be used then.
+ */
+static int
+uses_instance_tokens(const struct child_config *cc)
+{
+	return child_config_uses_token(cc, TPL_NUM)
+		|| child_config_uses_token(cc, TPL_PORT);
+}
+
 /*
  * start command handler.
  */
@@ -909,6 +4524,12 @@ c_spwn(struct client_con *con, char *buf)
 {
 	int			i;
 	struct child_config	*cc;
+	const char		*err;
+
+	if (draining) {
+		send_status_msg(con, 0, "server is stopping.");
+		return 1;
+	}
 
 	if ((cc = child_config_unserialize(buf)) == NULL) {
 		send_status_msg(con, 0, "failure");
@@ -936,21 +4557,149 @@ c_spwn(struct client_con *con, char *buf)
 	if (cc->cc_instances == -1)
 	       cc->cc_instances = 1;
 
-	if (cc->cc_instances < 1) {
-		send_status_msg(con, 0, "instances > 0 required.");
+	if (cc->cc_priority == -1)
+		cc->cc_priority = 0;
+
+	if (cc->cc_standby == -1)
+		cc->cc_standby = 0;
+
+	if (cc->cc_stop_timeout == -1)
+		cc->cc_stop_timeout = STOP_TIMEOUT_DEFAULT;
+
+	if (cc->cc_instances < 1) {
+		send_status_msg(con, 0, "instances > 0 required.");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_instances > MAX_INSTANCES) {
+		send_status_msg(con, 0, "too many instances.");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_priority < -1) {
+		send_status_msg(con, 0, "priority >= 0 required.");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_stop_timeout < -1) {
+		send_status_msg(con, 0, "stop_timeout >= 0 required.");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_port < -1 || cc->cc_port > 65535) {
+		send_status_msg(con, 0, "port out of range.");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_env != NULL && (err = env_check(cc->cc_env)) != NULL) {
+		send_status_msg(con, 0, err);
+		child_config_free(cc);
+		return 1;
+	}
+
+	child_config_compile(cc);
+	if (cc->cc_port == -1 && child_config_uses_token(cc, TPL_PORT)) {
+		send_status_msg(con, 0, "port required for %(PORT).");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_zygote == 1 && !subreaper_set()) {
+		send_status_msg(con, 0, "zygote not supported");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_standby < 0 || cc->cc_standby > MAX_INSTANCES) {
+		send_status_msg(con, 0, "standby out of range.");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_standby > 0 && cc->cc_zygote == 1) {
+		send_status_msg(con, 0, "standby not supported for zygote groups.");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_standby > 0 && uses_instance_tokens(cc)) {
+		send_status_msg(con, 0, "standby not supported with %(NUM) or %(PORT).");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_ondemand > 0 && cc->cc_listen == NULL) {
+		send_status_msg(con, 0, "ondemand requires listen.");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_ondemand > 0 && cc->cc_zygote == 1) {
+		send_status_msg(con, 0, "ondemand not supported for zygote groups.");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_cpus != NULL
+			&& (cc->cc_cpu_policy = cpu_policy_new(cc->cc_cpus, &err)) == NULL) {
+		send_status_msg(con, 0, err);
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_standby > 0 && cc->cc_cpu_policy != NULL
+			&& cpu_policy_per_instance(cc->cc_cpu_policy)) {
+		send_status_msg(con, 0, "standby not supported with per instance cpus.");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if ((err = resources_set(cc)) != NULL) {
+		send_status_msg(con, 0, err);
+		child_config_free(cc);
+		return 1;
+	}
+
+	if ((err = backoff_set(cc)) != NULL) {
+		send_status_msg(con, 0, err);
+		child_config_free(cc);
+		return 1;
+	}
+
+	if ((err = crashloop_set(cc)) != NULL) {
+		send_status_msg(con, 0, err);
+		child_config_free(cc);
+		return 1;
+	}
+
+	if ((err = listen_open(cc)) != NULL) {
+		send_status_msg(con, 0, err);
 		child_config_free(cc);
 		return 1;
 	}
 
-	if (cc->cc_instances > MAX_INSTANCES) {
-		send_status_msg(con, 0, "too many instances.");
+	if ((err = cgroup_set(cc)) != NULL) {
+		send_status_msg(con, 0, err);
 		child_config_free(cc);
 		return 1;
 	}
 
 	cc->cc_childs = xmalloc(sizeof(struct process *) * cc->cc_instances);
 	memset(cc->cc_childs, '\0', sizeof(struct process *) * cc->cc_instances);
+	cc->cc_inst_stat = xmalloc(sizeof(struct exit_stat) * cc->cc_instances);
+	memset(cc->cc_inst_stat, '\0', sizeof(struct exit_stat) * cc->cc_instances);
+	if (cc->cc_standby > 0) {
+		cc->cc_standbys = xmalloc(sizeof(struct process *) * cc->cc_standby);
+		memset(cc->cc_standbys, '\0', sizeof(struct process *) * cc->cc_standby);
+	}
+	cred_resolve(cc);
 	child_config_insert(cc);
+	ondemand_init(cc);
 	if (!auto_dump)
 		send_status_msg(con, 1, "success");
 	else
@@ -959,11 +4708,13 @@ c_spwn(struct client_con *con, char *buf)
 	slog("[start] creating group %s\n", cc->cc_name);
 	send_status_update_notification(cc->cc_name, STATUS_CREATE);
 	send_status_update_notification(cc->cc_name, cc->cc_status);
-	if (cc->cc_status != STATUS_RUNNING)
+	if (!group_wants_processes(cc))
 		return 1;
 
 	for (i = 0; i < cc->cc_instances; i++)
-		spawn(cc, i);
+		spawn_queue_add(cc, i);
+	standby_queue_missing(cc);
+	spawn_queue_run();
 	return 1;
 }
 
@@ -974,9 +4725,20 @@ static int
 c_updt(struct client_con *con, char *buf)
 {
 	int			i,
-				changed = 0;
+				changed = 0,
+				res_changed = 0;
 	struct child_config	*cc,
 				*up;
+	struct cpu_policy	*cp = NULL;
+	struct resources	rs;
+	struct backoff		bo;
+	struct crashloop	cl;
+	const char		*err;
+
+	if (draining) {
+		send_status_msg(con, 0, "server is stopping.");
+		return 1;
+	}
 
 	if ((cc = child_config_unserialize(buf)) == NULL) {
 		slog("[update] parse error\n");
@@ -1015,6 +4777,36 @@ c_updt(struct client_con *con, char *buf)
 		return 1;
 	}
 
+	if (cc->cc_zygote != -1) {
+		send_status_msg(con, 0, "zygote cannot be updated");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_listen != NULL) {
+		send_status_msg(con, 0, "listen cannot be updated");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_ondemand != -1) {
+		send_status_msg(con, 0, "ondemand cannot be updated");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_standby < -1 || cc->cc_standby > MAX_INSTANCES) {
+		send_status_msg(con, 0, "standby out of range.");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_standby > 0 && up->cc_zygote == 1) {
+		send_status_msg(con, 0, "standby not supported for zygote groups.");
+		child_config_free(cc);
+		return 1;
+	}
+
 	if (cc->cc_instances != -1 && cc->cc_instances < 1) {
 		send_status_msg(con, 0, "instances > 0 required.");
 		child_config_free(cc);
@@ -1027,6 +4819,104 @@ c_updt(struct client_con *con, char *buf)
 		return 1;
 	}
 
+	if (cc->cc_priority < -1) {
+		send_status_msg(con, 0, "priority >= 0 required.");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_stop_timeout < -1) {
+		send_status_msg(con, 0, "stop_timeout >= 0 required.");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_port < -1 || cc->cc_port > 65535) {
+		send_status_msg(con, 0, "port out of range.");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_env != NULL && (err = env_check(cc->cc_env)) != NULL) {
+		send_status_msg(con, 0, err);
+		child_config_free(cc);
+		return 1;
+	}
+
+	/* check new templates before changing anything */
+	child_config_compile(cc);
+	if (cc->cc_port == -1 && up->cc_port == -1
+			&& child_config_uses_token(cc, TPL_PORT)) {
+		send_status_msg(con, 0, "port required for %(PORT).");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if ((cc->cc_standby > 0 || (cc->cc_standby == -1 && up->cc_standby > 0))
+			&& uses_instance_tokens(cc)) {
+		send_status_msg(con, 0, "standby not supported with %(NUM) or %(PORT).");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_standby > 0 && uses_instance_tokens(up)) {
+		send_status_msg(con, 0, "standby not supported with %(NUM) or %(PORT).");
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_cpus != NULL && (cp = cpu_policy_new(cc->cc_cpus, &err)) == NULL) {
+		send_status_msg(con, 0, err);
+		child_config_free(cc);
+		return 1;
+	}
+
+	if ((cc->cc_standby > 0 || (cc->cc_standby == -1 && up->cc_standby > 0))
+			&& ((cp != NULL && cpu_policy_per_instance(cp))
+			|| (cp == NULL && up->cc_cpu_policy != NULL
+			&& cpu_policy_per_instance(up->cc_cpu_policy)))) {
+		send_status_msg(con, 0, "standby not supported with per instance cpus.");
+		cpu_policy_free(cp);
+		child_config_free(cc);
+		return 1;
+	}
+
+#define RES_PICK(X, U)	(cc->X != U ? cc->X : up->X)
+	if ((err = resources_compile(&rs, RES_PICK(cc_nice, RES_UNSET),
+			RES_PICK(cc_oom_score_adj, RES_UNSET),
+			RES_PICK(cc_ioprio, NULL), RES_PICK(cc_sched, NULL),
+			RES_PICK(cc_rlimits, NULL))) != NULL) {
+		send_status_msg(con, 0, err);
+		cpu_policy_free(cp);
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_cgroup != NULL && (err = up->cc_cgroup_fd == -1
+			? "cgroup requires a cgroup root."
+			: cgroup_limits_check(cc->cc_cgroup)) != NULL) {
+		send_status_msg(con, 0, err);
+		cpu_policy_free(cp);
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_backoff != NULL && cc->cc_backoff[0] != '\0'
+			&& (err = backoff_compile(&bo, cc->cc_backoff)) != NULL) {
+		send_status_msg(con, 0, err);
+		cpu_policy_free(cp);
+		child_config_free(cc);
+		return 1;
+	}
+
+	if (cc->cc_crashloop != NULL && cc->cc_crashloop[0] != '\0'
+			&& (err = crashloop_compile(&cl, cc->cc_crashloop)) != NULL) {
+		send_status_msg(con, 0, err);
+		cpu_policy_free(cp);
+		child_config_free(cc);
+		return 1;
+	}
+
 	if (cc->cc_dir != NULL && xstrcmp(cc->cc_dir, up->cc_dir)) {
 		slog("[update] %s dir \"%s\" -> \"%s\"\n", up->cc_name,
 				up->cc_dir, cc->cc_dir);
@@ -1045,6 +4935,24 @@ c_updt(struct client_con *con, char *buf)
 		up->cc_heartbeat = xstrdup(cc->cc_heartbeat);
 	}
 
+	if (cc->cc_username != NULL && xstrcmp(cc->cc_username, up->cc_username)) {
+		slog("[update] %s username \"%s\" -> \"%s\"\n", up->cc_name,
+				up->cc_username, cc->cc_username);
+		changed = 1;
+		free(up->cc_username);
+		up->cc_username = xstrdup(cc->cc_username);
+		cred_resolve(up);
+	}
+
+	if (cc->cc_groupname != NULL && xstrcmp(cc->cc_groupname, up->cc_groupname)) {
+		slog("[update] %s groupname \"%s\" -> \"%s\"\n", up->cc_name,
+				up->cc_groupname, cc->cc_groupname);
+		changed = 1;
+		free(up->cc_groupname);
+		up->cc_groupname = xstrdup(cc->cc_groupname);
+		cred_resolve(up);
+	}
+
 	if (cc->cc_fatal_cb != NULL && xstrcmp(cc->cc_fatal_cb, up->cc_fatal_cb)) {
 		slog("[update] %s fatal_cb \"%s\" -> \"%s\"\n", up->cc_name,
 				up->cc_fatal_cb, cc->cc_fatal_cb);
@@ -1072,6 +4980,105 @@ c_updt(struct client_con *con, char *buf)
 		up->cc_stderr = xstrdup(cc->cc_stderr);
 	}
 
+	if (cc->cc_port != -1 && cc->cc_port != up->cc_port) {
+		slog("[update] %s port %d -> %d\n", up->cc_name,
+				up->cc_port, cc->cc_port);
+		changed = 1;
+		up->cc_port = cc->cc_port;
+	}
+
+	/* the environment replaces the old one, an empty one removes it */
+	if (cc->cc_env != NULL) {
+		slog("[update] %s env\n", up->cc_name);
+		changed = 1;
+		str_array_free(up->cc_env);
+		up->cc_env = NULL;
+		if (cc->cc_env[0] != NULL) {
+			up->cc_env = cc->cc_env;
+			cc->cc_env = NULL;
+		}
+	}
+
+	if (changed)
+		child_config_compile(up);
+
+	/* resource controls are used for processes started from now on */
+#define RES_UPDATE_INT(X, N)	if (cc->X != RES_UNSET && cc->X != up->X) { \
+				slog("[update] %s " N " %d -> %d\n", up->cc_name, \
+						up->X, cc->X); \
+				res_changed = 1; \
+				up->X = cc->X; \
+			}
+
+#define RES_UPDATE_STR(X, N)	if (cc->X != NULL && xstrcmp(cc->X, up->X)) { \
+				slog("[update] %s " N " \"%s\" -> \"%s\"\n", \
+						up->cc_name, up->X, cc->X); \
+				res_changed = 1; \
+				free(up->X); \
+				up->X = xstrdup(cc->X); \
+			}
+
+	RES_UPDATE_INT(cc_nice, "nice");
+	RES_UPDATE_INT(cc_oom_score_adj, "oom_score_adj");
+	RES_UPDATE_STR(cc_ioprio, "ioprio");
+	RES_UPDATE_STR(cc_sched, "sched");
+	RES_UPDATE_STR(cc_rlimits, "rlimits");
+	if (res_changed) {
+		changed = 1;
+		resources_set(up);
+	}
+
+	/* cgroup limits apply to running processes immediately */
+	if (cc->cc_cgroup != NULL && xstrcmp(cc->cc_cgroup, up->cc_cgroup)) {
+		slog("[update] %s cgroup \"%s\" -> \"%s\"\n", up->cc_name,
+				up->cc_cgroup, cc->cc_cgroup);
+		changed = 1;
+		free(up->cc_cgroup);
+		up->cc_cgroup = xstrdup(cc->cc_cgroup);
+		if ((err = cgroup_group_limits(up->cc_cgroup_fd, up->cc_cgroup)) != NULL)
+			slog("[update] %s cgroup: %s\n", up->cc_name, err);
+	}
+
+	/* a new policy starts from scratch, an empty one removes it */
+	if (cc->cc_backoff != NULL && xstrcmp(cc->cc_backoff, up->cc_backoff)
+			&& (cc->cc_backoff[0] != '\0' || up->cc_backoff != NULL)) {
+		slog("[update] %s backoff \"%s\" -> \"%s\"\n", up->cc_name,
+				up->cc_backoff, cc->cc_backoff);
+		changed = 1;
+		free(up->cc_backoff);
+		up->cc_backoff = xstrdup(cc->cc_backoff);
+		backoff_set(up);
+		backoff_drop(up, 0, 1);
+	}
+
+	/* a new policy forgets old errors, broken instances are started again */
+	if (cc->cc_crashloop != NULL && xstrcmp(cc->cc_crashloop, up->cc_crashloop)
+			&& (cc->cc_crashloop[0] != '\0' || up->cc_crashloop != NULL)) {
+		slog("[update] %s crashloop \"%s\" -> \"%s\"\n", up->cc_name,
+				up->cc_crashloop, cc->cc_crashloop);
+		changed = 1;
+		free(up->cc_crashloop);
+		up->cc_crashloop = xstrdup(cc->cc_crashloop);
+		crashloop_set(up);
+		if (group_wants_processes(up)) {
+			for (i = 0; i < up->cc_instances; i++) {
+				if (process_find_instance(up, i) == NULL
+						&& !backoff_pending(up, i))
+					spawn_queue_add(up, i);
+			}
+		}
+	}
+
+	if (cp != NULL) {
+		slog("[update] %s cpus \"%s\" -> \"%s\"\n", up->cc_name,
+				up->cc_cpus, cc->cc_cpus);
+		changed = 1;
+		free(up->cc_cpus);
+		cpu_policy_free(up->cc_cpu_policy);
+		up->cc_cpus = xstrdup(cc->cc_cpus);
+		up->cc_cpu_policy = cp;
+	}
+
 	if (cc->cc_killsig != -1 && cc->cc_killsig != up->cc_killsig) {
 		slog("[update] %s killsig %d -> %d\n", up->cc_name,
 				up->cc_killsig, cc->cc_killsig);
@@ -1083,20 +5090,34 @@ c_updt(struct client_con *con, char *buf)
 		slog("[update] %s instances %d -> %d\n", up->cc_name,
 				up->cc_instances, cc->cc_instances);
 		changed = 1;
+		/* INSTANCES is part of the environment */
+		child_config_envp_free(up);
 		if (cc->cc_instances > up->cc_instances) {
 			up->cc_childs = xrealloc(up->cc_childs,
 					sizeof(struct process *) * cc->cc_instances);
+			backoff_resize(up, cc->cc_instances);
+			up->cc_inst_stat = xrealloc(up->cc_inst_stat,
+					sizeof(struct exit_stat) * cc->cc_instances);
+			memset(up->cc_inst_stat + up->cc_instances, '\0',
+					sizeof(struct exit_stat)
+					* (cc->cc_instances - up->cc_instances));
+			if (up->cc_crash_rings != NULL) {
+				up->cc_crash_rings = xrealloc(up->cc_crash_rings,
+						sizeof(struct crash_ring) * cc->cc_instances);
+				memset(up->cc_crash_rings + up->cc_instances, '\0',
+						sizeof(struct crash_ring)
+						* (cc->cc_instances - up->cc_instances));
+			}
 			i = up->cc_instances;
 			up->cc_instances = cc->cc_instances;
 			for (; i < up->cc_instances; i++) {
-				if (up->cc_status == STATUS_RUNNING) {
-					spawn(up, i);
-				} else {
-					up->cc_childs[i] = NULL;
-				}
+				up->cc_childs[i] = NULL;
+				if (up->cc_status == STATUS_RUNNING)
+					spawn_queue_add(up, i);
 			}
 		} else {
 			/* XXX: maybe return pids for cc->cc_instances > up->cc_instances */
+			backoff_resize(up, cc->cc_instances);
 			for (i = cc->cc_instances; i < up->cc_instances; i++) {
 				if (up->cc_childs[i] != NULL)
 					up->cc_childs[i]->p_child_config = NULL;
@@ -1105,69 +5126,775 @@ c_updt(struct client_con *con, char *buf)
 			up->cc_instances = cc->cc_instances;
 			up->cc_childs = xrealloc(up->cc_childs,
 					sizeof(struct process *) * up->cc_instances);
+			up->cc_inst_stat = xrealloc(up->cc_inst_stat,
+					sizeof(struct exit_stat) * up->cc_instances);
+			if (up->cc_crash_rings != NULL)
+				up->cc_crash_rings = xrealloc(up->cc_crash_rings,
+						sizeof(struct crash_ring) * up->cc_instances);
+		}
+	}
+
+	if (cc->cc_status != -1 && cc->cc_status != up->cc_status) {
+		slog("[update] %s status %d -> %d\n", up->cc_name,
+				up->cc_status, cc->cc_status);
+		changed = 1;
+		up->cc_error = 0;
+		backoff_drop(up, 0, 0);
+		if (up->cc_crash_rings != NULL)
+			memset(up->cc_crash_rings, '\0',
+					sizeof(struct crash_ring) * up->cc_instances);
+		/* look up names again, e.g. after a missing user was added */
+		if (up->cc_username != NULL || up->cc_groupname != NULL)
+			cred_resolve(up);
+		if (up->cc_status != STATUS_RUNNING
+				&& cc->cc_status == STATUS_RUNNING) {
+			for (i = 0; i < up->cc_instances; i++) {
+				if (process_find_instance(up, i) == NULL)
+					spawn_queue_add(up, i);
+			}
+		}
+		up->cc_status = cc->cc_status;
+		ondemand_update(up);
+		standby_queue_missing(up);
+		send_status_update_notification(up->cc_name, up->cc_status);
+	}
+
+	if (cc->cc_priority != -1 && cc->cc_priority != up->cc_priority) {
+		slog("[update] %s priority %d -> %d\n", up->cc_name,
+				up->cc_priority, cc->cc_priority);
+		changed = 1;
+		up->cc_priority = cc->cc_priority;
+		/* requeue waiting instances with the new priority, delayed
+		 * and broken ones stay where they are */
+		spawn_queue_drop(up);
+		if (group_wants_processes(up)) {
+			for (i = 0; i < up->cc_instances; i++) {
+				if (up->cc_childs[i] == NULL
+						&& !backoff_pending(up, i)
+						&& !instance_broken(up, i))
+					spawn_queue_add(up, i);
+			}
+		}
+		standby_queue_missing(up);
+	}
+
+	if (cc->cc_standby != -1 && cc->cc_standby != up->cc_standby) {
+		slog("[update] %s standby %d -> %d\n", up->cc_name,
+				up->cc_standby, cc->cc_standby);
+		changed = 1;
+		i = up->cc_standby;
+		standby_resize(up, cc->cc_standby);
+		if (up->cc_standby > i)
+			standby_queue_missing(up);
+	}
+
+	if (cc->cc_age > 0 && cc->cc_age != up->cc_age) {
+		slog("[update] %s age %d -> %d\n", up->cc_name,
+				up->cc_age, cc->cc_age);
+		changed = 1;
+		up->cc_age = cc->cc_age;
+	}
+
+	if (cc->cc_stop_timeout != -1 && cc->cc_stop_timeout != up->cc_stop_timeout) {
+		slog("[update] %s stop_timeout %d -> %d\n", up->cc_name,
+				up->cc_stop_timeout, cc->cc_stop_timeout);
+		changed = 1;
+		up->cc_stop_timeout = cc->cc_stop_timeout;
+	}
+
+	/* processes started from now on get NOTIFY_SOCKET */
+	if (cc->cc_notify != -1 && cc->cc_notify != up->cc_notify) {
+		slog("[update] %s notify %d -> %d\n", up->cc_name,
+				up->cc_notify, cc->cc_notify);
+		changed = 1;
+		up->cc_notify = cc->cc_notify;
+		child_config_envp_free(up);
+	}
+
+	child_config_free(cc);
+	spawn_queue_run();
+
+	if (changed)
+		send_group_cfg_update_notification(up);
+
+	if (!auto_dump)
+		send_status_msg(con, 1, "success");
+	else
+		c_dump(con, NULL);
+	return 1;
+}
+
+/*
+ * set a group stopped and stop its processes. The reply is sent when they
+ * exited, see stop_op_finish().
+ */
+static int
+c_stop(struct client_con *con, char *buf)
+{
+	struct child_config	*cc;
+	struct stop_op		*so;
+	json_object		*obj,
+				*m;
+	int			timeout = -1;
+
+	if ((obj = json_tokener_parse(buf)) == NULL || is_error(obj)) {
+		send_status_msg(con, 0, "failure");
+		return 0;
+	}
+
+	if (!json_object_is_type(obj, json_type_object)) {
+		json_object_put(obj);
+		send_status_msg(con, 0, "failure");
+		return 0;
+	}
+
+	if ((m = json_object_object_get(obj, "name")) == NULL
+			|| !json_object_is_type(m, json_type_string)) {
+		json_object_put(obj);
+		send_status_msg(con, 0, "failure");
+		return 1;
+	}
+
+	if ((cc = child_config_find_by_name(json_object_get_string(m))) == NULL) {
+		json_object_put(obj);
+		send_status_msg(con, 0, "name not found");
+		return 1;
+	}
+
+	if ((m = json_object_object_get(obj, "timeout")) != NULL
+			&& json_object_is_type(m, json_type_int))
+		timeout = json_object_get_int(m);
+	json_object_put(obj);
+	if (timeout < 0)
+		timeout = cc->cc_stop_timeout;
+
+	slog("[stop] %s timeout %d\n", cc->cc_name, timeout);
+	roll_abort(cc, "group stopped, roll aborted.");
+	if (cc->cc_status != STATUS_STOPPED) {
+		cc->cc_status = STATUS_STOPPED;
+		ondemand_update(cc);
+		send_status_update_notification(cc->cc_name, cc->cc_status);
+	}
+	so = stop_op_new(con, 0);
+	group_stop(cc, timeout, so);
+	stop_op_start(so);
+	return 1;
+}
+
+/*
+ * rolling restart handler: {"name": .., "batch": n or "n%", "min_uptime": n,
+ * "timeout": n}. Progress and the final reply are sent by roll_timer_cb().
+ */
+static int
+c_roll(struct client_con *con, char *buf)
+{
+	struct child_config	*cc;
+	struct roll		*r;
+	json_object		*obj,
+				*m;
+	const char		*s;
+	char			*end;
+	int			batch = 1,
+				min_uptime = ROLL_MIN_UPTIME_DEFAULT,
+				timeout = ROLL_TIMEOUT_DEFAULT;
+
+	if ((obj = json_tokener_parse(buf)) == NULL || is_error(obj)) {
+		send_status_msg(con, 0, "failure");
+		return 0;
+	}
+
+	if (!json_object_is_type(obj, json_type_object)) {
+		json_object_put(obj);
+		send_status_msg(con, 0, "failure");
+		return 0;
+	}
+
+	if ((m = json_object_object_get(obj, "name")) == NULL
+			|| !json_object_is_type(m, json_type_string)) {
+		json_object_put(obj);
+		send_status_msg(con, 0, "failure");
+		return 1;
+	}
+
+	if ((cc = child_config_find_by_name(json_object_get_string(m))) == NULL) {
+		json_object_put(obj);
+		send_status_msg(con, 0, "name not found");
+		return 1;
+	}
+
+	if ((m = json_object_object_get(obj, "batch")) != NULL) {
+		if (json_object_is_type(m, json_type_int)) {
+			batch = json_object_get_int(m);
+		} else if (json_object_is_type(m, json_type_string)) {
+			s = json_object_get_string(m);
+			batch = strtol(s, &end, 10);
+			if (end == s || (*end != '\0' && strcmp(end, "%") != 0)
+					|| batch > 100)
+				batch = 0;
+			else if (*end == '%')
+				batch = (cc->cc_instances * batch + 99) / 100;
+		} else {
+			batch = 0;
 		}
 	}
+	if ((m = json_object_object_get(obj, "min_uptime")) != NULL
+			&& json_object_is_type(m, json_type_int))
+		min_uptime = json_object_get_int(m);
+	if ((m = json_object_object_get(obj, "timeout")) != NULL
+			&& json_object_is_type(m, json_type_int))
+		timeout = json_object_get_int(m);
+	json_object_put(obj);
+
+	if (batch <= 0 || min_uptime < 0 || timeout < 0) {
+		send_status_msg(con, 0, "invalid batch, min_uptime or timeout.");
+		return 1;
+	}
+	if (draining) {
+		send_status_msg(con, 0, "server is stopping.");
+		return 1;
+	}
+	if (!group_wants_processes(cc) || cc->cc_instances < 1) {
+		send_status_msg(con, 0, "group is not running.");
+		return 1;
+	}
+	if (roll_find(cc) != NULL) {
+		send_status_msg(con, 0, "group is already rolling.");
+		return 1;
+	}
+
+	if (batch > cc->cc_instances)
+		batch = cc->cc_instances;
+	r = xmalloc(sizeof(struct roll));
+	memset(r, '\0', sizeof(struct roll));
+	r->r_child_config = cc;
+	r->r_con = con;
+	r->r_cid = con->c_cid;
+	r->r_batch = batch;
+	r->r_min_uptime = min_uptime;
+	r->r_timeout = timeout;
+	r->r_waves = (cc->cc_instances + batch - 1) / batch;
+	r->r_old = xmalloc(sizeof(pid_t) * batch);
+	evtimer_set(&r->r_timer, roll_timer_cb, r);
+	LIST_INSERT_HEAD(&rolls, r, r_ent);
+	slog("[roll] %s batch %d, %d waves\n", cc->cc_name, batch, r->r_waves);
+	roll_wave_start(r);
+	return 1;
+}
+
+/*
+ * wait command handler: {"name": .., "timeout": n}. Replies when all
+ * instances of the group are ready, see wait_timer_cb().
+ */
+static int
+c_wait(struct client_con *con, char *buf)
+{
+	struct child_config	*cc;
+	struct wait_op		*w;
+	json_object		*obj,
+				*m;
+	int			timeout = WAIT_TIMEOUT_DEFAULT;
+
+	if ((obj = json_tokener_parse(buf)) == NULL || is_error(obj)) {
+		send_status_msg(con, 0, "failure");
+		return 0;
+	}
 
-	if (cc->cc_status != -1 && cc->cc_status != up->cc_status) {
-		slog("[update] %s status %d -> %d\n", up->cc_name,
-				up->cc_status, cc->cc_status);
-		changed = 1;
-		up->cc_error = 0;
-		if (up->cc_status != STATUS_RUNNING
-				&& cc->cc_status == STATUS_RUNNING) {
-			for (i = 0; i < up->cc_instances; i++) {
-				if (process_find_instance(up, i) == NULL)
-					spawn(up, i);
-			}
-		}
-		up->cc_status = cc->cc_status;
-		send_status_update_notification(up->cc_name, up->cc_status);
+	if (!json_object_is_type(obj, json_type_object)) {
+		json_object_put(obj);
+		send_status_msg(con, 0, "failure");
+		return 0;
 	}
 
-	if (cc->cc_age > 0 && cc->cc_age != up->cc_age) {
-		slog("[update] %s age %d -> %d\n", up->cc_name,
-				up->cc_age, cc->cc_age);
-		changed = 1;
-		up->cc_age = cc->cc_age;
+	if ((m = json_object_object_get(obj, "name")) == NULL
+			|| !json_object_is_type(m, json_type_string)) {
+		json_object_put(obj);
+		send_status_msg(con, 0, "failure");
+		return 1;
 	}
 
-	child_config_free(cc);
+	if ((cc = child_config_find_by_name(json_object_get_string(m))) == NULL) {
+		json_object_put(obj);
+		send_status_msg(con, 0, "name not found");
+		return 1;
+	}
 
-	if (changed)
-		send_group_cfg_update_notification(up);
+	if ((m = json_object_object_get(obj, "timeout")) != NULL
+			&& json_object_is_type(m, json_type_int))
+		timeout = json_object_get_int(m);
+	json_object_put(obj);
 
-	if (!auto_dump)
-		send_status_msg(con, 1, "success");
-	else
-		c_dump(con, NULL);
+	w = xmalloc(sizeof(struct wait_op));
+	memset(w, '\0', sizeof(struct wait_op));
+	w->w_child_config = cc;
+	w->w_con = con;
+	w->w_cid = con->c_cid;
+	w->w_deadline = time(NULL) + timeout;
+	evtimer_set(&w->w_timer, wait_timer_cb, w);
+	LIST_INSERT_HEAD(&wait_ops, w, w_ent);
+	wait_timer_cb(0, 0, w);
 	return 1;
 }
 
 /*
- * exit command handler.
+ * stop all groups for EXIT {"stop": true}, the server exits when the
+ * processes exited.
+ */
+static void
+server_drain(struct client_con *con, int timeout)
+{
+	struct child_config	*cc;
+	struct stop_op		*so;
+
+	slog("[drain] stopping all groups.\n");
+	draining = 1;
+	so = stop_op_new(con, 1);
+	LIST_FOREACH (cc, &child_config_list_head, cc_ent) {
+		if (cc->cc_status != STATUS_STOPPED) {
+			cc->cc_status = STATUS_STOPPED;
+			ondemand_update(cc);
+			send_status_update_notification(cc->cc_name,
+					cc->cc_status);
+		}
+		roll_abort(cc, "server is stopping, roll aborted.");
+		group_stop(cc, timeout < 0 ? cc->cc_stop_timeout : timeout, so);
+	}
+	stop_op_start(so);
+}
+
+/*
+ * exit command handler. With {"stop": true} all processes are stopped
+ * first, "timeout" overrides stop_timeout of the groups.
  */
 static int
-c_exit(struct client_con *con, char *unused __attribute__((unused)))
+c_exit(struct client_con *con, char *buf)
 {
+	json_object		*obj = NULL,
+				*m;
+	const char		*err;
+	int			stop = 0,
+				timeout = -1;
+
 	if (!allow_exit) {
 		send_status_msg(con, 0, "prohibited");
 		return 1;
 	}
 
+	if (buf != NULL && buf[0] != '\0') {
+		if ((obj = json_tokener_parse(buf)) == NULL || is_error(obj)
+				|| !json_object_is_type(obj, json_type_object)) {
+			send_status_msg(con, 0, "failure");
+			if (obj != NULL && !is_error(obj))
+				json_object_put(obj);
+			return 0;
+		}
+		if ((m = json_object_object_get(obj, "stop")) != NULL)
+			stop = json_object_get_boolean(m);
+		if ((m = json_object_object_get(obj, "timeout")) != NULL
+				&& json_object_is_type(m, json_type_int))
+			timeout = json_object_get_int(m);
+		json_object_put(obj);
+	}
+
+	if (stop) {
+		/* the dump keeps the groups running for the next start */
+		if (auto_dump && (err = dump_write()) != NULL)
+			slog("dump %s\n", err);
+		server_drain(con, timeout);
+		return 1;
+	}
+
 	if (!auto_dump)
 		send_status_msg(con, 1, "exiting");
 	else
 		c_dump(con, NULL);
 	slog("server exiting due to exit command.\n");
+	clients_flush(NULL);
 	exit(0);
 	return 1;
 }
 
 /*
- * dump command handler.
+ * server upgrade: the UPGR command writes the state the new binary can't
+ * recover from the outside to UPGRADE_PATH and executes it with the same
+ * arguments. The server socket, client connections, listen sockets and the
+ * processes (children stay children across execve) are kept, the new image
+ * picks them up in handoff_load() and continues without restarting anything.
+ * UBERVISOR_UPGRADE holds the server socket.
+ */
+#define UPGRADE_FLUSH_MSEC	1000
+
+static json_object *
+handoff_process(const struct process *p)
+{
+	json_object		*o;
+
+	o = json_object_new_object();
+	json_object_object_add(o, "pid", json_object_new_int(p->p_pid));
+	json_object_object_add(o, "instance", json_object_new_int(p->p_instance));
+	json_object_object_add(o, "standby", json_object_new_int(p->p_standby));
+	json_object_object_add(o, "start", json_object_new_double(p->p_start));
+	json_object_object_add(o, "terminated",
+			json_object_new_int(p->p_terminated));
+	json_object_object_add(o, "adopted", json_object_new_int(p->p_adopted));
+	json_object_object_add(o, "ticks", json_object_new_double(p->p_ticks));
+	if (p->p_stopping)
+		json_object_object_add(o, "stop_until",
+				json_object_new_double(p->p_stop_until));
+	json_object_object_add(o, "ready", json_object_new_int(p->p_ready));
+	json_object_object_add(o, "reloading", json_object_new_int(p->p_reloading));
+	json_object_object_add(o, "watchdog", json_object_new_double(p->p_watchdog));
+	if (p->p_status != NULL)
+		json_object_object_add(o, "status_text",
+				json_object_new_string(p->p_status));
+	return o;
+}
+
+/*
+ * zygote of a group with its control socket and pending requests, NULL if
+ * there is none to hand over.
+ */
+static json_object *
+handoff_zygote(const struct zygote *z)
+{
+	json_object		*o,
+				*a;
+	struct zygote_req	*r;
+
+	if (z == NULL || z->z_pid == -1 || z->z_fd == -1)
+		return NULL;
+	o = json_object_new_object();
+	json_object_object_add(o, "pid", json_object_new_int(z->z_pid));
+	json_object_object_add(o, "fd", json_object_new_int(z->z_fd));
+	json_object_object_add(o, "ready", json_object_new_int(z->z_ready));
+	a = json_object_new_array();
+	LIST_FOREACH (r, &z->z_reqs, zr_ent)
+		json_object_array_add(a, json_object_new_int(r->zr_instance));
+	json_object_object_add(o, "requests", a);
+	return o;
+}
+
+/*
+ * runtime state of a group: listen sockets, zygote, processes, sessions,
+ * exit stats and crash history.
+ */
+static json_object *
+handoff_group(const struct child_config *cc)
+{
+	json_object		*h,
+				*a,
+				*o,
+				*t;
+	struct session		*s;
+	struct crash_ring	*cr;
+	int			i,
+				j;
+
+	h = json_object_new_object();
+	a = json_object_new_array();
+	for (i = 0; i < cc->cc_nlisten; i++)
+		json_object_array_add(a, json_object_new_int(cc->cc_listen_fds[i]));
+	json_object_object_add(h, "listen_fds", a);
+	if ((o = handoff_zygote(cc->cc_zyg)) != NULL)
+		json_object_object_add(h, "zygote", o);
+
+	a = json_object_new_array();
+	for (i = 0; i < cc->cc_instances; i++) {
+		if (cc->cc_childs[i] != NULL)
+			json_object_array_add(a, handoff_process(cc->cc_childs[i]));
+	}
+	for (i = 0; i < cc->cc_standby; i++) {
+		if (cc->cc_standbys[i] != NULL)
+			json_object_array_add(a, handoff_process(cc->cc_standbys[i]));
+	}
+	json_object_object_add(h, "processes", a);
+
+	a = json_object_new_array();
+	LIST_FOREACH (s, &sessions, s_ent) {
+		if (s->s_child_config != cc)
+			continue;
+		o = json_object_new_object();
+		json_object_object_add(o, "sid", json_object_new_int(s->s_sid));
+		json_object_object_add(o, "instance",
+				json_object_new_int(s->s_instance));
+		json_object_array_add(a, o);
+	}
+	json_object_object_add(h, "sessions", a);
+
+	json_object_object_add(h, "exit_stat", exit_stat_to_json(&cc->cc_exit_stat));
+	a = json_object_new_array();
+	for (i = 0; i < cc->cc_instances; i++)
+		json_object_array_add(a, exit_stat_to_json(&cc->cc_inst_stat[i]));
+	json_object_object_add(h, "instance_exit_stats", a);
+
+	if (cc->cc_crash_rings != NULL) {
+		a = json_object_new_array();
+		for (i = 0; i < cc->cc_instances; i++) {
+			cr = &cc->cc_crash_rings[i];
+			o = json_object_new_object();
+			t = json_object_new_array();
+			for (j = 0; j < CRASHLOOP_MAX; j++)
+				json_object_array_add(t,
+					json_object_new_double(cr->cr_times[j]));
+			json_object_object_add(o, "times", t);
+			json_object_object_add(o, "next", json_object_new_int(cr->cr_next));
+			json_object_object_add(o, "broken",
+					json_object_new_int(cr->cr_broken));
+			json_object_array_add(a, o);
+		}
+		json_object_object_add(h, "crash", a);
+	}
+	return h;
+}
+
+/*
+ * client connection with its partly read command and subscriptions. The
+ * reply to the UPGR command of con is sent by the new server.
+ */
+static json_object *
+handoff_client(struct client_con *c, struct client_con *con)
+{
+	json_object		*o,
+				*a,
+				*e;
+	struct subscription	*s;
+	struct evbuffer		*in = c->c_be->input;
+	char			*hex;
+	size_t			i;
+
+	o = json_object_new_object();
+	json_object_object_add(o, "fd", json_object_new_int(c->c_sock));
+	json_object_object_add(o, "len", json_object_new_int(c->c_len));
+	json_object_object_add(o, "cid", json_object_new_int(c == con ? 0 : c->c_cid));
+	if (c == con)
+		json_object_object_add(o, "reply", json_object_new_int(c->c_cid));
+
+	hex = xmalloc(EVBUFFER_LENGTH(in) * 2 + 1);
+	for (i = 0; i < EVBUFFER_LENGTH(in); i++)
+		snprintf(hex + i * 2, 3, "%02x", EVBUFFER_DATA(in)[i]);
+	hex[i * 2] = '\0';
+	json_object_object_add(o, "pending", json_object_new_string(hex));
+	free(hex);
+
+	a = json_object_new_array();
+	LIST_FOREACH (s, &subscription_list_head, s_ent) {
+		if (s->s_client != c)
+			continue;
+		e = json_object_new_object();
+		json_object_object_add(e, "ident", json_object_new_int(s->s_ident));
+		json_object_object_add(e, "cid", json_object_new_int(s->s_cid));
+		json_object_array_add(a, e);
+	}
+	json_object_object_add(o, "subs", a);
+	return o;
+}
+
+/*
+ * write groups (as DUMP does) with their runtime state and the client
+ * connections to fname. Returns 0 on failure.
  */
 static int
-c_dump(struct client_con *con, char *unused __attribute__((unused)))
+handoff_write(const char *fname, struct client_con *con)
+{
+	struct child_config	*cc;
+	struct client_con	*c;
+	json_object		*obj,
+				*a,
+				*g;
+	FILE			*fo;
+	char			tmp[PATH_MAX];
+	int			r;
+
+	obj = json_object_new_object();
+	a = json_object_new_array();
+	LIST_FOREACH (cc, &child_config_list_head, cc_ent) {
+		g = child_config_to_json(cc);
+		if (cc->cc_backoff_slots != NULL)
+			json_object_object_add(g, "backoff_state", backoff_to_json(cc));
+		json_object_object_add(g, "handoff", handoff_group(cc));
+		json_object_array_add(a, g);
+	}
+	json_object_object_add(obj, "groups", a);
+
+	a = json_object_new_array();
+	LIST_FOREACH (c, &client_con_list_head, c_ent)
+		json_object_array_add(a, handoff_client(c, con));
+	json_object_object_add(obj, "clients", a);
+	if (notify_fd != -1)
+		json_object_object_add(obj, "notify_fd", json_object_new_int(notify_fd));
+
+	snprintf(tmp, sizeof(tmp), "tmp.%s", fname);
+	if ((fo = fopen(tmp, "w")) == NULL) {
+		json_object_put(obj);
+		return 0;
+	}
+	r = fputs(json_object_to_json_string(obj), fo) != EOF;
+	r = fclose(fo) == 0 && r;
+	json_object_put(obj);
+	if (!r || rename(tmp, fname) == -1) {
+		unlink(tmp);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * write pending replies and notifications, the new server starts with empty
+ * buffers. Clients that don't take them are dropped, except con.
+ */
+static void
+clients_flush(struct client_con *con)
+{
+	struct client_con	*c,
+				*tmp;
+	struct evbuffer		*out;
+	struct pollfd		pfd;
+	size_t			off;
+	ssize_t			n;
+
+	LIST_FOREACH_SAFE (c, &client_con_list_head, c_ent, tmp) {
+		out = c->c_be->output;
+		/* the bufferevent keeps its output frozen, write around it.
+		 * The buffer is discarded by exec or exit anyway. */
+		off = 0;
+		while (off < EVBUFFER_LENGTH(out)) {
+			n = write(c->c_sock, EVBUFFER_DATA(out) + off,
+					EVBUFFER_LENGTH(out) - off);
+			if (n == -1 && errno != EAGAIN && errno != EINTR)
+				break;
+			if (n > 0)
+				off += n;
+			if (off == EVBUFFER_LENGTH(out))
+				break;
+			pfd.fd = c->c_sock;
+			pfd.events = POLLOUT;
+			if (poll(&pfd, 1, UPGRADE_FLUSH_MSEC) <= 0)
+				break;
+		}
+		if (off < EVBUFFER_LENGTH(out) && c != con) {
+			slog("dropping client, output not written.\n");
+			drop_client_connection(c);
+		}
+	}
+}
+
+/*
+ * let the descriptors handed over survive execve (inherit set) or not.
+ */
+static void
+handoff_fds(int inherit)
+{
+	struct client_con	*c;
+	struct child_config	*cc;
+	int			(*f)(int),
+				i;
+
+	f = inherit ? clearcloseonexec : setcloseonexec;
+	f(server_fd);
+	if (notify_fd != -1)
+		f(notify_fd);
+	LIST_FOREACH (c, &client_con_list_head, c_ent)
+		f(c->c_sock);
+	LIST_FOREACH (cc, &child_config_list_head, cc_ent) {
+		for (i = 0; i < cc->cc_nlisten; i++)
+			f(cc->cc_listen_fds[i]);
+		if (cc->cc_zyg != NULL && cc->cc_zyg->z_pid != -1
+				&& cc->cc_zyg->z_fd != -1)
+			f(cc->cc_zyg->z_fd);
+	}
+}
+
+/*
+ * execute the new server. Only returns if execv failed.
+ */
+static void
+server_exec(const char *exe)
+{
+	struct child_config	*cc;
+	char			fd_str[16];
+	int			saved;
+
+	handoff_fds(1);
+	snprintf(fd_str, sizeof(fd_str), "%d", server_fd);
+	setenv("UBERVISOR_UPGRADE", fd_str, 1);
+	if (log_fd != NULL)
+		fflush(log_fd);
+
+	/* zygotes that closed their socket are not handed over, they are
+	 * started again on demand */
+	LIST_FOREACH (cc, &child_config_list_head, cc_ent) {
+		if (cc->cc_zyg != NULL && cc->cc_zyg->z_pid != -1
+				&& cc->cc_zyg->z_fd == -1)
+			kill(cc->cc_zyg->z_pid, SIGTERM);
+	}
+	execv(exe, server_argv);
+
+	saved = errno;
+	unsetenv("UBERVISOR_UPGRADE");
+	handoff_fds(0);
+	errno = saved;
+}
+
+/*
+ * upgrade command handler. {"exec": PATH} executes PATH instead of the
+ * running binary.
+ */
+static int
+c_upgr(struct client_con *con, char *buf)
+{
+	json_object		*obj = NULL,
+				*m;
+	const char		*exe = server_exe;
+	static char		msg[PATH_MAX + 64];
+
+	if (buf != NULL && buf[0] != '\0') {
+		if ((obj = json_tokener_parse(buf)) == NULL || is_error(obj)
+				|| !json_object_is_type(obj, json_type_object)) {
+			send_status_msg(con, 0, "failure");
+			if (obj != NULL && !is_error(obj))
+				json_object_put(obj);
+			return 0;
+		}
+		if ((m = json_object_object_get(obj, "exec")) != NULL
+				&& json_object_is_type(m, json_type_string))
+			exe = json_object_get_string(m);
+	}
+
+	if (spawn_inflight > 0) {
+		send_status_msg(con, 0, "processes are starting, try again.");
+	} else if (!LIST_EMPTY(&stop_ops)) {
+		send_status_msg(con, 0, "processes are stopping, try again.");
+	} else if (!LIST_EMPTY(&rolls)) {
+		send_status_msg(con, 0, "rolling restart in progress, try again.");
+	} else if (!LIST_EMPTY(&wait_ops)) {
+		send_status_msg(con, 0, "clients wait for readiness, try again.");
+	} else if (access(exe, X_OK) == -1) {
+		snprintf(msg, sizeof(msg), "%s: %s", exe, strerror(errno));
+		send_status_msg(con, 0, msg);
+	} else {
+		clients_flush(con);
+		if (!handoff_write(UPGRADE_PATH, con)) {
+			snprintf(msg, sizeof(msg), "%s: %s", UPGRADE_PATH,
+					strerror(errno));
+			send_status_msg(con, 0, msg);
+		} else {
+			slog("[upgrade] executing %s\n", exe);
+			server_exec(exe);
+			snprintf(msg, sizeof(msg), "%s: %s", exe, strerror(errno));
+			slog("upgrade failed: %s\n", msg);
+			unlink(UPGRADE_PATH);
+			send_status_msg(con, 0, msg);
+		}
+	}
+	if (obj != NULL)
+		json_object_put(obj);
+	return 1;
+}
+
+/*
+ * write the groups to a new dump. Returns NULL or an error message.
+ */
+static const char *
+dump_write(void)
 {
 	static int		cnt = 0;
 	struct child_config	*i;
@@ -1179,6 +5906,7 @@ c_dump(struct client_con *con, char *unused __attribute__((unused)))
 	char			time_buf[64];
 	struct tm		*t;
 	time_t			tt;
+	json_object		*obj;
 
 	tt = time(NULL);
 	t = gmtime(&tt);
@@ -1188,55 +5916,57 @@ c_dump(struct client_con *con, char *unused __attribute__((unused)))
 
 	r = snprintf(fname, PATH_MAX, DUMP_PATH, cnt,
 			geteuid(), time_buf);
-	if (r < 0 || r >= PATH_MAX) {
-		send_status_msg(con, 0, "failure");
-		return 1;
-	}
+	if (r < 0 || r >= PATH_MAX)
+		return "failure";
 
 	r = snprintf(fname_tmp, PATH_MAX, "tmp." DUMP_PATH, cnt,
 			geteuid(), time_buf);
-	if (r < 0 || r >= PATH_MAX) {
-		send_status_msg(con, 0, "failure");
-		return 1;
-	}
+	if (r < 0 || r >= PATH_MAX)
+		return "failure";
 
-	if ((fo = fopen(fname_tmp, "w")) == NULL) {
-		send_status_msg(con, 0, "failure");
-		return 1;
-	}
+	if ((fo = fopen(fname_tmp, "w")) == NULL)
+		return "failure";
 
 	fprintf(fo, "[\n");
 	LIST_FOREACH (i, &child_config_list_head, cc_ent) {
-		if ((ptr = child_config_serialize(i)) == NULL) {
-			fclose(fo);
-			send_status_msg(con, 0, "failure");
-			return 1;
-		}
+		obj = child_config_to_json(i);
+		if (i->cc_backoff_slots != NULL)
+			json_object_object_add(obj, "backoff_state",
+					backoff_to_json(i));
+		ptr = xstrdup(json_object_to_json_string(obj));
+		json_object_put(obj);
 
 		if (fprintf(fo, "%s,\n", ptr) < 0) {
 			fclose(fo);
-			send_status_msg(con, 0, "failure");
 			free(ptr);
-			return 1;
+			return "failure";
 		}
 
 		free(ptr);
 	}
 
-	if (fprintf(fo, "]\n") < 0) {
-		fclose(fo);
-		send_status_msg(con, 0, "failure");
-	}
-
+	fprintf(fo, "]\n");
 	fclose(fo);
 
-	if (link(fname_tmp, fname) == -1) {
-		send_status_msg(con, 0, "failure.");
-		return 1;
-	}
+	if (link(fname_tmp, fname) == -1)
+		return "failure.";
 
 	unlink(fname_tmp);
-	send_status_msg(con, 1, "dump successful.");
+	return NULL;
+}
+
+/*
+ * dump command handler.
+ */
+static int
+c_dump(struct client_con *con, char *unused __attribute__((unused)))
+{
+	const char		*err;
+
+	if ((err = dump_write()) != NULL)
+		send_status_msg(con, 0, err);
+	else
+		send_status_msg(con, 1, "dump successful.");
 	return 1;
 }
 
@@ -1332,12 +6062,12 @@ c_kill(struct client_con *con, char *buf)
 
 	json_object_object_add(obj, "pids", m);
 
+	instance_kill(cc, idx, sig);
 	if (idx == -1) {
 		for (x = 0; x < cc->cc_instances; x++) {
 			i = cc->cc_childs[x];
 			if (i == NULL)
 				continue;
-			kill(i->p_pid, sig);
 			if ((p = json_object_new_int(i->p_pid)) == NULL)
 				return 1;
 			json_object_array_add(m, p);
@@ -1346,7 +6076,6 @@ c_kill(struct client_con *con, char *buf)
 		if (idx >= 0 && idx < cc->cc_instances) {
 			i = cc->cc_childs[idx];
 			if (i != NULL) {
-				kill(i->p_pid, sig);
 				if ((p = json_object_new_int(i->p_pid)) == NULL)
 					return 1;
 				json_object_array_add(m, p);
@@ -1375,6 +6104,7 @@ c_dele(struct client_con *con, char *buf)
 
 	struct child_config	*cc;
 	struct process		*i;
+	struct stop_op		*so = NULL;
 
 	json_object		*obj,
 				*c,
@@ -1427,6 +6157,8 @@ c_dele(struct client_con *con, char *buf)
 
 	child_config_remove(cc);
 	slog("[dele] %s\n", cc->cc_name);
+	roll_abort(cc, "group deleted, roll aborted.");
+	wait_abort(cc);
 
 	/* construct reply */
 	if ((obj = json_object_new_object()) == NULL)
@@ -1442,10 +6174,24 @@ c_dele(struct client_con *con, char *buf)
 
 	json_object_object_add(obj, "pids", m);
 
+	/* the cgroup is removed when the processes in it exited */
+	if (cc->cc_cgroup_fd != -1) {
+		so = stop_op_new(NULL, 0);
+		so->so_cgroup_fd = cc->cc_cgroup_fd;
+		so->so_cgroup = xstrdup(cc->cc_name);
+		cc->cc_cgroup_fd = -1;
+		for (x = 0; x < cc->cc_standby; x++) {
+			if (cc->cc_standbys[x] != NULL)
+				process_stop(cc->cc_standbys[x], SIGKILL, 0, so);
+		}
+	}
+
+	session_kill(cc, -1, cc->cc_killsig);
 	for (x = 0; x < cc->cc_instances; x++) {
 		i = cc->cc_childs[x];
 		if (i == NULL)
 			continue;
+		process_stop(i, cc->cc_killsig, cc->cc_stop_timeout, so);
 		i->p_child_config = NULL;
 		if ((p = json_object_new_int(i->p_pid)) == NULL)
 			return 1;
@@ -1453,6 +6199,16 @@ c_dele(struct client_con *con, char *buf)
 	}
 
 	send_status_update_notification(cc->cc_name, STATUS_DELETE);
+	spawn_queue_drop(cc);
+	helper_forget(cc);
+	cred_forget(cc);
+	backoff_drop(cc, 0, 0);
+	standby_kill(cc, 0);
+	session_drop(cc);
+	zygote_free(cc);
+	ondemand_free(cc);
+	if (so != NULL)
+		stop_op_start(so);
 	child_config_free(cc);
 
 	ret = xstrdup(json_object_to_json_string(obj));
@@ -1463,6 +6219,31 @@ c_dele(struct client_con *con, char *buf)
 	return 1;
 }
 
+/*
+ * cpu affinity of each instance of a group as cpu list, null for instances
+ * without process.
+ */
+static json_object *
+cpus_effective(struct child_config *cc)
+{
+	json_object		*arr;
+	struct cpu_mask		m;
+	char			buf[256];
+	int			i;
+
+	arr = json_object_new_array();
+	for (i = 0; i < cc->cc_instances; i++) {
+		if (cc->cc_childs[i] == NULL
+				|| cpu_mask_get(cc->cc_childs[i]->p_pid, &m) == -1) {
+			json_object_array_add(arr, NULL);
+			continue;
+		}
+		cpu_mask_format(&m, buf, sizeof(buf));
+		json_object_array_add(arr, json_object_new_string(buf));
+	}
+	return arr;
+}
+
 /*
  * get command handler.
  */
@@ -1473,11 +6254,14 @@ c_getc(struct client_con *con, char *buf)
 	const char		*n;
 
 	ssize_t			ret_len;
+	int			i,
+				ready;
 
 	struct child_config	*cc;
 
 	json_object		*obj,
-				*m;
+				*m,
+				*a;
 
 
 	if ((obj = json_tokener_parse(buf)) == NULL) {
@@ -1522,7 +6306,33 @@ c_getc(struct client_con *con, char *buf)
 		return 1;
 	}
 
-	ret = child_config_serialize(cc);
+	obj = child_config_to_json(cc);
+	if (cc->cc_cpu_policy != NULL)
+		json_object_object_add(obj, "cpus_effective", cpus_effective(cc));
+	if (cc->cc_cgroup_fd != -1)
+		json_object_object_add(obj, "cgroup_stats", cgroup_group_stats(cc->cc_cgroup_fd));
+	json_object_object_add(obj, "exit_stats", exit_stat_to_json(&cc->cc_exit_stat));
+	a = json_object_new_array();
+	for (i = 0; i < cc->cc_instances; i++)
+		json_object_array_add(a, exit_stat_to_json(&cc->cc_inst_stat[i]));
+	json_object_object_add(obj, "instance_exit_stats", a);
+	if (cc->cc_backoff_slots != NULL)
+		json_object_object_add(obj, "backoff_state", backoff_to_json(cc));
+	if (cc->cc_crash_rings != NULL)
+		json_object_object_add(obj, "broken_instances", broken_instances(cc));
+	for (i = 0, ready = 0; i < cc->cc_instances; i++) {
+		if (cc->cc_childs[i] != NULL && process_ready(cc->cc_childs[i]))
+			ready++;
+	}
+	json_object_object_add(obj, "ready", json_object_new_int(ready));
+	/* ids processes are started with */
+	json_object_object_add(obj, "cred_uid", json_object_new_int(cc->cc_cred_uid));
+	json_object_object_add(obj, "cred_gid", json_object_new_int(cc->cc_cred_gid));
+	if (cc->cc_cred_errfunc != NULL)
+		json_object_object_add(obj, "cred_error",
+				json_object_new_string(cc->cc_cred_errfunc));
+	ret = xstrdup(json_object_to_json_string(obj));
+	json_object_put(obj);
 	ret_len = strlen(ret);
 	send_message(con, ret, ret_len);
 	free(ret);
@@ -1668,6 +6478,27 @@ c_pids(struct client_con *con, char *buf)
 		json_object_array_add(m, p);
 	}
 
+	if ((m = json_object_new_array()) == NULL)
+		return 1;
+
+	json_object_object_add(obj, "standby", m);
+
+	for (x = 0; x < cc->cc_standby; x++) {
+		i = cc->cc_standbys[x];
+		if (i == NULL)
+			continue;
+		if ((p = json_object_new_int(i->p_pid)) == NULL)
+			return 1;
+		json_object_array_add(m, p);
+	}
+
+	m = json_object_new_array();
+	json_object_object_add(obj, "processes", m);
+	for (x = 0; x < cc->cc_instances; x++) {
+		if ((i = cc->cc_childs[x]) != NULL)
+			json_object_array_add(m, process_to_json(i));
+	}
+
 	ret = xstrdup(json_object_to_json_string(obj));
 	ret_len = strlen(ret);
 	json_object_put(obj);
@@ -1732,7 +6563,8 @@ c_read(struct client_con *con, char *buf)
 				fd,
 				r;
 
-	char			instance_str[5];
+	struct template_vars	tv;
+	struct template		*tpl = NULL;
 
 	const char		*n;
 	char			*fn = NULL,
@@ -1853,21 +6685,18 @@ c_read(struct client_con *con, char *buf)
 		return 1;
 	}
 
-	snprintf(instance_str, sizeof(instance_str), "%d", instance);
-	if (stream == 1) {
-		if (cc->cc_stdout)
-			fn = xstrdup(cc->cc_stdout);
-	} else if (stream == 2) {
-		if (cc->cc_stderr)
-			fn = xstrdup(cc->cc_stderr);
-	}
+	if (stream == 1)
+		tpl = cc->cc_tpl_stdout;
+	else if (stream == 2)
+		tpl = cc->cc_tpl_stderr;
 
-	if (!fn) {
+	if (!tpl) {
 		send_status_msg(con, 0, "stream is not logged.");
 		return 1;
 	}
 
-	replace_str(fn, "%(NUM)", instance_str);
+	template_vars_init(&tv, cc->cc_name, instance, cc->cc_port);
+	fn = template_expand_dup(tpl, &tv);
 
 	/* file may not exist. when starting a new group and reading
 	 * immediately, the file may not be there, yet.
@@ -1917,6 +6746,52 @@ c_read(struct client_con *con, char *buf)
 	return 1;
 }
 
+/*
+ * spawn queue statistics. Wait times are in milliseconds.
+ */
+static int
+c_stat(struct client_con *con, char *unused __attribute__((unused)))
+{
+	const char		*ret;
+	ssize_t			ret_len;
+	json_object		*obj;
+	struct spawn_entry	*se;
+	long long		oldest = 0;
+
+	if ((se = TAILQ_FIRST(&spawn_queue_head)) != NULL) {
+		/* the head is not necessarily the oldest entry */
+		oldest = se->se_queued;
+		TAILQ_FOREACH (se, &spawn_queue_head, se_ent) {
+			if (se->se_queued < oldest)
+				oldest = se->se_queued;
+		}
+		oldest = monotonic_msec() - oldest;
+	}
+
+	obj = json_object_new_object();
+
+#define ADDSTAT(X, Y)	json_object_object_add(obj, X, json_object_new_int(Y))
+
+	ADDSTAT("queued", spawn_queue_len);
+	ADDSTAT("inflight", spawn_inflight);
+	ADDSTAT("rate", spawn_rate);
+	ADDSTAT("max_inflight", spawn_max_inflight);
+	ADDSTAT("spawned", spawn_total);
+	ADDSTAT("wait_oldest", oldest);
+	ADDSTAT("wait_avg", spawn_total ? spawn_wait_total / spawn_total : 0);
+	ADDSTAT("wait_max", spawn_wait_max);
+
+	json_object_object_add(obj, "fork_exec", hist_to_json(&hist_fork_exec));
+	json_object_object_add(obj, "setids", hist_to_json(&hist_setids));
+	json_object_object_add(obj, "logopen", hist_to_json(&hist_logopen));
+
+	ret = json_object_to_json_string(obj);
+	ret_len = strlen(ret);
+	send_message(con, ret, ret_len);
+	json_object_put(obj);
+	return 1;
+}
+
 /*
  * find command to run.
  */
@@ -2047,23 +6922,13 @@ error_cb(struct bufferevent *b __attribute__((unused)),
 }
 
 /*
- * accept connection from socket and hand it over to libevent.
- */
-static void
-accept_cb(int fd, short evtype, void *unused __attribute__((unused)))
-{
-	int			s;
-	struct client_con	*c;
-
-
-	if ((evtype & EV_READ) == 0)
-		return;
-
-	if ((s = accept(fd, NULL, 0)) == -1) {
-		if (errno != EWOULDBLOCK && errno != EAGAIN)
-			slog("Failed to accept a connection.\n");
-		return;
-	}
+ * hand a client connection over to libevent. Returns NULL on failure, s is
+ * closed then.
+ */
+static struct client_con *
+client_con_new(int s)
+{
+	struct client_con	*c;
 
 	setcloseonexec(s);
 	setnonblock(s);
@@ -2076,7 +6941,7 @@ accept_cb(int fd, short evtype, void *unused __attribute__((unused)))
 		free(c);
 		slog("bufferevent_new failed.\n");
 		close(s);
-		return;
+		return NULL;
 	}
 
 #if 0
@@ -2085,7 +6950,7 @@ accept_cb(int fd, short evtype, void *unused __attribute__((unused)))
 		free(c);
 		slog("bufferevent_base_set failed.\n");
 		close(s);
-		return;
+		return NULL;
 	}
 #endif
 
@@ -2094,50 +6959,254 @@ accept_cb(int fd, short evtype, void *unused __attribute__((unused)))
 		free(c);
 		slog("bufferevent_enable failed.\n");
 		close(s);
-		return;
+		return NULL;
 	}
 
 	bufferevent_setwatermark(c->c_be, EV_READ, 4, CHUNKSIZ);
 	LIST_INSERT_HEAD(&client_con_list_head, c, c_ent);
+	return c;
 }
 
 /*
- * Read dump (as created by the DUMP command) and restore process groups.
+ * accept connection from socket and hand it over to libevent.
  */
-static int
-load_dump(char *fname)
+static void
+accept_cb(int fd, short evtype, void *unused __attribute__((unused)))
 {
-	char			*buf;
-	int			buf_siz,
-				i,
-				j,
-				len;
-	FILE			*f;
+	int			s;
 
-	struct child_config	*cc;
+	if ((evtype & EV_READ) == 0)
+		return;
 
-	json_object		*obj,
-				*t;
+	if ((s = accept(fd, NULL, 0)) == -1) {
+		if (errno != EWOULDBLOCK && errno != EAGAIN)
+			slog("Failed to accept a connection.\n");
+		return;
+	}
+
+	client_con_new(s);
+}
+
+/*
+ * read and parse a json file. An empty file is an empty array. Returns NULL
+ * on failure.
+ */
+static json_object *
+json_file_read(const char *fname)
+{
+	char			*buf;
+	int			buf_siz;
+	FILE			*f;
+	json_object		*obj;
 
 	if ((f = fopen(fname, "r")) == NULL)
-		return 0;
+		return NULL;
 
 	fseek(f, 0, SEEK_END);
 	buf_siz = ftell(f);
 	fseek(f, 0, SEEK_SET);
 	if (buf_siz == 0) {
 		fclose(f);
-		return 1;
+		return json_object_new_array();
 	}
 	buf = xmalloc(buf_siz + 1);
 	if (fread(buf, buf_siz, 1, f) != 1)
 		die("fread");
 	buf[buf_siz] = '\0';
+	fclose(f);
+
+	obj = json_tokener_parse(buf);
+	free(buf);
+	if (obj == NULL || is_error(obj))
+		return NULL;
+	return obj;
+}
+
+/*
+ * listen sockets of a group handed over by the previous server.
+ */
+static const char *
+listen_inherit(struct child_config *cc, json_object *h)
+{
+	json_object		*a;
+	int			n,
+				i;
+
+	if (cc->cc_listen == NULL)
+		return NULL;
+	for (n = 0; cc->cc_listen[n] != NULL; n++)
+		;
+	a = json_object_object_get(h, "listen_fds");
+	if (a == NULL || !json_object_is_type(a, json_type_array)
+			|| (int) json_object_array_length(a) != n)
+		return "listen sockets not handed over.";
+
+	cc->cc_listen_fds = xmalloc(sizeof(int) * (n > 0 ? n : 1));
+	for (i = 0; i < n; i++) {
+		cc->cc_listen_fds[i] = json_object_get_int(json_object_array_get_idx(a, i));
+		setcloseonexec(cc->cc_listen_fds[i]);
+	}
+	cc->cc_nlisten = n;
+	return NULL;
+}
+
+/*
+ * zygote of a group handed over by the previous server, see
+ * handoff_zygote().
+ */
+static void
+zygote_inherit(struct child_config *cc, json_object *o)
+{
+	struct zygote		*z;
+	struct zygote_req	*r;
+	json_object		*a;
+	int			i,
+				len;
+
+	if (o == NULL || !json_object_is_type(o, json_type_object))
+		return;
+	z = xmalloc(sizeof(struct zygote));
+	memset(z, '\0', sizeof(struct zygote));
+	z->z_pid = json_object_get_int(json_object_object_get(o, "pid"));
+	z->z_fd = json_object_get_int(json_object_object_get(o, "fd"));
+	z->z_ready = json_object_get_int(json_object_object_get(o, "ready"));
+	z->z_child_config = cc;
+	LIST_INIT(&z->z_reqs);
+	cc->cc_zyg = z;
+	setcloseonexec(z->z_fd);
+
+	a = json_object_object_get(o, "requests");
+	len = a != NULL && json_object_is_type(a, json_type_array)
+		? json_object_array_length(a) : 0;
+	for (i = 0; i < len; i++) {
+		r = xmalloc(sizeof(struct zygote_req));
+		r->zr_instance = json_object_get_int(json_object_array_get_idx(a, i));
+		LIST_INSERT_HEAD(&z->z_reqs, r, zr_ent);
+	}
+
+	event_set(&z->z_ev, z->z_fd, EV_READ | EV_PERSIST, zygote_read_cb, z);
+	event_add(&z->z_ev, NULL);
+	slog("[zygote_adopt] %s pid: %d\n", cc->cc_name, z->z_pid);
+
+	/* a zygote not meant to run any more is stopped as usual */
+	if (cc->cc_zygote != 1 || cc->cc_status == STATUS_BROKEN)
+		zygote_free(cc);
+}
+
+/*
+ * take over zygote, processes, sessions, exit stats and crash history of a
+ * group from the previous server.
+ */
+static void
+handoff_adopt(struct child_config *cc, json_object *h)
+{
+	json_object		*a,
+				*e,
+				*t;
+	struct process		*p;
+	struct crash_ring	*cr;
+	time_t			until;
+	int			i,
+				j,
+				len,
+				inst,
+				standby;
+
+	zygote_inherit(cc, json_object_object_get(h, "zygote"));
+
+	a = json_object_object_get(h, "processes");
+	len = a != NULL && json_object_is_type(a, json_type_array)
+		? json_object_array_length(a) : 0;
+	for (i = 0; i < len; i++) {
+		e = json_object_array_get_idx(a, i);
+		inst = json_object_get_int(json_object_object_get(e, "instance"));
+		standby = json_object_get_int(json_object_object_get(e, "standby"));
+		if (inst < 0 || (standby ? inst >= cc->cc_standby
+				|| cc->cc_standbys[inst] != NULL
+				: inst >= cc->cc_instances
+				|| cc->cc_childs[inst] != NULL))
+			continue;
+		p = process_new(cc, inst, standby,
+				json_object_get_int(json_object_object_get(e, "pid")));
+		p->p_terminated = json_object_get_int(json_object_object_get(e,
+				"terminated"));
+		p->p_adopted = json_object_get_int(json_object_object_get(e,
+				"adopted"));
+		p->p_ticks = json_object_get_double(json_object_object_get(e,
+				"ticks"));
+		process_set_start(p, json_object_get_double(json_object_object_get(e,
+				"start")));
+		p->p_ready = json_object_get_int(json_object_object_get(e,
+				"ready"));
+		p->p_reloading = json_object_get_int(json_object_object_get(e,
+				"reloading"));
+		p->p_watchdog = json_object_get_double(json_object_object_get(e,
+				"watchdog"));
+		if ((t = json_object_object_get(e, "status_text")) != NULL)
+			p->p_status = xstrdup(json_object_get_string(t));
+		if ((t = json_object_object_get(e, "stop_until")) != NULL) {
+			until = json_object_get_double(t);
+			process_stop(p, 0, until > time(NULL) ? until - time(NULL) : 0,
+					NULL);
+		}
+	}
+
+	a = json_object_object_get(h, "sessions");
+	len = a != NULL && json_object_is_type(a, json_type_array)
+		? json_object_array_length(a) : 0;
+	for (i = 0; i < len; i++) {
+		e = json_object_array_get_idx(a, i);
+		session_add(cc, json_object_get_int(json_object_object_get(e,
+				"instance")), json_object_get_int(
+				json_object_object_get(e, "sid")));
+	}
+
+	exit_stat_load(&cc->cc_exit_stat, json_object_object_get(h, "exit_stat"));
+	a = json_object_object_get(h, "instance_exit_stats");
+	len = a != NULL && json_object_is_type(a, json_type_array)
+		? json_object_array_length(a) : 0;
+	for (i = 0; i < len && i < cc->cc_instances; i++)
+		exit_stat_load(&cc->cc_inst_stat[i], json_object_array_get_idx(a, i));
+
+	a = json_object_object_get(h, "crash");
+	len = a != NULL && json_object_is_type(a, json_type_array)
+		? json_object_array_length(a) : 0;
+	for (i = 0; cc->cc_crash_rings != NULL && i < len
+			&& i < cc->cc_instances; i++) {
+		e = json_object_array_get_idx(a, i);
+		cr = &cc->cc_crash_rings[i];
+		if ((t = json_object_object_get(e, "times")) != NULL
+				&& json_object_is_type(t, json_type_array)) {
+			for (j = 0; j < CRASHLOOP_MAX
+					&& j < (int) json_object_array_length(t); j++)
+				cr->cr_times[j] = json_object_get_double(
+						json_object_array_get_idx(t, j));
+		}
+		cr->cr_next = json_object_get_int(json_object_object_get(e,
+				"next")) % CRASHLOOP_MAX;
+		cr->cr_broken = json_object_get_int(json_object_object_get(e,
+				"broken"));
+	}
+}
+
+/*
+ * restore process groups from an array as created by the DUMP command.
+ * Groups with a "handoff" object (see c_upgr()) continue with the sockets
+ * and processes of the previous server.
+ */
+static int
+load_groups(json_object *obj)
+{
+	int			i,
+				j,
+				len;
+	const char		*err;
+
+	struct child_config	*cc;
+
+	json_object		*t,
+				*h;
 
-	if ((obj = json_tokener_parse(buf)) == NULL)
-		return 0;
-	if (is_error(obj))
-		return 0;
 	if (!json_object_is_type(obj, json_type_array))
 		return 0;
 
@@ -2159,16 +7228,187 @@ load_dump(char *fname)
 			cc->cc_instances = 1;
 		if (cc->cc_status == -1)
 			cc->cc_status = STATUS_RUNNING;
+		if (cc->cc_priority == -1)
+			cc->cc_priority = 0;
+		if (cc->cc_standby == -1)
+			cc->cc_standby = 0;
+		if (cc->cc_stop_timeout == -1)
+			cc->cc_stop_timeout = STOP_TIMEOUT_DEFAULT;
+		if (cc->cc_zygote == 1 && !subreaper_set()) {
+			slog("zygote not supported. setting broken on %s\n",
+					cc->cc_name);
+			cc->cc_status = STATUS_BROKEN;
+		}
+		h = json_object_object_get(t, "handoff");
+		if ((err = h != NULL ? listen_inherit(cc, h) : listen_open(cc)) != NULL) {
+			slog("%s. setting broken on %s\n", err, cc->cc_name);
+			cc->cc_status = STATUS_BROKEN;
+		} else if (cc->cc_cpus != NULL && (cc->cc_cpu_policy =
+					cpu_policy_new(cc->cc_cpus, &err)) == NULL) {
+			slog("cpus: %s setting broken on %s\n", err, cc->cc_name);
+			cc->cc_status = STATUS_BROKEN;
+		} else if ((err = resources_set(cc)) != NULL) {
+			slog("%s setting broken on %s\n", err, cc->cc_name);
+			cc->cc_status = STATUS_BROKEN;
+		} else if ((err = cgroup_set(cc)) != NULL) {
+			slog("cgroup: %s setting broken on %s\n", err, cc->cc_name);
+			cc->cc_status = STATUS_BROKEN;
+		} else if ((err = backoff_set(cc)) != NULL) {
+			slog("%s setting broken on %s\n", err, cc->cc_name);
+			cc->cc_status = STATUS_BROKEN;
+		} else if ((err = crashloop_set(cc)) != NULL) {
+			slog("%s setting broken on %s\n", err, cc->cc_name);
+			cc->cc_status = STATUS_BROKEN;
+		} else if (cc->cc_ondemand > 0 && cc->cc_listen == NULL) {
+			slog("ondemand requires listen. setting broken on %s\n",
+					cc->cc_name);
+			cc->cc_status = STATUS_BROKEN;
+		}
 		cc->cc_childs = xmalloc(sizeof(struct process *) * cc->cc_instances);
 		memset(cc->cc_childs, '\0', sizeof(struct process *) * cc->cc_instances);
+		cc->cc_inst_stat = xmalloc(sizeof(struct exit_stat) * cc->cc_instances);
+		memset(cc->cc_inst_stat, '\0', sizeof(struct exit_stat) * cc->cc_instances);
+		cred_resolve(cc);
+		child_config_compile(cc);
+		if (cc->cc_standby > 0) {
+			cc->cc_standbys = xmalloc(sizeof(struct process *) * cc->cc_standby);
+			memset(cc->cc_standbys, '\0', sizeof(struct process *) * cc->cc_standby);
+		}
 		child_config_insert(cc);
-		if (cc->cc_status == STATUS_RUNNING) {
-			for (j = 0; j < cc->cc_instances; j++)
-				spawn(cc, j);
+		backoff_load(cc, json_object_object_get(t, "backoff_state"));
+		if (h != NULL)
+			handoff_adopt(cc, h);
+		instances_adopt(cc);
+		ondemand_init(cc);
+		if (group_wants_processes(cc)) {
+			for (j = 0; j < cc->cc_instances; j++) {
+				if (cc->cc_childs[j] == NULL && !backoff_pending(cc, j))
+					spawn_queue_add(cc, j);
+			}
 		}
+		standby_queue_missing(cc);
 	}
+	spawn_queue_run();
+	return 1;
+}
+
+/*
+ * Read dump (as created by the DUMP command) and restore process groups.
+ */
+static int
+load_dump(char *fname)
+{
+	json_object		*obj;
+	int			r;
+
+	if ((obj = json_file_read(fname)) == NULL)
+		return 0;
+	r = load_groups(obj);
 	json_object_put(obj);
-	fclose(f);
+	return r;
+}
+
+/*
+ * restore a client connection of the previous server. Returns NULL if it
+ * can't be used.
+ */
+static struct client_con *
+handoff_client_load(json_object *e)
+{
+	struct client_con	*c;
+	struct subscription	*subs;
+	json_object		*a,
+				*v;
+	const char		*hex;
+	unsigned int		x;
+	unsigned char		byte;
+	int			i,
+				len;
+
+	if ((c = client_con_new(json_object_get_int(json_object_object_get(e,
+			"fd")))) == NULL)
+		return NULL;
+	c->c_len = json_object_get_int(json_object_object_get(e, "len"));
+	c->c_cid = json_object_get_int(json_object_object_get(e, "cid"));
+	if (c->c_len > 0)
+		bufferevent_setwatermark(c->c_be, EV_READ, c->c_cid == 0
+				? sizeof(uint16_t) : c->c_len, CHUNKSIZ);
+
+	if ((v = json_object_object_get(e, "pending")) != NULL
+			&& (hex = json_object_get_string(v)) != NULL) {
+		for (; hex[0] != '\0' && hex[1] != '\0'; hex += 2) {
+			if (sscanf(hex, "%2x", &x) != 1)
+				break;
+			byte = x;
+			evbuffer_add(c->c_be->input, &byte, 1);
+		}
+	}
+
+	a = json_object_object_get(e, "subs");
+	len = a != NULL && json_object_is_type(a, json_type_array)
+		? json_object_array_length(a) : 0;
+	for (i = 0; i < len; i++) {
+		v = json_object_array_get_idx(a, i);
+		subs = xmalloc(sizeof(struct subscription));
+		subs->s_client = c;
+		subs->s_ident = json_object_get_int(json_object_object_get(v,
+				"ident"));
+		subs->s_cid = json_object_get_int(json_object_object_get(v, "cid"));
+		subscription_insert(&subscription_list_head, subs);
+	}
+	return c;
+}
+
+/*
+ * continue where the previous server stopped, see c_upgr(). The UPGR
+ * command is answered now.
+ */
+static int
+handoff_load(const char *fname)
+{
+	json_object		*obj,
+				*a,
+				*e,
+				*v;
+	struct client_con	*c,
+				*tmp;
+	uint16_t		cid;
+	int			i,
+				len;
+
+	if ((obj = json_file_read(fname)) == NULL)
+		return 0;
+	if ((v = json_object_object_get(obj, "notify_fd")) != NULL)
+		notify_fd = json_object_get_int(v);
+	notify_start();
+	if (!json_object_is_type(obj, json_type_object)
+			|| (a = json_object_object_get(obj, "groups")) == NULL
+			|| !load_groups(a)) {
+		json_object_put(obj);
+		return 0;
+	}
+
+	a = json_object_object_get(obj, "clients");
+	len = a != NULL && json_object_is_type(a, json_type_array)
+		? json_object_array_length(a) : 0;
+	for (i = 0; i < len; i++) {
+		e = json_object_array_get_idx(a, i);
+		if ((c = handoff_client_load(e)) == NULL)
+			continue;
+		if ((v = json_object_object_get(e, "reply")) != NULL) {
+			cid = c->c_cid;
+			c->c_cid = json_object_get_int(v);
+			send_status_msg(c, 1, "upgraded.");
+			c->c_cid = cid;
+		}
+	}
+	json_object_put(obj);
+
+	/* commands sent after UPGR */
+	LIST_FOREACH_SAFE (c, &client_con_list_head, c_ent, tmp) {
+		if (EVBUFFER_LENGTH(c->c_be->input) > 0)
+			read_cb(c->c_be, c);
+	}
 	return 1;
 }
 
@@ -2216,6 +7456,58 @@ load_newest_dump(const char *dump_file) {
 	closedir(dh);
 }
 
+/*
+ * create the server socket. Returns -1 on failure.
+ */
+static int
+server_listen(const char *sock_path_ptr, mode_t numask)
+{
+	struct sockaddr_un	addr;
+	struct stat		st;
+	socklen_t		addr_len;
+	char			tmp[PATH_MAX];
+	int			fd;
+	mode_t			oumask;
+
+	if (stat(sock_path_ptr, &st) != -1) {
+		if (!S_ISSOCK(st.st_mode)) {
+			fprintf(stderr, "Refusing to delete non-socket \"%s\"\n", sock_path_ptr);
+			return -1;
+		}
+		if (unlink(sock_path_ptr) == -1) {
+			snprintf(tmp, sizeof(tmp), "Can't delete existing socket \"%s\"", sock_path_ptr);
+			die(tmp);
+		}
+	}
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+		die("socket");
+	setcloseonexec(fd);
+
+	if (strlen(sock_path_ptr) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "socket path too long\n");
+		return -1;
+	}
+
+	memset(&addr, '\0', sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, sock_path_ptr);
+	addr_len = sizeof(addr);
+
+
+	oumask = umask(numask);
+
+	if (bind(fd, (struct sockaddr *) &addr, addr_len) == -1)
+		die("bind");
+
+	umask(oumask);
+
+	listen(fd, SERVER_LISTEN_BACKLOG);
+	printf("socket: %s\n", sock_path_ptr);
+
+	return fd;
+}
+
 /*
  * server main function.
  */
@@ -2223,25 +7515,27 @@ int
 cmd_server(int argc, char **argv)
 {
 	struct event		ev, se, se1;
-	struct sockaddr_un	addr;
 	struct passwd		*pw;
 	struct stat		st;
-	socklen_t		addr_len;
 	char			tmp[PATH_MAX],
 				*dump_file = NULL,
 				*sock_path_ptr,
-				*dir = NULL;
+				*dir = NULL,
+				*cgroup_dir = NULL;
+	const char		*state_file = STATE_PATH;
 	int			fd,
 				do_fork = 1,
 				silent = 0,
 				load_latest = 0,
+				upgrade = 0,
 				ch,
+				i,
 				r;
+	ssize_t			len;
 	pid_t			pid;
 	struct sigaction	sa;
 	FILE			*tmp_fd;
-	mode_t			oumask,
-				numask = 0777 - (S_IRUSR | S_IWUSR);
+	mode_t			numask = 0777 - (S_IRUSR | S_IWUSR);
 
 
 	if ((pw = getpwuid(geteuid())) == NULL)
@@ -2257,8 +7551,14 @@ cmd_server(int argc, char **argv)
 	allow_exit = 1;
 	server_logfile = NULL;
 	log_fd = stdout;
+	spawn_method = spawn_method_from_string(SPAWN_DEFAULT);
+	spawn_rate = SPAWN_RATE_DEFAULT;
+	spawn_max_inflight = SPAWN_MAX_INFLIGHT_DEFAULT;
+	TAILQ_INIT(&spawn_queue_head);
 	LIST_INIT(&child_config_list_head);
 	LIST_INIT(&client_con_list_head);
+	LIST_INIT(&sessions);
+	LIST_INIT(&stop_ops);
 	process_hash = uvhash_new(HASH_BSIZE_PROCESS);
 	child_config_hash = uvstrhash_new(HASH_BSIZE_CHILD_CONFIG);
 
@@ -2266,6 +7566,9 @@ cmd_server(int argc, char **argv)
 	dump_file = getenv("UBERVISOR_CONFIG");
 	server_logfile = getenv("UBERVISOR_LOGFILE");
 	dir = getenv("UBERVISOR_DIR");
+	cgroup_dir = getenv("UBERVISOR_CGROUP");
+	if (getenv("UBERVISOR_STATE") != NULL)
+		state_file = getenv("UBERVISOR_STATE");
 	if (getenv("UBERVISOR_PERM") != NULL)
 		numask = 0777 - strtol(getenv("UBERVISOR_PERM"), NULL, 8);
 	if (getenv("UBERVISOR_AUTODUMP") != NULL)
@@ -2278,6 +7581,37 @@ cmd_server(int argc, char **argv)
 		silent = strtol(getenv("UBERVISOR_SILENT"), NULL, 10) == 1;
 	if (getenv("UBERVISOR_FOREGROUND") != NULL)
 		do_fork = strtol(getenv("UBERVISOR_FOREGROUND"), NULL, 10) == 1 ? 0 : 1;
+	if (getenv("UBERVISOR_SPAWN") != NULL) {
+		if ((spawn_method = spawn_method_from_string(getenv("UBERVISOR_SPAWN"))) == -1) {
+			fprintf(stderr, "unsupported spawn method \"%s\"\n",
+					getenv("UBERVISOR_SPAWN"));
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (getenv("UBERVISOR_RATE") != NULL)
+		spawn_rate = strtol(getenv("UBERVISOR_RATE"), NULL, 10);
+	if (getenv("UBERVISOR_INFLIGHT") != NULL)
+		spawn_max_inflight = strtol(getenv("UBERVISOR_INFLIGHT"), NULL, 10);
+
+	/* executed by c_upgr(), the server socket is inherited */
+	if (getenv("UBERVISOR_UPGRADE") != NULL) {
+		upgrade = 1;
+		server_fd = strtol(getenv("UBERVISOR_UPGRADE"), NULL, 10);
+		setcloseonexec(server_fd);
+		unsetenv("UBERVISOR_UPGRADE");
+	}
+
+	/* getopt permutes argv, keep it to execute the server again */
+	server_argv = xmalloc(sizeof(char *) * (argc + 2));
+	server_argv[0] = program_name;
+	for (i = 0; i < argc; i++)
+		server_argv[i + 1] = argv[i];
+	server_argv[argc + 1] = NULL;
+	if ((len = readlink("/proc/self/exe", server_exe, sizeof(server_exe) - 1)) > 0)
+		server_exe[len] = '\0';
+	else
+		snprintf(server_exe, sizeof(server_exe), "%s", program_name);
 
 	while ((ch = getopt_long(argc, argv, server_opts, server_longopts, NULL)) != -1) {
 		switch (ch) {
@@ -2296,9 +7630,15 @@ cmd_server(int argc, char **argv)
 		case 'f':
 			do_fork = 0;
 			break;
+		case 'g':
+			cgroup_dir = optarg;
+			break;
 		case 'h':
 			help_server();
 			break;
+		case 'I':
+			spawn_max_inflight = strtol(optarg, NULL, 10);
+			break;
 		case 'l':
 			load_latest = 1;
 			break;
@@ -2308,9 +7648,21 @@ cmd_server(int argc, char **argv)
 		case 'P':
 			numask = 0777 - strtol(optarg, NULL, 8);
 			break;
+		case 'R':
+			spawn_rate = strtol(optarg, NULL, 10);
+			break;
 		case 's':
 			silent ^= 1;
 			break;
+		case 'S':
+			if ((spawn_method = spawn_method_from_string(optarg)) == -1) {
+				fprintf(stderr, "unsupported spawn method \"%s\"\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 't':
+			state_file = optarg;
+			break;
 		default:
 			help_server();
 			break;
@@ -2327,6 +7679,17 @@ cmd_server(int argc, char **argv)
 	if (argc != 0)
 		help_server();
 
+	if (spawn_rate < 1 || spawn_max_inflight < 1) {
+		fprintf(stderr, "rate and inflight must be > 0\n");
+		return EXIT_FAILURE;
+	}
+
+	if (cgroup_dir != NULL && cgroup_root_init(cgroup_dir) == -1) {
+		fprintf(stderr, "cannot use cgroup root %s: %s\n", cgroup_dir,
+				strerror(errno));
+		return EXIT_FAILURE;
+	}
+
 	if (getenv("UBERVISOR_RSH") != NULL) {
 		fprintf(stderr, "unsetting UBERVISOR_RSH.\n");
 		unsetenv("UBERVISOR_RSH");
@@ -2335,7 +7698,7 @@ cmd_server(int argc, char **argv)
 	sock_path_ptr = sock_path();
 
 	errno = 0;
-	if ((fd = sock_connect()) != -1) {
+	if (!upgrade && (fd = sock_connect()) != -1) {
 		if (sock_send_helo(fd) != -1) {
 			if (!silent)
 				fprintf(stderr, "server running?\n");
@@ -2350,7 +7713,9 @@ cmd_server(int argc, char **argv)
 		die(tmp);
 	}
 
-	if (dir) {
+	if (upgrade) {
+		/* still in the directory of the previous server */
+	} else if (dir) {
 		printf("chdir to: %s\n", dir);
 		if (chdir(dir) == -1)
 			die("chdir");
@@ -2379,40 +7744,8 @@ cmd_server(int argc, char **argv)
 	if (server_logfile)
 		printf("logfile: %s\n", server_logfile);
 
-	if (stat(sock_path_ptr, &st) != -1) {
-		if (!S_ISSOCK(st.st_mode)) {
-			fprintf(stderr, "Refusing to delete non-socket \"%s\"\n", sock_path_ptr);
-			return EXIT_FAILURE;
-		}
-		if (unlink(sock_path_ptr) == -1) {
-			snprintf(tmp, sizeof(tmp), "Can't delete existing socket \"%s\"", sock_path_ptr);
-			die(tmp);
-		}
-	}
-
-	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
-		die("socket");
-
-	if (strlen(sock_path_ptr) >= sizeof(addr.sun_path)) {
-		fprintf(stderr, "socket path too long\n");
+	if (!upgrade && (server_fd = server_listen(sock_path_ptr, numask)) == -1)
 		return EXIT_FAILURE;
-	}
-
-	memset(&addr, '\0', sizeof(addr));
-	addr.sun_family = AF_UNIX;
-	strcpy(addr.sun_path, sock_path_ptr);
-	addr_len = sizeof(addr);
-
-
-	oumask = umask(numask);
-
-	if (bind(fd, (struct sockaddr *) &addr, addr_len) == -1)
-		die("bind");
-
-	umask(oumask);
-
-	listen(fd, SERVER_LISTEN_BACKLOG);
-	printf("socket: %s\n", sock_path_ptr);
 
 	if (server_logfile != NULL)
 		log_fd = NULL;
@@ -2426,13 +7759,13 @@ cmd_server(int argc, char **argv)
 	}
 
 	/* check if we can open the dumpfile before we fork. */
-	if (dump_file != NULL) {
+	if (dump_file != NULL && !upgrade) {
 		if ((tmp_fd = fopen(dump_file, "r")) == NULL)
 			die("fopen");
 		fclose(tmp_fd);
 	}
 
-	if (do_fork) {
+	if (do_fork && !upgrade) {
 		pid = fork();
 
 		if (pid == -1)
@@ -2444,6 +7777,9 @@ cmd_server(int argc, char **argv)
 		setsid();
 	}
 
+	if (spawn_method == SPAWN_HELPER && spawn_helper_start() == -1)
+		die("spawn helper");
+
 	/* can't do this before fork */
 	event_init();
 
@@ -2453,19 +7789,43 @@ cmd_server(int argc, char **argv)
 	if (server_logfile != NULL)
 		open_server_log();
 
+	if (!subreaper_set())
+		slog("orphaned descendants of instances are reaped by init.\n");
+
+	spawn_chan_open();
+	helper_watch();
+	if (cred_resolver_start() == -1)
+		slog("failed to start name resolver. forking for lookups.\n");
+	resolver_watch();
+	if (!upgrade)
+		notify_start();
+	if (state_file[0] != '\0' && state_open(state_file) == -1)
+		slog("state file %s: %s. processes are not taken over after a restart.\n",
+				state_file, strerror(errno));
+	evtimer_set(&spawn_timer, spawn_timer_cb, NULL);
+	evtimer_set(&cred_timer, cred_timer_cb, NULL);
+	cred_timer_cb(0, 0, NULL);
+
 	/* loading a dump will start the processes - must do this after
 	 * event_init */
-	if (dump_file != NULL && !load_latest) {
-		if (!load_dump(dump_file))
-			die("dump_file");
-	}
-
-	if (load_latest)
-		load_newest_dump(dump_file);
+	if (upgrade) {
+		/* processes are known from the handoff */
+		state_old_free();
+		if (!handoff_load(UPGRADE_PATH))
+			die("upgrade state");
+		unlink(UPGRADE_PATH);
+	} else {
+		if (dump_file != NULL && !load_latest) {
+			if (!load_dump(dump_file))
+				die("dump_file");
+		}
 
-	setcloseonexec(fd);
+		if (load_latest)
+			load_newest_dump(dump_file);
+		state_forget();
+	}
 
-	event_set(&ev, fd, EV_READ | EV_PERSIST, accept_cb, NULL);
+	event_set(&ev, server_fd, EV_READ | EV_PERSIST, accept_cb, NULL);
 	event_add(&ev, NULL);
 
 	event_set(&se, SIGCHLD, EV_SIGNAL | EV_PERSIST, sigchld_cb, NULL);
@@ -2474,7 +7834,12 @@ cmd_server(int argc, char **argv)
 	event_set(&se1, SIGHUP, EV_SIGNAL | EV_PERSIST, sighup_cb, NULL);
 	event_add(&se1, NULL);
 
-	slog("server started.\n");
+	/* children that exited while the server was executed */
+	if (upgrade)
+		sigchld_cb(0, 0, NULL);
+
+	slog("server %s (spawn method: %s).\n", upgrade ? "upgraded" : "started",
+			spawn_method_name(spawn_method));
 	event_dispatch();
 	return EXIT_SUCCESS;
 }
@@ -36,23 +36,41 @@
 #include "misc.h"
 #include "child_config.h"
 
-static char start_opts[] = "+a:d:e:f:g:G:hH:i:k:o:s:u:U:";
+static char start_opts[] = "+a:b:B:c:d:e:E:f:F:g:G:hH:i:I:k:l:L:m:n:No:O:p:P:r:s:S:T:u:U:Z";
 
 static struct option start_longopts[] = {
 	{ "age",	required_argument,	NULL,	'a' },
+	{ "standby",	required_argument,	NULL,	'b' },
+	{ "backoff",	required_argument,	NULL,	'B' },
+	{ "cpus",	required_argument,	NULL,	'c' },
 	{ "dir",	required_argument,	NULL,	'd' },
 	{ "stderr",	required_argument,	NULL,	'e' },
+	{ "env",	required_argument,	NULL,	'E' },
 	{ "fatal",	required_argument,	NULL,	'f' },
+	{ "crashloop",	required_argument,	NULL,	'F' },
 	{ "gid",	required_argument,	NULL,	'g' },
 	{ "groupname",	required_argument,	NULL,	'G' },
 	{ "help",	no_argument,		NULL,	'h' },
 	{ "heartbeat",	required_argument,	NULL,	'H' },
 	{ "instances",	required_argument,	NULL,	'i' },
+	{ "ioprio",	required_argument,	NULL,	'I' },
 	{ "killsig",	required_argument,	NULL,	'k' },
+	{ "oomadj",	required_argument,	NULL,	'm' },
+	{ "nice",	required_argument,	NULL,	'n' },
+	{ "listen",	required_argument,	NULL,	'l' },
+	{ "cgroup",	required_argument,	NULL,	'L' },
+	{ "notify",	no_argument,		NULL,	'N' },
 	{ "stdout",	required_argument,	NULL,	'o' },
+	{ "ondemand",	required_argument,	NULL,	'O' },
+	{ "priority",	required_argument,	NULL,	'p' },
+	{ "port",	required_argument,	NULL,	'P' },
+	{ "rlimit",	required_argument,	NULL,	'r' },
 	{ "status",	required_argument,	NULL,	's' },
+	{ "sched",	required_argument,	NULL,	'S' },
+	{ "stoptimeout",	required_argument,	NULL,	'T' },
 	{ "uid",	required_argument,	NULL,	'u' },
 	{ "username",	required_argument,	NULL,	'U' },
+	{ "zygote",	no_argument,		NULL,	'Z' },
 	{ NULL,		0,			NULL,	0 }
 };
 
@@ -63,25 +81,66 @@ help_start(void)
 	printf("\n");
 	printf("Options: (defaults in brackets)\n");
 	printf("\t-a, --age SEC         max process age in seconds (not set).\n");
+	printf("\t-b, --standby COUNT   stopped processes kept to replace exited ones (0).\n");
+	printf("\t-B, --backoff SPEC    delay restarts after errors, see below (not set).\n");
+	printf("\t-c, --cpus POLICY     cpu affinity of processes, see below (not set).\n");
 	printf("\t-d, --dir DIR         chdir to DIR (not set).\n");
 	printf("\t-e, --stderr FILE     stderr log FILE (/dev/null).\n");
+	printf("\t-E, --env KEY=VALUE   environment variable, may be repeated (not set).\n");
 	printf("\t-f, --fatal COMMAND   command to run on fatal condition (not set).\n");
+	printf("\t-F, --crashloop SPEC  crash loop detection, see below (not set).\n");
 	printf("\t-g, --gid GID         GID to start processes as (not set).\n");
 	printf("\t-G, --groupname NAME  loopup and set group id for group NAME (not set).\n");
 	printf("\t-h, --help            help.\n");
 	printf("\t-H, --heartbeat COMMAND\n");
 	printf("\t                      run COMMAND 5 secondly (not set).\n");
 	printf("\t-i, --instances COUNT number of process to start (1).\n");
+	printf("\t-I, --ioprio CLASS[:LEVEL]\n");
+	printf("\t                      io priority, CLASS is rt, be or idle (not set).\n");
 	printf("\t-k, --killsig SIGNAL  signal used to kill processes in this group (15).\n");
+	printf("\t-l, --listen SPEC     socket passed to all processes, may be repeated (not set).\n");
+	printf("\t-L, --cgroup LIMITS   cgroup limits KEY=VALUE,.., see below (not set).\n");
+	printf("\t-m, --oomadj ADJ      oom_score_adj of processes (not set).\n");
+	printf("\t-n, --nice NICE       nice value of processes (not set).\n");
+	printf("\t-N, --notify          processes report readiness to NOTIFY_SOCKET (no).\n");
 	printf("\t-o, --stdout FILE     stdout log FILE (/dev/null).\n");
+	printf("\t-O, --ondemand SEC    start on first connection, stop after SEC idle (not set).\n");
+	printf("\t-p, --priority PRIO   groups with higher PRIO are started first (0).\n");
+	printf("\t-P, --port PORT       port base, %%(PORT) is PORT + instance number (not set).\n");
+	printf("\t-r, --rlimit SPEC     NAME=SOFT[:HARD],.. for nofile, as and core (not set).\n");
 	printf("\t-s, --status STATUS   status to create group with (1).\n");
+	printf("\t-S, --sched POLICY    scheduling policy: other, batch or idle (not set).\n");
+	printf("\t-T, --stoptimeout SEC stopped processes get SIGKILL after SEC (10).\n");
 	printf("\t-u, --uid UID         UID to start processes as (not set).\n");
 	printf("\t-U, --username NAME   lookup user NAME and set uid of this user (not set).\n");
+	printf("\t-Z, --zygote          command is a zygote that forks the instances (no).\n");
 	printf("\n");
 	printf("Status codes:\n");
 	printf("\t1 or start:           running\n");
 	printf("\t2 or stop:            stopped\n");
 	printf("\n");
+	printf("Listen specs:\n");
+	printf("\ttcp:PORT, tcp:ADDR:PORT, unix:PATH\n");
+	printf("\n");
+	printf("Cpu policies:\n");
+	printf("\tLIST[:LIST..]        cpu lists like 0-3,8, used round robin by instance\n");
+	printf("\tspread               one cpu per instance, one thread per core first\n");
+	printf("\tnode                 one numa node per block of instances\n");
+	printf("\n");
+	printf("Cgroup limits (server needs a cgroup root):\n");
+	printf("\tcpu.max=QUOTA[/PERIOD], cpu.weight=1..10000, memory.high=BYTES,\n");
+	printf("\tmemory.max=BYTES, pids.max=COUNT. BYTES may end in k, m or g, all but\n");
+	printf("\tcpu.weight can be max.\n");
+	printf("\n");
+	printf("Restart backoff (KEY=VALUE,.., missing keys get the default):\n");
+	printf("\tinitial=MSEC (1000), max=MSEC (60000), factor=F (2), jitter=PERCENT (10),\n");
+	printf("\tstable=SEC (60): runs longer than SEC reset the delay.\n");
+	printf("\n");
+	printf("Crash loops (KEY=VALUE,.., missing keys get the default):\n");
+	printf("\tcount=N (5) errors of one instance within window=SEC (60) seconds\n");
+	printf("\tare a crash loop. scope=group (group) sets the group broken,\n");
+	printf("\tscope=instance only stops restarting the instance.\n");
+	printf("\n");
 	printf("Examples:\n");
 	printf("\tuber start -o /tmp/stdout sleeper /bin/sleep 4\n");
 	printf("\n");
@@ -94,7 +153,9 @@ cmd_start(int argc, char **argv)
 	struct child_config	*cc;
 	int			ch,
 				x,
-				ret;
+				ret,
+				nlisten = 0,
+				nenv = 0;
 	const char		*b;
 	int			sock;
 
@@ -114,15 +175,30 @@ cmd_start(int argc, char **argv)
 		case 'a':
 			cc->cc_age = strtol(optarg, NULL, 10);
 			break;
+		case 'b':
+			cc->cc_standby = strtol(optarg, NULL, 10);
+			break;
+		case 'c':
+			cc->cc_cpus = optarg;
+			break;
 		case 'd':
 			cc->cc_dir = optarg;
 			break;
 		case 'e':
 			cc->cc_stderr = optarg;
 			break;
+		case 'E':
+			cc->cc_env = xrealloc(cc->cc_env,
+					sizeof(char *) * (nenv + 2));
+			cc->cc_env[nenv++] = optarg;
+			cc->cc_env[nenv] = NULL;
+			break;
 		case 'f':
 			cc->cc_fatal_cb = optarg;
 			break;
+		case 'F':
+			cc->cc_crashloop = optarg;
+			break;
 		case 'g':
 			cc->cc_gid = strtol(optarg, NULL, 10);
 			break;
@@ -138,12 +214,48 @@ cmd_start(int argc, char **argv)
 		case 'i':
 			cc->cc_instances = strtol(optarg, NULL, 10);
 			break;
+		case 'I':
+			cc->cc_ioprio = optarg;
+			break;
 		case 'k':
 			cc->cc_killsig = strtol(optarg, NULL, 10);
 			break;
+		case 'm':
+			cc->cc_oom_score_adj = strtol(optarg, NULL, 10);
+			break;
+		case 'n':
+			cc->cc_nice = strtol(optarg, NULL, 10);
+			break;
+		case 'l':
+			cc->cc_listen = xrealloc(cc->cc_listen,
+					sizeof(char *) * (nlisten + 2));
+			cc->cc_listen[nlisten++] = optarg;
+			cc->cc_listen[nlisten] = NULL;
+			break;
+		case 'B':
+			cc->cc_backoff = optarg;
+			break;
+		case 'L':
+			cc->cc_cgroup = optarg;
+			break;
+		case 'N':
+			cc->cc_notify = 1;
+			break;
 		case 'o':
 			cc->cc_stdout = optarg;
 			break;
+		case 'O':
+			cc->cc_ondemand = strtol(optarg, NULL, 10);
+			break;
+		case 'p':
+			cc->cc_priority = strtol(optarg, NULL, 10);
+			break;
+		case 'P':
+			cc->cc_port = strtol(optarg, NULL, 10);
+			break;
+		case 'r':
+			cc->cc_rlimits = optarg;
+			break;
 		case 's':
 			cc->cc_status = child_config_status_from_string(optarg);
 			if (cc->cc_status == -1) {
@@ -151,12 +263,21 @@ cmd_start(int argc, char **argv)
 				exit(1);
 			}
 			break;
+		case 'S':
+			cc->cc_sched = optarg;
+			break;
+		case 'T':
+			cc->cc_stop_timeout = strtol(optarg, NULL, 10);
+			break;
 		case 'u':
 			cc->cc_uid = strtol(optarg, NULL, 10);
 			break;
 		case 'U':
 			cc->cc_username = optarg;
 			break;
+		case 'Z':
+			cc->cc_zygote = 1;
+			break;
 		default:
 			help_start();
 			break;
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2011-2013 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <json/json.h>
+
+#include "main.h"
+#include "client.h"
+#include "misc.h"
+
+int
+cmd_stats(int argc, char **argv)
+{
+	int		sock;
+
+	char		*buf;
+	size_t		buf_siz;
+
+	json_object	*obj,
+			*n,
+			*h;
+
+	if (argc > 1) {
+		fprintf(stderr, "%s takes no options.\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if ((sock = sock_connect()) == -1) {
+		die("Failed to connect server");
+	}
+
+	if (sock_send_command(sock, "STAT", NULL) == -1) {
+		fprintf(stderr, "failed.\n");
+		return EXIT_FAILURE;
+	}
+
+	if ((buf = read_reply(sock, &buf_siz)) == NULL) {
+		fprintf(stderr, "Failed to read reply.\n");
+		return EXIT_FAILURE;
+	}
+
+	close(sock);
+
+	if ((obj = json_tokener_parse(buf)) == NULL) {
+		free(buf);
+		fprintf(stderr, "Failed to parse reply.\n");
+		return EXIT_FAILURE;
+	}
+
+	free(buf);
+
+	if (!json_object_is_type(obj, json_type_object)) {
+		fprintf(stderr, "Failed to parse reply.\n");
+		return EXIT_FAILURE;
+	}
+
+#define PRINTSTAT(X)	if ((n = json_object_object_get(obj, X)) != NULL) \
+				printf("%-14s%d\n", X, json_object_get_int(n));
+
+	PRINTSTAT("queued");
+	PRINTSTAT("inflight");
+	PRINTSTAT("rate");
+	PRINTSTAT("max_inflight");
+	PRINTSTAT("spawned");
+	PRINTSTAT("wait_oldest");
+	PRINTSTAT("wait_avg");
+	PRINTSTAT("wait_max");
+
+	/* latency histograms, microseconds */
+#define PRINTHIST(X)	if ((h = json_object_object_get(obj, X)) != NULL) { \
+				printf("%-14s", X); \
+				if ((n = json_object_object_get(h, "count")) != NULL) \
+					printf("count %d", json_object_get_int(n)); \
+				if ((n = json_object_object_get(h, "avg")) != NULL) \
+					printf(" avg %dus", json_object_get_int(n)); \
+				if ((n = json_object_object_get(h, "max")) != NULL) \
+					printf(" max %dus", json_object_get_int(n)); \
+				printf("\n"); \
+			}
+
+	PRINTHIST("fork_exec");
+	PRINTHIST("setids");
+	PRINTHIST("logopen");
+
+	json_object_put(obj);
+	return EXIT_SUCCESS;
+}
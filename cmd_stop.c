@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <json/json.h>
+
+#include "main.h"
+#include "client.h"
+#include "cmd_stop.h"
+#include "misc.h"
+
+static char stop_opts[] = "ht:";
+
+static struct option stop_longopts[] = {
+	{ "help",	no_argument,		NULL,	'h' },
+	{ "timeout",	required_argument,	NULL,	't' },
+	{ NULL,		0,			NULL,	0 }
+};
+
+static void
+help_stop(void)
+{
+	printf("Usage: %s stop [Options] <name>\n", program_name);
+	printf("\n");
+	printf("Set a group stopped and stop its processes. Returns when they\n");
+	printf("exited.\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("\t-h, --help         help.\n");
+	printf("\t-t, --timeout SEC  SIGKILL after SEC instead of the stop timeout\n");
+	printf("\t                   of the group.\n");
+	printf("\n");
+	exit(EXIT_FAILURE);
+}
+
+int
+cmd_stop(int argc, char **argv)
+{
+	int		sock,
+			ch,
+			timeout = -1;
+	char		*msg,
+			*buf;
+	size_t		buf_siz;
+	json_object	*obj,
+			*n;
+
+	while ((ch = getopt_long(argc, argv, stop_opts, stop_longopts, NULL)) != -1) {
+		switch (ch) {
+		case 't':
+			timeout = strtol(optarg, NULL, 10);
+			break;
+		case 'h':
+		default:
+			help_stop();
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 1)
+		help_stop();
+
+	obj = json_object_new_object();
+	json_object_object_add(obj, "name", json_object_new_string(argv[0]));
+	if (timeout != -1)
+		json_object_object_add(obj, "timeout", json_object_new_int(timeout));
+	msg = xstrdup(json_object_to_json_string(obj));
+	json_object_put(obj);
+
+	if ((sock = sock_connect()) == -1) {
+		die("Failed to connect server");
+	}
+
+	if (sock_send_command(sock, "STOP", msg) == -1) {
+		fprintf(stderr, "write data\n");
+		return EXIT_FAILURE;
+	}
+	free(msg);
+
+	if ((buf = read_reply(sock, &buf_siz)) == NULL) {
+		fprintf(stderr, "Failed to parse reply.\n");
+		return EXIT_FAILURE;
+	}
+	close(sock);
+
+	if ((obj = json_tokener_parse(buf)) == NULL || is_error(obj)) {
+		free(buf);
+		fprintf(stderr, "Failed to parse reply.\n");
+		return EXIT_FAILURE;
+	}
+	free(buf);
+
+	if ((n = json_object_object_get(obj, "code")) == NULL
+			|| !json_object_get_boolean(n)) {
+		n = json_object_object_get(obj, "msg");
+		fprintf(stderr, "%s\n", n != NULL ? json_object_get_string(n)
+				: "Command failed.");
+		json_object_put(obj);
+		return EXIT_FAILURE;
+	}
+
+	n = json_object_object_get(obj, "msg");
+	printf("%s", n != NULL ? json_object_get_string(n) : "");
+	if ((n = json_object_object_get(obj, "killed")) != NULL)
+		printf(" killed: %d", json_object_get_int(n));
+	if ((n = json_object_object_get(obj, "running")) != NULL)
+		printf(" running: %d", json_object_get_int(n));
+	printf("\n");
+	json_object_put(obj);
+	return EXIT_SUCCESS;
+}
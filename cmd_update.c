@@ -36,19 +36,36 @@
 #include "misc.h"
 #include "child_config.h"
 
-static char update_opts[] = "a:d:e:f:hH:i:k:o:s:";
+static char update_opts[] = "a:b:B:c:d:e:E:f:F:G:hH:i:I:k:L:m:n:N:o:p:P:r:s:S:T:U:";
 
 static struct option update_longopts[] = {
 	{ "age",	required_argument,	NULL,	'a' },
+	{ "standby",	required_argument,	NULL,	'b' },
+	{ "backoff",	required_argument,	NULL,	'B' },
+	{ "cpus",	required_argument,	NULL,	'c' },
 	{ "dir",	required_argument,	NULL,	'd' },
 	{ "stderr",	required_argument,	NULL,	'e' },
+	{ "env",	required_argument,	NULL,	'E' },
 	{ "fatal",	required_argument,	NULL,	'f' },
+	{ "crashloop",	required_argument,	NULL,	'F' },
+	{ "groupname",	required_argument,	NULL,	'G' },
 	{ "help",	no_argument,		NULL,	'h' },
 	{ "heartbeat",	required_argument,	NULL,	'H' },
 	{ "instances",	required_argument,	NULL,	'i' },
+	{ "ioprio",	required_argument,	NULL,	'I' },
 	{ "killsig",	required_argument,	NULL,	'k' },
+	{ "cgroup",	required_argument,	NULL,	'L' },
+	{ "oomadj",	required_argument,	NULL,	'm' },
+	{ "nice",	required_argument,	NULL,	'n' },
+	{ "notify",	required_argument,	NULL,	'N' },
 	{ "stdout",	required_argument,	NULL,	'o' },
+	{ "priority",	required_argument,	NULL,	'p' },
+	{ "port",	required_argument,	NULL,	'P' },
+	{ "rlimit",	required_argument,	NULL,	'r' },
 	{ "status",	required_argument,	NULL,	's' },
+	{ "sched",	required_argument,	NULL,	'S' },
+	{ "stoptimeout",	required_argument,	NULL,	'T' },
+	{ "username",	required_argument,	NULL,	'U' },
 	{ NULL,		0,			NULL,	0 }
 };
 
@@ -59,16 +76,39 @@ help_update(void)
 	printf("\n");
 	printf("Options:\n");
 	printf("\t-a, --age SEC         max process age in seconds.\n");
+	printf("\t-b, --standby COUNT   stopped processes kept to replace exited ones.\n");
+	printf("\t-B, --backoff SPEC    restart backoff, see start help. -B '' removes it.\n");
+	printf("\t-c, --cpus POLICY     cpu affinity of processes, see start help.\n");
 	printf("\t-d, --dir DIR         chdir to DIR.\n");
 	printf("\t-e, --stderr FILE     stderr log FILE.\n");
+	printf("\t-E, --env KEY=VALUE   environment variable, may be repeated. Replaces\n");
+	printf("\t                      the environment, -E '' removes it.\n");
 	printf("\t-f, --fatal COMMAND   run COMMAND if fatal state.\n");
+	printf("\t-F, --crashloop SPEC  crash loop detection, see start help. Restarts\n");
+	printf("\t                      broken instances, -F '' removes it.\n");
+	printf("\t-G, --groupname NAME  look up group NAME for processes started next.\n");
 	printf("\t-h, --help            help.\n");
 	printf("\t-H, --heartbeat COMMAND\n");
 	printf("\t                      run COMMAND 5 secondly.\n");
 	printf("\t-i, --instances COUNT number of process to start.\n");
+	printf("\t-I, --ioprio CLASS[:LEVEL]\n");
+	printf("\t                      io priority, CLASS is rt, be or idle.\n");
 	printf("\t-k, --killsig SIGNAL  signal used to kill processes in this group.\n");
+	printf("\t-L, --cgroup LIMITS   cgroup limits, see start help. Applied at once.\n");
+	printf("\t-m, --oomadj ADJ      oom_score_adj of processes.\n");
+	printf("\t-n, --nice NICE       nice value of processes.\n");
+	printf("\t-N, --notify 0|1      readiness notification for processes started next.\n");
 	printf("\t-o, --stdout FILE     stdout log FILE.\n");
+	printf("\t-p, --priority PRIO   groups with higher PRIO are started first.\n");
+	printf("\t-P, --port PORT       port base for %%(PORT).\n");
+	printf("\t-r, --rlimit SPEC     NAME=SOFT[:HARD],.. for nofile, as and core.\n");
 	printf("\t-s, --status STATUS   status to create group with.\n");
+	printf("\t-S, --sched POLICY    scheduling policy: other, batch or idle.\n");
+	printf("\t-T, --stoptimeout SEC stopped processes get SIGKILL after SEC.\n");
+	printf("\t-U, --username NAME   look up user NAME for processes started next.\n");
+	printf("\n");
+	printf("Cpu policies, cgroup limits, backoff and crash loops are described in\n");
+	printf("the help of the start command.\n");
 	printf("\n");
 	printf("Examples:\n");
 	printf("\tuber update -i 4 test\n");
@@ -81,7 +121,8 @@ cmd_update(int argc, char **argv)
 {
 	struct child_config	*cc;
 	int			ch,
-				ret;
+				ret,
+				nenv = 0;
 	const char		*b;
 	int			sock;
 
@@ -95,15 +136,31 @@ cmd_update(int argc, char **argv)
 		case 'a':
 			cc->cc_age = strtol(optarg, NULL, 10);
 			break;
+		case 'b':
+			cc->cc_standby = strtol(optarg, NULL, 10);
+			break;
+		case 'c':
+			cc->cc_cpus = optarg;
+			break;
 		case 'd':
 			cc->cc_dir = optarg;
 			break;
 		case 'e':
 			cc->cc_stderr = optarg;
 			break;
+		case 'E':
+			cc->cc_env = xrealloc(cc->cc_env,
+					sizeof(char *) * (nenv + 2));
+			if (*optarg != '\0')
+				cc->cc_env[nenv++] = optarg;
+			cc->cc_env[nenv] = NULL;
+			break;
 		case 'f':
 			cc->cc_fatal_cb = optarg;
 			break;
+		case 'F':
+			cc->cc_crashloop = optarg;
+			break;
 		case 'h':
 			help_update();
 			break;
@@ -113,12 +170,45 @@ cmd_update(int argc, char **argv)
 		case 'i':
 			cc->cc_instances = strtol(optarg, NULL, 10);
 			break;
+		case 'I':
+			cc->cc_ioprio = optarg;
+			break;
 		case 'k':
 			cc->cc_killsig = strtol(optarg, NULL, 10);
 			break;
+		case 'G':
+			cc->cc_groupname = optarg;
+			break;
+		case 'U':
+			cc->cc_username = optarg;
+			break;
+		case 'B':
+			cc->cc_backoff = optarg;
+			break;
+		case 'L':
+			cc->cc_cgroup = optarg;
+			break;
+		case 'm':
+			cc->cc_oom_score_adj = strtol(optarg, NULL, 10);
+			break;
+		case 'n':
+			cc->cc_nice = strtol(optarg, NULL, 10);
+			break;
+		case 'N':
+			cc->cc_notify = strtol(optarg, NULL, 10) != 0;
+			break;
 		case 'o':
 			cc->cc_stdout = optarg;
 			break;
+		case 'p':
+			cc->cc_priority = strtol(optarg, NULL, 10);
+			break;
+		case 'P':
+			cc->cc_port = strtol(optarg, NULL, 10);
+			break;
+		case 'r':
+			cc->cc_rlimits = optarg;
+			break;
 		case 's':
 			cc->cc_status = child_config_status_from_string(optarg);
 			if (cc->cc_status == -1) {
@@ -126,6 +216,12 @@ cmd_update(int argc, char **argv)
 				exit(1);
 			}
 			break;
+		case 'S':
+			cc->cc_sched = optarg;
+			break;
+		case 'T':
+			cc->cc_stop_timeout = strtol(optarg, NULL, 10);
+			break;
 		default:
 			help_update();
 			break;
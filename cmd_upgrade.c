@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <json/json.h>
+
+#include "main.h"
+#include "client.h"
+#include "cmd_upgrade.h"
+#include "misc.h"
+
+static char upgrade_opts[] = "h";
+
+static struct option upgrade_longopts[] = {
+	{ "help",	no_argument,		NULL,	'h' },
+	{ NULL,		0,			NULL,	0 }
+};
+
+static void
+help_upgrade(void)
+{
+	printf("Usage: %s upgrade [Options] [<path>]\n", program_name);
+	printf("\n");
+	printf("Execute the server binary again (or <path>). Processes and\n");
+	printf("connections are kept.\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("\t-h, --help         help.\n");
+	printf("\n");
+	exit(EXIT_FAILURE);
+}
+
+int
+cmd_upgrade(int argc, char **argv)
+{
+	int		sock,
+			ch,
+			ret;
+	char		*msg = NULL;
+	json_object	*obj;
+
+	while ((ch = getopt_long(argc, argv, upgrade_opts, upgrade_longopts, NULL)) != -1) {
+		switch (ch) {
+		case 'h':
+		default:
+			help_upgrade();
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc > 1)
+		help_upgrade();
+
+	if (argc == 1) {
+		obj = json_object_new_object();
+		json_object_object_add(obj, "exec", json_object_new_string(argv[0]));
+		msg = xstrdup(json_object_to_json_string(obj));
+		json_object_put(obj);
+	}
+
+	if ((sock = sock_connect()) == -1) {
+		die("Failed to connect server");
+	}
+
+	if (sock_send_command(sock, "UPGR", msg) == -1) {
+		fprintf(stderr, "write data\n");
+		return EXIT_FAILURE;
+	}
+
+	free(msg);
+	ret = get_status_reply(sock);
+	close(sock);
+	return ret;
+}
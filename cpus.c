@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+
+#include <sys/types.h>
+#include <sys/syscall.h>
+
+#include "config.h"
+#include "misc.h"
+#include "cpus.h"
+
+#define CPU_POLICY_LISTS	1	/* LIST[:LIST..], round robin */
+#define CPU_POLICY_SPREAD	2	/* one cpu per instance, cores first */
+#define CPU_POLICY_NODE		3	/* one numa node per instance block */
+
+/* from linux/mempolicy.h */
+#define UV_MPOL_PREFERRED	1
+
+#define SYSFS_CPU		"/sys/devices/system/cpu"
+#define SYSFS_NODE		"/sys/devices/system/node"
+
+struct cpu_policy {
+	int			cp_mode,
+				cp_n;
+	/* cpu lists (LISTS) or cpus of each node (NODE) */
+	struct cpu_mask		*cp_masks;
+	/* node ids (NODE) or cpus in spread order (SPREAD) */
+	int			*cp_ids;
+};
+
+#define MASK_SET(M, C)	((M)->cm_bits[(C) / 64] |= (uint64_t) 1 << ((C) % 64))
+#define MASK_ISSET(M, C) (((M)->cm_bits[(C) / 64] >> ((C) % 64)) & 1)
+
+/*
+ * parse a cpu list like "0-3,8". Trailing white space is ignored (sysfs).
+ * Returns -1 on syntax errors, cpus >= CPUS_MAX and empty lists.
+ */
+int
+cpu_mask_parse(const char *str, struct cpu_mask *m)
+{
+	char		*end;
+	long		a,
+			b,
+			i;
+	int		n = 0;
+
+	memset(m, '\0', sizeof(struct cpu_mask));
+	for (;;) {
+		if (*str < '0' || *str > '9')
+			return -1;
+		a = b = strtol(str, &end, 10);
+		if (*end == '-') {
+			str = end + 1;
+			if (*str < '0' || *str > '9')
+				return -1;
+			b = strtol(str, &end, 10);
+		}
+		if (a > b || b >= CPUS_MAX)
+			return -1;
+		for (i = a; i <= b; i++)
+			MASK_SET(m, i);
+		n++;
+		str = end;
+		if (*str != ',')
+			break;
+		str++;
+	}
+	while (*str == ' ' || *str == '\n')
+		str++;
+	return *str == '\0' && n > 0 ? 0 : -1;
+}
+
+/*
+ * format mask as cpu list. Truncated if buf is too small.
+ */
+void
+cpu_mask_format(const struct cpu_mask *m, char *buf, size_t len)
+{
+	size_t		off = 0;
+	int		a,
+			b,
+			r;
+
+	buf[0] = '\0';
+	for (a = 0; a < CPUS_MAX; a = b + 1) {
+		if (!MASK_ISSET(m, a)) {
+			b = a;
+			continue;
+		}
+		for (b = a; b + 1 < CPUS_MAX && MASK_ISSET(m, b + 1); b++)
+			;
+		if (a == b)
+			r = snprintf(buf + off, len - off, "%s%d", off ? "," : "", a);
+		else
+			r = snprintf(buf + off, len - off, "%s%d-%d", off ? "," : "", a, b);
+		if (r < 0 || (size_t) r >= len - off)
+			return;
+		off += r;
+	}
+}
+
+/*
+ * cpu affinity of a process (0 is the calling process).
+ */
+int
+cpu_mask_get(pid_t pid, struct cpu_mask *m)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+	cpu_set_t	set;
+	int		i;
+
+	if (sched_getaffinity(pid, sizeof(set), &set) == -1)
+		return -1;
+	memset(m, '\0', sizeof(struct cpu_mask));
+	for (i = 0; i < CPUS_MAX && i < CPU_SETSIZE; i++) {
+		if (CPU_ISSET(i, &set))
+			MASK_SET(m, i);
+	}
+	return 0;
+#else
+	(void) pid;
+	(void) m;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*
+ * set cpu affinity of a process. Does not allocate, may be called between
+ * vfork and exec.
+ */
+int
+cpu_mask_set(pid_t pid, const struct cpu_mask *m)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+	cpu_set_t	set;
+	int		i;
+
+	CPU_ZERO(&set);
+	for (i = 0; i < CPUS_MAX && i < CPU_SETSIZE; i++) {
+		if (MASK_ISSET(m, i))
+			CPU_SET(i, &set);
+	}
+	return sched_setaffinity(pid, sizeof(set), &set);
+#else
+	(void) pid;
+	(void) m;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*
+ * prefer memory of numa node for the calling process. Does not allocate.
+ */
+int
+cpu_node_prefer(int node)
+{
+#ifdef SYS_set_mempolicy
+	unsigned long	nodes[CPUS_MAX / (8 * sizeof(unsigned long))];
+
+	if (node < 0 || node >= CPUS_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset(nodes, '\0', sizeof(nodes));
+	nodes[node / (8 * sizeof(unsigned long))] |=
+		1UL << (node % (8 * sizeof(unsigned long)));
+	return syscall(SYS_set_mempolicy, UV_MPOL_PREFERRED, nodes,
+			(unsigned long) CPUS_MAX);
+#else
+	(void) node;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*
+ * read a cpu or node list from sysfs.
+ */
+static int
+read_mask(const char *path, struct cpu_mask *m)
+{
+	char		buf[4096];
+	FILE		*f;
+	int		ret = -1;
+
+	if ((f = fopen(path, "r")) == NULL)
+		return -1;
+	if (fgets(buf, sizeof(buf), f) != NULL)
+		ret = cpu_mask_parse(buf, m);
+	fclose(f);
+	return ret;
+}
+
+/*
+ * order allowed cpus for spreading: the first thread of every core, then
+ * the second thread and so on.
+ */
+static int
+spread_order(const struct cpu_mask *allowed, int *order)
+{
+	struct cpu_mask	sib;
+	char		path[128];
+	int		rank[CPUS_MAX],
+			c,
+			s,
+			r,
+			n = 0,
+			left = 0;
+
+	for (c = 0; c < CPUS_MAX; c++) {
+		if (!MASK_ISSET(allowed, c))
+			continue;
+		rank[c] = 0;
+		left++;
+		snprintf(path, sizeof(path),
+				SYSFS_CPU "/cpu%d/topology/thread_siblings_list", c);
+		if (read_mask(path, &sib) == -1)
+			continue;
+		for (s = 0; s < c; s++) {
+			if (MASK_ISSET(&sib, s) && MASK_ISSET(allowed, s))
+				rank[c]++;
+		}
+	}
+
+	for (r = 0; left > 0; r++) {
+		for (c = 0; c < CPUS_MAX; c++) {
+			if (MASK_ISSET(allowed, c) && rank[c] == r) {
+				order[n++] = c;
+				left--;
+			}
+		}
+	}
+	return n;
+}
+
+/*
+ * numa nodes with allowed cpus.
+ */
+static int
+node_masks(const struct cpu_mask *allowed, struct cpu_policy *cp)
+{
+	struct cpu_mask	online,
+			m;
+	char		path[128];
+	int		node,
+			i,
+			any;
+
+	if (read_mask(SYSFS_NODE "/online", &online) == -1)
+		return 0;
+	cp->cp_masks = xmalloc(sizeof(struct cpu_mask) * CPUS_MAX);
+	cp->cp_ids = xmalloc(sizeof(int) * CPUS_MAX);
+	for (node = 0; node < CPUS_MAX; node++) {
+		if (!MASK_ISSET(&online, node))
+			continue;
+		snprintf(path, sizeof(path), SYSFS_NODE "/node%d/cpulist", node);
+		if (read_mask(path, &m) == -1)
+			continue;
+		for (i = any = 0; i < CPUS_MAX / 64; i++) {
+			m.cm_bits[i] &= allowed->cm_bits[i];
+			any |= m.cm_bits[i] != 0;
+		}
+		/* memory only nodes */
+		if (!any)
+			continue;
+		cp->cp_masks[cp->cp_n] = m;
+		cp->cp_ids[cp->cp_n++] = node;
+	}
+	return cp->cp_n;
+}
+
+/*
+ * compile a cpus policy: "spread", "node" or cpu lists separated by ':'.
+ * Placements are computed from the cpus the server may run on. Returns NULL
+ * and sets err on errors.
+ */
+struct cpu_policy *
+cpu_policy_new(const char *spec, const char **err)
+{
+	struct cpu_policy	*cp;
+	struct cpu_mask		allowed;
+	const char		*p;
+	char			*s,
+				*tok,
+				*save;
+
+	cp = xmalloc(sizeof(struct cpu_policy));
+	memset(cp, '\0', sizeof(struct cpu_policy));
+
+	if (!strcmp(spec, "spread") || !strcmp(spec, "node")) {
+		if (cpu_mask_get(0, &allowed) == -1) {
+			*err = "cpu affinity not supported.";
+			goto fail;
+		}
+	}
+
+	if (!strcmp(spec, "spread")) {
+		cp->cp_mode = CPU_POLICY_SPREAD;
+		cp->cp_ids = xmalloc(sizeof(int) * CPUS_MAX);
+		cp->cp_n = spread_order(&allowed, cp->cp_ids);
+		return cp;
+	}
+
+	if (!strcmp(spec, "node")) {
+		cp->cp_mode = CPU_POLICY_NODE;
+		if (node_masks(&allowed, cp) == 0) {
+			*err = "no numa nodes found.";
+			goto fail;
+		}
+		return cp;
+	}
+
+	cp->cp_mode = CPU_POLICY_LISTS;
+	for (p = spec, cp->cp_n = 1; *p != '\0'; p++) {
+		if (*p == ':')
+			cp->cp_n++;
+	}
+	cp->cp_masks = xmalloc(sizeof(struct cpu_mask) * cp->cp_n);
+	s = xstrdup(spec);
+	cp->cp_n = 0;
+	for (tok = strtok_r(s, ":", &save); tok != NULL;
+			tok = strtok_r(NULL, ":", &save)) {
+		if (cpu_mask_parse(tok, &cp->cp_masks[cp->cp_n]) == -1)
+			break;
+		cp->cp_n++;
+	}
+	free(s);
+	if (tok != NULL || cp->cp_n == 0) {
+		*err = "illegal cpus.";
+		goto fail;
+	}
+	return cp;
+
+fail:
+	cpu_policy_free(cp);
+	return NULL;
+}
+
+void
+cpu_policy_free(struct cpu_policy *cp)
+{
+	if (cp == NULL)
+		return;
+	free(cp->cp_masks);
+	free(cp->cp_ids);
+	free(cp);
+}
+
+/*
+ * Return 1 if the placement depends on the instance number.
+ */
+int
+cpu_policy_per_instance(const struct cpu_policy *cp)
+{
+	return cp->cp_mode != CPU_POLICY_LISTS || cp->cp_n > 1;
+}
+
+/*
+ * placement of instance of a group with instances instances. The same
+ * instance always gets the same placement.
+ */
+void
+cpu_policy_place(const struct cpu_policy *cp, int instance, int instances,
+		struct cpu_place *pl)
+{
+	int		k;
+
+	memset(pl, '\0', sizeof(struct cpu_place));
+	pl->cp_node = -1;
+
+	switch (cp->cp_mode) {
+	case CPU_POLICY_SPREAD:
+		MASK_SET(&pl->cp_mask, cp->cp_ids[instance % cp->cp_n]);
+		break;
+	case CPU_POLICY_NODE:
+		/* consecutive instances share a node */
+		if (instance < instances)
+			k = (long long) instance * cp->cp_n / instances;
+		else
+			k = instance % cp->cp_n;
+		pl->cp_mask = cp->cp_masks[k];
+		pl->cp_node = cp->cp_ids[k];
+		break;
+	default:
+		pl->cp_mask = cp->cp_masks[instance % cp->cp_n];
+		break;
+	}
+}
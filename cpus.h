@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __CPUS_H
+#define __CPUS_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#define CPUS_MAX	1024
+
+struct cpu_mask {
+	uint64_t	cm_bits[CPUS_MAX / 64];
+};
+
+/*
+ * placement of one process: cpu affinity and preferred numa node (-1 if
+ * not set).
+ */
+struct cpu_place {
+	struct cpu_mask	cp_mask;
+	int32_t		cp_node;
+};
+
+struct cpu_policy;
+
+int cpu_mask_parse(const char *, struct cpu_mask *);
+void cpu_mask_format(const struct cpu_mask *, char *, size_t);
+int cpu_mask_get(pid_t, struct cpu_mask *);
+int cpu_mask_set(pid_t, const struct cpu_mask *);
+int cpu_node_prefer(int);
+
+struct cpu_policy *cpu_policy_new(const char *, const char **);
+void cpu_policy_free(struct cpu_policy *);
+int cpu_policy_per_instance(const struct cpu_policy *);
+void cpu_policy_place(const struct cpu_policy *, int, int, struct cpu_place *);
+
+#endif /* __CPUS_H */
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "crashloop.h"
+
+#define CRASHLOOP_COUNT		5
+#define CRASHLOOP_WINDOW	60
+
+/*
+ * parse "KEY=VALUE,.." with keys count, window (seconds) and scope (group
+ * or instance). Missing keys get defaults.
+ */
+const char *
+crashloop_compile(struct crashloop *cl, const char *spec)
+{
+	const char	*p = spec,
+			*eq,
+			*end;
+	char		*e;
+	long		v;
+
+	cl->cl_count = CRASHLOOP_COUNT;
+	cl->cl_window = CRASHLOOP_WINDOW;
+	cl->cl_instance = 0;
+
+	while (*p != '\0') {
+		if ((end = strchr(p, ',')) == NULL)
+			end = p + strlen(p);
+		if ((eq = memchr(p, '=', end - p)) == NULL)
+			return "illegal crashloop.";
+#define KEY(N)	((size_t) (eq - p) == strlen(N) && !strncmp(p, N, eq - p))
+#define VAL(N)	((size_t) (end - eq - 1) == strlen(N) && !strncmp(eq + 1, N, end - eq - 1))
+		if (KEY("scope")) {
+			if (VAL("group"))
+				cl->cl_instance = 0;
+			else if (VAL("instance"))
+				cl->cl_instance = 1;
+			else
+				return "illegal crashloop scope.";
+		} else {
+			if (eq[1] < '0' || eq[1] > '9')
+				return "illegal crashloop.";
+			v = strtol(eq + 1, &e, 10);
+			if (e != end)
+				return "illegal crashloop.";
+			if (KEY("count") && v >= 1 && v <= CRASHLOOP_MAX)
+				cl->cl_count = v;
+			else if (KEY("window") && v >= 1 && v <= 86400)
+				cl->cl_window = v;
+			else
+				return "illegal crashloop.";
+		}
+#undef KEY
+#undef VAL
+		p = *end == ',' ? end + 1 : end;
+	}
+	return NULL;
+}
+
+/*
+ * number of errors within the window ending at now.
+ */
+int
+crash_ring_recent(const struct crash_ring *cr, const struct crashloop *cl,
+		time_t now)
+{
+	int		i,
+			n = 0;
+
+	for (i = 0; i < cl->cl_count; i++) {
+		if (cr->cr_times[i] != 0 && cr->cr_times[i] > now - cl->cl_window)
+			n++;
+	}
+	return n;
+}
+
+/*
+ * record an error at now. Returns 1 if the instance is in a crash loop.
+ */
+int
+crash_ring_add(struct crash_ring *cr, const struct crashloop *cl, time_t now)
+{
+	cr->cr_times[cr->cr_next] = now;
+	cr->cr_next = (cr->cr_next + 1) % cl->cl_count;
+	return crash_ring_recent(cr, cl, now) >= cl->cl_count;
+}
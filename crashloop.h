@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __CRASHLOOP_H
+#define __CRASHLOOP_H
+
+#include <time.h>
+
+#define CRASHLOOP_MAX	32
+
+/*
+ * crash loop policy of a group: an instance with cl_count errors within
+ * cl_window seconds is broken. With cl_instance only the instance is not
+ * restarted any more, else the whole group is set broken.
+ */
+struct crashloop {
+	int		cl_count,
+			cl_window,
+			cl_instance;
+};
+
+/*
+ * times of the last errors of an instance.
+ */
+struct crash_ring {
+	time_t		cr_times[CRASHLOOP_MAX];
+	int		cr_next,
+			cr_broken;
+};
+
+const char *crashloop_compile(struct crashloop *, const char *);
+int crash_ring_add(struct crash_ring *, const struct crashloop *, time_t);
+int crash_ring_recent(const struct crash_ring *, const struct crashloop *,
+		time_t);
+
+#endif /* __CRASHLOOP_H */
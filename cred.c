@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pwd.h>
+#include <grp.h>
+
+#include <stdint.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "misc.h"
+#include "cred.h"
+
+/*
+ * name resolver. A small process (the server binary re-executed) that looks
+ * up user and group names for the server, one request at a time, so the
+ * server neither waits for the name service nor forks itself per lookup.
+ */
+#define CRED_RESOLVER_EXE	"/proc/self/exe"
+#define CRED_RESOLVER_CMD	"cred-resolver"
+#define CRED_MSGSIZ		4096
+
+/* names present in a request */
+#define CR_USER		0x01
+#define CR_GROUP	0x02
+
+struct cred_req {
+	uint32_t	cr_seq,
+			cr_present;
+	int32_t		cr_uid,
+			cr_gid;
+	/* followed by the present names, each NUL terminated */
+};
+
+static int		resolver_fd = -1;
+static pid_t		resolver_pid = -1;
+static uint32_t		resolver_seq;
+
+/*
+ * look up username and groupname (either may be NULL). uid and gid are
+ * used for a name that is not set.
+ */
+void
+cred_lookup(const char *username, const char *groupname, int uid, int gid,
+		struct cred_rep *rep)
+{
+	struct passwd		*pw;
+	struct group		*gr;
+
+	memset(rep, '\0', sizeof(struct cred_rep));
+	rep->cr_uid = uid;
+	rep->cr_gid = gid;
+
+	if (username != NULL) {
+		errno = 0;
+		if ((pw = getpwnam(username)) == NULL) {
+			rep->cr_errfunc = CRED_F_GETPWNAM;
+			rep->cr_errno = errno;
+			return;
+		}
+		rep->cr_uid = pw->pw_uid;
+	}
+
+	if (groupname != NULL) {
+		errno = 0;
+		if ((gr = getgrnam(groupname)) == NULL) {
+			rep->cr_errfunc = CRED_F_GETGRNAM;
+			rep->cr_errno = errno;
+			return;
+		}
+		rep->cr_gid = gr->gr_gid;
+	}
+}
+
+/*
+ * handle one request in the resolver.
+ */
+static void
+cred_resolver_handle(char *buf, size_t len)
+{
+	struct cred_req		*cr = (struct cred_req *) buf;
+	struct cred_rep		rep;
+	char			*username = NULL,
+				*groupname = NULL,
+				*p = buf + sizeof(struct cred_req),
+				*end = buf + len;
+
+	if (cr->cr_present & CR_USER) {
+		if ((username = p) == end || memchr(p, '\0', end - p) == NULL)
+			return;
+		p += strlen(p) + 1;
+	}
+	if (cr->cr_present & CR_GROUP) {
+		if ((groupname = p) == end || memchr(p, '\0', end - p) == NULL)
+			return;
+	}
+
+	cred_lookup(username, groupname, cr->cr_uid, cr->cr_gid, &rep);
+	rep.cr_seq = cr->cr_seq;
+	send(resolver_fd, &rep, sizeof(rep), 0);
+}
+
+/*
+ * main loop of the resolver. The request socket is passed as stdin.
+ */
+int
+cred_resolver_main(int argc __attribute__((unused)),
+		char **argv __attribute__((unused)))
+{
+	char			*buf;
+	ssize_t			r;
+	int			fd;
+
+	if ((resolver_fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 3)) == -1)
+		return EXIT_FAILURE;
+	if ((fd = open("/dev/null", O_RDONLY)) == -1)
+		return EXIT_FAILURE;
+	dup2(fd, STDIN_FILENO);
+	close(fd);
+
+	/* SIGHUP to all ubervisor processes reopens logfiles */
+	signal(SIGHUP, SIG_IGN);
+	buf = xmalloc(CRED_MSGSIZ);
+
+	for (;;) {
+		if ((r = recv(resolver_fd, buf, CRED_MSGSIZ, 0)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return EXIT_FAILURE;
+		}
+
+		/* server is gone */
+		if (r == 0)
+			return EXIT_SUCCESS;
+
+		if (r >= (ssize_t) sizeof(struct cred_req))
+			cred_resolver_handle(buf, r);
+	}
+}
+
+/*
+ * start the resolver. returns -1 on failure.
+ */
+int
+cred_resolver_start(void)
+{
+	int		sp[2];
+	pid_t		pid;
+	char		arg0[] = "ubervisor",
+			arg1[] = CRED_RESOLVER_CMD;
+	char		*args[3] = {arg0, arg1, NULL};
+
+	if (resolver_fd != -1) {
+		close(resolver_fd);
+		resolver_fd = -1;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sp) == -1)
+		return -1;
+
+	setcloseonexec(sp[0]);
+
+	if ((pid = fork()) == -1) {
+		close(sp[0]);
+		close(sp[1]);
+		return -1;
+	}
+
+	if (pid == 0) {
+		if (dup2(sp[1], STDIN_FILENO) == -1)
+			_exit(EXIT_FAILURE);
+		execv(CRED_RESOLVER_EXE, args);
+		_exit(EXIT_FAILURE);
+	}
+
+	close(sp[1]);
+	resolver_fd = sp[0];
+	resolver_pid = pid;
+	return 0;
+}
+
+pid_t
+cred_resolver_pid(void)
+{
+	return resolver_pid;
+}
+
+int
+cred_resolver_fd(void)
+{
+	return resolver_fd;
+}
+
+/*
+ * drop a stuck or broken resolver. The server notices the exit and starts a
+ * new one.
+ */
+void
+cred_resolver_stop(void)
+{
+	if (resolver_fd == -1)
+		return;
+	close(resolver_fd);
+	resolver_fd = -1;
+	kill(resolver_pid, SIGKILL);
+}
+
+/*
+ * the resolver exited and was reaped.
+ */
+void
+cred_resolver_reaped(void)
+{
+	if (resolver_fd != -1)
+		close(resolver_fd);
+	resolver_fd = -1;
+	resolver_pid = -1;
+}
+
+/*
+ * ask the resolver to look up username and groupname (either may be NULL),
+ * see cred_lookup(). Returns the sequence number of the request or 0 and sets errno. Never
+ * blocks.
+ */
+uint32_t
+cred_resolver_send(const char *username, const char *groupname, int uid,
+		int gid)
+{
+	char			buf[CRED_MSGSIZ];
+	struct cred_req		*cr = (struct cred_req *) buf;
+	size_t			off = sizeof(struct cred_req),
+				len;
+	ssize_t			r;
+
+	if (resolver_fd == -1) {
+		errno = EPIPE;
+		return 0;
+	}
+
+	cr->cr_present = 0;
+	cr->cr_uid = uid;
+	cr->cr_gid = gid;
+	if (username != NULL) {
+		if ((len = strlen(username) + 1) > sizeof(buf) - off) {
+			errno = ENAMETOOLONG;
+			return 0;
+		}
+		memcpy(buf + off, username, len);
+		off += len;
+		cr->cr_present |= CR_USER;
+	}
+	if (groupname != NULL) {
+		if ((len = strlen(groupname) + 1) > sizeof(buf) - off) {
+			errno = ENAMETOOLONG;
+			return 0;
+		}
+		memcpy(buf + off, groupname, len);
+		off += len;
+		cr->cr_present |= CR_GROUP;
+	}
+
+	/* 0 means error */
+	if (++resolver_seq == 0)
+		resolver_seq++;
+	cr->cr_seq = resolver_seq;
+
+	while ((r = send(resolver_fd, buf, off, MSG_DONTWAIT | MSG_NOSIGNAL))
+			== -1 && errno == EINTR)
+		;
+	if (r != (ssize_t) off)
+		return 0;
+	return resolver_seq;
+}
+
+/*
+ * read one reply of the resolver. Returns 1 if rep was read, 0 if there is
+ * none and -1 if the resolver is gone.
+ */
+int
+cred_resolver_recv(struct cred_rep *rep)
+{
+	ssize_t			r;
+
+	if (resolver_fd == -1)
+		return -1;
+	while ((r = recv(resolver_fd, rep, sizeof(struct cred_rep),
+			MSG_DONTWAIT)) == -1 && errno == EINTR)
+		;
+	if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return 0;
+	if (r != sizeof(struct cred_rep))
+		return -1;
+	return 1;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __CRED_H
+#define __CRED_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+/*
+ * reply to a lookup of a user and a group name. cr_errfunc is one of the
+ * CRED_F_* codes, 0 on success.
+ */
+struct cred_rep {
+	uint32_t		cr_seq;
+	int32_t			cr_uid,
+				cr_gid,
+				cr_errfunc,
+				cr_errno;
+};
+
+#define CRED_F_GETPWNAM		1
+#define CRED_F_GETGRNAM		2
+#define CRED_F_LOOKUP		3
+#define CRED_F_FORK		4
+
+void cred_lookup(const char *, const char *, int, int, struct cred_rep *);
+int cred_resolver_start(void);
+pid_t cred_resolver_pid(void);
+int cred_resolver_fd(void);
+void cred_resolver_stop(void);
+void cred_resolver_reaped(void);
+uint32_t cred_resolver_send(const char *, const char *, int, int);
+int cred_resolver_recv(struct cred_rep *);
+int cred_resolver_main(int, char **);
+
+#endif /* __CRED_H */
@@ -41,7 +41,12 @@ man_pages = [
     ('man/command_all',    'ubervisor-all',    u'Ubervisor-all',            [u'Kilian Klimek'], 1),
     ('man/command_pids',   'ubervisor-pids',   u'Ubervisor-pids',           [u'Kilian Klimek'], 1),
     ('man/command_read',   'ubervisor-read',   u'Ubervisor-read',           [u'Kilian Klimek'], 1),
+    ('man/command_roll',   'ubervisor-roll',   u'Ubervisor roll command',   [u'Kilian Klimek'], 1),
     ('man/command_subs',   'ubervisor-subs',   u'Ubervisor-subs',           [u'Kilian Klimek'], 1),
     ('man/command_proxy',  'ubervisor-proxy',  u'Ubervisor-proxy',          [u'Kilian Klimek'], 1),
+    ('man/command_stats',  'ubervisor-stats',  u'Ubervisor-stats',          [u'Kilian Klimek'], 1),
+    ('man/command_stop',   'ubervisor-stop',   u'Ubervisor stop command',   [u'Kilian Klimek'], 1),
+    ('man/command_upgrade', 'ubervisor-upgrade', u'Ubervisor upgrade command', [u'Kilian Klimek'], 1),
+    ('man/command_wait',   'ubervisor-wait',   u'Ubervisor wait command',   [u'Kilian Klimek'], 1),
 ]
 
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <json/json.h>
+
+#include "exitstat.h"
+
+#define TV_USEC(tv)	((long long) (tv).tv_sec * 1000000 + (tv).tv_usec)
+
+/*
+ * sum up resource usage of one process.
+ */
+static void
+exit_stat_rusage(struct exit_stat *es, const struct rusage *ru)
+{
+	es->es_utime += TV_USEC(ru->ru_utime);
+	es->es_stime += TV_USEC(ru->ru_stime);
+	if (ru->ru_maxrss > es->es_maxrss)
+		es->es_maxrss = ru->ru_maxrss;
+	es->es_minflt += ru->ru_minflt;
+	es->es_majflt += ru->ru_majflt;
+	es->es_nvcsw += ru->ru_nvcsw;
+	es->es_nivcsw += ru->ru_nivcsw;
+}
+
+/*
+ * add exit status and resource usage (may be NULL) of one process. An
+ * EXIT_UNKNOWN status is reported as code -1 and signal 0.
+ */
+void
+exit_stat_add(struct exit_stat *es, int status, const struct rusage *ru)
+{
+	es->es_exits++;
+	if (status == EXIT_UNKNOWN) {
+		es->es_adopted++;
+		es->es_code = -1;
+		es->es_signal = 0;
+	} else if (WIFSIGNALED(status)) {
+		es->es_code = -1;
+		es->es_signal = WTERMSIG(status);
+	} else {
+		es->es_code = WEXITSTATUS(status);
+		es->es_signal = 0;
+	}
+
+	if (ru != NULL)
+		exit_stat_rusage(es, ru);
+}
+
+/*
+ * add resource usage of a descendant that outlived its parent. Its exit
+ * status is not the one of the instance.
+ */
+void
+exit_stat_orphan(struct exit_stat *es, const struct rusage *ru)
+{
+	es->es_orphans++;
+	exit_stat_rusage(es, ru);
+}
+
+/*
+ * stats as json object. Times in seconds, counters as doubles since they
+ * may not fit into an int.
+ */
+json_object *
+exit_stat_to_json(const struct exit_stat *es)
+{
+	json_object	*obj;
+
+	obj = json_object_new_object();
+	json_object_object_add(obj, "exits", json_object_new_double(es->es_exits));
+	json_object_object_add(obj, "orphans", json_object_new_double(es->es_orphans));
+	json_object_object_add(obj, "adopted", json_object_new_double(es->es_adopted));
+	json_object_object_add(obj, "utime", json_object_new_double(es->es_utime / 1e6));
+	json_object_object_add(obj, "stime", json_object_new_double(es->es_stime / 1e6));
+	json_object_object_add(obj, "maxrss", json_object_new_double(es->es_maxrss));
+	json_object_object_add(obj, "minflt", json_object_new_double(es->es_minflt));
+	json_object_object_add(obj, "majflt", json_object_new_double(es->es_majflt));
+	json_object_object_add(obj, "nvcsw", json_object_new_double(es->es_nvcsw));
+	json_object_object_add(obj, "nivcsw", json_object_new_double(es->es_nivcsw));
+	if (es->es_exits > 0) {
+		json_object_object_add(obj, "code", json_object_new_int(es->es_code));
+		json_object_object_add(obj, "signal", json_object_new_int(es->es_signal));
+	}
+	return obj;
+}
+
+/*
+ * restore stats saved by exit_stat_to_json().
+ */
+void
+exit_stat_load(struct exit_stat *es, json_object *obj)
+{
+	json_object	*v;
+
+	if (obj == NULL || !json_object_is_type(obj, json_type_object))
+		return;
+#define LOAD(key, field, scale) \
+	if ((v = json_object_object_get(obj, key)) != NULL) \
+		es->field = json_object_get_double(v) * scale;
+	LOAD("exits", es_exits, 1);
+	LOAD("orphans", es_orphans, 1);
+	LOAD("adopted", es_adopted, 1);
+	LOAD("utime", es_utime, 1e6);
+	LOAD("stime", es_stime, 1e6);
+	LOAD("maxrss", es_maxrss, 1);
+	LOAD("minflt", es_minflt, 1);
+	LOAD("majflt", es_majflt, 1);
+	LOAD("nvcsw", es_nvcsw, 1);
+	LOAD("nivcsw", es_nivcsw, 1);
+#undef LOAD
+	if ((v = json_object_object_get(obj, "code")) != NULL)
+		es->es_code = json_object_get_int(v);
+	if ((v = json_object_object_get(obj, "signal")) != NULL)
+		es->es_signal = json_object_get_int(v);
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __EXITSTAT_H
+#define __EXITSTAT_H
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <json/json.h>
+
+/*
+ * exit status of a process the server did not reap (adopted from a previous
+ * server), for exit_stat_add().
+ */
+#define EXIT_UNKNOWN	(-1)
+
+/*
+ * resource usage of exited processes, summed up from wait4(). Times in
+ * microseconds, es_maxrss is the largest ru_maxrss seen (kilobytes).
+ */
+struct exit_stat {
+	long long	es_exits,
+			es_orphans,	/* descendants reaped by the server */
+			es_adopted,	/* exits with EXIT_UNKNOWN */
+			es_utime,
+			es_stime,
+			es_maxrss,
+			es_minflt,
+			es_majflt,
+			es_nvcsw,
+			es_nivcsw;
+	int		es_code,	/* of the last exit, -1 if killed */
+			es_signal;	/* of the last exit, 0 if exited */
+};
+
+void exit_stat_add(struct exit_stat *, int, const struct rusage *);
+void exit_stat_orphan(struct exit_stat *, const struct rusage *);
+json_object *exit_stat_to_json(const struct exit_stat *);
+void exit_stat_load(struct exit_stat *, json_object *);
+
+#endif /* __EXITSTAT_H */
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+
+#include <json/json.h>
+
+#include "hist.h"
+
+/*
+ * add value (microseconds) to histogram.
+ */
+void
+hist_add(struct hist *h, long long usec)
+{
+	int		i = 0;
+
+	if (usec < 0)
+		usec = 0;
+	h->h_count++;
+	h->h_sum += usec;
+	if (usec > h->h_max)
+		h->h_max = usec;
+	while (usec > 1 && i < HIST_BUCKETS - 1) {
+		usec >>= 1;
+		i++;
+	}
+	h->h_buckets[i]++;
+}
+
+/*
+ * histogram as json object: count, avg, max (microseconds) and buckets.
+ */
+json_object *
+hist_to_json(const struct hist *h)
+{
+	json_object	*obj,
+			*b;
+	int		i;
+
+	obj = json_object_new_object();
+	json_object_object_add(obj, "count", json_object_new_int(h->h_count));
+	json_object_object_add(obj, "avg",
+			json_object_new_int(h->h_count ? h->h_sum / h->h_count : 0));
+	json_object_object_add(obj, "max", json_object_new_int(h->h_max));
+
+	b = json_object_new_array();
+	for (i = 0; i < HIST_BUCKETS; i++)
+		json_object_array_add(b, json_object_new_int(h->h_buckets[i]));
+	json_object_object_add(obj, "buckets", b);
+	return obj;
+}
@@ -41,12 +41,19 @@
 #include "cmd_proxy.h"
 #include "cmd_subscribe.h"
 #include "cmd_read.h"
+#include "cmd_roll.h"
 #include "cmd_exit.h"
 #include "cmd_pids.h"
 #include "cmd_list.h"
 #include "cmd_dump.h"
 #include "cmd_delete.h"
 #include "cmd_kill.h"
+#include "cmd_stats.h"
+#include "cmd_stop.h"
+#include "cmd_upgrade.h"
+#include "cmd_wait.h"
+#include "spawn.h"
+#include "cred.h"
 
 #define AUTHOR		"Kilian Klimek <kilian.klimek@googlemail.com>"
 #ifdef DEBUG
@@ -80,10 +87,15 @@ help(void)
 	printf("\tpids\t get pids of processes in a group.\n");
 	printf("\tproxy\t multiplex stdin/out to socket.\n");
 	printf("\tread\t read from log file.\n");
+	printf("\troll\t restart the instances of a group in waves.\n");
 	printf("\tserver\t start the server\n");
 	printf("\tstart\t start a program\n");
+	printf("\tstats\t show spawn queue statistics.\n");
+	printf("\tstop\t stop a group, SIGKILL after its stop timeout.\n");
 	printf("\tsubs\t subscribe to server events.\n");
 	printf("\tupdate\t modify a group\n");
+	printf("\tupgrade\t execute a new server binary, keeping all processes.\n");
+	printf("\twait\t wait until all instances of a group are ready.\n");
 	printf("\n");
 	printf("`ubervisor <command> -h` to get a list of supported options.\n");
 	printf("\n");
@@ -133,6 +145,22 @@ main(int argc, char **argv)
 		ret = cmd_pids(argc, argv);
 	} else if (!strcmp(cmd, "read")) {
 		ret = cmd_read(argc, argv);
+	} else if (!strcmp(cmd, "roll")) {
+		ret = cmd_roll(argc, argv);
+	} else if (!strcmp(cmd, "stats")) {
+		ret = cmd_stats(argc, argv);
+	} else if (!strcmp(cmd, "stop")) {
+		ret = cmd_stop(argc, argv);
+	} else if (!strcmp(cmd, "upgrade")) {
+		ret = cmd_upgrade(argc, argv);
+	} else if (!strcmp(cmd, "wait")) {
+		ret = cmd_wait(argc, argv);
+	} else if (!strcmp(cmd, "spawn-helper")) {
+		/* started by the server, not documented */
+		ret = spawn_helper_main(argc, argv);
+	} else if (!strcmp(cmd, "cred-resolver")) {
+		/* started by the server, not documented */
+		ret = cred_resolver_main(argc, argv);
 	} else if (!strcmp(cmd, "-v") || !strcmp(cmd, "-V")) {
 		print_version();
 	} else {
@@ -29,6 +29,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include "misc.h"
 
@@ -82,6 +83,19 @@ setcloseonexec(int fd)
 	return 0;
 }
 
+int
+clearcloseonexec(int fd)
+{
+	int fl;
+	fl = fcntl(fd, F_GETFD);
+	if (fl < 0)
+		return fl;
+	fl &= ~FD_CLOEXEC;
+	if (fcntl(fd, F_SETFD, fl) < 0)
+		return -1;
+	return 0;
+}
+
 int
 setnonblock(int fd)
 {
@@ -105,3 +119,87 @@ xstrcmp(const char *a, const char *b) {
 		return 1;
 	return strcmp(a, b);
 }
+
+/*
+ * milliseconds on the monotonic clock. Only useful to measure intervals.
+ */
+long long
+monotonic_msec(void)
+{
+	return monotonic_usec() / 1000;
+}
+
+/*
+ * microseconds on the monotonic clock. The clock is the same for all
+ * processes, so timestamps from children can be compared. Safe to call in a
+ * vfork'ed child.
+ */
+long long
+monotonic_usec(void)
+{
+	struct timespec	ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1)
+		return 0;
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * user plus system time of a process in clock ticks, from /proc. Returns -1
+ * if the process is gone or /proc is not available.
+ */
+long long
+proc_cpu_ticks(pid_t pid)
+{
+	char			path[64],
+				buf[512],
+				*p;
+	unsigned long long	utime,
+				stime;
+	FILE			*f;
+	size_t			n;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+	if ((f = fopen(path, "r")) == NULL)
+		return -1;
+	n = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[n] = '\0';
+
+	/* the command name may contain spaces and parens */
+	if ((p = strrchr(buf, ')')) == NULL)
+		return -1;
+	if (sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+				&utime, &stime) != 2)
+		return -1;
+	return utime + stime;
+}
+
+/*
+ * parent pid and real user id of a process, from /proc. Returns -1 if the
+ * process is gone or /proc is not available.
+ */
+int
+proc_owner(pid_t pid, pid_t *ppid, uid_t *uid)
+{
+	char			path[64],
+				line[256];
+	unsigned long		v;
+	FILE			*f;
+	int			found = 0;
+
+	snprintf(path, sizeof(path), "/proc/%d/status", (int) pid);
+	if ((f = fopen(path, "r")) == NULL)
+		return -1;
+	while (found != 3 && fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "PPid: %lu", &v) == 1) {
+			*ppid = v;
+			found |= 1;
+		} else if (sscanf(line, "Uid: %lu", &v) == 1) {
+			*uid = v;
+			found |= 2;
+		}
+	}
+	fclose(f);
+	return found == 3 ? 0 : -1;
+}
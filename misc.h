@@ -37,5 +37,10 @@ char *xstrdup(const char *);
 void die(const char *) __attribute__ ((noreturn));
 int setnonblock(int);
 int setcloseonexec(int);
+int clearcloseonexec(int);
+long long monotonic_msec(void);
+long long monotonic_usec(void);
+long long proc_cpu_ticks(pid_t);
+int proc_owner(pid_t, pid_t *, uid_t *);
 
 #endif /* __MISC_H */
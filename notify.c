@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stddef.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "misc.h"
+#include "notify.h"
+
+/*
+ * bind the datagram socket children send readiness notifications to. name
+ * is the value of NOTIFY_SOCKET, a leading '@' is an abstract address.
+ * Returns the socket or -1.
+ */
+int
+notify_open(const char *name)
+{
+	struct sockaddr_un	sun;
+	size_t			len = strlen(name);
+	int			fd,
+				on = 1;
+
+	if (len >= sizeof(sun.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	memset(&sun, '\0', sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	memcpy(sun.sun_path, name, len);
+	if (name[0] == '@')
+		sun.sun_path[0] = '\0';
+	else
+		unlink(name);
+
+	if ((fd = socket(AF_UNIX, SOCK_DGRAM, 0)) == -1)
+		return -1;
+	if (bind(fd, (struct sockaddr *) &sun,
+			offsetof(struct sockaddr_un, sun_path) + len) == -1
+			|| setsockopt(fd, SOL_SOCKET, SO_PASSCRED, &on,
+				sizeof(on)) == -1) {
+		close(fd);
+		return -1;
+	}
+	setcloseonexec(fd);
+	setnonblock(fd);
+	return fd;
+}
+
+/*
+ * receive one notification into buf (NUL terminated). Descriptors sent
+ * along are closed. Returns the pid of the sender, 0 if the message had
+ * no credentials and -1 if there is none left.
+ */
+pid_t
+notify_recv(int fd, char *buf, size_t siz)
+{
+	union {
+		struct cmsghdr	cm;
+		char		b[CMSG_SPACE(sizeof(struct ucred))
+				  + CMSG_SPACE(sizeof(int) * 16)];
+	}			ctl;
+	struct msghdr		mh;
+	struct iovec		iov;
+	struct cmsghdr		*cm;
+	struct ucred		uc;
+	ssize_t			n;
+	pid_t			pid = 0;
+	int			i,
+				*fds;
+
+	iov.iov_base = buf;
+	iov.iov_len = siz - 1;
+	memset(&mh, '\0', sizeof(mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = &ctl;
+	mh.msg_controllen = sizeof(ctl);
+
+	do {
+		n = recvmsg(fd, &mh, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+	} while (n == -1 && errno == EINTR);
+	if (n == -1)
+		return -1;
+	buf[n] = '\0';
+
+	for (cm = CMSG_FIRSTHDR(&mh); cm != NULL; cm = CMSG_NXTHDR(&mh, cm)) {
+		if (cm->cmsg_level != SOL_SOCKET)
+			continue;
+		if (cm->cmsg_type == SCM_CREDENTIALS
+				&& cm->cmsg_len == CMSG_LEN(sizeof(struct ucred))) {
+			memcpy(&uc, CMSG_DATA(cm), sizeof(uc));
+			pid = uc.pid;
+		} else if (cm->cmsg_type == SCM_RIGHTS) {
+			fds = (int *) CMSG_DATA(cm);
+			for (i = 0; i < (int) ((cm->cmsg_len - CMSG_LEN(0))
+					/ sizeof(int)); i++)
+				close(fds[i]);
+		}
+	}
+	return pid;
+}
+
+/*
+ * parse the "KEY=VALUE" lines of a notification. Unknown keys are
+ * ignored, STATUS is cut at NOTIFY_STATUS_MAX bytes.
+ */
+void
+notify_parse(char *buf, struct notify_msg *nm)
+{
+	char		*line;
+
+	nm->nm_ready = -1;
+	nm->nm_reloading = -1;
+	nm->nm_watchdog = -1;
+	nm->nm_status = NULL;
+
+	while ((line = strsep(&buf, "\n")) != NULL) {
+		if (!strcmp(line, "READY=1"))
+			nm->nm_ready = 1;
+		else if (!strcmp(line, "RELOADING=1"))
+			nm->nm_reloading = 1;
+		else if (!strcmp(line, "WATCHDOG=1"))
+			nm->nm_watchdog = 1;
+		else if (!strncmp(line, "STATUS=", 7)) {
+			if (strlen(line + 7) > NOTIFY_STATUS_MAX)
+				line[7 + NOTIFY_STATUS_MAX] = '\0';
+			nm->nm_status = line + 7;
+		}
+	}
+}
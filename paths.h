@@ -32,5 +32,8 @@
 #define SOCK_PATH	"%s/.uber/socket"
 #define LOG_PATH	"%s/.uber/uber.log"
 #define DUMP_PATH	"uberdump_%d_%d_%s"
+#define STATE_PATH	"uberstate"
+#define UPGRADE_PATH	"uberupgrade"
+#define NOTIFY_PATH	"ubernotify"
 
 #endif /* __PATHS_H */
@@ -27,7 +27,11 @@
  */
 
 #include <sys/types.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <signal.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <event.h>
 
@@ -62,3 +66,46 @@ process_remove(struct process *p)
 	uvhash_remove(process_hash, p->p_pid);
 }
 
+
+/*
+ * open a pidfd for pid. Returns -1 if pidfds are not supported.
+ */
+int
+process_pidfd_open(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	(void) pid;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*
+ * send sig to p. With a pidfd the signal can't reach another process that
+ * got the pid of p.
+ */
+int
+process_kill(struct process *p, int sig)
+{
+#ifdef SYS_pidfd_send_signal
+	if (p->p_pidfd != -1)
+		return syscall(SYS_pidfd_send_signal, p->p_pidfd, sig, NULL, 0);
+#endif
+	return kill(p->p_pid, sig);
+}
+
+/*
+ * send sig to the process group of p, so forked workers and children of
+ * wrapper scripts get it too. Instances call setsid(), the group id is the
+ * pid of p and can't be reused before p was reaped. Falls back to p alone
+ * if it didn't call setsid() yet.
+ */
+int
+process_kill_group(struct process *p, int sig)
+{
+	if (kill(-p->p_pid, sig) == 0)
+		return 0;
+	return process_kill(p, sig);
+}
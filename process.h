@@ -37,6 +37,8 @@
 
 #include "uvhash.h"
 
+struct stop_op;
+
 struct process {
 	pid_t			p_pid;
 	time_t			p_start,
@@ -45,8 +47,27 @@ struct process {
 	struct child_config	*p_child_config;
 	int			p_instance;
 	struct event		p_heartbeat_timer;
-	struct bufferevent	*p_child_sockbuf;      		/* pipe to child process pre-execve */
-	int			p_child_sock;
+	int			p_pidfd;				/* -1 if not supported */
+	struct event		p_pidfd_ev;				/* or timer if p_gone */
+	int			p_gone;					/* reaped before it was known */
+	int			p_starting;				/* counted in spawn_inflight until execve */
+	int			p_failed;				/* child reported setup or execv failure */
+	int			p_standby;				/* p_instance is the standby slot */
+	int			p_state_slot;				/* record in the state file, -1 if none */
+	int			p_adopted;				/* started by a previous server, not a child */
+	unsigned long long	p_ticks;				/* kernel start time of adopted processes */
+	int			p_stopping;				/* SIGKILL at p_stop_until */
+	time_t			p_stop_until;
+	struct event		p_stop_timer;
+	struct stop_op		*p_stop_op;				/* STOP or EXIT waiting for the exit */
+	int			p_ready,				/* sent READY=1 */
+				p_reloading;				/* sent RELOADING=1 */
+	char			*p_status;				/* last STATUS=, NULL if none */
+	time_t			p_watchdog;				/* last WATCHDOG=1, 0 if none */
+	long long		p_spawn_usec,				/* monotonic, before fork */
+				p_exec_usec,				/* monotonic, before execv */
+				p_setids_usec,
+				p_logopen_usec;
 };
 
 extern uvhash_t			*process_hash;
@@ -55,5 +76,8 @@ void process_insert(struct process *);
 struct process * process_find_by_pid(pid_t);
 struct process * process_find_instance(struct child_config *, int);
 void process_remove(struct process *);
+int process_pidfd_open(pid_t);
+int process_kill(struct process *, int);
+int process_kill_group(struct process *, int);
 
 #endif /* __PROCESS_H */
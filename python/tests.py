@@ -32,12 +32,16 @@
 import sys
 from ubervisor import *
 from unittest import TestCase, TestLoader, TextTestRunner
-from os import stat, unlink, path, environ
-from time import sleep
+from os import stat, unlink, path, environ, mkdir, kill, listdir, getuid, \
+        chmod
+from pwd import getpwuid, getpwnam
+from time import sleep, time
 from tempfile import mkdtemp
 from shutil import rmtree
+from signal import SIGSTOP, SIGCONT, SIGKILL
 from subprocess import Popen, PIPE
 from socket import error as socket_error
+from socket import socket, AF_INET, AF_UNIX
 from uuid import uuid4
 
 SEND_GARBAGE = True
@@ -56,6 +60,13 @@ class BaseTest(TestCase):
                 command = [environ.get("UBERVISOR_PATH", ""), 'proxy'],
                 sock_file = environ.get("UBERVISOR_SOCKET"))
 
+    def free_port(self):
+        s = socket(AF_INET)
+        s.bind(('127.0.0.1', 0))
+        port = s.getsockname()[1]
+        s.close()
+        return port
+
     def setUp(self):
         self.c = self.get_client()
         self.c._delete = self.c.delete
@@ -146,6 +157,14 @@ class TestStartCommand(BaseTest):
         r = self.c.delete(self.group_name)
         self.assertEqual(len(r), 1)
 
+    def test_start_priority(self):
+        self.c.start(self.group_name, ['/bin/sleep', '1'], priority = 5)
+        r = self.c.get(self.group_name)
+        self.assertEqual(r['priority'], 5)
+
+    def test_start_priority_err(self):
+        self.assertRaises(UbervisorClientException, self.c.start, self.group_name, ['/bin/sleep', '0.1'], priority = -2)
+
     def test_start_instances_err_0(self):
         self.assertRaises(UbervisorClientException, self.c.start, self.group_name, ['/bin/sleep', '0.1'], instances = 0)
 
@@ -199,6 +218,84 @@ class TestKillCommand(BaseTest):
         r = self.c.kill(self.group_name, sig = 15)
         self.assertEqual(len(r), 1)
 
+class TestReap(BaseTest):
+    def gone(self, pid):
+        try:
+            kill(pid, 0)
+        except OSError:
+            return True
+        return False
+
+    def test_reap_batch(self):
+        # the heartbeat kills the instance and exits with it, the instance
+        # is reaped and restarted all the same
+        hb = path.join(self.tmpdir, 'hb')
+        f = open(hb, 'w')
+        f.write('#!/bin/sh\nkill -9 $2\n')
+        f.close()
+        chmod(hb, 0755)
+        self.c.start(self.group_name, ['/bin/sleep', '30'], heartbeat = hb)
+        sleep(0.5)
+        r1 = self.c.pids(self.group_name)
+        self.assertEqual(len(r1), 1)
+        sleep(5)
+        r2 = self.c.pids(self.group_name)
+        self.assertEqual(len(r2), 1)
+        self.assertNotEqual(r1, r2)
+        self.assertTrue(self.gone(r1[0]))
+        self.assertEqual(self.c.get(self.group_name)['exit_stats']['exits'], 1)
+
+    def test_kill_reaped(self):
+        self.c.start(self.group_name, ['/bin/sleep', '30'],
+                backoff = 'initial=5000,jitter=0')
+        sleep(0.5)
+        r = self.c.pids(self.group_name)
+        self.assertEqual(self.c.kill(self.group_name, index = 0), r)
+        sleep(0.5)
+        self.assertTrue(self.gone(r[0]))
+        self.assertEqual(self.c.kill(self.group_name, index = 0), [])
+        self.assertEqual(self.c.kill(self.group_name), [])
+
+class TestProcessGroup(BaseTest):
+    def alive(self, pid):
+        try:
+            kill(pid, 0)
+        except OSError:
+            return False
+        return True
+
+    def test_kill_group(self):
+        cmd = 'sleep 100 & echo $! > %s; wait' % self.tmpfile
+        self.c.start(self.group_name, ['/bin/sh', '-c', cmd])
+        sleep(0.3)
+        pid = int(open(self.tmpfile).read())
+        self.assertTrue(self.alive(pid))
+        self.c.kill(self.group_name)
+        sleep(0.3)
+        self.assertFalse(self.alive(pid))
+
+    def test_orphans(self):
+        self.c.start(self.group_name, ['/bin/sh', '-c',
+                '(sleep 0.2 &); exec sleep 10'])
+        sleep(0.8)
+        r = self.c.get(self.group_name)
+        self.assertEqual(r['exit_stats']['exits'], 0)
+        self.assertEqual(r['exit_stats']['orphans'], 1)
+        self.assertEqual(r['instance_exit_stats'][0]['orphans'], 1)
+
+    def test_delete_session(self):
+        # the instance exits, its child is killed on delete
+        cmd = 'sleep 100 & echo $! > %s; exit 1' % self.tmpfile
+        self.c.start(self.group_name, ['/bin/sh', '-c', cmd],
+                crashloop = 'count=1')
+        sleep(0.3)
+        self.assertEqual(self.c.get(self.group_name)['status'], STATUS_BROKEN)
+        pid = int(open(self.tmpfile).read())
+        self.assertTrue(self.alive(pid))
+        self.c.delete(self.group_name)
+        sleep(0.3)
+        self.assertFalse(self.alive(pid))
+
 class TestPidsCommand(BaseTest):
     def test_pids0(self):
         self.c.start(self.group_name, ['/bin/sleep', '1'], status = STATUS_STOPPED,
@@ -374,6 +471,22 @@ class TestReplace(BaseTest):
         for x in range(0, 2):
             stat(n % x)
 
+    def test_args_replace(self):
+        fs = path.join(self.tmpdir, '%(NAME)-%(NUM).log')
+        self.c.start(self.group_name, ['/bin/sh', '-c',
+            'echo %(NAME) %(NUM) %(PORT); sleep 1'], instances = 2,
+            stdout = fs, port = 8000)
+        sleep(0.2)
+        self.c.update(self.group_name, status = 2)
+        for x in range(0, 2):
+            f = open(path.join(self.tmpdir, '%s-%d.log' % (self.group_name, x)))
+            self.assertEqual(f.read(), '%s %d %d\n' % (self.group_name, x, 8000 + x))
+            f.close()
+
+    def test_port_required(self):
+        self.assertRaises(UbervisorClientException, self.c.start,
+                self.group_name, ['/bin/echo', '%(PORT)'])
+
 class TestUpdateCommand(BaseTest):
     def test_instances_increase(self):
         self.c.start(self.group_name, ['/bin/sleep', '1'], instances = 1)
@@ -459,6 +572,14 @@ class TestUpdateCommand(BaseTest):
         r = self.c.get(self.group_name)
         self.assertEqual(r['age'], 10)
 
+    def test_priority(self):
+        self.c.start(self.group_name, ['/bin/sleep', '1'])
+        r = self.c.get(self.group_name)
+        self.assertEqual(r['priority'], 0)
+        self.c.update(self.group_name, priority = 3)
+        r = self.c.get(self.group_name)
+        self.assertEqual(r['priority'], 3)
+
 
 class TestListCommand(BaseTest):
     def test_list0(self):
@@ -484,6 +605,29 @@ class TestListCommand(BaseTest):
         r = self.c.list()
         self.assertEquals(r, [self.group_name])
 
+class TestStatsCommand(BaseTest):
+    def test_stats(self):
+        r = self.c.stats()
+        for x in ('queued', 'inflight', 'rate', 'max_inflight', 'spawned',
+                'wait_oldest', 'wait_avg', 'wait_max'):
+            self.assertTrue(x in r)
+
+    def test_stats_spawned(self):
+        n = self.c.stats()['spawned']
+        self.c.start(self.group_name, ['/bin/sleep', '1'], instances = 3)
+        r = self.c.stats()
+        self.assertEqual(r['spawned'], n + 3)
+        self.assertEqual(r['queued'], 0)
+
+    def test_stats_latency(self):
+        n = self.c.stats()['fork_exec']['count']
+        self.c.start(self.group_name, ['/bin/sleep', '1'], instances = 2)
+        sleep(0.1)
+        r = self.c.stats()
+        self.assertEqual(r['fork_exec']['count'], n + 2)
+        self.assertEqual(sum(r['fork_exec']['buckets']), n + 2)
+        self.assertEqual(r['setids']['count'], n + 2)
+
 class TestRead(BaseTest):
 
     cmd = path.join(path.dirname(path.abspath(__file__)), 'sleep_echo.sh')
@@ -528,6 +672,871 @@ class TestRead(BaseTest):
         self.c.delete(self.group_name)
 
 
+class TestZygote(BaseTest):
+
+    cmd = path.join(path.dirname(path.abspath(__file__)), 'zygote_sleep.py')
+
+    def test_zygote(self):
+        self.c.start(self.group_name, [sys.executable, self.cmd],
+                instances = 2, zygote = True,
+                stdout = path.join(self.tmpdir, 'out-%(NUM)'))
+        sleep(1)
+        r = self.c.pids(self.group_name)
+        self.assertEqual(len(r), 2)
+        stat(path.join(self.tmpdir, 'out-0'))
+        stat(path.join(self.tmpdir, 'out-1'))
+        self.assertEqual(self.c.get(self.group_name)['zygote'], 1)
+
+    def test_zygote_restart(self):
+        self.c.start(self.group_name, [sys.executable, self.cmd],
+                instances = 2, zygote = True)
+        sleep(1)
+        r1 = self.c.pids(self.group_name)
+        self.c.kill(self.group_name, index = 0)
+        sleep(1)
+        r2 = self.c.pids(self.group_name)
+        self.assertEqual(len(r2), 2)
+        self.assertNotEqual(sorted(r1), sorted(r2))
+
+    def test_zygote_env(self):
+        self.c.start(self.group_name, [sys.executable, self.cmd, self.tmpdir],
+                instances = 2, zygote = True, port = 9000,
+                env = {'FOO': 'bar-%(NUM)'})
+        sleep(1)
+        for i in range(2):
+            f = open(path.join(self.tmpdir, 'env.%d' % i)).read()
+            e = dict(l.split('=', 1) for l in f.splitlines() if '=' in l)
+            self.assertEqual(e['INSTANCE'], str(i))
+            self.assertEqual(e['PORT'], str(9000 + i))
+            self.assertEqual(e['FOO'], 'bar-%d' % i)
+
+class TestStandby(BaseTest):
+    def test_standby(self):
+        self.c.start(self.group_name, ['/bin/sleep', '10'], standby = 2)
+        sleep(0.5)
+        s = self.c.pids(self.group_name, standby = True)
+        self.assertEqual(len(s), 2)
+        self.c.kill(self.group_name, index = 0)
+        sleep(0.5)
+        r = self.c.pids(self.group_name)
+        self.assertEqual(len(r), 1)
+        self.assertTrue(r[0] in s)
+        self.assertEqual(len(self.c.pids(self.group_name, standby = True)), 2)
+        self.c.kill(self.group_name)
+
+    def test_standby_update(self):
+        self.c.start(self.group_name, ['/bin/sleep', '10'])
+        self.c.update(self.group_name, standby = 1)
+        self.assertEqual(self.c.get(self.group_name)['standby'], 1)
+        sleep(0.5)
+        self.assertEqual(len(self.c.pids(self.group_name, standby = True)), 1)
+        self.c.update(self.group_name, standby = 0)
+        self.assertEqual(len(self.c.pids(self.group_name, standby = True)), 0)
+        self.c.kill(self.group_name)
+
+    def test_standby_tokens(self):
+        self.assertRaises(UbervisorClientException, self.c.start,
+                self.group_name, ['/bin/sleep', '10'], standby = 1,
+                stdout = path.join(self.tmpdir, '%(NUM)'))
+
+class TestEnv(BaseTest):
+    def read_env(self, num):
+        f = open(path.join(self.tmpdir, 'env.%d' % num)).read()
+        return dict(l.split('=', 1) for l in f.splitlines() if '=' in l)
+
+    def test_env(self):
+        cmd = 'env > %s/env.$INSTANCE; sleep 10' % self.tmpdir
+        self.c.start(self.group_name, ['/bin/sh', '-c', cmd], instances = 2,
+                port = 9000, env = {'FOO': 'bar-%(NUM)', 'GROUP': 'mine'})
+        self.assertEqual(self.c.get(self.group_name)['env'],
+                ['FOO=bar-%(NUM)', 'GROUP=mine'])
+        sleep(0.5)
+        e = self.read_env(1)
+        self.assertEqual(e['FOO'], 'bar-1')
+        self.assertEqual(e['GROUP'], 'mine')
+        self.assertEqual(e['INSTANCE'], '1')
+        self.assertEqual(e['INSTANCES'], '2')
+        self.assertEqual(e['PORT'], '9001')
+        self.assertEqual(e['PATH'], environ['PATH'])
+
+        # used for processes started from now on
+        self.c.update(self.group_name, env = {'FOO': 'baz'}, instances = 3)
+        self.c.kill(self.group_name, index = 0)
+        sleep(0.5)
+        e = self.read_env(0)
+        self.assertEqual(e['FOO'], 'baz')
+        self.assertEqual(e['GROUP'], self.group_name)
+        self.assertEqual(e['INSTANCES'], '3')
+        self.c.update(self.group_name, env = {})
+        self.assertFalse('env' in self.c.get(self.group_name))
+        self.c.kill(self.group_name)
+
+    def test_env_err(self):
+        self.assertRaises(UbervisorClientException, self.c.start,
+                self.group_name, ['/bin/sleep', '1'], env = {'': 'x'})
+
+class TestExitStats(BaseTest):
+    def test_exit_stats(self):
+        cmd = 'i=0; while [ $i -lt 20000 ]; do i=$((i+1)); done; exit 3'
+        self.c.start(self.group_name, ['/bin/sh', '-c', cmd], instances = 2)
+        sleep(1.5)
+        r = self.c.get(self.group_name)
+        es = r['exit_stats']
+        self.assertTrue(es['exits'] >= 2)
+        self.assertEqual(es['code'], 3)
+        self.assertEqual(es['signal'], 0)
+        self.assertTrue(es['utime'] + es['stime'] > 0)
+        self.assertTrue(es['maxrss'] > 0)
+        inst = r['instance_exit_stats']
+        self.assertEqual(len(inst), 2)
+        self.assertEqual(sum(i['exits'] for i in inst), es['exits'])
+
+class TestBackoff(BaseTest):
+    def test_backoff(self):
+        self.c.start(self.group_name, ['/bin/sh', '-c', 'exit 1'],
+                backoff = 'initial=300,max=600,jitter=0')
+        sleep(1)
+        r = self.c.get(self.group_name)
+        self.assertEqual(r['backoff'], 'initial=300,max=600,jitter=0')
+        self.assertTrue(r['exit_stats']['exits'] <= 4)
+        self.assertEqual(r['backoff_state'][0]['delay'], 600)
+        self.assertEqual(r['status'], 1)
+
+        # removing the policy restarts at once
+        self.c.update(self.group_name, backoff = '')
+        sleep(0.5)
+        r = self.c.get(self.group_name)
+        self.assertFalse('backoff' in r)
+        self.assertFalse('backoff_state' in r)
+        self.assertEqual(r['status'], 3)
+
+    def test_backoff_priority(self):
+        m = path.join(self.tmpdir, 'ran')
+        cmd = 'if [ -e %s ]; then sleep 10; fi; touch %s; exit 1' % (m, m)
+        self.c.start(self.group_name, ['/bin/sh', '-c', cmd],
+                backoff = 'initial=2000,jitter=0')
+        sleep(0.5)
+        self.assertEqual(self.c.pids(self.group_name), [])
+
+        # the delayed restart is not requeued by a priority change
+        self.c.update(self.group_name, priority = 5)
+        sleep(0.5)
+        r = self.c.get(self.group_name)
+        self.assertEqual(r['exit_stats']['exits'], 1)
+        self.assertEqual(self.c.pids(self.group_name), [])
+        sleep(1.5)
+        self.assertEqual(len(self.c.pids(self.group_name)), 1)
+
+    def test_backoff_err(self):
+        for spec in ('initial', 'initial=0', 'foo=1', 'max=10,initial=20',
+                'jitter=101'):
+            self.assertRaises(UbervisorClientException, self.c.start,
+                    self.group_name, ['/bin/sleep', '1'], backoff = spec)
+
+class TestCrashloop(BaseTest):
+    def test_crashloop_instance(self):
+        cmd = 'if [ $INSTANCE = 0 ]; then exit 1; fi; sleep 10'
+        self.c.start(self.group_name, ['/bin/sh', '-c', cmd], instances = 2,
+                crashloop = 'count=3,scope=instance')
+        sleep(1)
+        r = self.c.get(self.group_name)
+        self.assertEqual(r['crashloop'], 'count=3,scope=instance')
+        self.assertEqual(r['status'], 1)
+        self.assertEqual(r['broken_instances'], [0])
+        self.assertEqual(r['instance_exit_stats'][0]['exits'], 3)
+        self.assertEqual(len(self.c.pids(self.group_name)), 1)
+
+        # a new policy starts the broken instance again
+        self.c.update(self.group_name, crashloop = 'count=5,scope=instance')
+        sleep(1)
+        r = self.c.get(self.group_name)
+        self.assertEqual(r['broken_instances'], [0])
+        self.assertEqual(r['instance_exit_stats'][0]['exits'], 8)
+
+        self.c.update(self.group_name, crashloop = '')
+        r = self.c.get(self.group_name)
+        self.assertFalse('crashloop' in r)
+        self.assertFalse('broken_instances' in r)
+        self.c.kill(self.group_name)
+
+    def test_crashloop_group(self):
+        cmd = 'if [ $INSTANCE = 0 ]; then exit 1; fi; sleep 10'
+        self.c.start(self.group_name, ['/bin/sh', '-c', cmd], instances = 4,
+                crashloop = 'count=2')
+        sleep(1)
+        r = self.c.get(self.group_name)
+        self.assertEqual(r['status'], 3)
+        self.assertEqual(r['exit_stats']['exits'], 2)
+
+    def test_crashloop_err(self):
+        for spec in ('count', 'count=0', 'count=33', 'window=0', 'foo=1',
+                'scope=foo'):
+            self.assertRaises(UbervisorClientException, self.c.start,
+                    self.group_name, ['/bin/sleep', '1'], crashloop = spec)
+
+class TestListen(BaseTest):
+    def test_listen(self):
+        port = self.free_port()
+        spec = 'tcp:%d' % port
+        cmd = 'echo $LISTEN_FDS $LISTEN_PID $$ `readlink /proc/$$/fd/3`; sleep 10'
+        self.c.start(self.group_name, ['/bin/sh', '-c', cmd], listen = [spec],
+                stdout = self.tmpfile)
+        self.assertEqual(self.c.get(self.group_name)['listen'], [spec])
+        sleep(0.5)
+        f = open(self.tmpfile).read().split()
+        self.assertEqual(f[0], '1')
+        self.assertEqual(f[1], f[2])
+        self.assertTrue(f[3].startswith('socket:'))
+        # the server keeps the socket, connects work across restarts
+        self.c.kill(self.group_name)
+        s = socket(AF_INET)
+        s.connect(('127.0.0.1', port))
+        s.close()
+        self.c.kill(self.group_name)
+
+    def test_listen_unix(self):
+        p = path.join(self.tmpdir, 'sock')
+        self.c.start(self.group_name, ['/bin/sleep', '10'],
+                listen = ['unix:' + p])
+        s = socket(AF_UNIX)
+        s.connect(p)
+        s.close()
+        self.c.kill(self.group_name)
+
+    def test_listen_err(self):
+        self.assertRaises(UbervisorClientException, self.c.start,
+                self.group_name, ['/bin/sleep', '1'], listen = ['foo:1'])
+        self.assertRaises(UbervisorClientException, self.c.start,
+                self.group_name, ['/bin/sleep', '1'], listen = ['tcp:0'])
+
+class TestOndemand(BaseTest):
+    def test_ondemand(self):
+        port = self.free_port()
+        cmd = ('import socket, time; '
+            's = socket.fromfd(3, socket.AF_INET, socket.SOCK_STREAM); '
+            's.accept()[0].close(); time.sleep(30)')
+        self.c.start(self.group_name, [sys.executable, '-c', cmd],
+                listen = ['tcp:%d' % port], ondemand = 1)
+        self.assertEqual(self.c.get(self.group_name)['ondemand'], 1)
+        self.assertEqual(self.c.pids(self.group_name), [])
+        s = socket(AF_INET)
+        s.connect(('127.0.0.1', port))
+        sleep(0.5)
+        self.assertEqual(len(self.c.pids(self.group_name)), 1)
+        s.close()
+        # idle after the connection was accepted
+        sleep(3.5)
+        self.assertEqual(self.c.pids(self.group_name), [])
+        s = socket(AF_INET)
+        s.connect(('127.0.0.1', port))
+        sleep(0.5)
+        self.assertEqual(len(self.c.pids(self.group_name)), 1)
+        s.close()
+        self.c.kill(self.group_name)
+
+    def test_ondemand_err(self):
+        self.assertRaises(UbervisorClientException, self.c.start,
+                self.group_name, ['/bin/sleep', '1'], ondemand = 1)
+
+class TestCpus(BaseTest):
+    def test_cpus(self):
+        self.c.start(self.group_name, ['/bin/sleep', '10'], cpus = '0',
+                instances = 2)
+        sleep(0.2)
+        r = self.c.get(self.group_name)
+        self.assertEqual(r['cpus'], '0')
+        self.assertEqual(r['cpus_effective'], ['0', '0'])
+        self.c.update(self.group_name, cpus = 'spread')
+        self.assertEqual(self.c.get(self.group_name)['cpus'], 'spread')
+        self.c.kill(self.group_name)
+
+    def test_cpus_err(self):
+        self.assertRaises(UbervisorClientException, self.c.start,
+                self.group_name, ['/bin/sleep', '1'], cpus = '0-')
+        self.assertRaises(UbervisorClientException, self.c.start,
+                self.group_name, ['/bin/sleep', '1'], cpus = 'spread',
+                standby = 1)
+
+class TestResources(BaseTest):
+    def test_resources(self):
+        self.c.start(self.group_name, ['/bin/sleep', '10'], nice = 5,
+                sched = 'batch', rlimits = 'nofile=100:200,core=0',
+                oom_score_adj = 100, ioprio = 'be:6')
+        sleep(0.2)
+        pid = self.c.pids(self.group_name)[0]
+        fields = open('/proc/%d/stat' % pid).read().rsplit(')', 1)[1].split()
+        self.assertEqual(int(fields[16]), 5)
+        self.assertEqual(int(fields[38]), 3)  # SCHED_BATCH
+        limits = open('/proc/%d/limits' % pid).read()
+        self.assertTrue('Max open files            100                  200' in limits)
+        self.assertEqual(open('/proc/%d/oom_score_adj' % pid).read(), '100\n')
+
+        # used for the next process
+        self.c.update(self.group_name, nice = 3, sched = 'other')
+        r = self.c.get(self.group_name)
+        self.assertEqual(r['nice'], 3)
+        self.assertEqual(r['sched'], 'other')
+        self.assertEqual(r['ioprio'], 'be:6')
+        self.c.kill(self.group_name)
+
+    def test_resources_err(self):
+        for kw in [dict(nice = 20), dict(sched = 'fifo'),
+                dict(rlimits = 'nofile'), dict(rlimits = 'stack=1'),
+                dict(ioprio = 'be:8'), dict(oom_score_adj = 1001)]:
+            self.assertRaises(UbervisorClientException, self.c.start,
+                    self.group_name, ['/bin/sleep', '1'], **kw)
+        self.c.start(self.group_name, ['/bin/sleep', '1'])
+        self.assertRaises(UbervisorClientException, self.c.update,
+                self.group_name, nice = -21)
+        self.c.delete(self.group_name)
+
+class TestCgroup(BaseTest):
+    def test_cgroup(self):
+        # a second server with a directory as fake cgroup root: limits are
+        # written to files, processes are not moved.
+        run = environ.get("UBERVISOR_RUN", None)
+        if not run:
+            return
+        root = path.join(self.tmpdir, 'cgroup')
+        sock = path.join(self.tmpdir, 'socket')
+        mkdir(root)
+        env = dict(environ, UBERVISOR_SOCKET = sock)
+        p = Popen([run, 'server', '-f', '-g', root, '-o',
+                path.join(self.tmpdir, 'log')], env = env)
+        for x in range(100):
+            if path.exists(sock):
+                break
+            sleep(0.05)
+        c = UbervisorClient(sock_file = sock)
+        try:
+            c.start(self.group_name, ['/bin/sleep', '10'],
+                    cgroup = 'cpu.max=50000/100000,memory.max=64m')
+            d = path.join(root, self.group_name)
+            self.assertEqual(open(path.join(d, 'cpu.max')).read(), '50000 100000')
+            self.assertEqual(open(path.join(d, 'memory.max')).read(), '67108864')
+
+            # limits left out are reset
+            c.update(self.group_name, cgroup = 'pids.max=10')
+            self.assertEqual(open(path.join(d, 'pids.max')).read(), '10')
+            self.assertEqual(open(path.join(d, 'memory.max')).read(), 'max')
+            self.assertTrue('cgroup_stats' in c.get(self.group_name))
+
+            for spec in ['cpu.weight=0', 'memory.max=1x', 'io.max=1']:
+                self.assertRaises(UbervisorClientException, c.update,
+                        self.group_name, cgroup = spec)
+            c.kill(self.group_name)
+            c.delete(self.group_name)
+            sleep(0.5)
+            self.assertFalse(path.exists(d))
+
+            # removed once the processes of the deleted group exited
+            cmd = 'trap "" TERM; while :; do sleep 0.1; done'
+            c.start(self.group_name, ['/bin/sh', '-c', cmd],
+                    cgroup = 'pids.max=10', stop_timeout = 1)
+            sleep(0.3)
+            c.delete(self.group_name)
+            self.assertTrue(path.exists(d))
+            sleep(1.5)
+            self.assertFalse(path.exists(d))
+        finally:
+            c.close()
+            Popen([run, 'exit'], env = env, stdout = PIPE).wait()
+            p.wait()
+
+    def test_cgroup_no_root(self):
+        self.assertRaises(UbervisorClientException, self.c.start,
+                self.group_name, ['/bin/sleep', '1'], cgroup = 'pids.max=1')
+
+class TestAdopt(BaseTest):
+    def server(self, *args):
+        run = environ.get("UBERVISOR_RUN", None)
+        sock = path.join(self.tmpdir, 'socket')
+        env = dict(environ, UBERVISOR_SOCKET = sock)
+        p = Popen([run, 'server', '-f', '-d', self.tmpdir, '-o',
+                path.join(self.tmpdir, 'log')] + list(args), env = env,
+                stdout = PIPE)
+        for x in range(100):
+            if path.exists(sock):
+                break
+            sleep(0.05)
+        sleep(0.2)
+        return p, UbervisorClient(sock_file = sock)
+
+    def test_adopt(self):
+        # a restarted server takes over the running instances
+        if not environ.get("UBERVISOR_RUN", None):
+            return
+        p, c = self.server()
+        c.start(self.group_name, ['/bin/sleep', '10'], instances = 2)
+        sleep(0.3)
+        pids = c.pids(self.group_name)
+        c.dump()
+        c.close()
+        p.kill()
+        p.wait()
+
+        p, c = self.server('-l')
+        try:
+            self.assertEqual(c.pids(self.group_name), pids)
+            # exits are noticed and the instance is started again
+            kill(pids[0], 15)
+            sleep(0.5)
+            n = c.pids(self.group_name)
+            self.assertEqual(len(n), 2)
+            self.assertFalse(pids[0] in n)
+            self.assertTrue(pids[1] in n)
+            # the exit status went to another process
+            r = c.get(self.group_name)['instance_exit_stats'][0]
+            self.assertEqual(r['exits'], 1)
+            self.assertEqual(r['adopted'], 1)
+            self.assertEqual(r['code'], -1)
+            self.assertEqual(r['signal'], 0)
+            c.delete(self.group_name)
+        finally:
+            c.close()
+            p.kill()
+            p.wait()
+
+    def test_upgrade(self):
+        # the server executes itself again, processes and connections stay
+        if not environ.get("UBERVISOR_RUN", None):
+            return
+        p, c = self.server()
+        try:
+            c.start(self.group_name, ['/bin/sleep', '10'], instances = 2)
+            sleep(0.3)
+            kill(c.pids(self.group_name)[0], 15)
+            sleep(0.5)
+            pids = c.pids(self.group_name)
+            c.upgrade()
+            self.assertEqual(p.poll(), None)
+            self.assertEqual(c.pids(self.group_name), pids)
+            r = c.get(self.group_name)
+            self.assertEqual(r['exit_stats']['exits'], 1)
+            self.assertFalse(path.exists(path.join(self.tmpdir, 'uberupgrade')))
+            kill(pids[1], 15)
+            sleep(0.5)
+            n = c.pids(self.group_name)
+            self.assertEqual(len(n), 2)
+            self.assertTrue(pids[0] in n)
+            self.assertFalse(pids[1] in n)
+            self.assertEqual(c.get(self.group_name)['exit_stats']['exits'], 2)
+            self.assertRaises(UbervisorClientException, c.upgrade,
+                    '/nonexistent')
+            c.delete(self.group_name)
+        finally:
+            c.close()
+            p.kill()
+            p.wait()
+
+    def test_upgrade_zygote(self):
+        # the zygote and its control socket survive the upgrade
+        if not environ.get("UBERVISOR_RUN", None):
+            return
+        cmd = path.join(path.dirname(path.abspath(__file__)), 'zygote_sleep.py')
+        p, c = self.server()
+        try:
+            c.start(self.group_name, [sys.executable, cmd], instances = 2,
+                    zygote = True)
+            sleep(1)
+            pids = c.pids(self.group_name)
+            self.assertEqual(len(pids), 2)
+            zyg = self.zygote_pid(cmd, pids)
+            c.upgrade()
+            self.assertEqual(c.pids(self.group_name), pids)
+            # instances are still forked by the same zygote
+            kill(pids[0], 15)
+            sleep(1)
+            n = c.pids(self.group_name)
+            self.assertEqual(len(n), 2)
+            self.assertFalse(pids[0] in n)
+            self.assertEqual(self.zygote_pid(cmd, n), zyg)
+            c.delete(self.group_name)
+        finally:
+            c.close()
+            p.kill()
+            p.wait()
+
+    def zygote_pid(self, cmd, pids):
+        z = []
+        for d in listdir('/proc'):
+            try:
+                a = open('/proc/%s/cmdline' % d).read().split('\0')
+            except (IOError, OSError):
+                continue
+            if cmd in a and int(d) not in pids:
+                z.append(int(d))
+        self.assertEqual(len(z), 1)
+        return z[0]
+
+    def test_exit_stop(self):
+        # the server stops all groups and exits when they exited
+        if not environ.get("UBERVISOR_RUN", None):
+            return
+        p, c = self.server()
+        try:
+            c.start(self.group_name, ['/bin/sh', '-c', 'trap "" TERM; sleep 10'],
+                    instances = 2, stop_timeout = 1)
+            sleep(0.3)
+            pids = c.pids(self.group_name)
+            c.exit(stop = True)
+            for x in range(40):
+                if p.poll() is not None:
+                    break
+                sleep(0.05)
+            self.assertEqual(p.poll(), 0)
+            for pid in pids:
+                self.assertRaises(OSError, kill, pid, 0)
+        finally:
+            c.close()
+            if p.poll() is None:
+                p.kill()
+            p.wait()
+
+class TestStop(BaseTest):
+    def test_stop(self):
+        self.c.start(self.group_name, ['/bin/sleep', '10'], instances = 2)
+        sleep(0.3)
+        self.assertEqual(self.c.get(self.group_name)['stop_timeout'], 10)
+        r = self.c.stop(self.group_name)
+        self.assertEqual(r['msg'], 'stopped.')
+        self.assertEqual(r['killed'], 0)
+        self.assertEqual(r['running'], 0)
+        self.assertEqual(self.c.get(self.group_name)['status'], STATUS_STOPPED)
+        self.assertEqual(self.c.pids(self.group_name), [])
+        self.assertEqual(self.c.get(self.group_name)['error'], 0)
+        self.c.delete(self.group_name)
+
+    def test_stop_deadline(self):
+        self.c.start(self.group_name, ['/bin/sh', '-c', 'trap "" TERM; sleep 10'],
+                stop_timeout = 1)
+        sleep(0.3)
+        r = self.c.stop(self.group_name)
+        self.assertEqual(r['killed'], 1)
+        self.assertEqual(self.c.pids(self.group_name), [])
+        r = self.c.stop(self.group_name, timeout = 0)
+        self.assertEqual(r['killed'], 0)
+        self.c.delete(self.group_name)
+
+    def test_stop_timeout(self):
+        self.c.start(self.group_name, ['/bin/sleep', '10'], status = STATUS_STOPPED,
+                stop_timeout = 3)
+        self.assertEqual(self.c.get(self.group_name)['stop_timeout'], 3)
+        self.c.update(self.group_name, stop_timeout = 0)
+        self.assertEqual(self.c.get(self.group_name)['stop_timeout'], 0)
+        self.assertRaises(UbervisorClientException, self.c.update,
+                self.group_name, stop_timeout = -2)
+        self.assertRaises(UbervisorClientException, self.c.stop, 'nonexistent')
+        self.c.delete(self.group_name)
+
+class TestRoll(BaseTest):
+    def test_roll(self):
+        self.c.start(self.group_name, ['/bin/sleep', '10'], instances = 5)
+        sleep(0.3)
+        pids = self.c.pids(self.group_name)
+        waves = []
+        r = self.c.roll(self.group_name, batch = '40%', min_uptime = 0,
+                progress = waves.append)
+        self.assertEqual(r['msg'], 'rolled.')
+        self.assertEqual(r['waves'], 3)
+        self.assertEqual([w['instances'] for w in waves if w['state'] == 'ready'],
+                [[0, 1], [2, 3], [4]])
+        n = self.c.pids(self.group_name)
+        self.assertEqual(len(n), 5)
+        for pid in pids:
+            self.assertFalse(pid in n)
+        self.assertEqual(self.c.get(self.group_name)['error'], 0)
+        self.c.delete(self.group_name)
+
+    def test_roll_uptime(self):
+        self.c.start(self.group_name, ['/bin/sleep', '10'])
+        sleep(0.3)
+        # uptime is counted in seconds
+        t = time()
+        self.c.roll(self.group_name, min_uptime = 2)
+        self.assertTrue(time() - t >= 1)
+        self.c.delete(self.group_name)
+
+    def test_roll_crashloop(self):
+        f = path.join(self.tmpdir, 'crash')
+        self.c.start(self.group_name, ['/bin/sh', '-c',
+                'test -e %s && exit 1; sleep 10' % f], instances = 3,
+                crashloop = 'count=2,scope=instance')
+        sleep(0.3)
+        pids = self.c.pids(self.group_name)
+        open(f, 'w').close()
+        self.assertRaises(UbervisorClientException, self.c.roll,
+                self.group_name)
+        # the other instances are not restarted
+        n = self.c.pids(self.group_name)
+        self.assertEqual(n, pids[1:])
+        self.c.delete(self.group_name)
+
+    def test_roll_errors(self):
+        self.assertRaises(UbervisorClientException, self.c.roll, 'nonexistent')
+        self.c.start(self.group_name, ['/bin/sleep', '10'], instances = 2)
+        self.assertRaises(UbervisorClientException, self.c.roll,
+                self.group_name, batch = '0%')
+        self.assertRaises(UbervisorClientException, self.c.roll,
+                self.group_name, batch = 'x')
+        x = self.c.roll(self.group_name, min_uptime = 5, wait = False)
+        y = self.c.roll(self.group_name, wait = False)
+        r = self.c._reply(x)
+        self.assertEqual(r['state'], 'restarting')
+        r = self.c._reply(y)
+        self.assertEqual(r['msg'], 'group is already rolling.')
+        y = self.c.stop(self.group_name, wait = False)
+        r = self.c._reply(x)
+        self.assertEqual(r['msg'], 'group stopped, roll aborted.')
+        self.assertEqual(self.c._reply(y)['msg'], 'stopped.')
+        self.c.delete(self.group_name)
+
+class TestNotify(BaseTest):
+    def notifier(self, gate):
+        # sends READY=1 once *gate* exists
+        f = path.join(self.tmpdir, 'notify.py')
+        open(f, 'w').write(
+            'import os, socket, time\n'
+            'while not os.path.exists(%r):\n'
+            '    time.sleep(0.05)\n'
+            'a = os.environ["NOTIFY_SOCKET"]\n'
+            's = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)\n'
+            's.sendto(b"READY=1\\nSTATUS=serving", "\\0" + a[1:])\n'
+            'time.sleep(10)\n' % gate)
+        return [sys.executable, f]
+
+    def test_notify(self):
+        gate = path.join(self.tmpdir, 'gate')
+        self.c.start(self.group_name, self.notifier(gate), instances = 2,
+                notify = True)
+        sleep(0.3)
+        p = self.c.processes(self.group_name)
+        self.assertEqual([x['state'] for x in p], ['starting', 'starting'])
+        self.assertEqual(self.c.get(self.group_name)['ready'], 0)
+        x = self.c.wait_ready(self.group_name, wait = False)
+        open(gate, 'w').close()
+        r = self.c._reply(x)
+        self.assertEqual(r['msg'], 'ready.')
+        self.assertEqual(r['ready'], 2)
+        p = self.c.processes(self.group_name)
+        self.assertEqual([x['state'] for x in p], ['ready', 'ready'])
+        self.assertEqual([x['status_text'] for x in p], ['serving', 'serving'])
+        self.assertEqual(sorted(r['pids']), sorted(self.c.pids(self.group_name)))
+        self.assertEqual(self.c.get(self.group_name)['ready'], 2)
+        self.c.delete(self.group_name)
+
+    def test_notify_subs(self):
+        gate = path.join(self.tmpdir, 'gate')
+        open(gate, 'w').close()
+        s = self.get_client()
+        try:
+            cid = s.subs(8)
+            self.c.start(self.group_name, self.notifier(gate), notify = True)
+            c, r = s.wait()
+            self.assertEqual(c, cid)
+            self.assertEqual(r['name'], self.group_name)
+            self.assertEqual(r['state'], 'ready')
+            self.assertEqual(r['status_text'], 'serving')
+            self.assertEqual(r['pid'], self.c.pids(self.group_name)[0])
+        finally:
+            s.close()
+        self.c.delete(self.group_name)
+
+    def test_notify_timeout(self):
+        self.c.start(self.group_name, ['/bin/sleep', '10'], notify = True)
+        self.assertEqual(self.c.processes(self.group_name)[0]['state'],
+                'starting')
+        self.assertRaises(UbervisorClientException, self.c.wait_ready,
+                self.group_name, timeout = 1)
+        self.assertRaises(UbervisorClientException, self.c.wait_ready,
+                'nonexistent')
+        # without notify, running processes are ready
+        self.c.update(self.group_name, notify = False)
+        self.c.kill(self.group_name)
+        sleep(0.3)
+        self.assertEqual(self.c.wait_ready(self.group_name)['ready'], 1)
+        self.c.delete(self.group_name)
+
+    def test_notify_roll(self):
+        gate = path.join(self.tmpdir, 'gate')
+        open(gate, 'w').close()
+        self.c.start(self.group_name, self.notifier(gate), notify = True)
+        self.c.wait_ready(self.group_name)
+        unlink(gate)
+        x = self.c.roll(self.group_name, min_uptime = 0, timeout = 5,
+                wait = False)
+        self.assertEqual(self.c._reply(x)['state'], 'restarting')
+        sleep(0.5)
+        p = self.c.processes(self.group_name)
+        self.assertEqual(p[0]['state'], 'starting')
+        open(gate, 'w').close()
+        r = self.c._reply(x)
+        self.assertEqual(r['state'], 'ready')
+        self.assertEqual(self.c._reply(x)['msg'], 'rolled.')
+        self.c.delete(self.group_name)
+
+class TestSpawnHelper(BaseTest):
+    # a second server that uses the spawn helper, whatever the spawn method
+    # of the server under test is.
+    def setUp(self):
+        run = environ.get("UBERVISOR_RUN", None)
+        if not run:
+            self.skipTest('UBERVISOR_RUN not set')
+        BaseTest.setUp(self)
+        sock = path.join(self.tmpdir, 'socket')
+        self.env = dict(environ, UBERVISOR_SOCKET = sock,
+                UBERVISOR_SPAWN = 'helper')
+        self.server = Popen([run, 'server', '-f', '-o',
+                path.join(self.tmpdir, 'log')], env = self.env)
+        for x in range(100):
+            if path.exists(sock):
+                break
+            sleep(0.05)
+        self.c.close()
+        self.c = UbervisorClient(sock_file = sock)
+
+    def tearDown(self):
+        try:
+            self.c.delete(self.group_name)
+        except:
+            pass
+        self.c.close()
+        Popen([environ["UBERVISOR_RUN"], 'exit'], env = self.env,
+                stdout = PIPE).wait()
+        self.server.wait()
+        rmtree(self.tmpdir)
+
+    def helper_pids(self):
+        pids = []
+        for d in listdir('/proc'):
+            try:
+                cmd = open('/proc/%s/cmdline' % d).read().split('\0')
+                st = open('/proc/%s/stat' % d).read()
+            except (IOError, OSError):
+                continue
+            ppid = int(st[st.rindex(')') + 2:].split()[1])
+            if cmd[:2] == ['ubervisor', 'spawn-helper'] \
+                    and ppid == self.server.pid:
+                pids.append(int(d))
+        self.assertTrue(pids)
+        return pids
+
+    def count(self, arg):
+        n = 0
+        for d in listdir('/proc'):
+            try:
+                cmd = open('/proc/%s/cmdline' % d).read().split('\0')
+            except (IOError, OSError):
+                continue
+            if cmd[:2] == ['/bin/sleep', arg]:
+                n += 1
+        return n
+
+    def test_stuck_helper(self):
+        pids = self.helper_pids()
+        for pid in pids:
+            kill(pid, SIGSTOP)
+        try:
+            t = time()
+            self.c.start(self.group_name, ['/bin/sleep', '10'])
+            # answered while the helper does not reply
+            self.assertEqual(self.c.pids(self.group_name), [])
+            self.assertEqual(self.c.stats()['inflight'], 1)
+            self.assertTrue(time() - t < 1)
+        finally:
+            for pid in pids:
+                kill(pid, SIGCONT)
+        sleep(0.3)
+        self.assertEqual(len(self.c.pids(self.group_name)), 1)
+        self.assertEqual(self.c.stats()['inflight'], 0)
+        self.c.delete(self.group_name)
+
+    def test_late_reply(self):
+        arg = '10.%d' % self.free_port()
+        pids = self.helper_pids()
+        for pid in pids:
+            kill(pid, SIGSTOP)
+        try:
+            self.c.start(self.group_name, ['/bin/sleep', arg])
+            # the request times out and is sent again
+            sleep(5.5)
+        finally:
+            for pid in pids:
+                kill(pid, SIGCONT)
+        sleep(0.5)
+        # the process of the late reply is killed
+        self.assertEqual(len(self.c.pids(self.group_name)), 1)
+        self.assertEqual(self.count(arg), 1)
+        self.c.delete(self.group_name)
+
+class TestCred(BaseTest):
+    def wait_cred(self, uid):
+        for i in range(50):
+            if self.c.get(self.group_name)['cred_uid'] == uid:
+                return True
+            sleep(0.1)
+        return False
+
+    def test_cred_update(self):
+        me = getpwuid(getuid())
+        self.c.start(self.group_name, ['/bin/sleep', '10'],
+                username = me.pw_name, status = STATUS_STOPPED)
+        self.assertTrue(self.wait_cred(me.pw_uid))
+        try:
+            other = getpwnam('nobody')
+        except KeyError:
+            return
+        self.c.update(self.group_name, username = 'nobody')
+        self.assertTrue(self.wait_cred(other.pw_uid))
+        # a failed lookup keeps the cached ids
+        self.c.update(self.group_name, username = 'no-such-user-' + str(uuid4())[:8])
+        sleep(0.5)
+        r = self.c.get(self.group_name)
+        self.assertEqual(r['cred_uid'], other.pw_uid)
+        self.assertFalse('cred_error' in r)
+        self.c.delete(self.group_name)
+
+    def test_cred_start(self):
+        # instances are started once the ids are looked up
+        me = getpwuid(getuid())
+        self.c.start(self.group_name, ['/bin/sleep', '10'],
+                username = me.pw_name, instances = 2)
+        sleep(0.5)
+        pids = self.c.pids(self.group_name)
+        self.assertEqual(len(pids), 2)
+        for pid in pids:
+            uid = [l.split()[1] for l in open('/proc/%d/status' % pid)
+                    if l.startswith('Uid:')][0]
+            self.assertEqual(int(uid), me.pw_uid)
+        self.assertEqual(self.c.get(self.group_name)['error'], 0)
+        self.c.delete(self.group_name)
+
+    def resolver_pids(self):
+        pids = []
+        for d in listdir('/proc'):
+            try:
+                cmd = open('/proc/%s/cmdline' % d).read().split('\0')
+            except (IOError, OSError):
+                continue
+            if cmd[:2] == ['ubervisor', 'cred-resolver']:
+                pids.append(int(d))
+        return pids
+
+    def test_cred_resolver(self):
+        # names are looked up by the resolver, which is restarted if it
+        # exits
+        me = getpwuid(getuid())
+        pids = self.resolver_pids()
+        self.assertTrue(pids)
+        for pid in pids:
+            kill(pid, SIGKILL)
+        sleep(0.5)
+        self.assertTrue(self.resolver_pids())
+        self.c.start(self.group_name, ['/bin/sleep', '10'],
+                username = me.pw_name, status = STATUS_STOPPED)
+        self.assertTrue(self.wait_cred(me.pw_uid))
+        self.c.delete(self.group_name)
+
 class TestInt(BaseTest):
     def test_call_fatal(self):
         cmd = path.join(path.dirname(path.abspath(__file__)), 'fatal_test.sh')
@@ -47,6 +47,12 @@ CHUNKSIZ = 0x3fff
 class UbervisorClientException(Exception):
     pass
 
+def _env_list(env):
+    """
+    dict of environment variables as sorted list of ``KEY=VALUE``.
+    """
+    return ['%s=%s' % (k, v) for k, v in sorted(env.items())]
+
 class SSHSock(object):
     """
     Ubervisor ssh transport. This provides a socket-like object to communicate
@@ -232,7 +238,13 @@ class UbervisorClient(object):
 
     def start(self, name, args, dir = None, stdout = None, stderr = None,
             instances = 1, status = STATUS_RUNNING, killsig = 15, uid = -1,
-            gid = -1, heartbeat = None, fatal_cb = None, age = None, wait = True):
+            gid = -1, heartbeat = None, fatal_cb = None, age = None,
+            priority = None, port = None, zygote = False, standby = None,
+            listen = None, ondemand = None, cpus = None, nice = None,
+            ioprio = None, sched = None, rlimits = None, oom_score_adj = None,
+            cgroup = None, env = None, backoff = None, crashloop = None,
+            stop_timeout = None, notify = False, username = None,
+            groupname = None, wait = True):
         """
         Create a new process group and start it.
 
@@ -248,6 +260,58 @@ class UbervisorClient(object):
         :param str fatal_cb:    command to run on error conditions.
         :param int age:         maximum runtime of a process in this group in
                                 seconds.
+        :param int priority:    groups with higher priority are started
+                                first.
+        :param int port:        port base. ``%(PORT)`` in args, dir, stdout
+                                and stderr is replaced with port + instance
+                                number.
+        :param bool zygote:     if ``True``, *args* is a zygote which forks
+                                the instances (see :mod:`zygote`).
+        :param int standby:     number of stopped processes kept to replace
+                                exited instances.
+        :param list listen:     sockets bound by the server and passed to
+                                all instances as fd 3 and up
+                                (``tcp:PORT``, ``tcp:ADDR:PORT`` or
+                                ``unix:PATH``).
+        :param int ondemand:    start instances on the first connection to
+                                a *listen* socket and stop them after
+                                *ondemand* idle seconds.
+        :param str cpus:        cpu policy: cpu lists like ``0-3,8``
+                                separated by ``:`` (used round robin by
+                                instance), ``spread`` or ``node``.
+        :param int nice:        nice value of the processes.
+        :param str ioprio:      io priority, ``CLASS[:LEVEL]`` with class
+                                ``rt``, ``be`` or ``idle``.
+        :param str sched:       scheduling policy: ``other``, ``batch`` or
+                                ``idle``.
+        :param str rlimits:     resource limits, ``NAME=SOFT[:HARD],..``
+                                for ``nofile``, ``as`` and ``core``.
+        :param int oom_score_adj: oom_score_adj of the processes.
+        :param str cgroup:      limits of the group cgroup, ``KEY=VALUE,..``
+                                for ``cpu.max``, ``cpu.weight``,
+                                ``memory.high``, ``memory.max`` and
+                                ``pids.max``. The server needs a cgroup
+                                root.
+        :param dict env:        environment variables of the processes.
+                                Values may contain tokens like args. GROUP,
+                                INSTANCE, INSTANCES and PORT are set by the
+                                server.
+        :param str backoff:     delay restarts after error exits,
+                                ``KEY=VALUE,..`` for ``initial`` and ``max``
+                                (milliseconds), ``factor``, ``jitter``
+                                (percent) and ``stable`` (seconds).
+        :param str crashloop:   crash loop detection, ``KEY=VALUE,..`` for
+                                ``count`` errors of one instance within
+                                ``window`` seconds. With ``scope=instance``
+                                only the instance is no longer restarted,
+                                else the group is set broken.
+        :param int stop_timeout: seconds stopped processes get before
+                                SIGKILL (default 10).
+        :param bool notify:     if ``True``, processes report readiness by
+                                sending ``READY=1`` to ``NOTIFY_SOCKET``.
+        :param str username:    user to run program as, looked up by the
+                                server. Overrides *uid*.
+        :param str groupname:   group to run program as. Overrides *gid*.
         :param bool wait:       if ``True``, wait for server reply.
         """
         d = dict(name = name, args = args,
@@ -263,6 +327,46 @@ class UbervisorClient(object):
             d['fatal_cb'] = fatal_cb
         if age != None:
             d['age'] = age
+        if priority != None:
+            d['priority'] = priority
+        if port != None:
+            d['port'] = port
+        if zygote:
+            d['zygote'] = 1
+        if standby != None:
+            d['standby'] = standby
+        if listen:
+            d['listen'] = listen
+        if ondemand != None:
+            d['ondemand'] = ondemand
+        if cpus:
+            d['cpus'] = cpus
+        if nice != None:
+            d['nice'] = nice
+        if ioprio:
+            d['ioprio'] = ioprio
+        if sched:
+            d['sched'] = sched
+        if rlimits:
+            d['rlimits'] = rlimits
+        if oom_score_adj != None:
+            d['oom_score_adj'] = oom_score_adj
+        if cgroup != None:
+            d['cgroup'] = cgroup
+        if backoff != None:
+            d['backoff'] = backoff
+        if crashloop != None:
+            d['crashloop'] = crashloop
+        if stop_timeout != None:
+            d['stop_timeout'] = stop_timeout
+        if notify:
+            d['notify'] = 1
+        if username != None:
+            d['username'] = username
+        if groupname != None:
+            d['groupname'] = groupname
+        if env != None:
+            d['env'] = _env_list(env)
 
         d = dumps(d)
         c = self._send('SPWN', d)
@@ -278,7 +382,8 @@ class UbervisorClient(object):
         Delete process group, identified by *name*
 
         :param str name:        name of process group to delete.
-        :returns:               list of pids still alive in this process group.
+        :returns:               list of pids of the instances, they are
+                                sent the kill signal.
         :param bool wait:       if ``True``, wait for server reply.
         """
         d = dumps(dict(name = name))
@@ -314,11 +419,51 @@ class UbervisorClient(object):
             raise UbervisorClientException(r['msg'])
         return r['pids']
 
-    def pids(self, name, wait = True):
+    def roll(self, name, batch = None, min_uptime = None, timeout = None,
+            progress = None, wait = True):
+        """
+        Restart the instances of group *name* in waves. A wave starts when
+        the new processes of the wave before run for *min_uptime* seconds.
+
+        :param str name:        name of the process group.
+        :param batch:           instances per wave, ``int`` or a percentage
+                                of the instances like ``'25%'``.
+        :param int min_uptime:  seconds new processes have to run.
+        :param int timeout:     abort if a wave is not done this many seconds
+                                after the stop timeout of the group.
+        :param progress:        called with every progress message, a dict
+                                with ``wave``, ``waves``, ``state``,
+                                ``instances`` and ``pids``.
+        :param bool wait:       if ``True``, wait until the roll is done.
+        :returns:               the final reply.
+        """
+        d = dict(name = name)
+        if batch != None:
+            d['batch'] = batch
+        if min_uptime != None:
+            d['min_uptime'] = min_uptime
+        if timeout != None:
+            d['timeout'] = timeout
+        x = self._send('ROLL', dumps(d))
+        if not wait:
+            return x
+        while True:
+            r = self._reply(x)
+            if 'msg' in r:
+                break
+            if progress:
+                progress(r)
+        if r['code'] != True:
+            raise UbervisorClientException(r['msg'])
+        return r
+
+    def pids(self, name, standby = False, wait = True):
         """
         Get current pids in group *name*.
 
         :param str name:        name of group.
+        :param bool standby:    if ``True``, return pids of standby processes
+                                instead.
         :param bool wait:       if ``True``, wait for server reply.
         :returns:               list of pids in the group.
         """
@@ -329,8 +474,30 @@ class UbervisorClient(object):
         r = self._reply(x)
         if r['code'] != True:
             raise UbervisorClientException(r['msg'])
+        if standby:
+            return r['standby']
         return r['pids']
 
+    def processes(self, name, wait = True):
+        """
+        Get the processes in group *name*.
+
+        :param str name:        name of group.
+        :param bool wait:       if ``True``, wait for server reply.
+        :returns:               list of dicts with ``pid``, ``instance``,
+                                ``state`` and, if reported, ``status_text``
+                                and ``watchdog`` (seconds since the last
+                                ping).
+        """
+        d = dumps(dict(name = name))
+        x = self._send('PIDS', d)
+        if not wait:
+            return x
+        r = self._reply(x)
+        if r['code'] != True:
+            raise UbervisorClientException(r['msg'])
+        return r['processes']
+
     def get(self, name, wait = True):
         """
         Get config for *name*.
@@ -359,13 +526,110 @@ class UbervisorClient(object):
             return x
         return self._reply(x)
 
-    def exit(self, wait = True):
+    def stats(self, wait = True):
+        """
+        Get spawn queue statistics.
+
+        :param bool wait:       if ``True``, wait for server reply.
+        :returns:               dictionary with queue length (``queued``),
+                                processes not yet running (``inflight``),
+                                limits (``rate``, ``max_inflight``), number
+                                of processes started (``spawned``) and wait
+                                times in milliseconds (``wait_oldest``,
+                                ``wait_avg``, ``wait_max``). ``fork_exec``,
+                                ``setids`` and ``logopen`` are latency
+                                histograms in microseconds for processes that
+                                called execv (``count``, ``avg``, ``max`` and
+                                ``buckets``, bucket i counting values from
+                                2^i to 2^(i+1)).
+        """
+        x = self._send('STAT')
+        if not wait:
+            return x
+        return self._reply(x)
+
+    def exit(self, stop = False, timeout = None, wait = True):
         """
         Send exit command to ubervisor.
 
+        :param bool stop:       stop all processes first, the reply is sent
+                                when they exited.
+        :param int timeout:     seconds until SIGKILL, instead of the
+                                stop_timeout of the groups.
         :param bool wait:       if ``True``, wait for server reply.
         """
-        x = self._send('EXIT')
+        d = dict()
+        if stop:
+            d['stop'] = True
+        if timeout != None:
+            d['timeout'] = timeout
+        x = self._send('EXIT', dumps(d) if d else '')
+        if not wait:
+            return x
+        r = self._reply(x)
+        if r['code'] != True:
+            raise UbervisorClientException(r['msg'])
+        return self
+
+    def stop(self, name, timeout = None, wait = True):
+        """
+        Set a group stopped and stop its processes. The kill signal is sent
+        to all processes at once, SIGKILL to the ones still running after
+        the stop timeout.
+
+        :param str name:        name of the process group.
+        :param int timeout:     seconds until SIGKILL, instead of the
+                                stop_timeout of the group.
+        :param bool wait:       if ``True``, wait until the processes exited.
+        :returns:               the reply, ``killed`` is the number of
+                                processes sent SIGKILL, ``running`` the
+                                number still running.
+        """
+        d = dict(name = name)
+        if timeout != None:
+            d['timeout'] = timeout
+        x = self._send('STOP', dumps(d))
+        if not wait:
+            return x
+        r = self._reply(x)
+        if r['code'] != True:
+            raise UbervisorClientException(r['msg'])
+        return r
+
+    def wait_ready(self, name, timeout = None, wait = True):
+        """
+        Wait until all instances of group *name* are ready.
+
+        :param str name:        name of the process group.
+        :param int timeout:     give up after this many seconds (default 60).
+        :param bool wait:       if ``True``, wait for server reply.
+        :returns:               the reply, ``pids`` of the ready processes
+                                and their number ``ready``.
+        """
+        d = dict(name = name)
+        if timeout != None:
+            d['timeout'] = timeout
+        x = self._send('WAIT', dumps(d))
+        if not wait:
+            return x
+        r = self._reply(x)
+        if r['code'] != True:
+            raise UbervisorClientException(r['msg'])
+        return r
+
+    def upgrade(self, path = None, wait = True):
+        """
+        Execute the server binary again, or ``path``. Processes, groups and
+        connections, this one included, are kept.
+
+        :param str path:        server binary to execute.
+        :param bool wait:       if ``True``, wait for the new server to
+                                reply.
+        """
+        d = dict()
+        if path is not None:
+            d['exec'] = path
+        x = self._send('UPGR', dumps(d) if d else '')
         if not wait:
             return x
         r = self._reply(x)
@@ -389,7 +653,12 @@ class UbervisorClient(object):
 
     def update(self, name, stdout = None, stderr = None,
             instances = None, status = None, killsig = None,
-            heartbeat = None, fatal_cb = None, age = None, dir = None, wait = True):
+            heartbeat = None, fatal_cb = None, age = None, dir = None,
+            priority = None, port = None, standby = None, cpus = None,
+            nice = None, ioprio = None, sched = None, rlimits = None,
+            oom_score_adj = None, cgroup = None, env = None, backoff = None,
+            crashloop = None, stop_timeout = None, notify = None,
+            username = None, groupname = None, wait = True):
         """
         Create a new process group and start it.
 
@@ -403,6 +672,37 @@ class UbervisorClient(object):
         :param str fatal_cb:    command to run on error conditions.
         :param str stdout_pipe: pipe standard output into standard input of
                                 ``stdout_pipe``.
+        :param int priority:    groups with higher priority are started
+                                first.
+        :param int port:        port base.
+        :param int standby:     number of standby processes.
+        :param str cpus:        cpu policy for processes started from now
+                                on.
+        :param int nice:        nice value, for processes started from now
+                                on. The same holds for the following
+                                parameters (see :meth:`start`).
+        :param str ioprio:      io priority.
+        :param str sched:       scheduling policy.
+        :param str rlimits:     resource limits.
+        :param int oom_score_adj: oom_score_adj.
+        :param str cgroup:      cgroup limits, applied to running processes
+                                at once. Limits left out are reset.
+        :param dict env:        environment, replaces the old one. Used for
+                                processes started from now on, an empty
+                                dict removes it.
+        :param str backoff:     restart backoff, an empty string removes it.
+        :param str crashloop:   crash loop detection, broken instances are
+                                started again. An empty string removes it.
+        :param int stop_timeout: seconds stopped processes get before
+                                SIGKILL.
+        :param bool notify:     readiness notification, for processes
+                                started from now on.
+        :param str username:    user to run processes started from now on
+                                as. The ids are looked up in the
+                                background. Until then, and if the lookup
+                                fails, the old ones are used.
+        :param str groupname:   group to run processes started from now on
+                                as.
         :param bool wait:       if ``True``, wait for server reply.
         """
         d = dict(name = name)
@@ -424,6 +724,40 @@ class UbervisorClient(object):
             d['age'] = age
         if dir != None:
             d['dir'] = dir
+        if priority != None:
+            d['priority'] = priority
+        if port != None:
+            d['port'] = port
+        if standby != None:
+            d['standby'] = standby
+        if cpus:
+            d['cpus'] = cpus
+        if nice != None:
+            d['nice'] = nice
+        if ioprio:
+            d['ioprio'] = ioprio
+        if sched:
+            d['sched'] = sched
+        if rlimits:
+            d['rlimits'] = rlimits
+        if oom_score_adj != None:
+            d['oom_score_adj'] = oom_score_adj
+        if cgroup != None:
+            d['cgroup'] = cgroup
+        if backoff != None:
+            d['backoff'] = backoff
+        if crashloop != None:
+            d['crashloop'] = crashloop
+        if stop_timeout != None:
+            d['stop_timeout'] = stop_timeout
+        if notify != None:
+            d['notify'] = int(bool(notify))
+        if username != None:
+            d['username'] = username
+        if groupname != None:
+            d['groupname'] = groupname
+        if env != None:
+            d['env'] = _env_list(env)
         d = dumps(d)
         x = self._send('UPDT', d)
         if not wait:
@@ -0,0 +1,123 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2011-2014 Kilian Klimek <kilian.klimek@googlemail.com>
+# All rights reserved.
+# 
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 
+#   1. Redistributions of source code must retain the above copyright
+#      notice, this list of conditions and the following disclaimer.
+# 
+#   2. Redistributions in binary form must reproduce the above copyright
+#      notice, this list of conditions and the following disclaimer in the
+#      documentation and/or other materials provided with the distribution.
+# 
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+# ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+# HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+# OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+"""
+Zygote side of ubervisor zygote groups (``ubervisor start --zygote``).
+
+The program does its expensive initialization once and then calls
+:func:`serve`. :func:`serve` returns only in the forked instances, with the
+instance number as return value::
+
+    from ubervisor import zygote
+    load_application()
+    instance = zygote.serve()
+    run_application(instance)
+"""
+from json import dumps, loads
+from os import environ, fork, setsid, chdir, open as os_open, dup2, close, \
+        pipe, read, write, waitpid, _exit, O_RDONLY, O_WRONLY, O_CREAT, \
+        O_APPEND
+from socket import fromfd, AF_UNIX, SOCK_SEQPACKET
+
+ZYGOTE_FD_ENV = 'UBERVISOR_ZYGOTE_FD'
+
+def _redirect(fd, name, flags):
+    f = os_open(name, flags, 0o644)
+    if f != fd:
+        dup2(f, fd)
+        close(f)
+
+def _start(sock, req):
+    """
+    double fork an instance. Returns the instance number in the new process
+    and the pid of the new process in the zygote.
+    """
+    r, w = pipe()
+    pid = fork()
+    if pid == 0:
+        close(r)
+        try:
+            pid = fork()
+        except OSError:
+            _exit(1)
+        if pid != 0:
+            write(w, str(pid).encode())
+            _exit(0)
+        # instance, reparented to the server
+        close(w)
+        sock.close()
+        try:
+            if req.get('env') is not None:
+                environ.clear()
+                for e in req['env']:
+                    k, _, v = e.partition('=')
+                    environ[k] = v
+            setsid()
+            if req.get('dir'):
+                chdir(req['dir'])
+            _redirect(0, '/dev/null', O_RDONLY)
+            _redirect(1, req.get('stdout') or '/dev/null',
+                    O_WRONLY | O_CREAT | O_APPEND)
+            _redirect(2, req.get('stderr') or '/dev/null',
+                    O_WRONLY | O_CREAT | O_APPEND)
+        except OSError:
+            _exit(1)
+        return None
+    close(w)
+    buf = read(r, 32)
+    close(r)
+    waitpid(pid, 0)
+    if not buf:
+        raise OSError('fork failed')
+    return int(buf)
+
+def serve():
+    """
+    report ready to the server and fork instances on request. Returns the
+    instance number in forked instances, returns ``None`` when the server
+    closes the control socket.
+    """
+    fd = int(environ.pop(ZYGOTE_FD_ENV))
+    sock = fromfd(fd, AF_UNIX, SOCK_SEQPACKET)
+    close(fd)
+    sock.send(dumps(dict(ready = 1)).encode())
+
+    while True:
+        msg = sock.recv(65536)
+        if not msg:
+            return None
+        req = loads(msg.decode())
+        instance = req['instance']
+        try:
+            pid = _start(sock, req)
+        except (OSError, IOError) as e:
+            sock.send(dumps(dict(instance = instance, error = str(e))).encode())
+            continue
+        if pid is None:
+            return instance
+        sock.send(dumps(dict(instance = instance, pid = pid)).encode())
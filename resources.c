@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "resources.h"
+
+/* from linux/ioprio.h */
+#define IOPRIO_CLASS_SHIFT	13
+#define IOPRIO_CLASS_RT		1
+#define IOPRIO_CLASS_BE		2
+#define IOPRIO_CLASS_IDLE	3
+#define IOPRIO_WHO_PROCESS	1
+
+static const struct {
+	const char	*name;
+	int		index,
+			flag,
+			resource;
+} rlimits[] = {
+	{ "nofile",	RES_RLIM_NOFILE,	RES_NOFILE,	RLIMIT_NOFILE },
+	{ "as",		RES_RLIM_AS,		RES_AS,		RLIMIT_AS },
+	{ "core",	RES_RLIM_CORE,		RES_CORE,	RLIMIT_CORE },
+	{ NULL,		0,			0,		0 }
+};
+
+/*
+ * parse a limit: a number with optional k, m or g suffix or "unlimited".
+ */
+static int
+parse_limit(const char *str, const char *end, int64_t *v)
+{
+	char		*e;
+	long long	n;
+
+	if ((size_t) (end - str) == 9 && !strncmp(str, "unlimited", 9)) {
+		*v = -1;
+		return 0;
+	}
+	if (*str < '0' || *str > '9')
+		return -1;
+	n = strtoll(str, &e, 10);
+	switch (*e) {
+	case 'k': case 'K':
+		n <<= 10;
+		e++;
+		break;
+	case 'm': case 'M':
+		n <<= 20;
+		e++;
+		break;
+	case 'g': case 'G':
+		n <<= 30;
+		e++;
+		break;
+	}
+	if (e != end)
+		return -1;
+	*v = n;
+	return 0;
+}
+
+/*
+ * parse "NAME=SOFT[:HARD],..". The hard limit defaults to the soft limit.
+ */
+static const char *
+parse_rlimits(struct resources *rs, const char *spec)
+{
+	const char	*p = spec,
+			*eq,
+			*colon,
+			*end;
+	int		i;
+
+	while (*p != '\0') {
+		if ((end = strchr(p, ',')) == NULL)
+			end = p + strlen(p);
+		if ((eq = memchr(p, '=', end - p)) == NULL)
+			return "illegal rlimit.";
+		for (i = 0; rlimits[i].name != NULL; i++) {
+			if ((size_t) (eq - p) == strlen(rlimits[i].name)
+					&& !strncmp(p, rlimits[i].name, eq - p))
+				break;
+		}
+		if (rlimits[i].name == NULL)
+			return "unknown rlimit.";
+		if ((colon = memchr(eq, ':', end - eq)) == NULL)
+			colon = end;
+		if (parse_limit(eq + 1, colon, &rs->rs_rlim[rlimits[i].index][0]) == -1)
+			return "illegal rlimit.";
+		if (colon == end)
+			rs->rs_rlim[rlimits[i].index][1] = rs->rs_rlim[rlimits[i].index][0];
+		else if (parse_limit(colon + 1, end, &rs->rs_rlim[rlimits[i].index][1]) == -1)
+			return "illegal rlimit.";
+		rs->rs_flags |= rlimits[i].flag;
+		p = *end == ',' ? end + 1 : end;
+	}
+	return NULL;
+}
+
+/*
+ * parse "CLASS[:LEVEL]", CLASS is rt, be or idle.
+ */
+static const char *
+parse_ioprio(struct resources *rs, const char *spec)
+{
+	const char	*colon;
+	char		*e;
+	size_t		len;
+	long		level = 4;
+	int		class;
+
+	if ((colon = strchr(spec, ':')) == NULL)
+		colon = spec + strlen(spec);
+	len = colon - spec;
+	if (len == 2 && !strncmp(spec, "rt", 2))
+		class = IOPRIO_CLASS_RT;
+	else if (len == 2 && !strncmp(spec, "be", 2))
+		class = IOPRIO_CLASS_BE;
+	else if (len == 4 && !strncmp(spec, "idle", 4))
+		class = IOPRIO_CLASS_IDLE;
+	else
+		return "illegal ioprio class.";
+
+	if (*colon == ':') {
+		level = strtol(colon + 1, &e, 10);
+		if (e == colon + 1 || *e != '\0' || level < 0 || level > 7)
+			return "illegal ioprio level.";
+	}
+	if (class == IOPRIO_CLASS_IDLE)
+		level = 0;
+	rs->rs_ioprio = class << IOPRIO_CLASS_SHIFT | level;
+	rs->rs_flags |= RES_IOPRIO;
+	return NULL;
+}
+
+/*
+ * compile controls of a group. nice and oom are RES_UNSET, the strings NULL
+ * if not set. Returns an error message or NULL.
+ */
+const char *
+resources_compile(struct resources *rs, int nice, int oom, const char *ioprio,
+		const char *sched, const char *rlimits_spec)
+{
+	const char	*err;
+
+	memset(rs, '\0', sizeof(struct resources));
+
+	if (nice != RES_UNSET) {
+		if (nice < -20 || nice > 19)
+			return "nice out of range.";
+		rs->rs_nice = nice;
+		rs->rs_flags |= RES_NICE;
+	}
+
+	if (oom != RES_UNSET) {
+		if (oom < -1000 || oom > 1000)
+			return "oom_score_adj out of range.";
+		rs->rs_oom = oom;
+		rs->rs_flags |= RES_OOM;
+	}
+
+	if (ioprio != NULL && (err = parse_ioprio(rs, ioprio)) != NULL)
+		return err;
+
+	if (sched != NULL) {
+		if (!strcmp(sched, "other"))
+			rs->rs_sched = SCHED_OTHER;
+		else if (!strcmp(sched, "batch"))
+			rs->rs_sched = SCHED_BATCH;
+		else if (!strcmp(sched, "idle"))
+			rs->rs_sched = SCHED_IDLE;
+		else
+			return "illegal sched policy.";
+		rs->rs_flags |= RES_SCHED;
+	}
+
+	if (rlimits_spec != NULL && (err = parse_rlimits(rs, rlimits_spec)) != NULL)
+		return err;
+	return NULL;
+}
+
+/*
+ * apply controls to the calling process. Runs in the child before ids are
+ * changed, must not allocate. Returns the name of the failed function or
+ * NULL.
+ */
+const char *
+resources_apply(const struct resources *rs)
+{
+	struct rlimit		rl;
+	struct sched_param	sp;
+	char			buf[16],
+				*p;
+	int			i,
+				fd,
+				v;
+
+	for (i = 0; rlimits[i].name != NULL; i++) {
+		if (!(rs->rs_flags & rlimits[i].flag))
+			continue;
+		rl.rlim_cur = rs->rs_rlim[rlimits[i].index][0] == -1 ? RLIM_INFINITY
+			: (rlim_t) rs->rs_rlim[rlimits[i].index][0];
+		rl.rlim_max = rs->rs_rlim[rlimits[i].index][1] == -1 ? RLIM_INFINITY
+			: (rlim_t) rs->rs_rlim[rlimits[i].index][1];
+		if (setrlimit(rlimits[i].resource, &rl) == -1)
+			return "setrlimit";
+	}
+
+	if (rs->rs_flags & RES_SCHED) {
+		memset(&sp, '\0', sizeof(sp));
+		if (sched_setscheduler(0, rs->rs_sched, &sp) == -1)
+			return "sched_setscheduler";
+	}
+
+	if ((rs->rs_flags & RES_NICE) && setpriority(PRIO_PROCESS, 0, rs->rs_nice) == -1)
+		return "setpriority";
+
+	if (rs->rs_flags & RES_IOPRIO) {
+#ifdef SYS_ioprio_set
+		if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, rs->rs_ioprio) == -1)
+			return "ioprio_set";
+#else
+		return "ioprio_set";
+#endif
+	}
+
+	if (rs->rs_flags & RES_OOM) {
+		v = rs->rs_oom < 0 ? -rs->rs_oom : rs->rs_oom;
+		p = buf + sizeof(buf);
+		do {
+			*--p = '0' + v % 10;
+			v /= 10;
+		} while (v > 0);
+		if (rs->rs_oom < 0)
+			*--p = '-';
+		if ((fd = open("/proc/self/oom_score_adj", O_WRONLY)) == -1)
+			return "open (oom_score_adj)";
+		if (write(fd, p, buf + sizeof(buf) - p) == -1) {
+			close(fd);
+			return "write (oom_score_adj)";
+		}
+		close(fd);
+	}
+	return NULL;
+}
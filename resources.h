@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __RESOURCES_H
+#define __RESOURCES_H
+
+#include <stdint.h>
+
+/* set controls, rs_flags */
+#define RES_NICE	0x01
+#define RES_IOPRIO	0x02
+#define RES_SCHED	0x04
+#define RES_OOM		0x08
+#define RES_NOFILE	0x10
+#define RES_AS		0x20
+#define RES_CORE	0x40
+
+/* unset nice and oom_score_adj (-1 is a valid value for both) */
+#define RES_UNSET	INT32_MIN
+
+/* rs_rlim indices */
+#define RES_RLIM_NOFILE	0
+#define RES_RLIM_AS	1
+#define RES_RLIM_CORE	2
+#define RES_RLIM_MAX	3
+
+/*
+ * resource and scheduling controls of a group, compiled from the group
+ * config by the server and applied by the child before execv.
+ */
+struct resources {
+	int32_t		rs_flags,
+			rs_nice,
+			rs_ioprio,	/* class << 13 | level */
+			rs_sched,
+			rs_oom;
+	/* soft and hard limit, -1 is unlimited */
+	int64_t		rs_rlim[RES_RLIM_MAX][2];
+};
+
+const char *resources_compile(struct resources *, int, int, const char *,
+		const char *, const char *);
+const char *resources_apply(const struct resources *);
+
+#endif /* __RESOURCES_H */
@@ -0,0 +1,1012 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
+
+#include <stdint.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "config.h"
+#include "misc.h"
+#include "spawn.h"
+
+/* logfile create mode */
+#define _LO_C		(O_APPEND | O_CREAT | O_WRONLY)
+
+/* logfile open mode */
+#define _LO_O 		(S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)
+
+/* set in the child if it was cloned into its cgroup */
+#define SPAWN_F_INCGROUP	0x100
+
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP	0x200000000ULL
+#endif
+
+#ifdef HAVE_CLONE
+/*
+ * stack for vfork'ed children. The server is blocked while a child runs on
+ * it, so one stack is enough.
+ */
+#define SPAWN_STACK_SIZE	(256 * 1024)
+
+static char		*spawn_stack;
+static sigset_t		spawn_sigmask;
+
+/*
+ * spawn helper. A small process (the server binary re-executed) that forks
+ * children on behalf of the server with CLONE_PARENT, so they are children
+ * of the server but forking them only copies the helper.
+ */
+#define SPAWN_HELPER_EXE	"/proc/self/exe"
+#define SPAWN_HELPER_CMD	"spawn-helper"
+#define SPAWN_HELPER_MSGSIZ	65536
+
+/* optional strings present in a request */
+#define SR_NAME		0x01
+#define SR_DIR		0x02
+#define SR_STDOUT	0x04
+#define SR_STDERR	0x08
+#define SR_ERRFUNC	0x10
+/* sa_errfd is the first passed fd, followed by sr_nlisten listen sockets */
+#define SR_ERRFD	0x20
+#define SR_PLACE	0x40
+#define SR_RES		0x80
+/* sa_cgroup_fd follows sa_errfd (if present) */
+#define SR_CGROUP	0x100
+/* sr_nenv strings of sa_env follow argv */
+#define SR_ENV		0x200
+
+struct spawn_req {
+	uint32_t	sr_seq,
+			sr_present;
+	int32_t		sr_flags,
+			sr_uid,
+			sr_gid,
+			sr_errno,
+			sr_argc,
+			sr_nlisten,
+			sr_nenv;
+	struct cpu_place sr_place;	/* if SR_PLACE */
+	struct resources sr_res;	/* if SR_RES */
+	/* followed by the present optional strings, argv and the environment,
+	 * each NUL terminated */
+};
+
+struct spawn_rep {
+	uint32_t	sr_seq;
+	int32_t		sr_pid,
+			sr_errno;
+};
+
+static int		helper_fd = -1;
+static pid_t		helper_pid = -1;
+static uint32_t		helper_seq;
+#endif
+
+/*
+ * report error from spawn_child to the server.
+ */
+static void
+spawn_child_log(struct spawn_args *sa, int type, const char *func, int err)
+{
+	struct spawn_rec	rec;
+
+	if (sa->sa_errfd == -1)
+		return;
+	memset(&rec, '\0', sizeof(rec));
+	rec.sr_pid = getpid();
+	rec.sr_type = type;
+	rec.sr_errno = err;
+	strncpy(rec.sr_func, func, sizeof(rec.sr_func) - 1);
+	write(sa->sa_errfd, &rec, sizeof(rec));
+}
+
+/*
+ * log error and leave.
+ */
+static void
+spawn_child_fail(struct spawn_args *sa, const char *func)
+{
+	spawn_child_log(sa, SPAWN_REC_FAIL, func, errno);
+	_exit(EXIT_FAILURE);
+}
+
+/*
+ * set uid/gid if needed. Resource controls are applied first, raising
+ * limits or lowering nice may need the ids of the server.
+ */
+static void
+spawn_child_setids(struct spawn_args *sa)
+{
+	const char	*func;
+
+	if (sa->sa_errfunc != NULL) {
+		spawn_child_log(sa, SPAWN_REC_FAIL, sa->sa_errfunc, sa->sa_errno);
+		_exit(EXIT_FAILURE);
+	}
+
+	if (sa->sa_res != NULL && (func = resources_apply(sa->sa_res)) != NULL)
+		spawn_child_fail(sa, func);
+
+	if (sa->sa_gid != -1) {
+		if (setgid(sa->sa_gid) != 0)
+			spawn_child_fail(sa, "setgid");
+
+		if (setegid(sa->sa_gid) != 0)
+			spawn_child_fail(sa, "setegid");
+	}
+
+	if (sa->sa_uid != -1) {
+		if (setuid(sa->sa_uid) != 0)
+			spawn_child_fail(sa, "setuid");
+
+		if (seteuid(sa->sa_uid) != 0)
+			spawn_child_fail(sa, "seteuid");
+
+		if (sa->sa_uid != 0) {
+			if (setuid(0) != -1)
+				spawn_child_fail(sa, "setuid");
+		}
+	}
+
+	if (sa->sa_gid > 0) {
+		if (setgid(0) != -1)
+			spawn_child_fail(sa, "setgid");
+	}
+}
+
+#define LISTEN_PID_VAR		"LISTEN_PID="
+#define LISTEN_PID_LEN		32
+
+/*
+ * build the environment for a child with listen sockets: sa_env (or
+ * environ) without LISTEN_* variables, plus LISTEN_FDS and LISTEN_PID. The
+ * value of LISTEN_PID is filled in by the child. One block, free sa_envp.
+ */
+static void
+spawn_listen_env(struct spawn_args *sa)
+{
+	char		**env = sa->sa_env != NULL ? sa->sa_env : environ,
+			*fds;
+	int		i,
+			j,
+			n;
+
+	for (n = 0; env[n] != NULL; n++)
+		;
+
+	sa->sa_envp = xmalloc(sizeof(char *) * (n + 3) + 2 * LISTEN_PID_LEN);
+	fds = (char *) (sa->sa_envp + n + 3);
+	sa->sa_listen_pid = fds + LISTEN_PID_LEN;
+
+	for (i = j = 0; i < n; i++) {
+		if (strncmp(env[i], "LISTEN_", 7) != 0)
+			sa->sa_envp[j++] = env[i];
+	}
+	snprintf(fds, LISTEN_PID_LEN, "LISTEN_FDS=%d", sa->sa_nlisten);
+	strcpy(sa->sa_listen_pid, LISTEN_PID_VAR);
+	sa->sa_envp[j++] = fds;
+	sa->sa_envp[j++] = sa->sa_listen_pid;
+	sa->sa_envp[j] = NULL;
+}
+
+/*
+ * move listen sockets to fd 3 and up and set LISTEN_PID. Runs in the child,
+ * must not allocate.
+ */
+static void
+spawn_child_listen(struct spawn_args *sa)
+{
+	int		fds[SPAWN_MAX_LISTEN],
+			n = sa->sa_nlisten,
+			i,
+			fd;
+	char		buf[16],
+			*p;
+	pid_t		pid;
+
+	/* get everything out of the way of 3 .. 3 + n - 1 first. */
+	if (sa->sa_errfd != -1 && sa->sa_errfd < 3 + n) {
+		if ((fd = fcntl(sa->sa_errfd, F_DUPFD_CLOEXEC, 3 + n)) == -1)
+			spawn_child_fail(sa, "fcntl");
+		sa->sa_errfd = fd;
+	}
+	for (i = 0; i < n; i++) {
+		if ((fds[i] = fcntl(sa->sa_listen_fds[i], F_DUPFD_CLOEXEC, 3 + n)) == -1)
+			spawn_child_fail(sa, "fcntl");
+	}
+	/* the copies at 3 .. are not close on exec */
+	for (i = 0; i < n; i++) {
+		if (dup2(fds[i], 3 + i) == -1)
+			spawn_child_fail(sa, "dup2");
+	}
+
+	pid = getpid();
+	p = buf + sizeof(buf) - 1;
+	*p = '\0';
+	do {
+		*--p = '0' + pid % 10;
+		pid /= 10;
+	} while (pid > 0);
+	strcpy(sa->sa_listen_pid + sizeof(LISTEN_PID_VAR) - 1, p);
+}
+
+/*
+ * apply cpu affinity and memory policy. Failures are not fatal.
+ */
+static void
+spawn_child_place(struct spawn_args *sa)
+{
+	if (cpu_mask_set(0, &sa->sa_place->cp_mask) == -1)
+		spawn_child_log(sa, SPAWN_REC_LOG, "sched_setaffinity", errno);
+	if (sa->sa_place->cp_node != -1 && cpu_node_prefer(sa->sa_place->cp_node) == -1)
+		spawn_child_log(sa, SPAWN_REC_LOG, "set_mempolicy", errno);
+}
+
+/*
+ * move into the group cgroup if clone3 could not start us there.
+ */
+static void
+spawn_child_cgroup(struct spawn_args *sa)
+{
+	int	fd;
+
+	if ((fd = openat(sa->sa_cgroup_fd, "cgroup.procs", O_WRONLY | O_CLOEXEC)) == -1)
+		spawn_child_fail(sa, "open (cgroup.procs)");
+	if (write(fd, "0", 1) != 1)
+		spawn_child_fail(sa, "write (cgroup.procs)");
+	close(fd);
+}
+
+/*
+ * setup child process. we are already forked here.
+ */
+static void
+spawn_child(struct spawn_args *sa)
+{
+	int			stdout_fd = 0,
+				stderr_fd = 0;
+	long long		t;
+	struct spawn_rec	rec;
+
+	if (sa->sa_flags & SPAWN_F_EXEC) {
+		execv(sa->sa_argv[0], sa->sa_argv);
+		_exit(EXIT_FAILURE);
+	}
+
+	if ((sa->sa_flags & (SPAWN_F_CGROUP | SPAWN_F_INCGROUP)) == SPAWN_F_CGROUP)
+		spawn_child_cgroup(sa);
+
+	memset(&rec, '\0', sizeof(rec));
+	rec.sr_pid = getpid();
+	rec.sr_type = SPAWN_REC_EXEC;
+
+	t = monotonic_usec();
+	spawn_child_setids(sa);
+	rec.sr_setids = monotonic_usec() - t;
+
+	if (sa->sa_place != NULL)
+		spawn_child_place(sa);
+
+	if (sa->sa_dir != NULL) {
+		if (chdir(sa->sa_dir) == -1)
+			spawn_child_fail(sa, "chdir");
+	}
+	close(0);
+	close(1);
+	close(2);
+
+	t = monotonic_usec();
+	if (sa->sa_stdout != NULL) {
+		if ((stdout_fd = open(sa->sa_stdout, _LO_C, _LO_O)) == -1)
+			spawn_child_log(sa, SPAWN_REC_LOG, "open (stdout)", errno);
+		dup2(stdout_fd, STDOUT_FILENO);
+		close(stdout_fd);
+	}
+
+	if (sa->sa_stderr != NULL) {
+		if ((stderr_fd = open(sa->sa_stderr, _LO_C, _LO_O)) == -1)
+			spawn_child_log(sa, SPAWN_REC_LOG, "open (stderr)", errno);
+		dup2(stderr_fd, STDERR_FILENO);
+		close(stderr_fd);
+	}
+	rec.sr_logopen = monotonic_usec() - t;
+
+	if (sa->sa_nlisten > 0)
+		spawn_child_listen(sa);
+
+	setsid();
+	rec.sr_exec = monotonic_usec();
+	write(sa->sa_errfd, &rec, sizeof(rec));
+	if (sa->sa_envp != NULL)
+		execve(sa->sa_argv[0], sa->sa_argv, sa->sa_envp);
+	else if (sa->sa_env != NULL)
+		execve(sa->sa_argv[0], sa->sa_argv, sa->sa_env);
+	else
+		execv(sa->sa_argv[0], sa->sa_argv);
+	spawn_child_fail(sa, "execv");
+}
+
+/*
+ * fork with clone3(CLONE_INTO_CGROUP): the child starts in the cgroup of
+ * sa, there is no window where it runs (or forks) outside of it. Returns
+ * -1 if not possible, the caller falls back to fork and spawn_child moves
+ * the child.
+ */
+static pid_t
+spawn_clone_cgroup(struct spawn_args *sa, uint64_t flags)
+{
+#ifdef SYS_clone3
+	struct {
+		uint64_t	flags,
+				pidfd,
+				child_tid,
+				parent_tid,
+				exit_signal,
+				stack,
+				stack_size,
+				tls,
+				set_tid,
+				set_tid_size,
+				cgroup;
+	} ca;
+	pid_t		pid;
+	/* clone3 failed for reasons that will not change: always migrate. */
+	static int	spawn_clone3_broken;
+
+	if (spawn_clone3_broken)
+		return -1;
+	memset(&ca, '\0', sizeof(ca));
+	ca.flags = flags | CLONE_INTO_CGROUP;
+	ca.exit_signal = SIGCHLD;
+	ca.cgroup = sa->sa_cgroup_fd;
+	if ((pid = syscall(SYS_clone3, &ca, sizeof(ca))) == 0)
+		sa->sa_flags |= SPAWN_F_INCGROUP;
+	else if (pid == -1 && (errno == ENOSYS || errno == E2BIG || errno == EINVAL))
+		spawn_clone3_broken = 1;
+	return pid;
+#else
+	(void) sa;
+	(void) flags;
+	return -1;
+#endif
+}
+
+/*
+ * classic fork. Copies the page tables of the server.
+ */
+static pid_t
+spawn_fork(struct spawn_args *sa)
+{
+	pid_t		pid = -1;
+
+	if (sa->sa_flags & SPAWN_F_CGROUP)
+		pid = spawn_clone_cgroup(sa, 0);
+	if (pid == -1)
+		pid = fork();
+	if (pid == 0) {
+		spawn_child(sa);
+		/* not reached */
+	}
+	return pid;
+}
+
+#ifdef HAVE_CLONE
+/*
+ * entry point for vfork'ed children. The child shares memory with the
+ * (suspended) server: don't allocate, don't return.
+ */
+static int
+spawn_vfork_child(void *arg)
+{
+	struct sigaction	sa;
+	int			i;
+
+	/* signal handlers of the server must not run in the child. */
+	for (i = 1; i < NSIG; i++) {
+		if (sigaction(i, NULL, &sa) != 0)
+			continue;
+		if (sa.sa_handler == SIG_IGN || sa.sa_handler == SIG_DFL)
+			continue;
+		sa.sa_handler = SIG_DFL;
+		sa.sa_flags = 0;
+		sigaction(i, &sa, NULL);
+	}
+	sigprocmask(SIG_SETMASK, &spawn_sigmask, NULL);
+
+	spawn_child(arg);
+	return 0;
+}
+
+/*
+ * clone(CLONE_VM | CLONE_VFORK). The server is suspended until the child
+ * called execv or exited, no page tables are copied.
+ */
+static pid_t
+spawn_vfork(struct spawn_args *sa)
+{
+	sigset_t	all;
+	pid_t		pid;
+
+	if (spawn_stack == NULL) {
+		spawn_stack = mmap(NULL, SPAWN_STACK_SIZE, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+		if (spawn_stack == MAP_FAILED) {
+			spawn_stack = NULL;
+			return -1;
+		}
+	}
+
+	sigfillset(&all);
+	sigprocmask(SIG_BLOCK, &all, &spawn_sigmask);
+	pid = clone(spawn_vfork_child, spawn_stack + SPAWN_STACK_SIZE,
+			CLONE_VM | CLONE_VFORK | SIGCHLD, sa);
+	sigprocmask(SIG_SETMASK, &spawn_sigmask, NULL);
+	return pid;
+}
+#endif
+
+#ifdef HAVE_CLONE
+/*
+ * append string to a request buffer. returns new offset or -1.
+ */
+static int
+spawn_req_add(char *buf, int off, const char *str)
+{
+	size_t		len;
+
+	len = strlen(str) + 1;
+	if (off + len > SPAWN_HELPER_MSGSIZ)
+		return -1;
+	memcpy(buf + off, str, len);
+	return off + len;
+}
+
+/*
+ * get next string from a request buffer. returns NULL if the request is
+ * truncated.
+ */
+static char *
+spawn_req_get(char *buf, int len, int *off)
+{
+	char		*ret,
+			*end;
+
+	if (*off >= len)
+		return NULL;
+	ret = buf + *off;
+	if ((end = memchr(ret, '\0', len - *off)) == NULL)
+		return NULL;
+	*off += end - ret + 1;
+	return ret;
+}
+
+/*
+ * fork as sibling of the helper (i.e. child of the server).
+ */
+static pid_t
+spawn_helper_fork(struct spawn_args *sa)
+{
+	pid_t		pid = -1;
+
+	if (sa->sa_flags & SPAWN_F_CGROUP)
+		pid = spawn_clone_cgroup(sa, CLONE_PARENT);
+	if (pid == -1)
+		pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, 0, 0, 0);
+	return pid;
+}
+
+/*
+ * handle a single request in the helper.
+ */
+static void
+spawn_helper_handle(char *buf, int len, int *fds, int nfds)
+{
+	struct spawn_req	*sr = (struct spawn_req *) buf;
+	struct spawn_rep	rep;
+	struct spawn_args	sa;
+	int			off = sizeof(struct spawn_req),
+				i;
+
+	memset(&sa, '\0', sizeof(sa));
+	rep.sr_seq = sr->sr_seq;
+	rep.sr_pid = -1;
+	rep.sr_errno = EINVAL;
+
+#define GETSTR(B, X)	if (sr->sr_present & B) { \
+				if ((X = spawn_req_get(buf, len, &off)) == NULL) \
+					goto out; \
+			}
+
+	GETSTR(SR_NAME, sa.sa_name);
+	GETSTR(SR_DIR, sa.sa_dir);
+	GETSTR(SR_STDOUT, sa.sa_stdout);
+	GETSTR(SR_STDERR, sa.sa_stderr);
+	GETSTR(SR_ERRFUNC, sa.sa_errfunc);
+
+	if (sr->sr_argc < 1 || sr->sr_argc > len)
+		goto out;
+	sa.sa_argv = xmalloc(sizeof(char *) * (sr->sr_argc + 1));
+	for (i = 0; i < sr->sr_argc; i++) {
+		if ((sa.sa_argv[i] = spawn_req_get(buf, len, &off)) == NULL)
+			goto out;
+	}
+	sa.sa_argv[i] = NULL;
+
+	if (sr->sr_present & SR_ENV) {
+		if (sr->sr_nenv < 0 || sr->sr_nenv > len)
+			goto out;
+		sa.sa_env = xmalloc(sizeof(char *) * (sr->sr_nenv + 1));
+		for (i = 0; i < sr->sr_nenv; i++) {
+			if ((sa.sa_env[i] = spawn_req_get(buf, len, &off)) == NULL)
+				goto out;
+		}
+		sa.sa_env[i] = NULL;
+	}
+
+	sa.sa_flags = sr->sr_flags & ~(SPAWN_F_CGROUP | SPAWN_F_INCGROUP);
+	sa.sa_uid = sr->sr_uid;
+	sa.sa_gid = sr->sr_gid;
+	sa.sa_errno = sr->sr_errno;
+	sa.sa_errfd = -1;
+	if (sr->sr_present & SR_PLACE)
+		sa.sa_place = &sr->sr_place;
+	if (sr->sr_present & SR_RES)
+		sa.sa_res = &sr->sr_res;
+
+	i = (sr->sr_present & SR_ERRFD) ? 1 : 0;
+	if (sr->sr_present & SR_CGROUP)
+		i++;
+	if (sr->sr_nlisten < 0 || sr->sr_nlisten > SPAWN_MAX_LISTEN
+			|| nfds != i + sr->sr_nlisten)
+		goto out;
+	i = 0;
+	if (sr->sr_present & SR_ERRFD)
+		sa.sa_errfd = fds[i++];
+	if (sr->sr_present & SR_CGROUP) {
+		sa.sa_cgroup_fd = fds[i++];
+		sa.sa_flags |= SPAWN_F_CGROUP;
+	}
+	sa.sa_listen_fds = fds + i;
+	sa.sa_nlisten = sr->sr_nlisten;
+	if (sa.sa_nlisten > 0)
+		spawn_listen_env(&sa);
+
+	if ((rep.sr_pid = spawn_helper_fork(&sa)) == 0) {
+		signal(SIGHUP, SIG_DFL);
+		spawn_child(&sa);
+		/* not reached */
+	}
+	rep.sr_errno = rep.sr_pid == -1 ? errno : 0;
+out:
+	free(sa.sa_argv);
+	free(sa.sa_env);
+	free(sa.sa_envp);
+	send(helper_fd, &rep, sizeof(rep), 0);
+}
+
+/*
+ * nothing to do. only here so that SIGHUP to all ubervisor processes
+ * (i.e. to reopen logfiles) doesn't kill the helper.
+ */
+static void
+spawn_helper_sighup(int unused __attribute__((unused)))
+{
+}
+
+/*
+ * main loop of the spawn helper. The request socket is passed as stdin.
+ */
+int
+spawn_helper_main(int argc __attribute__((unused)),
+		char **argv __attribute__((unused)))
+{
+	char			*buf,
+				cbuf[CMSG_SPACE(sizeof(int) * (2 + SPAWN_MAX_LISTEN))];
+	struct msghdr		msg;
+	struct iovec		iov;
+	struct cmsghdr		*cmsg;
+	ssize_t			r;
+	int			fds[2 + SPAWN_MAX_LISTEN],
+				nfds,
+				fd,
+				i;
+
+	/* children must not inherit the request socket. */
+	if ((helper_fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 3)) == -1)
+		return EXIT_FAILURE;
+	if ((fd = open("/dev/null", O_RDONLY)) == -1)
+		return EXIT_FAILURE;
+	dup2(fd, STDIN_FILENO);
+	close(fd);
+
+	signal(SIGHUP, spawn_helper_sighup);
+	buf = xmalloc(SPAWN_HELPER_MSGSIZ);
+
+	for (;;) {
+		iov.iov_base = buf;
+		iov.iov_len = SPAWN_HELPER_MSGSIZ;
+		memset(&msg, '\0', sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = cbuf;
+		msg.msg_controllen = sizeof(cbuf);
+
+		if ((r = recvmsg(helper_fd, &msg, MSG_CMSG_CLOEXEC)) == -1) {
+			if (errno == EINTR)
+				continue;
+			return EXIT_FAILURE;
+		}
+
+		/* server is gone */
+		if (r == 0)
+			return EXIT_SUCCESS;
+
+		nfds = 0;
+		cmsg = CMSG_FIRSTHDR(&msg);
+		if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET
+				&& cmsg->cmsg_type == SCM_RIGHTS) {
+			nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * nfds);
+		}
+
+		if (r >= (ssize_t) sizeof(struct spawn_req))
+			spawn_helper_handle(buf, r, fds, nfds);
+
+		for (i = 0; i < nfds; i++)
+			close(fds[i]);
+	}
+}
+
+/*
+ * start the spawn helper. returns -1 on failure.
+ */
+int
+spawn_helper_start(void)
+{
+	int		sp[2];
+	pid_t		pid;
+	char		arg0[] = "ubervisor",
+			arg1[] = SPAWN_HELPER_CMD;
+	char		*args[3] = {arg0, arg1, NULL};
+
+	if (helper_fd != -1) {
+		close(helper_fd);
+		helper_fd = -1;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sp) == -1)
+		return -1;
+
+	setcloseonexec(sp[0]);
+
+	if ((pid = fork()) == -1) {
+		close(sp[0]);
+		close(sp[1]);
+		return -1;
+	}
+
+	if (pid == 0) {
+		if (dup2(sp[1], STDIN_FILENO) == -1)
+			_exit(EXIT_FAILURE);
+		execv(SPAWN_HELPER_EXE, args);
+		_exit(EXIT_FAILURE);
+	}
+
+	close(sp[1]);
+	helper_fd = sp[0];
+	helper_pid = pid;
+	return 0;
+}
+
+pid_t
+spawn_helper_pid(void)
+{
+	return helper_pid;
+}
+
+int
+spawn_helper_fd(void)
+{
+	return helper_fd;
+}
+
+/*
+ * drop a broken helper. The server notices the exit and starts a new one.
+ */
+void
+spawn_helper_stop(void)
+{
+	if (helper_fd == -1)
+		return;
+	close(helper_fd);
+	helper_fd = -1;
+	kill(helper_pid, SIGKILL);
+}
+
+/*
+ * ask the helper to start sa. The helper replies with the pid, see
+ * spawn_helper_recv(). Returns the sequence number of the request or 0 and
+ * sets errno. Never blocks: a full request socket fails with EAGAIN.
+ */
+uint32_t
+spawn_helper_send(struct spawn_args *sa)
+{
+	char			*buf,
+				cbuf[CMSG_SPACE(sizeof(int) * (2 + SPAWN_MAX_LISTEN))];
+	struct spawn_req	*sr;
+	struct msghdr		msg;
+	struct iovec		iov;
+	struct cmsghdr		*cmsg;
+	int			off = sizeof(struct spawn_req),
+				fds[2 + SPAWN_MAX_LISTEN],
+				nfds = 0,
+				i,
+				r;
+
+	if (helper_fd == -1) {
+		errno = EPIPE;
+		return 0;
+	}
+	if (sa->sa_nlisten > SPAWN_MAX_LISTEN) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	/* 0 means error */
+	if (++helper_seq == 0)
+		helper_seq++;
+	buf = xmalloc(SPAWN_HELPER_MSGSIZ);
+	sr = (struct spawn_req *) buf;
+	sr->sr_seq = helper_seq;
+	sr->sr_present = 0;
+	sr->sr_flags = sa->sa_flags;
+	sr->sr_uid = sa->sa_uid;
+	sr->sr_gid = sa->sa_gid;
+	sr->sr_errno = sa->sa_errno;
+	sr->sr_argc = 0;
+	sr->sr_nlisten = sa->sa_nlisten;
+	sr->sr_nenv = 0;
+	if (sa->sa_place != NULL) {
+		sr->sr_present |= SR_PLACE;
+		sr->sr_place = *sa->sa_place;
+	}
+	if (sa->sa_res != NULL) {
+		sr->sr_present |= SR_RES;
+		sr->sr_res = *sa->sa_res;
+	}
+
+#define ADDSTR(B, X)	if (X != NULL && off != -1) { \
+				sr->sr_present |= B; \
+				off = spawn_req_add(buf, off, X); \
+			}
+
+	ADDSTR(SR_NAME, sa->sa_name);
+	ADDSTR(SR_DIR, sa->sa_dir);
+	ADDSTR(SR_STDOUT, sa->sa_stdout);
+	ADDSTR(SR_STDERR, sa->sa_stderr);
+	ADDSTR(SR_ERRFUNC, sa->sa_errfunc);
+	for (i = 0; sa->sa_argv[i] != NULL && off != -1; i++) {
+		off = spawn_req_add(buf, off, sa->sa_argv[i]);
+		sr->sr_argc++;
+	}
+	if (sa->sa_env != NULL) {
+		sr->sr_present |= SR_ENV;
+		for (i = 0; sa->sa_env[i] != NULL && off != -1; i++) {
+			off = spawn_req_add(buf, off, sa->sa_env[i]);
+			sr->sr_nenv++;
+		}
+	}
+
+	if (off == -1) {
+		free(buf);
+		errno = E2BIG;
+		return 0;
+	}
+
+	iov.iov_base = buf;
+	iov.iov_len = off;
+	memset(&msg, '\0', sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (sa->sa_errfd != -1) {
+		sr->sr_present |= SR_ERRFD;
+		fds[nfds++] = sa->sa_errfd;
+	}
+	if (sa->sa_flags & SPAWN_F_CGROUP) {
+		sr->sr_present |= SR_CGROUP;
+		fds[nfds++] = sa->sa_cgroup_fd;
+	}
+	for (i = 0; i < sa->sa_nlisten; i++)
+		fds[nfds++] = sa->sa_listen_fds[i];
+
+	if (nfds > 0) {
+		msg.msg_control = cbuf;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+	}
+
+	r = sendmsg(helper_fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+	free(buf);
+	if (r != off) {
+		if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return 0;
+		spawn_helper_stop();
+		errno = EPIPE;
+		return 0;
+	}
+	return helper_seq;
+}
+
+/*
+ * read one reply of the helper. Returns 1 and sets seq, pid (-1 on error)
+ * and err, 0 if there is no reply or -1 if the helper is gone.
+ */
+int
+spawn_helper_recv(uint32_t *seq, pid_t *pid, int *err)
+{
+	struct spawn_rep	rep;
+	ssize_t			r;
+
+	if (helper_fd == -1)
+		return -1;
+	while ((r = recv(helper_fd, &rep, sizeof(rep), MSG_DONTWAIT)) == -1
+			&& errno == EINTR)
+		;
+	if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return 0;
+	if (r != sizeof(rep))
+		return -1;
+	*seq = rep.sr_seq;
+	*pid = rep.sr_pid;
+	*err = rep.sr_errno;
+	return 1;
+}
+#else
+int
+spawn_helper_start(void)
+{
+	return -1;
+}
+
+int
+spawn_helper_fd(void)
+{
+	return -1;
+}
+
+void
+spawn_helper_stop(void)
+{
+}
+
+uint32_t
+spawn_helper_send(struct spawn_args *sa __attribute__((unused)))
+{
+	errno = ENOSYS;
+	return 0;
+}
+
+int
+spawn_helper_recv(uint32_t *seq __attribute__((unused)),
+		pid_t *pid __attribute__((unused)),
+		int *err __attribute__((unused)))
+{
+	return -1;
+}
+
+pid_t
+spawn_helper_pid(void)
+{
+	return -1;
+}
+
+int
+spawn_helper_main(int argc __attribute__((unused)),
+		char **argv __attribute__((unused)))
+{
+	return EXIT_FAILURE;
+}
+#endif
+
+/*
+ * parse spawn method name. returns -1 if unknown or not supported.
+ */
+int
+spawn_method_from_string(const char *str)
+{
+	if (!strcmp(str, "fork"))
+		return SPAWN_FORK;
+#ifdef HAVE_CLONE
+	if (!strcmp(str, "vfork"))
+		return SPAWN_VFORK;
+	if (!strcmp(str, "helper"))
+		return SPAWN_HELPER;
+#endif
+	return -1;
+}
+
+const char *
+spawn_method_name(int method)
+{
+	switch (method) {
+	case SPAWN_FORK:
+		return "fork";
+	case SPAWN_VFORK:
+		return "vfork";
+	case SPAWN_HELPER:
+		return "helper";
+	}
+	return "unknown";
+}
+
+/*
+ * start child process described by sa. returns the pid of the child or -1.
+ * SPAWN_HELPER starts with vfork here, the server sends requests to a
+ * running helper with spawn_helper_send().
+ */
+pid_t
+spawn_process(int method, struct spawn_args *sa)
+{
+	pid_t		pid;
+
+	if (sa->sa_nlisten > SPAWN_MAX_LISTEN) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (sa->sa_nlisten > 0)
+		spawn_listen_env(sa);
+#ifdef HAVE_CLONE
+	if (method == SPAWN_VFORK || method == SPAWN_HELPER)
+		pid = spawn_vfork(sa);
+	else
+#endif
+		pid = spawn_fork(sa);
+	free(sa->sa_envp);
+	sa->sa_envp = NULL;
+	return pid;
+}
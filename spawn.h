@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __SPAWN_H
+#define __SPAWN_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include "cpus.h"
+#include "resources.h"
+
+#define SPAWN_FORK	1
+#define SPAWN_VFORK	2
+#define SPAWN_HELPER	3
+
+/* only call execv: keep ids, dir, stdio and session of the server. */
+#define SPAWN_F_EXEC	1
+/* start the child in the cgroup sa_cgroup_fd. */
+#define SPAWN_F_CGROUP	2
+
+/* ms the server waits for a reply of the spawn helper */
+#define SPAWN_HELPER_TIMEOUT	5000
+
+/* max. number of sockets passed to a child */
+#define SPAWN_MAX_LISTEN	16
+
+/*
+ * everything a child needs between fork and exec. All lookups (user and
+ * group names, log file names) are done by the server before spawning, so
+ * the child does not have to touch the server's memory.
+ */
+struct spawn_args {
+	char			**sa_argv;
+	const char		*sa_name,
+				*sa_dir,
+				*sa_stdout,
+				*sa_stderr;
+
+	/* -1 if not set */
+	int			sa_uid,
+				sa_gid;
+
+	/* if set, the server failed to prepare the child (sa_errno is
+	 * reported). */
+	const char		*sa_errfunc;
+	int			sa_errno;
+
+	/* socket to report errors to the server, shared by all children */
+	int			sa_errfd;
+
+	/* sockets passed as fd 3 and up, announced in LISTEN_FDS and
+	 * LISTEN_PID. */
+	const int		*sa_listen_fds;
+	int			sa_nlisten;
+
+	int			sa_flags;
+
+	/* cpu affinity and numa node, if set */
+	const struct cpu_place	*sa_place;
+
+	/* resource and scheduling controls, if set */
+	const struct resources	*sa_res;
+
+	/* cgroup directory, only used with SPAWN_F_CGROUP */
+	int			sa_cgroup_fd;
+
+	/* environment of the child, NULL for the one of the server */
+	char			**sa_env;
+
+	/* sa_env with LISTEN_* set, built by spawn_process() */
+	char			**sa_envp,
+				*sa_listen_pid;
+};
+
+/*
+ * records written by the child to sa_errfd, a SOCK_SEQPACKET socket shared by
+ * all children. Every record is one message, sr_pid tells the server which
+ * process sent it. SPAWN_REC_EXEC is written right before execv and counts as
+ * a successful start, a failing execv is still reported by SPAWN_REC_FAIL.
+ */
+#define SPAWN_REC_LOG	1	/* non fatal error */
+#define SPAWN_REC_FAIL	2	/* setup or execv failed, child exits */
+#define SPAWN_REC_EXEC	3	/* about to call execv */
+
+struct spawn_rec {
+	int32_t			sr_pid,
+				sr_type,
+				sr_errno;
+	/* microseconds. sr_exec is a CLOCK_MONOTONIC timestamp taken right
+	 * before execv, the others are durations. */
+	int64_t			sr_setids,
+				sr_logopen,
+				sr_exec;
+	char			sr_func[32];
+};
+
+int spawn_method_from_string(const char *);
+const char *spawn_method_name(int);
+pid_t spawn_process(int, struct spawn_args *);
+int spawn_helper_start(void);
+pid_t spawn_helper_pid(void);
+int spawn_helper_fd(void);
+void spawn_helper_stop(void);
+uint32_t spawn_helper_send(struct spawn_args *);
+int spawn_helper_recv(uint32_t *, pid_t *, int *);
+int spawn_helper_main(int, char **);
+
+#endif /* __SPAWN_H */
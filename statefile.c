@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "misc.h"
+#include "statefile.h"
+
+/*
+ * the state file is a header followed by sh_size records, mapped shared so
+ * every change is in the page cache at once and survives a crash of the
+ * server. It is locked, a second server on the same file runs without it.
+ */
+#define STATE_MAGIC	"UBSTATE"
+#define STATE_VERSION	1
+#define STATE_INITIAL	64
+
+struct state_hdr {
+	char			sh_magic[8];
+	int			sh_version,
+				sh_size;
+};
+
+static int			state_fd = -1;
+static struct state_hdr		*state_map;
+static size_t			state_len;
+static struct state_rec		*state_prev;
+static int			state_nprev;
+
+#define STATE_RECS()	((struct state_rec *) (state_map + 1))
+#define STATE_LEN(n)	(sizeof(struct state_hdr) + (size_t) (n) * sizeof(struct state_rec))
+
+/*
+ * map the file with room for n records.
+ */
+static int
+state_map_size(int n)
+{
+	void		*m;
+
+	if (ftruncate(state_fd, STATE_LEN(n)) == -1)
+		return -1;
+	m = mmap(NULL, STATE_LEN(n), PROT_READ | PROT_WRITE, MAP_SHARED,
+			state_fd, 0);
+	if (m == MAP_FAILED)
+		return -1;
+	if (state_map != NULL)
+		munmap(state_map, state_len);
+	state_map = m;
+	state_len = STATE_LEN(n);
+	return 0;
+}
+
+/*
+ * open and lock the state file. Records left by the previous server are
+ * kept for state_old(), the file starts empty. Returns -1 on error.
+ */
+int
+state_open(const char *path)
+{
+	struct stat		st;
+	struct state_hdr	*h;
+	struct state_rec	*r;
+	void			*m;
+	int			i,
+				n;
+
+	if ((state_fd = open(path, O_RDWR | O_CREAT, 0600)) == -1)
+		return -1;
+	setcloseonexec(state_fd);
+	if (flock(state_fd, LOCK_EX | LOCK_NB) == -1 || fstat(state_fd, &st) == -1)
+		goto fail;
+
+	/* copy the live records of the previous server */
+	if ((size_t) st.st_size >= sizeof(struct state_hdr)) {
+		m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, state_fd, 0);
+		if (m == MAP_FAILED)
+			goto fail;
+		h = m;
+		n = h->sh_size;
+		if (memcmp(h->sh_magic, STATE_MAGIC, sizeof(STATE_MAGIC)) == 0
+				&& h->sh_version == STATE_VERSION && n > 0
+				&& STATE_LEN(n) <= (size_t) st.st_size) {
+			state_prev = xmalloc(n * sizeof(struct state_rec));
+			r = (struct state_rec *) (h + 1);
+			for (i = 0; i < n; i++) {
+				if (r[i].sr_pid <= 0)
+					continue;
+				state_prev[state_nprev] = r[i];
+				state_prev[state_nprev].sr_name[STATE_NAME_MAX - 1] = '\0';
+				state_nprev++;
+			}
+		}
+		munmap(m, st.st_size);
+	}
+
+	if (ftruncate(state_fd, 0) == -1 || state_map_size(STATE_INITIAL) == -1)
+		goto fail;
+	memcpy(state_map->sh_magic, STATE_MAGIC, sizeof(STATE_MAGIC));
+	state_map->sh_version = STATE_VERSION;
+	state_map->sh_size = STATE_INITIAL;
+	return 0;
+
+fail:
+	i = errno;
+	close(state_fd);
+	state_fd = -1;
+	state_old_free();
+	errno = i;
+	return -1;
+}
+
+/*
+ * records of the previous server, *n is set to their number.
+ */
+struct state_rec *
+state_old(int *n)
+{
+	*n = state_nprev;
+	return state_prev;
+}
+
+void
+state_old_free(void)
+{
+	free(state_prev);
+	state_prev = NULL;
+	state_nprev = 0;
+}
+
+/*
+ * store a started process. Returns its slot, -1 if there is no state file,
+ * the group name is too long or the file can't grow.
+ */
+int
+state_add(const char *name, int instance, int standby, pid_t pid,
+		time_t start)
+{
+	struct state_rec	*r;
+	int			i,
+				n;
+
+	if (state_map == NULL || strlen(name) >= STATE_NAME_MAX)
+		return -1;
+
+	n = state_map->sh_size;
+	for (i = 0; i < n; i++) {
+		if (STATE_RECS()[i].sr_pid == 0)
+			break;
+	}
+	if (i == n) {
+		if (state_map_size(n * 2) == -1)
+			return -1;
+		state_map->sh_size = n * 2;
+	}
+
+	r = &STATE_RECS()[i];
+	snprintf(r->sr_name, sizeof(r->sr_name), "%s", name);
+	r->sr_instance = instance;
+	r->sr_standby = standby;
+	r->sr_start = start;
+	r->sr_ticks = state_pid_ticks(pid);
+	r->sr_pid = pid;
+	return i;
+}
+
+/*
+ * a process moved to another slot, e.g. a standby became an instance.
+ */
+void
+state_set(int slot, int instance, int standby)
+{
+	if (state_map == NULL || slot < 0)
+		return;
+	STATE_RECS()[slot].sr_instance = instance;
+	STATE_RECS()[slot].sr_standby = standby;
+}
+
+void
+state_del(int slot)
+{
+	if (state_map == NULL || slot < 0)
+		return;
+	memset(&STATE_RECS()[slot], '\0', sizeof(struct state_rec));
+}
+
+/*
+ * start time of pid in clock ticks after boot, from /proc. Together with
+ * the pid it identifies a process. Returns 0 if pid is not running.
+ */
+unsigned long long
+state_pid_ticks(pid_t pid)
+{
+	char			buf[1024],
+				*s;
+	unsigned long long	t;
+	ssize_t			len;
+	int			fd,
+				i;
+
+	snprintf(buf, sizeof(buf), "/proc/%d/stat", (int) pid);
+	if ((fd = open(buf, O_RDONLY)) == -1)
+		return 0;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return 0;
+	buf[len] = '\0';
+
+	/* the command may contain spaces, fields after it start with 3 */
+	if ((s = strrchr(buf, ')')) == NULL)
+		return 0;
+	for (i = 2; i < 22 && s != NULL; i++)
+		s = strchr(s + 1, ' ');
+	if (s == NULL || sscanf(s, " %llu", &t) != 1)
+		return 0;
+	return t;
+}
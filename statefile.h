@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __STATEFILE_H
+#define __STATEFILE_H
+
+#include <sys/types.h>
+#include <time.h>
+
+#define STATE_NAME_MAX	256
+
+/*
+ * one running process in the state file. A slot with sr_pid 0 is free.
+ */
+struct state_rec {
+	char			sr_name[STATE_NAME_MAX];	/* group */
+	pid_t			sr_pid;
+	int			sr_instance,	/* standby slot if sr_standby */
+				sr_standby;
+	time_t			sr_start;
+	unsigned long long	sr_ticks;	/* kernel start time */
+};
+
+int state_open(const char *);
+struct state_rec *state_old(int *);
+void state_old_free(void);
+int state_add(const char *, int, int, pid_t, time_t);
+void state_set(int, int, int);
+void state_del(int);
+unsigned long long state_pid_ticks(pid_t);
+
+#endif /* __STATEFILE_H */
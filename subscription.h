@@ -41,6 +41,7 @@
 #define SUBS_SERVER	1
 #define SUBS_STATUS	2
 #define SUBS_GROUP_CFG	4
+#define SUBS_PROCESS	8
 
 struct subscription {
 	LIST_ENTRY(subscription)	s_ent;
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "misc.h"
+#include "template.h"
+
+static const struct {
+	const char	*tt_name;
+	size_t		tt_len;
+	int		tt_type;
+} template_tokens[] = {
+	{ "%(NUM)",	6,	TPL_NUM },
+	{ "%(NAME)",	7,	TPL_NAME },
+	{ "%(PORT)",	7,	TPL_PORT },
+	{ NULL,		0,	0 }
+};
+
+/*
+ * append segment to template.
+ */
+static void
+template_add(struct template *t, int type, const char *str, size_t len)
+{
+	struct template_seg	*s;
+
+	if (type == TPL_LITERAL && len == 0)
+		return;
+
+	t->t_segs = xrealloc(t->t_segs, sizeof(struct template_seg) * (t->t_nsegs + 1));
+	s = &(t->t_segs[t->t_nsegs++]);
+	s->ts_type = type;
+	s->ts_str = str;
+	s->ts_len = len;
+	if (type == TPL_LITERAL)
+		t->t_literal_len += len;
+	else
+		t->t_tokens |= 1 << type;
+}
+
+/*
+ * split string into literal and token segments. Unknown tokens are kept as
+ * literal text.
+ */
+struct template *
+template_compile(const char *src)
+{
+	struct template		*t;
+	const char		*p,
+				*lit;
+	int			i;
+
+	t = xmalloc(sizeof(struct template));
+	memset(t, '\0', sizeof(struct template));
+	t->t_src = xstrdup(src);
+
+	lit = p = t->t_src;
+	while ((p = strstr(p, "%(")) != NULL) {
+		for (i = 0; template_tokens[i].tt_name != NULL; i++) {
+			if (!strncmp(p, template_tokens[i].tt_name, template_tokens[i].tt_len))
+				break;
+		}
+		if (template_tokens[i].tt_name == NULL) {
+			p += 2;
+			continue;
+		}
+		template_add(t, TPL_LITERAL, lit, p - lit);
+		template_add(t, template_tokens[i].tt_type, NULL, 0);
+		p += template_tokens[i].tt_len;
+		lit = p;
+	}
+	template_add(t, TPL_LITERAL, lit, strlen(lit));
+	return t;
+}
+
+void
+template_free(struct template *t)
+{
+	if (t == NULL)
+		return;
+	free(t->t_segs);
+	free(t->t_src);
+	free(t);
+}
+
+/*
+ * return 1 if template uses token type.
+ */
+int
+template_uses(const struct template *t, int type)
+{
+	return (t->t_tokens & (1 << type)) != 0;
+}
+
+/*
+ * values for the tokens of one instance.
+ */
+void
+template_vars_init(struct template_vars *v, const char *name, int instance,
+		int port)
+{
+	v->tv_name = name;
+	v->tv_name_len = strlen(name);
+	v->tv_num_len = snprintf(v->tv_num, sizeof(v->tv_num), "%d", instance);
+	if (port != -1)
+		v->tv_port_len = snprintf(v->tv_port, sizeof(v->tv_port), "%d", port + instance);
+	else
+		v->tv_port_len = snprintf(v->tv_port, sizeof(v->tv_port), "%d", instance);
+}
+
+/*
+ * length of expanded template, without terminating NUL.
+ */
+size_t
+template_length(const struct template *t, const struct template_vars *v)
+{
+	size_t		len;
+	int		i;
+
+	len = t->t_literal_len;
+	for (i = 0; i < t->t_nsegs; i++) {
+		switch (t->t_segs[i].ts_type) {
+		case TPL_NUM:
+			len += v->tv_num_len;
+			break;
+		case TPL_NAME:
+			len += v->tv_name_len;
+			break;
+		case TPL_PORT:
+			len += v->tv_port_len;
+			break;
+		}
+	}
+	return len;
+}
+
+/*
+ * expand template into buf, which must hold template_length() + 1 bytes.
+ * Returns pointer to terminating NUL.
+ */
+static char *
+template_write(const struct template *t, const struct template_vars *v, char *buf)
+{
+	const struct template_seg	*s;
+	int				i;
+
+	for (i = 0; i < t->t_nsegs; i++) {
+		s = &(t->t_segs[i]);
+		switch (s->ts_type) {
+		case TPL_LITERAL:
+			memcpy(buf, s->ts_str, s->ts_len);
+			buf += s->ts_len;
+			break;
+		case TPL_NUM:
+			memcpy(buf, v->tv_num, v->tv_num_len);
+			buf += v->tv_num_len;
+			break;
+		case TPL_NAME:
+			memcpy(buf, v->tv_name, v->tv_name_len);
+			buf += v->tv_name_len;
+			break;
+		case TPL_PORT:
+			memcpy(buf, v->tv_port, v->tv_port_len);
+			buf += v->tv_port_len;
+			break;
+		}
+	}
+	*buf = '\0';
+	return buf;
+}
+
+char *
+template_expand(const struct template *t, const struct template_vars *v, char *buf)
+{
+	template_write(t, v, buf);
+	return buf;
+}
+
+/*
+ * expand template into a new buffer. Must be freed.
+ */
+char *
+template_expand_dup(const struct template *t, const struct template_vars *v)
+{
+	return template_expand(t, v, xmalloc(template_length(t, v) + 1));
+}
+
+/*
+ * expand a NULL terminated list of templates into an argv array. The array
+ * and the strings are allocated in one block, free the returned pointer
+ * only.
+ */
+char **
+template_expand_argv(struct template **tpls, const struct template_vars *v)
+{
+	char		**argv,
+			*p;
+	size_t		len = 0;
+	int		i,
+			n;
+
+	for (n = 0; tpls[n] != NULL; n++)
+		len += template_length(tpls[n], v) + 1;
+
+	argv = xmalloc(sizeof(char *) * (n + 1) + len);
+	p = (char *) (argv + n + 1);
+	for (i = 0; i < n; i++) {
+		argv[i] = p;
+		p = template_write(tpls[i], v, p) + 1;
+	}
+	argv[n] = NULL;
+	return argv;
+}
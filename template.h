@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2014 Kilian Klimek <kilian.klimek@googlemail.com>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ * 
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __TEMPLATE_H
+#define __TEMPLATE_H
+
+#include <sys/types.h>
+
+/*
+ * templates for paths and arguments. A template is compiled once into a list
+ * of segments (literal text or a token) and expanded per instance.
+ *
+ * Tokens:
+ *	%(NUM)		instance number
+ *	%(NAME)		group name
+ *	%(PORT)		port base of the group + instance number
+ */
+#define TPL_LITERAL	0
+#define TPL_NUM		1
+#define TPL_NAME	2
+#define TPL_PORT	3
+
+struct template_seg {
+	int			ts_type;
+	const char		*ts_str;	/* TPL_LITERAL only */
+	size_t			ts_len;
+};
+
+struct template {
+	char			*t_src;
+	struct template_seg	*t_segs;
+	int			t_nsegs,
+				t_tokens;	/* bitmask of (1 << TPL_*) used */
+	size_t			t_literal_len;
+};
+
+struct template_vars {
+	const char		*tv_name;
+	size_t			tv_name_len,
+				tv_num_len,
+				tv_port_len;
+	char			tv_num[12],
+				tv_port[12];
+};
+
+struct template *template_compile(const char *);
+void template_free(struct template *);
+int template_uses(const struct template *, int);
+void template_vars_init(struct template_vars *, const char *, int, int);
+size_t template_length(const struct template *, const struct template_vars *);
+char *template_expand(const struct template *, const struct template_vars *, char *);
+char *template_expand_dup(const struct template *, const struct template_vars *);
+char **template_expand_argv(struct template **, const struct template_vars *);
+
+#endif /* __TEMPLATE_H */